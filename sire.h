@@ -47,6 +47,18 @@
 //#define SIRE_VULKAN
 //#define SIRE_INCLUDE_VULKAN
 
+// CPU rasterizer without any device, for headless runs and tests.
+//#define SIRE_SOFTWARE
+
+// Trace events around the hot paths, written with Sire::DumpProfile. Without it the markers compile to nothing.
+//#define SIRE_PROFILE
+
+// SSE2, AVX2 or NEON kernels are used when the target has them, define SIRE_NO_SIMD to force the scalar paths.
+//#define SIRE_NO_SIMD
+
+// With a single SIRE_XX renderer its backend is final and called without the vtable, define to derive from it.
+//#define SIRE_DYNAMIC_DISPATCH
+
 #pragma once
 
 #ifdef SIRE_INCLUDE_DX9
@@ -114,9 +126,45 @@ using namespace DirectX;
 #include <iostream>
 #include <vector>
 #include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
 #include <windef.h>
 #endif
 
+#ifndef SIRE_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIRE_SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIRE_AVX2
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SIRE_NEON
+#endif
+#endif
+
+#if !defined(SIRE_DYNAMIC_DISPATCH) && (defined(SIRE_DX9) + defined(SIRE_DX10) + defined(SIRE_DX11) + defined(SIRE_DX12) + defined(SIRE_OPENGL) + defined(SIRE_VULKAN) + defined(SIRE_SOFTWARE)) == 1
+#define SIRE_STATIC_DISPATCH
+#define SIRE_FINAL final
+#else
+#define SIRE_FINAL
+#endif
+
+#ifdef SIRE_PROFILE
+#define SIRE_PROFILE_SCOPE(name) Sire::tSireProfileScope sireProfileScope(name)
+#else
+#define SIRE_PROFILE_SCOPE(name)
+#endif
+
 #ifdef SIRE_DX11ON12
 namespace d3d11on12 {
 	static inline bool isD3D11on12 = false;
@@ -370,6 +418,7 @@ public:
 		SIRE_RENDERER_DX12,
 		SIRE_RENDERER_OPENGL,
 		SIRE_RENDERER_VULKAN,
+		SIRE_RENDERER_SOFTWARE,
 		SIRE_NUM_RENDERERS,
 	};
 
@@ -385,6 +434,53 @@ public:
 		SIRE_POINT,
 		SIRE_LINE,
 		SIRE_TRIANGLE,
+		SIRE_LINE_STRIP,
+		SIRE_TRIANGLE_STRIP,
+		SIRE_TRIANGLE_FAN,
+	};
+
+	enum eSireFillRule {
+		SIRE_FILL_RULE_NONZERO,
+		SIRE_FILL_RULE_EVENODD,
+	};
+
+	enum eSireLineJoin {
+		SIRE_LINE_JOIN_MITER,
+		SIRE_LINE_JOIN_ROUND,
+		SIRE_LINE_JOIN_BEVEL,
+	};
+
+	enum eSireLineCap {
+		SIRE_LINE_CAP_BUTT,
+		SIRE_LINE_CAP_ROUND,
+		SIRE_LINE_CAP_SQUARE,
+	};
+
+	// Channels are listed in memory order. The block compressed formats cover 4x4 pixels per block.
+	enum eSirePixelFormat {
+		SIRE_PIXEL_FORMAT_UNKNOWN,
+		SIRE_PIXEL_FORMAT_RGBA8,
+		SIRE_PIXEL_FORMAT_BGRA8,
+		SIRE_PIXEL_FORMAT_RGBA8_SRGB,
+		SIRE_PIXEL_FORMAT_BGRA8_SRGB,
+		SIRE_PIXEL_FORMAT_RGB8, // Source data only, expanded to 4 bytes at upload
+		SIRE_PIXEL_FORMAT_BC1, // 8 bytes, RGB with 1-bit alpha
+		SIRE_PIXEL_FORMAT_BC3, // 16 bytes, RGBA
+		SIRE_PIXEL_FORMAT_BC7, // 16 bytes, RGBA, D3D11 only
+	};
+
+	enum eSireMipmaps {
+		SIRE_MIPMAPS_NONE,
+		SIRE_MIPMAPS_BOX, // 2x2 box filter on the CPU
+		SIRE_MIPMAPS_BOX_SRGB, // 2x2 box filter on the CPU, averaged in linear space
+		SIRE_MIPMAPS_GPU, // Generated by the device after upload
+	};
+
+	enum eSireTextureState {
+		SIRE_TEXTURE_READY,
+		SIRE_TEXTURE_LOADING, // LoadTextureAsync, drawn with a placeholder until uploaded
+		SIRE_TEXTURE_FAILED,
+		SIRE_TEXTURE_EVICTED, // Released to stay within the texture budget, reloaded when used
 	};
 
 	struct tSireUnknown {
@@ -456,6 +552,12 @@ public:
 
 	struct tSireRenderTarget : tSireUnknown {
 		uintptr_t* renderTargetView;
+		uint64_t textureId; // The texture drawn into, see tSireTexture2D::id
+
+		tSireRenderTarget() {
+			renderTargetView = nullptr;
+			textureId = 0;
+		}
 
 		void Set(uintptr_t* rtv) {
 			renderTargetView = rtv;
@@ -466,35 +568,66 @@ public:
 				return;
 
 			switch (GetCurrentRenderer()) {
+#ifdef SIRE_DX9
 				case SIRE_RENDERER_DX9:
 				{
 					IDirect3DSurface9* surf = reinterpret_cast<IDirect3DSurface9*>(renderTargetView);
 					surf->Release();
 					break;
 				}
+#endif
+#ifdef SIRE_DX10
 				case SIRE_RENDERER_DX10:
 				{
 					ID3D10RenderTargetView* rtv = reinterpret_cast<ID3D10RenderTargetView*>(renderTargetView);
 					rtv->Release();
 					break;
 				}
+#endif
+#ifdef SIRE_DX11
 				case SIRE_RENDERER_DX11:
 				{
 					ID3D11RenderTargetView* rtv = reinterpret_cast<ID3D11RenderTargetView*>(renderTargetView);
 					rtv->Release();
 					break;
 				}
+#endif
+#ifdef SIRE_SOFTWARE
+				case SIRE_RENDERER_SOFTWARE:
+				{
+					tSoftwareImage* image = reinterpret_cast<tSoftwareImage*>(renderTargetView);
+					image->Release();
+					break;
+				}
+#endif
 			}
 
 			renderTargetView = nullptr;
 		}
 	};
 
+	struct tSireTextureReloader;
+
 	struct tSireTexture2D : tSireUnknown {
 		int32_t w;
 		int32_t h;
-		int32_t format;
-		int32_t swapColors;
+		eSirePixelFormat format;
+		eSireTextureState state;
+
+		// Texture budget bookkeeping, evictable textures are kept in a list from most to least recently used.
+		uint64_t bytes;
+		uint64_t lastUsedFrame;
+		bool tracked;
+
+		// Changes with the contents, retained layers hash it along with the texture pointer. Textures with a render
+		// target view also change with every batch drawn into it.
+		uint64_t generation;
+		// Unique for the lifetime of the process, unlike the address, see FindTexture.
+		uint64_t id;
+		tSireTextureReloader* reloader;
+		uint64_t reloadKey;
+		tSireTexture2D* lruPrev;
+		tSireTexture2D* lruNext;
 
 		struct tSirePtrsHolder : tSireUnknown {
 			uintptr_t* texture;
@@ -540,6 +673,15 @@ public:
 							Sire::Release(tex);
 							Sire::Release(surf);
 						} break;
+#endif
+#ifdef SIRE_SOFTWARE
+						case SIRE_RENDERER_SOFTWARE:
+						{
+							tSoftwareImage* tex = reinterpret_cast<tSoftwareImage*>(texture);
+							tSoftwareImage* surf = reinterpret_cast<tSoftwareImage*>(surface);
+							Sire::Release(tex);
+							Sire::Release(surf);
+						} break;
 #endif
 					}
 				}
@@ -553,20 +695,241 @@ public:
 		tSireTexture2D() {
 			w = 0;
 			h = 0;
-			format = 0;
-			swapColors = 0;
+			format = SIRE_PIXEL_FORMAT_UNKNOWN;
+			state = SIRE_TEXTURE_READY;
+			bytes = 0;
+			lastUsedFrame = 0;
+			tracked = false;
+			generation = 0;
+			id = ++textureIds;
+			reloader = nullptr;
+			reloadKey = 0;
+			lruPrev = nullptr;
+			lruNext = nullptr;
+
+			texturesById[id] = this;
 		}
 
 		~tSireTexture2D() {
+			if (state == SIRE_TEXTURE_LOADING)
+				CancelTextureLoad(this);
 
+			UntrackTexture(this);
+			texturesById.erase(id);
 		}
 
-		void Set(int32_t width, int32_t height, int32_t format, uintptr_t* tex, uintptr_t* surf) {
+		void Set(int32_t width, int32_t height, eSirePixelFormat format, uintptr_t* tex, uintptr_t* surf, uint32_t mipLevels = 1) {
 			this->w = width;
 			this->h = height;
 			this->format = format;
 			this->ptrs.texture = tex;
 			this->ptrs.surface = surf;
+
+			TouchTexture(this);
+			TrackTexture(this, GetImageDataSize(format, width, height, mipLevels));
+			TraceTexture(this, mipLevels);
+		}
+	};
+
+	// Recreates evicted textures, see SetTextureEvictable.
+	struct tSireTextureReloader {
+		virtual ~tSireTextureReloader() {}
+
+		// Returns a new texture with the same contents (i.e. from CreateTexture), its GPU objects are moved into the evicted one.
+		virtual SirePtr<tSireTexture2D> Reload(tSireTexture2D const* texture, uint64_t key) { return nullptr; }
+	};
+
+	struct tSireTextureStats {
+		uint64_t bytes; // Resident bytes of all tracked textures, mip levels included
+		uint64_t evictableBytes;
+		uint64_t budget;
+		uint32_t numTextures;
+		uint32_t numEvicted;
+		uint32_t evictions; // Totals since startup
+		uint32_t reloads;
+	};
+
+	// Work the backend was given in one frame, see GetFrameStats.
+	struct tSireFrameStats {
+		uint32_t draws; // Batches and meshes
+		uint32_t vertices;
+		uint64_t uploadBytes; // Vertices, indices and texture data
+	};
+
+	// GPU time of the batches that carried the same tag in one frame.
+	struct tSireGpuTiming {
+		const char* tag; // nullptr for batches drawn without a tag
+		uint32_t batches;
+		float gpuMs;
+	};
+
+	struct tSireGpuFrameTiming {
+		uint64_t frame; // Frame counter of EndFrame at the time the frame was drawn
+		float gpuMs; // From the start of the first batch to the end of the last one
+		std::vector<tSireGpuTiming> tags;
+	};
+
+	struct tSirePerfFrame {
+		float cpuMs;
+		tSireFrameStats stats;
+	};
+
+	// Measurements of a trace replayed by RunPerfTrace.
+	struct tSirePerfResult {
+		std::vector<tSirePerfFrame> frames;
+		double cpuMs; // Median frame time
+		uint64_t draws; // Totals over all frames
+		uint64_t vertices;
+		uint64_t uploadBytes;
+		int32_t width;
+		int32_t height;
+		std::vector<uint8_t> image; // RGBA8 back buffer after the last frame, empty when it wasn't captured
+
+		tSirePerfResult() {
+			cpuMs = 0.0;
+			draws = 0;
+			vertices = 0;
+			uploadBytes = 0;
+			width = 0;
+			height = 0;
+		}
+	};
+
+	// How far a result may be from its baseline before ComparePerf fails, relative limits are fractions of the baseline.
+	struct tSirePerfTolerance {
+		float cpuTime;
+		float uploadBytes;
+		uint32_t draws; // Extra draws over the whole trace
+		uint8_t pixelThreshold; // Channel difference the image diff ignores
+		float differentPixels; // Fraction of pixels allowed to differ, negative skips the image diff
+
+		tSirePerfTolerance() {
+			cpuTime = 0.1f;
+			uploadBytes = 0.0f;
+			draws = 0;
+			pixelThreshold = 2;
+			differentPixels = 0.0f;
+		}
+	};
+
+	enum eSireProfileFormat {
+		SIRE_PROFILE_FORMAT_CHROME_JSON, // chrome://tracing and ui.perfetto.dev
+		SIRE_PROFILE_FORMAT_PERFETTO, // Perfetto protobuf
+	};
+
+#ifdef SIRE_PROFILE
+	// Records the time between construction and destruction as an event of the calling thread, usually through
+	// SIRE_PROFILE_SCOPE. name is kept as a pointer and has to outlive the dump, a string literal is fine.
+	struct tSireProfileScope {
+		const char* name;
+		uint64_t start;
+
+		tSireProfileScope(const char* name) {
+			this->name = name;
+			start = GetProfileTime();
+		}
+
+		~tSireProfileScope() {
+			WriteProfileEvent(name, start, GetProfileTime());
+		}
+	};
+#endif
+
+#ifdef SIRE_SOFTWARE
+	// Init argument of the software renderer, the back buffer is created with this size.
+	struct tSireSoftwareDesc {
+		int32_t width;
+		int32_t height;
+		uint32_t framesInFlight; // 0 or 1 draws when called, 2 or 3 rasterize frames on a thread behind the recording
+	};
+#endif
+
+	struct tSireMesh : tSireUnknown {
+		uint32_t numVertices;
+		uint32_t numIndices;
+		eSirePrimitiveType primitiveType;
+
+		struct tSirePtrsHolder : tSireUnknown {
+			uintptr_t* vertexBuffer;
+			uintptr_t* indexBuffer;
+			eSireRenderer owner;
+
+			tSirePtrsHolder() {
+				owner = GetCurrentRenderer();
+				vertexBuffer = nullptr;
+				indexBuffer = nullptr;
+			}
+
+			~tSirePtrsHolder() {
+				Release();
+			}
+
+			void Release() override {
+				if (GetCurrentRenderer() == owner) {
+					switch (GetCurrentRenderer()) {
+#ifdef SIRE_DX9
+						case SIRE_RENDERER_DX9:
+						{
+							IDirect3DVertexBuffer9* vb = reinterpret_cast<IDirect3DVertexBuffer9*>(vertexBuffer);
+							IDirect3DIndexBuffer9* ib = reinterpret_cast<IDirect3DIndexBuffer9*>(indexBuffer);
+							Sire::Release(vb);
+							Sire::Release(ib);
+						} break;
+#endif
+#ifdef SIRE_DX10
+						case SIRE_RENDERER_DX10:
+						{
+							ID3D10Buffer* vb = reinterpret_cast<ID3D10Buffer*>(vertexBuffer);
+							ID3D10Buffer* ib = reinterpret_cast<ID3D10Buffer*>(indexBuffer);
+							Sire::Release(vb);
+							Sire::Release(ib);
+						} break;
+#endif
+#ifdef SIRE_DX11
+						case SIRE_RENDERER_DX11:
+						{
+							ID3D11Buffer* vb = reinterpret_cast<ID3D11Buffer*>(vertexBuffer);
+							ID3D11Buffer* ib = reinterpret_cast<ID3D11Buffer*>(indexBuffer);
+							Sire::Release(vb);
+							Sire::Release(ib);
+						} break;
+#endif
+#ifdef SIRE_OPENGL
+						case SIRE_RENDERER_OPENGL:
+						{
+							uint32_t buffers[2] = {
+								static_cast<uint32_t>(reinterpret_cast<uintptr_t>(vertexBuffer)),
+								static_cast<uint32_t>(reinterpret_cast<uintptr_t>(indexBuffer))
+							};
+							glDeleteBuffers(2, buffers);
+						} break;
+#endif
+#ifdef SIRE_SOFTWARE
+						case SIRE_RENDERER_SOFTWARE:
+						{
+							tSoftwareBuffer* vb = reinterpret_cast<tSoftwareBuffer*>(vertexBuffer);
+							tSoftwareBuffer* ib = reinterpret_cast<tSoftwareBuffer*>(indexBuffer);
+							Sire::Release(vb);
+							Sire::Release(ib);
+						} break;
+#endif
+					}
+				}
+
+				vertexBuffer = nullptr;
+				indexBuffer = nullptr;
+			}
+		};
+		tSirePtrsHolder ptrs;
+
+		tSireMesh() {
+			numVertices = 0;
+			numIndices = 0;
+			primitiveType = SIRE_TRIANGLE;
+		}
+
+		void Release() override {
+			ptrs.Release();
 		}
 	};
 
@@ -586,22 +949,6 @@ public:
 		float x, y, z, w;
 	};
 
-private:
-	struct tRenderState {
-		uint8_t blendEnable;
-		uint8_t srcBlend;
-		uint8_t dstBlend;
-		uint8_t blendop;
-		uint8_t srcBlendAlpha;
-		uint8_t destBlendAlpha;
-		uint8_t blendOpAlpha;
-		uint8_t renderTargetWriteMask;
-		uint8_t cullMode;
-		uint8_t fillMode;
-		uint8_t stencilEnable;
-		uint32_t sampleMask;
-	};
-
 	struct alignas(16) tSireMatrix {
 		union {
 			struct {
@@ -694,6 +1041,42 @@ private:
 			std::swap(_34, _43);
 		}
 
+		void Translation(float x, float y, float z) {
+			Identity();
+			_41 = x;
+			_42 = y;
+			_43 = z;
+		}
+
+		void Scaling(float x, float y, float z) {
+			Identity();
+			_11 = x;
+			_22 = y;
+			_33 = z;
+		}
+
+		void RotationZ(float angle) {
+			float s = sinf(angle);
+			float c = cosf(angle);
+
+			Identity();
+			_11 = c;
+			_12 = s;
+			_21 = -s;
+			_22 = c;
+		}
+
+		// Row vectors, a * b applies a first.
+		tSireMatrix operator*(tSireMatrix const& b) const {
+			tSireMatrix out;
+			for (int32_t i = 0; i < 4; i++) {
+				for (int32_t j = 0; j < 4; j++) {
+					out.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j] + m[i][3] * b.m[3][j];
+				}
+			}
+			return out;
+		}
+
 #ifdef SIRE_DX9
 		D3DXMATRIX ToD3DXMATRIX() {
 			D3DXMATRIX out = {};
@@ -747,13 +1130,6 @@ private:
 		}
 	};
 
-	struct tConstBuff {
-		tSireMatrix matrix;
-		int32_t hasTex;
-		int32_t hasMask;
-		int32_t swapColors;
-	};
-
 	struct tVertex {
 		tSireFloat3 pos;
 		tSireFloat4 col;
@@ -761,1226 +1137,1661 @@ private:
 		tSireFloat2 uv1;
 	};
 
-	struct tVertexLegacy {
-		tSireFloat3 pos;
-		uint32_t diff;
-		tSireFloat2 uv0;
-		tSireFloat2 uv1;
+	// Upstream source of frame arena blocks, override with SetFrameArenaAllocator.
+	struct tSireAllocator {
+		virtual ~tSireAllocator() {}
+		virtual void* Allocate(size_t size) { return ::operator new(size, std::nothrow); }
+		virtual void Free(void* ptr, size_t size) { ::operator delete(ptr); }
 	};
 
-	struct tSireViewport {
-		float x;
-		float y;
-		float w;
-		float h;
-		float mind;
-		float maxd;
+	struct tSireFrameArenaStats {
+		size_t used;
+		size_t capacity;
+		size_t highWaterMark;
+		uint32_t numBlocks;
 	};
 
-	struct tSireShared {
-		tSireViewport viewport;
-		float fov;
-		float nearPlane;
-		float farPlane;
-		tRenderState renderStates;
+	// Bump allocator for per-frame temporaries, everything allocated is released at once by Reset.
+	struct tSireFrameArena {
+		static constexpr size_t SIRE_FRAME_ARENA_BLOCK_SIZE = 1024 * 1024;
 
-		tSireShared() {
-			viewport = { 0.0f, 0.0f, 640.0f, 480.0f, 0.0f, 1.0f };
-			fov = 60.0f;
-			nearPlane = 0.0f;
-			farPlane = 1.0f;
-			renderStates = { 0, SIRE_BLEND_SRC_ALPHA, SIRE_BLEND_INV_SRC_ALPHA, SIRE_BLEND_OP_ADD, SIRE_BLEND_ONE, SIRE_BLEND_ZERO, SIRE_BLEND_OP_ADD, SIRE_COLOR_WRITE_ENABLE_ALL, SIRE_CULL_NONE, SIRE_FILL_SOLID };
-		}
+		struct tBlock {
+			tBlock* next;
+			size_t size;
+			size_t used;
+		};
 
-		~tSireShared() {
+		tSireAllocator defaultAllocator;
+		tSireAllocator* upstream;
+		tBlock* blocks;
+		size_t used;
+		size_t capacity;
+		size_t highWaterMark;
+		uint32_t generation;
 
+		tSireFrameArena() {
+			upstream = &defaultAllocator;
+			blocks = nullptr;
+			used = 0;
+			capacity = 0;
+			highWaterMark = 0;
+			generation = 0;
 		}
-	};
-
-	struct SireRenderer {
-		bool initialised;
-		HWND hWnd;
-		uint32_t textureFormat; // TODO: make global enum formats.
-
-		virtual bool IsRendererActive() { return false; }
-		virtual void Init(uintptr_t* ptr) {}
-		virtual void Shutdown() {}
-		virtual void Begin() {}
-		virtual void End() {}
-		virtual void SetVertices(tVertex const& v) {}
-		virtual void SetRenderStates(tRenderState const& s) {}
-		virtual void SetViewport(tSireViewport const& v) {}
-		virtual void CopyResource(uintptr_t* dst, uintptr_t* src) {}
-		virtual void SetTexture(uintptr_t* tex, uintptr_t* mask) {}
-		virtual HWND GetWindow() { return hWnd; }
-		virtual uint8_t* Lock(void* ptr) { return nullptr; }
-		virtual void Unlock(void* ptr) {}
-		virtual void SetTextureFormat(uint32_t format) { textureFormat = format; }
-		virtual uint32_t GetTextureFormat() { return textureFormat; }
-		virtual void SetPixelShader(uintptr_t* ps) {}
-		virtual void SetVertexShader(uintptr_t* vs) {}
-		virtual uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVersion = "ps_3_0") { return nullptr; }
-		virtual uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVersion = "vs_3_0") { return nullptr; }
 
-		SireRenderer() {
-			initialised = false;
-			hWnd = nullptr;
-			textureFormat = 0;
+		~tSireFrameArena() {
+			Release();
 		}
 
-		bool operator==(const SireRenderer& other) const {
-			return false;
+		static size_t GetHeaderSize() {
+			return (sizeof(tBlock) + 15) & ~static_cast<size_t>(15);
 		}
-	};
 
-#ifdef SIRE_DX9
-	struct SireDirectX9 : SireRenderer {
-		IDirect3DDevice9* dev;
-		IDirect3DVertexBuffer9* vb;
-		IDirect3DIndexBuffer9* ib;
-		IDirect3DTexture9* tex;
-		IDirect3DTexture9* mask;
-		IDirect3DVertexDeclaration9* vertexDeclaration;
-		IDirect3DPixelShader9* pixelShader;
-		IDirect3DVertexShader9* vertexShader;
-		ID3DXConstantTable* pct;
-		ID3DXConstantTable* vct;
-		IDirect3DPixelShader9* internalPixelShader;
-		IDirect3DVertexShader9* internalVertexShader;
-		std::vector<tVertexLegacy> verticesLegacy;
-		IDirect3DStateBlock9* stateBlock;
+		bool AddBlock(size_t size) {
+			tBlock* block = static_cast<tBlock*>(upstream->Allocate(GetHeaderSize() + size));
+			if (!block)
+				return false;
 
-		SireDirectX9() : SireRenderer() {
-			dev = nullptr;
-			vb = nullptr;
-			ib = nullptr;
-			tex = nullptr;
-			mask = nullptr;
-			vertexDeclaration = nullptr;
-			pixelShader = nullptr;
-			vertexShader = nullptr;
-			pct = nullptr;
-			vct = nullptr;
-			internalPixelShader = nullptr;
-			internalVertexShader = nullptr;
-			verticesLegacy = {};
-			stateBlock = nullptr;
-			textureFormat = D3DFMT_A8R8G8B8;
+			block->next = blocks;
+			block->size = size;
+			block->used = 0;
+			blocks = block;
+			capacity += size;
+			return true;
 		}
 
-		// Start virtual override
-		bool IsRendererActive() override {
-			if (initialised && dev) {
-				HRESULT hr = dev->TestCooperativeLevel();
-				return SUCCEEDED(hr);
+		void* Allocate(size_t size, size_t alignment = 16) {
+			if (size == 0)
+				return nullptr;
+
+			if (blocks) {
+				uintptr_t base = reinterpret_cast<uintptr_t>(blocks) + GetHeaderSize();
+				size_t offset = ((base + blocks->used + alignment - 1) & ~(alignment - 1)) - base;
+				if (offset + size <= blocks->size) {
+					used += offset + size - blocks->used;
+					blocks->used = offset + size;
+					highWaterMark = (std::max)(highWaterMark, used);
+					return reinterpret_cast<void*>(base + offset);
+				}
 			}
 
-			return false;
-		}
+			// Grow geometrically, Reset folds the chain back into a single block.
+			size_t blockSize = blocks ? blocks->size * 2 : SIRE_FRAME_ARENA_BLOCK_SIZE;
+			while (blockSize < size + alignment)
+				blockSize *= 2;
 
-		void Init(uintptr_t* d) override {
-			if (initialised)
-				return;
+			if (!AddBlock(blockSize))
+				return nullptr;
 
-			dev = reinterpret_cast<IDirect3DDevice9*>(d);
+			return Allocate(size, alignment);
+		}
 
-			IDirect3DSwapChain9* swapchain = nullptr;
-			dev->GetSwapChain(0, &swapchain);
+		template <typename T>
+		T* Allocate(size_t count) {
+			return static_cast<T*>(Allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+		}
 
-			D3DPRESENT_PARAMETERS presentParams;
-			ZeroMemory(&presentParams, sizeof(presentParams));
-			swapchain->GetPresentParameters(&presentParams);
+		void Reset() {
+			// Once the arena settled on a size a frame never reaches the upstream allocator.
+			if (blocks && blocks->next) {
+				size_t total = capacity;
+				Release();
+				AddBlock(total);
+			}
 
-			hWnd = presentParams.hDeviceWindow;
+			if (blocks)
+				blocks->used = 0;
 
-			dev->CreateVertexBuffer(sizeof(tVertexLegacy) * 65536, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
-									0, D3DPOOL_DEFAULT, &vb, nullptr);
+			used = 0;
+			generation++;
+		}
 
-			dev->CreateIndexBuffer(sizeof(uint16_t) * 65536, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
-								   D3DFMT_INDEX16, D3DPOOL_DEFAULT, &ib, nullptr);
+		void Release() {
+			while (blocks) {
+				tBlock* next = blocks->next;
+				upstream->Free(blocks, GetHeaderSize() + blocks->size);
+				blocks = next;
+			}
 
-			// Init shaders
-			ID3DXBuffer* VS = CompileShader(hlslShader2_0, "VShader", "vs_2_0");
-			ID3DXBuffer* PS = CompileShader(hlslShader2_0, "PShader", "ps_2_0");
+			used = 0;
+			capacity = 0;
+			generation++;
+		}
 
-			internalVertexShader = CreateVertexShader(VS->GetBufferPointer(), VS->GetBufferSize());
-			internalPixelShader = CreatePixelShader(PS->GetBufferPointer(), PS->GetBufferSize());
+		void SetUpstream(tSireAllocator* allocator) {
+			Release();
+			upstream = allocator ? allocator : &defaultAllocator;
+		}
 
-			D3DXGetShaderConstantTable(static_cast<const DWORD*>(VS->GetBufferPointer()), &pct);
-			D3DXGetShaderConstantTable(static_cast<const DWORD*>(PS->GetBufferPointer()), &vct);
+		tSireFrameArenaStats GetStats() {
+			tSireFrameArenaStats out = {};
+			out.used = used;
+			out.capacity = capacity;
+			out.highWaterMark = highWaterMark;
+			for (tBlock* it = blocks; it; it = it->next)
+				out.numBlocks++;
+			return out;
+		}
+	};
 
-			Release(VS);
-			Release(PS);
+	// Backend independent shader compiler, override with SetShaderCompiler (i.e. a stub for testing).
+	struct tSireShaderCompiler {
+		virtual ~tSireShaderCompiler() {}
 
-			D3DVERTEXELEMENT9 vertexElements[] = {
-				{ 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
-				{ 0, sizeof(float[3]), D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_COLOR, 0 },
-				{ 0, sizeof(float[3]) + sizeof(D3DCOLOR), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0},
-				{ 0, sizeof(float[5]) + sizeof(D3DCOLOR), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1},
-				D3DDECL_END()
-			};
+		// Blobs cached by a different compiler version are discarded.
+		virtual uint64_t GetVersion() { return 0; }
+		virtual bool Compile(std::string const& source, const char* entryPoint, const char* target, uint32_t flags, std::vector<uint8_t>& out) { return false; }
+	};
 
-			dev->CreateVertexDeclaration(vertexElements, &vertexDeclaration);
+	// Content addressed on-disk cache of compiled shader blobs, disabled while directory is empty.
+	struct tSireShaderCache {
+		static constexpr uint32_t SIRE_SHADER_CACHE_MAGIC = 0x53524953; // "SIRS"
+		static constexpr uint32_t SIRE_SHADER_CACHE_VERSION = 1;
+
+		struct tHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t compilerVersion;
+			uint64_t key;
+			uint64_t size;
+			uint64_t checksum;
+		};
 
-			initialised = true;
+		std::string directory;
+
+		uint64_t GetKey(std::string const& source, const char* entryPoint, const char* target, uint32_t flags) {
+			uint64_t key = Hash64(source.data(), source.size());
+			key = Hash64(entryPoint, strlen(entryPoint), key);
+			key = Hash64(target, strlen(target), key);
+			return Hash64(&flags, sizeof(flags), key);
 		}
 
-		void Shutdown() override {
-			if (!initialised)
-				return;
+		std::string GetPath(uint64_t key) {
+			char name[32] = {};
+			snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+			return directory + "/" + name;
+		}
 
-			Release(vb);
-			Release(ib);
-			Release(vertexDeclaration);
-			Release(pct);
-			Release(vct);
+		bool Load(uint64_t key, uint64_t compilerVersion, std::vector<uint8_t>& out) {
+			if (directory.empty())
+				return false;
 
-			tex = nullptr;
-			mask = nullptr;
-			dev = nullptr;
+			FILE* f = fopen(GetPath(key).c_str(), "rb");
+			if (!f)
+				return false;
 
-			initialised = false;
-		}
+			bool result = false;
+			tHeader header = {};
+			if (fread(&header, sizeof(header), 1, f) == 1 &&
+				header.magic == SIRE_SHADER_CACHE_MAGIC &&
+				header.version == SIRE_SHADER_CACHE_VERSION &&
+				header.compilerVersion == compilerVersion &&
+				header.key == key) {
+				out.resize(static_cast<size_t>(header.size));
+				result = fread(out.data(), 1, out.size(), f) == out.size() && Hash64(out.data(), out.size()) == header.checksum;
+			}
+			fclose(f);
 
-		void Begin() override {
-			verticesLegacy.clear();
+			if (!result)
+				out.clear();
 
-			dev->CreateStateBlock(D3DSBT_ALL, &stateBlock);
-			stateBlock->Capture();
+			return result;
 		}
 
-		void End() override {
-			// Fallback to internal shaders if unset.
-			if (!pixelShader && internalPixelShader)
-				pixelShader = internalPixelShader;
+		bool Store(uint64_t key, uint64_t compilerVersion, std::vector<uint8_t> const& data) {
+			if (directory.empty() || data.empty())
+				return false;
 
-			if (!vertexShader && internalVertexShader)
-				vertexShader = internalVertexShader;
+			// Write aside and rename so a concurrent reader never sees a partial blob, every process has its own temp file.
+			std::string path = GetPath(key);
+			std::string temp = path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+			FILE* f = fopen(temp.c_str(), "wb");
+			if (!f)
+				return false;
 
-			void* out = nullptr;
-			vb->Lock(0, 0, (void**)&out, 0);
-			memcpy(out, verticesLegacy.data(), verticesLegacy.size() * sizeof(tVertexLegacy));
-			vb->Unlock();
+			tHeader header = { SIRE_SHADER_CACHE_MAGIC, SIRE_SHADER_CACHE_VERSION, compilerVersion, key, data.size(), Hash64(data.data(), data.size()) };
+			bool result = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(data.data(), 1, data.size(), f) == data.size();
+			fclose(f);
 
-			ib->Lock(0, 0, (void**)&out, 0);
-			memcpy(out, indices.data(), indices.size() * sizeof(uint16_t));
-			ib->Unlock();
+			if (result) {
+				remove(path.c_str());
+				result = rename(temp.c_str(), path.c_str()) == 0;
+			}
 
-			tConstBuff tempcb = cb;
-			D3DXMATRIX m = tempcb.matrix.ToD3DXMATRIX();
-			pct->SetMatrix(dev, pct->GetConstantByName(NULL, "proj"), &m);
-			pct->SetMatrix(dev, vct->GetConstantByName(NULL, "proj"), &m);
+			if (!result)
+				remove(temp.c_str());
 
-			pct->SetInt(dev, pct->GetConstantByName(NULL, "hasTex"), tempcb.hasTex);
-			pct->SetInt(dev, vct->GetConstantByName(NULL, "hasTex"), tempcb.hasTex);
+			return result;
+		}
 
-			pct->SetInt(dev, pct->GetConstantByName(NULL, "hasMask"), tempcb.hasMask);
-			pct->SetInt(dev, vct->GetConstantByName(NULL, "hasMask"), tempcb.hasMask);
+		bool Compile(tSireShaderCompiler* compiler, std::string const& source, const char* entryPoint, const char* target, uint32_t flags, std::vector<uint8_t>& out) {
+			if (!compiler)
+				return false;
 
-			pct->SetInt(dev, pct->GetConstantByName(NULL, "swapColors"), tempcb.swapColors);
-			pct->SetInt(dev, vct->GetConstantByName(NULL, "swapColors"), tempcb.swapColors);
+			uint64_t key = GetKey(source, entryPoint, target, flags);
+			if (Load(key, compiler->GetVersion(), out))
+				return true;
 
-			if (currentRenderTargetView)
-				dev->SetRenderTarget(0, (IDirect3DSurface9*)currentRenderTargetView);
+			if (!compiler->Compile(source, entryPoint, target, flags, out))
+				return false;
 
-			dev->SetVertexDeclaration(vertexDeclaration);
+			Store(key, compiler->GetVersion(), out);
+			return true;
+		}
+	};
 
-			dev->SetTexture(0, tex);
-			dev->SetTexture(1, mask);
+	// Memory-mapped texture archive written by WriteTexturePack. The header is followed by the entries sorted by name hash,
+	// every image starts on a SIRE_TEXTURE_PACK_ALIGNMENT boundary and holds its mip levels back to back, largest first.
+	// Images are stored in their upload format, so creating a texture reads straight from the mapping.
+	struct tSireTexturePack : tSireUnknown {
+		static constexpr uint32_t SIRE_TEXTURE_PACK_MAGIC = 0x50524953; // "SIRP"
+		static constexpr uint32_t SIRE_TEXTURE_PACK_VERSION = 1;
+		static constexpr uint32_t SIRE_TEXTURE_PACK_ALIGNMENT = 16;
+
+		struct tHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t count;
+			uint32_t reserved;
+		};
 
-			dev->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
-			dev->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
-			dev->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
-			dev->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+		struct tEntry {
+			uint64_t key; // Hash64 of the name
+			uint64_t offset;
+			uint64_t size;
+			int32_t width;
+			int32_t height;
+			uint32_t format; // eSirePixelFormat
+			uint32_t mipLevels;
+		};
 
-			dev->SetSamplerState(1, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
-			dev->SetSamplerState(1, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
-			dev->SetSamplerState(1, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
-			dev->SetSamplerState(1, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+		uint8_t const* data;
+		size_t size;
+		tEntry const* entries;
+		uint32_t count;
 
-			dev->SetRenderState(D3DRS_WRAP0, 0);
-			dev->SetRenderState(D3DRS_WRAP1, 0);
+		tSireTexturePack() {
+			data = nullptr;
+			size = 0;
+			entries = nullptr;
+			count = 0;
+		}
 
-			dev->SetPixelShader(pixelShader);
-			dev->SetVertexShader(vertexShader);
+		~tSireTexturePack() {
+			Release();
+		}
 
-			dev->SetStreamSource(0, vb, 0, sizeof(tVertexLegacy));
-			dev->SetIndices(ib);
+		bool Open(std::string const& path) {
+			Release();
 
-			D3DPRIMITIVETYPE type = D3DPT_POINTLIST;
-			switch (primitiveType) {
-				case SIRE_LINE:
-					type = D3DPT_LINELIST;
-					break;
-				case SIRE_POINT:
-					type = D3DPT_POINTLIST;
-					break;
-				case SIRE_TRIANGLE:
-					type = D3DPT_TRIANGLELIST;
-					break;
-			}
+			data = MapFileData(path, size);
+			if (!data)
+				return false;
 
-			dev->DrawIndexedPrimitive(type, 0, 0, static_cast<uint32_t>(verticesLegacy.size()), 0, numIndices / 3);
+			if (!Validate()) {
+				Release();
+				return false;
+			}
 
-			stateBlock->Apply();
-			Release(stateBlock);
+			return true;
 		}
 
-		void SetVertices(tVertex const& v) override {
-			tVertexLegacy vl = {};
+		// Checked once here so textures can be created from the entries without further bounds checks.
+		bool Validate() {
+			if (size < sizeof(tHeader))
+				return false;
 
-			vl.pos = v.pos;
-			vl.diff = D3DCOLOR_ARGB(
-				static_cast<uint32_t>(v.col.w * 255),
-				static_cast<uint32_t>(v.col.x * 255),
-				static_cast<uint32_t>(v.col.y * 255),
-				static_cast<uint32_t>(v.col.z * 255)
-			);
-			vl.uv0 = v.uv0;
-			vl.uv1 = v.uv1;
+			tHeader const* header = reinterpret_cast<tHeader const*>(data);
+			if (header->magic != SIRE_TEXTURE_PACK_MAGIC || header->version != SIRE_TEXTURE_PACK_VERSION)
+				return false;
 
-			verticesLegacy.push_back(vl);
-		}
+			if (header->count > (size - sizeof(tHeader)) / sizeof(tEntry))
+				return false;
 
-		void SetRenderStates(tRenderState const& s) override {
-			// Set rasterizer state
-			dev->SetRenderState(D3DRS_CULLMODE, s.cullMode);
-			dev->SetRenderState(D3DRS_FILLMODE, s.fillMode);
+			tEntry const* it = reinterpret_cast<tEntry const*>(data + sizeof(tHeader));
+			for (uint32_t i = 0; i < header->count; i++) {
+				tEntry const& e = it[i];
+				if (i > 0 && e.key <= it[i - 1].key)
+					return false;
 
-			// Set blend state
-			dev->SetRenderState(D3DRS_ALPHABLENDENABLE, s.blendEnable);
-			dev->SetRenderState(D3DRS_SRCBLEND, s.srcBlend);
-			dev->SetRenderState(D3DRS_DESTBLEND, s.dstBlend);
-			dev->SetRenderState(D3DRS_BLENDOP, s.blendop);
-			dev->SetRenderState(D3DRS_SRCBLENDALPHA, s.srcBlendAlpha);
-			dev->SetRenderState(D3DRS_DESTBLENDALPHA, s.destBlendAlpha);
-			dev->SetRenderState(D3DRS_BLENDOPALPHA, s.blendOpAlpha);
-			dev->SetRenderState(D3DRS_COLORWRITEENABLE, s.sampleMask);
-		}
+				eSirePixelFormat format = static_cast<eSirePixelFormat>(e.format);
+				if (!IsCompressedFormat(format) && GetPixelSize(format) != 4)
+					return false;
 
-		void SetViewport(tSireViewport const& v) {
-			D3DVIEWPORT9 vp = {};
-			vp.X = static_cast<DWORD>(v.x);
-			vp.Y = static_cast<DWORD>(v.y);
-			vp.Width = static_cast<DWORD>(v.w);
-			vp.Height = static_cast<DWORD>(v.h);
-			vp.MinZ = v.mind;
-			vp.MaxZ = v.maxd;
-			dev->SetViewport(&vp);
-		}
+				if (e.width <= 0 || e.height <= 0 || e.width > SIRE_MAX_IMAGE_DIMENSION || e.height > SIRE_MAX_IMAGE_DIMENSION)
+					return false;
 
-		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
-			cb.hasTex = texture ? true : false;
-			cb.hasMask = textureMask ? true : false;
+				if (e.mipLevels < 1 || e.mipLevels > GetMipLevelCount(e.width, e.height))
+					return false;
 
-			tex = nullptr;
-			mask = nullptr;
+				if (e.offset % SIRE_TEXTURE_PACK_ALIGNMENT || e.offset > size || e.size > size - e.offset)
+					return false;
 
-			if (texture)
-				tex = reinterpret_cast<IDirect3DTexture9*>(texture);
+				if (e.size != GetImageDataSize(format, e.width, e.height, e.mipLevels))
+					return false;
+			}
 
-			if (textureMask)
-				mask = reinterpret_cast<IDirect3DTexture9*>(textureMask);
+			entries = it;
+			count = header->count;
+			return true;
 		}
 
-		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
-			dev->StretchRect(reinterpret_cast<IDirect3DSurface9*>(src), nullptr, reinterpret_cast<IDirect3DSurface9*>(dst), nullptr, D3DTEXF_NONE);
-		}
+		tEntry const* Find(std::string const& name) const {
+			uint64_t key = Hash64(name.data(), name.size());
+			tEntry const* it = std::lower_bound(entries, entries + count, key, [](tEntry const& e, uint64_t k) { return e.key < k; });
+			if (it == entries + count || it->key != key)
+				return nullptr;
 
-		uint8_t* Lock(void* ptr) override {
-			D3DLOCKED_RECT out;
-			reinterpret_cast<IDirect3DSurface9*>(ptr)->LockRect(&out, nullptr, 0);
-			return (uint8_t*)out.pBits;
+			return it;
 		}
 
-		void Unlock(void* ptr) override {
-			reinterpret_cast<IDirect3DSurface9*>(ptr)->UnlockRect();
+		void Release() override {
+			if (data)
+				UnmapFileData(data);
+
+			data = nullptr;
+			size = 0;
+			entries = nullptr;
+			count = 0;
 		}
+	};
 
-		void SetPixelShader(uintptr_t* ps) override {
-			pixelShader = (IDirect3DPixelShader9*)ps;
+	// Source image for WriteTexturePack.
+	struct tSireTexturePackImage {
+		std::string name;
+		int32_t width;
+		int32_t height;
+		uint8_t const* pixels;
+		eSirePixelFormat format; // Of pixels, UNKNOWN is taken as RGBA8
+	};
+
+	// 8-bit coverage of one glyph, offsets go from the pen position on the baseline to the top-left corner (y down).
+	struct tSireGlyphBitmap {
+		int32_t w;
+		int32_t h;
+		int32_t offsetX;
+		int32_t offsetY;
+		float advance;
+		std::vector<uint8_t> coverage;
+	};
+
+	struct tSireFontMetrics {
+		float ascent;
+		float descent;
+		float lineHeight;
+	};
+
+	// Source of glyph bitmaps for the text atlas, GDI by default. Override with SetGlyphRasterizer.
+	struct tSireGlyphRasterizer {
+		virtual ~tSireGlyphRasterizer() {}
+
+		virtual uintptr_t* CreateFace(const char* name, int32_t pixelSize, bool bold, tSireFontMetrics& metrics) { return nullptr; }
+		virtual void ReleaseFace(uintptr_t* face) {}
+		virtual bool Rasterize(uintptr_t* face, uint32_t codepoint, tSireGlyphBitmap& out) { return false; }
+	};
+
+	// Outline made of subpaths in pixels, curves are flattened when the path is tessellated.
+	struct tSirePath {
+		enum eVerb : uint8_t {
+			MOVE,
+			LINE,
+			QUADRATIC,
+			CUBIC,
+			CLOSE,
+		};
+
+		std::vector<uint8_t> verbs;
+		std::vector<tSireFloat2> points;
+
+		void MoveTo(float x, float y) {
+			verbs.push_back(MOVE);
+			points.push_back({ x, y });
 		}
 
-		void SetVertexShader(uintptr_t* vs) override {
-			vertexShader = (IDirect3DVertexShader9*)vs;
+		void LineTo(float x, float y) {
+			verbs.push_back(LINE);
+			points.push_back({ x, y });
 		}
 
-		uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVer) override {
-			ID3DXBuffer* buf = CompileShader(shaderCode, "main", targetVer);
-			return (uintptr_t*)CreatePixelShader(buf->GetBufferPointer(), buf->GetBufferSize());
+		void QuadraticTo(float cx, float cy, float x, float y) {
+			verbs.push_back(QUADRATIC);
+			points.push_back({ cx, cy });
+			points.push_back({ x, y });
 		}
 
-		uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVer) override {
-			ID3DXBuffer* buf = CompileShader(shaderCode, "main", targetVer);
-			return (uintptr_t*)CreateVertexShader(buf->GetBufferPointer(), buf->GetBufferSize());
+		void CubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y) {
+			verbs.push_back(CUBIC);
+			points.push_back({ c1x, c1y });
+			points.push_back({ c2x, c2y });
+			points.push_back({ x, y });
 		}
 
-		// End virtual override
+		void Close() {
+			verbs.push_back(CLOSE);
+		}
 
-		IDirect3DSurface9** GetRenderTargets() {
-			D3DCAPS9 caps;
-			dev->GetDeviceCaps(&caps);
-			UINT maxRTs = caps.NumSimultaneousRTs;
+		void AddPolyline(tSireFloat2 const* p, uint32_t count, bool closed) {
+			if (!count)
+				return;
 
-			static IDirect3DSurface9* out[8] = {};
-			memset(out, 0, sizeof(out));
+			MoveTo(p[0].x, p[0].y);
+			for (uint32_t i = 1; i < count; i++)
+				LineTo(p[i].x, p[i].y);
 
-			for (int32_t i = 0; i < maxRTs; i++) {
-				dev->GetRenderTarget(i, &out[i]);
-			}
-			return out;
+			if (closed)
+				Close();
 		}
 
-		IDirect3DSurface9* GetBackBufferSurface(uint32_t buffer) {
-			IDirect3DSurface9* out = nullptr;
-			dev->GetBackBuffer(0, buffer, D3DBACKBUFFER_TYPE_MONO, &out);
-			return out;
+		void Clear() {
+			verbs.clear();
+			points.clear();
 		}
 
-		D3DSURFACE_DESC GetDesc(IDirect3DSurface9* surface) {
-			D3DSURFACE_DESC out = {};
-			surface->GetDesc(&out);
-			return out;
+		uint64_t Hash(uint64_t seed = SIRE_HASH_SEED) const {
+			uint64_t out = Hash64(verbs.data(), verbs.size(), seed);
+			return Hash64(points.data(), points.size() * sizeof(tSireFloat2), out);
 		}
+	};
 
-		IDirect3DSurface9* GetSurfaceLevel(IDirect3DTexture9* texture, uint32_t level) {
-			IDirect3DSurface9* out;
-			texture->GetSurfaceLevel(level, &out);
-			return out;
-		}
+	struct tSireStrokeStyle {
+		float width = 1.0f;
+		eSireLineJoin join = SIRE_LINE_JOIN_MITER;
+		eSireLineCap cap = SIRE_LINE_CAP_BUTT;
+		// Miters longer than miterLimit * width / 2 are beveled.
+		float miterLimit = 4.0f;
+	};
 
-		ID3DXBuffer* CompileShader(const std::string& str, const char* szEntrypoint, const char* szTarget) {
-			ID3DXBuffer* out;
-			ID3DXBuffer* outerr;
-			HRESULT hr = D3DXCompileShader(str.c_str(), static_cast<uint32_t>(str.size()), NULL, NULL, szEntrypoint, szTarget, 0, &out, &outerr, NULL);
-			if (FAILED(hr)) {
-				if (outerr) {
-					char szError[256]{ 0 };
-					memcpy(szError, outerr->GetBufferPointer(), outerr->GetBufferSize());
-					MessageBoxA(nullptr, szError, "Error", MB_OK);
-				}
-				return outerr;
-			}
-			return out;
-		}
+	// Self-contained draw that can be built on any thread and queued with SubmitPacket. Textures and the target are
+	// borrowed and have to stay alive until the packet was drained. At most 65536 vertices.
+	struct tSireDrawPacket {
+		eSirePrimitiveType primitiveType = SIRE_TRIANGLE;
+		std::vector<tVertex> vertices;
+		std::vector<uint16_t> indices;
+		tSireTexture2D* texture = nullptr;
+		tSireTexture2D* mask = nullptr;
+		tSireRenderTarget* target = nullptr;
+		// Applied on top of the render thread's states for this packet only.
+		std::vector<std::pair<eSireRenderState, uint32_t>> renderStates;
+		tSireFloat4 tint = { 1.0f, 1.0f, 1.0f, 1.0f };
+	};
 
-		IDirect3DVertexShader9* CreateVertexShader(const void* buffer, uint32_t size) {
-			IDirect3DVertexShader9* pVertexShader = nullptr;
-			dev->CreateVertexShader(static_cast<const DWORD*>(buffer), &pVertexShader);
-			return pVertexShader;
+	// Structure of arrays so UpdateParticles runs four particles at a time. The first count entries are alive,
+	// dead particles are replaced by the last one.
+	struct tSireParticles {
+		std::vector<float> px, py, pz;
+		std::vector<float> vx, vy, vz;
+		std::vector<float> r, g, b, a;
+		std::vector<float> life;
+		std::vector<float> invLifetime;
+		std::vector<float> size;
+		uint32_t count = 0;
+
+		tSireFloat3 gravity = { 0.0f, 0.0f, 0.0f };
+		// Fraction of the velocity lost per second.
+		float drag = 0.0f;
+		// Size change per second.
+		float growth = 0.0f;
+		// Alpha follows the remaining life.
+		bool fadeOut = true;
+
+		void Reserve(uint32_t n) {
+			if (n <= px.size())
+				return;
+
+			// Padded so the SIMD loop never needs a tail.
+			n = (n + 3) & ~3u;
+			for (auto it : { &px, &py, &pz, &vx, &vy, &vz, &r, &g, &b, &a, &life, &invLifetime, &size })
+				it->resize(n, 0.0f);
 		}
 
-		IDirect3DPixelShader9* CreatePixelShader(const void* buffer, uint32_t size) {
-			IDirect3DPixelShader9* pPixelShader = nullptr;
-			dev->CreatePixelShader(static_cast<const DWORD*>(buffer), &pPixelShader);
-			return pPixelShader;
+		void Clear() {
+			count = 0;
 		}
+	};
 
-		const char* GetErrorString(HRESULT hr) {
-			switch (hr) {
-				case D3D_OK:
-					return "D3D_OK: No error.";
-				case D3DERR_NOTAVAILABLE:
-					return "D3DERR_NOTAVAILABLE: This device does not support the queried technique or method.";
-				case D3DERR_OUTOFVIDEOMEMORY:
-					return "D3DERR_OUTOFVIDEOMEMORY: Out of video memory.";
-				case D3DERR_INVALIDCALL:
-					return "D3DERR_INVALIDCALL: The method call is invalid.";
-				case D3DERR_DRIVERINTERNALERROR:
-					return "D3DERR_DRIVERINTERNALERROR: Internal driver error.";
-				case D3DERR_DEVICELOST:
-					return "D3DERR_DEVICELOST: The device is lost and needs to be reset.";
-				case D3DERR_INVALIDDEVICE:
-					return "D3DERR_INVALIDDEVICE: The requested device type is not valid.";
-				case D3DERR_MOREDATA:
-					return "D3DERR_MOREDATA: There is more data available.";
-				case D3DERR_NOTFOUND:
-					return "D3DERR_NOTFOUND: The requested item was not found.";
-				case D3DERR_DEVICEHUNG:
-					return "D3DERR_DEVICEHUNG: The device is hung and needs to be reset.";
-				case D3DERR_DEVICEREMOVED:
-					return "D3DERR_DEVICEREMOVED: The device has been removed.";
-				case D3DERR_DEVICENOTRESET:
-					return "D3DERR_DEVICENOTRESET: The device has not been reset.";
-				case D3DERR_WASSTILLDRAWING:
-					return "D3DERR_WASSTILLDRAWING: The previous rendering operation is still in progress.";
-				case D3DERR_UNSUPPORTEDALPHAARG:
-					return "D3DERR_UNSUPPORTEDALPHAARG: The alpha blending argument is not supported.";
-				case D3DERR_UNSUPPORTEDALPHAOPERATION:
-					return "D3DERR_UNSUPPORTEDALPHAOPERATION: The alpha blending operation is not supported.";
-				case D3DERR_UNSUPPORTEDCOLORARG:
-					return "D3DERR_UNSUPPORTEDCOLORARG: The color blending argument is not supported.";
-				case D3DERR_UNSUPPORTEDCOLOROPERATION:
-					return "D3DERR_UNSUPPORTEDCOLOROPERATION: The color blending operation is not supported.";
-				default:
-					return "Unknown error.";
+	// Spawns rate particles per second around position, every value is picked in value +- variance.
+	struct tSireParticleEmitter {
+		tSireFloat3 position = { 0.0f, 0.0f, 0.0f };
+		tSireFloat3 positionVariance = { 0.0f, 0.0f, 0.0f };
+		tSireFloat3 velocity = { 0.0f, 0.0f, 0.0f };
+		tSireFloat3 velocityVariance = { 0.0f, 0.0f, 0.0f };
+		tSireFloat4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
+		tSireFloat4 colorVariance = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float lifetime = 1.0f;
+		float lifetimeVariance = 0.0f;
+		float size = 4.0f;
+		float sizeVariance = 0.0f;
+		float rate = 0.0f;
+
+		float accumulator = 0.0f;
+		uint32_t seed = 0x9E3779B9;
+	};
+
+private:
+#if defined(SIRE_SSE2)
+	typedef __m128 tSimd4f;
+	static inline tSimd4f SimdLoad(const float* p) { return _mm_loadu_ps(p); }
+	static inline void SimdStore(float* p, tSimd4f v) { _mm_storeu_ps(p, v); }
+	static inline tSimd4f SimdSet(float v) { return _mm_set1_ps(v); }
+	static inline tSimd4f SimdAdd(tSimd4f a, tSimd4f b) { return _mm_add_ps(a, b); }
+	static inline tSimd4f SimdSub(tSimd4f a, tSimd4f b) { return _mm_sub_ps(a, b); }
+	static inline tSimd4f SimdMul(tSimd4f a, tSimd4f b) { return _mm_mul_ps(a, b); }
+	static inline tSimd4f SimdMin(tSimd4f a, tSimd4f b) { return _mm_min_ps(a, b); }
+	static inline tSimd4f SimdMax(tSimd4f a, tSimd4f b) { return _mm_max_ps(a, b); }
+	static inline tSimd4f SimdMulAdd(tSimd4f a, tSimd4f b, tSimd4f c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	static inline tSimd4f SimdSplatW(tSimd4f v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+	static inline tSimd4f SimdSelect(tSimd4f mask, tSimd4f a, tSimd4f b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static inline tSimd4f SimdLaneMask(uint32_t bits) {
+		return _mm_castsi128_ps(_mm_set_epi32(-static_cast<int32_t>((bits >> 3) & 1), -static_cast<int32_t>((bits >> 2) & 1), -static_cast<int32_t>((bits >> 1) & 1), -static_cast<int32_t>(bits & 1)));
+	}
+	static inline tSimd4f SimdLoadUnorm8(const uint8_t* p) {
+		int32_t v;
+		memcpy(&v, p, 4);
+		__m128i zero = _mm_setzero_si128();
+		__m128i i = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+		return _mm_mul_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(1.0f / 255.0f));
+	}
+	static inline void SimdStoreUnorm8(uint8_t* p, tSimd4f v) {
+		v = _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), v));
+		__m128i i = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+		i = _mm_packs_epi32(i, i);
+		int32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+		memcpy(p, &out, 4);
+	}
+#define SIRE_SIMD
+#elif defined(SIRE_NEON)
+	typedef float32x4_t tSimd4f;
+	static inline tSimd4f SimdLoad(const float* p) { return vld1q_f32(p); }
+	static inline void SimdStore(float* p, tSimd4f v) { vst1q_f32(p, v); }
+	static inline tSimd4f SimdSet(float v) { return vdupq_n_f32(v); }
+	static inline tSimd4f SimdAdd(tSimd4f a, tSimd4f b) { return vaddq_f32(a, b); }
+	static inline tSimd4f SimdSub(tSimd4f a, tSimd4f b) { return vsubq_f32(a, b); }
+	static inline tSimd4f SimdMul(tSimd4f a, tSimd4f b) { return vmulq_f32(a, b); }
+	static inline tSimd4f SimdMin(tSimd4f a, tSimd4f b) { return vminq_f32(a, b); }
+	static inline tSimd4f SimdMax(tSimd4f a, tSimd4f b) { return vmaxq_f32(a, b); }
+	static inline tSimd4f SimdMulAdd(tSimd4f a, tSimd4f b, tSimd4f c) { return vmlaq_f32(c, a, b); }
+	static inline tSimd4f SimdSplatW(tSimd4f v) { return vdupq_n_f32(vgetq_lane_f32(v, 3)); }
+	static inline tSimd4f SimdSelect(tSimd4f mask, tSimd4f a, tSimd4f b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+	static inline tSimd4f SimdLaneMask(uint32_t bits) {
+		uint32_t const m[4] = { 0u - (bits & 1), 0u - ((bits >> 1) & 1), 0u - ((bits >> 2) & 1), 0u - ((bits >> 3) & 1) };
+		return vreinterpretq_f32_u32(vld1q_u32(m));
+	}
+	static inline tSimd4f SimdLoadUnorm8(const uint8_t* p) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		uint32x4_t i = vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)))));
+		return vmulq_f32(vcvtq_f32_u32(i), vdupq_n_f32(1.0f / 255.0f));
+	}
+	static inline void SimdStoreUnorm8(uint8_t* p, tSimd4f v) {
+		v = vminq_f32(vdupq_n_f32(1.0f), vmaxq_f32(vdupq_n_f32(0.0f), v));
+		uint16x4_t h = vmovn_u32(vcvtq_u32_f32(vaddq_f32(vmulq_f32(v, vdupq_n_f32(255.0f)), vdupq_n_f32(0.5f))));
+		uint32_t out = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(h, h))), 0);
+		memcpy(p, &out, 4);
+	}
+#define SIRE_SIMD
+#endif
+
+	struct tRenderState {
+		uint8_t blendEnable;
+		uint8_t srcBlend;
+		uint8_t dstBlend;
+		uint8_t blendop;
+		uint8_t srcBlendAlpha;
+		uint8_t destBlendAlpha;
+		uint8_t blendOpAlpha;
+		uint8_t renderTargetWriteMask;
+		uint8_t cullMode;
+		uint8_t fillMode;
+		uint8_t stencilEnable;
+		uint32_t sampleMask;
+	};
+
+	struct tConstBuff {
+		tSireMatrix matrix;
+		int32_t hasTex;
+		int32_t hasMask;
+		int32_t texAlpha;
+		int32_t isSdf;
+		tSireFloat4 tint;
+	};
+
+	struct tVertexLegacy {
+		tSireFloat3 pos;
+		uint32_t diff;
+		tSireFloat2 uv0;
+		tSireFloat2 uv1;
+	};
+
+	// Growable array of trivially copyable elements living in the frame arena, storage is dropped when the arena resets.
+	// When the arena can't grow the elements move to the heap until the next reset.
+	template <typename T>
+	struct tSireArenaVector {
+		T* ptr;
+		uint32_t count;
+		uint32_t capacity;
+		uint32_t generation;
+		std::vector<T> heap;
+
+		tSireArenaVector() {
+			ptr = nullptr;
+			count = 0;
+			capacity = 0;
+			generation = 0;
+		}
+
+		// ptr may point into heap, copies would share it.
+		tSireArenaVector(tSireArenaVector const&) = delete;
+		tSireArenaVector& operator=(tSireArenaVector const&) = delete;
+
+		void Validate() {
+			if (generation != frameArena.generation) {
+				ptr = nullptr;
+				count = 0;
+				capacity = 0;
+				generation = frameArena.generation;
+				std::vector<T>().swap(heap);
 			}
 		}
 
-		IDirect3DSurface9* CreateSurface(uint32_t width, uint32_t height, uint8_t* pixels) {
-			IDirect3DSurface9* out = nullptr;
-			HRESULT hr = dev->CreateOffscreenPlainSurface(width, height, (D3DFORMAT)textureFormat, D3DPOOL_DEFAULT, &out, nullptr);
+		void reserve(uint32_t n) {
+			Validate();
+			if (n <= capacity)
+				return;
 
-			if (SUCCEEDED(hr)) {
-				if (pixels) {
-					uint8_t* texturePixels = Lock(out);
-					std::memcpy(texturePixels, pixels, width * height * 4);
-					Unlock(out);
-				}
-			}
-			else {
-				printf("%s", GetErrorString(hr));
+			uint32_t newCapacity = capacity ? capacity : 64;
+			while (newCapacity < n)
+				newCapacity *= 2;
+
+			T* newPtr = frameArena.Allocate<T>(newCapacity);
+			std::vector<T> spill;
+			if (!newPtr) {
+				spill.resize(newCapacity);
+				newPtr = spill.data();
 			}
 
-			return out;
+			if (count)
+				memcpy(newPtr, ptr, count * sizeof(T));
+
+			if (!spill.empty())
+				heap.swap(spill);
+
+			ptr = newPtr;
+			capacity = newCapacity;
 		}
 
-		IDirect3DTexture9* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels, IDirect3DSurface9** sout) {
-			IDirect3DTexture9* out = nullptr;
-			HRESULT hr = dev->CreateTexture(width, height, 1, D3DUSAGE_RENDERTARGET, (D3DFORMAT)textureFormat, D3DPOOL_DEFAULT, &out, nullptr);
+		void push_back(T const& v) {
+			Validate();
+			if (count == capacity)
+				reserve(count + 1);
 
-			if (SUCCEEDED(hr)) {
-				IDirect3DSurface9* surf = GetSurfaceLevel(out, 0);
+			ptr[count++] = v;
+		}
 
-				if (sout)
-					*sout = surf;
+		void assign(T const* src, uint32_t n) {
+			Validate();
+			count = 0;
+			reserve(n);
+			if (n)
+				memcpy(ptr, src, n * sizeof(T));
+			count = n;
+		}
 
-				if (pixels) {
-					IDirect3DSurface9* tempSurf = CreateSurface(width, height, pixels);
-					CopyResource(reinterpret_cast<uintptr_t*>(surf), reinterpret_cast<uintptr_t*>(tempSurf));
-					Release(tempSurf);
-				}
-			}
-			else {
-				printf("%s", GetErrorString(hr));
-			}
+		void resize(uint32_t n) {
+			reserve(n);
+			count = n;
+		}
 
-			return out;
+		void clear() {
+			Validate();
+			count = 0;
 		}
+
+		T* data() { Validate(); return ptr; }
+		uint32_t size() { Validate(); return count; }
+		bool empty() { return size() == 0; }
+		T& operator[](uint32_t i) { return ptr[i]; }
+		T* begin() { return data(); }
+		T* end() { return data() + count; }
 	};
-#endif
 
-#ifdef SIRE_DX10
-	struct SireDirectX10 : SireRenderer {
-		IDXGISwapChain* swapchain;
-		ID3D10Device* dev;
-		ID3D10Buffer* vb;
-		ID3D10Buffer* ib;
-		ID3D10Buffer* pb;
-		ID3D10SamplerState* ss;
-		ID3D10InputLayout* inputLayout;
-		ID3D10VertexShader* vertexShader;
-		ID3D10PixelShader* pixelShader;
-		ID3D10VertexShader* internalVertexShader;
-		ID3D10PixelShader* internalPixelShader;
-		ID3D10ShaderResourceView* tex;
-		ID3D10ShaderResourceView* mask;
-		ID3D10RasterizerState* rasterizerState;
-		ID3D10DepthStencilState* depthStencilState;
-		ID3D10BlendState* blendState;
-		FLOAT blendFactor[4];
-		UINT sampleMask;
-		UINT stencilRef;
+	struct tSireViewport {
+		float x;
+		float y;
+		float w;
+		float h;
+		float mind;
+		float maxd;
+	};
 
-		// Start virtual override
-		SireDirectX10() : SireRenderer() {
-			swapchain = nullptr;
-			dev = nullptr;
-			vb = nullptr;
-			ib = nullptr;
-			pb = nullptr;
-			ss = nullptr;
-			inputLayout = nullptr;
-			vertexShader = nullptr;
-			pixelShader = nullptr;
-			internalVertexShader = nullptr;
-			internalPixelShader = nullptr;
-			tex = nullptr;
-			mask = nullptr;
-			rasterizerState = nullptr;
-			depthStencilState = nullptr;
-			blendState = nullptr;
-			blendFactor[0] = 0.0f;
-			blendFactor[1] = 0.0f;
-			blendFactor[2] = 0.0f;
-			blendFactor[3] = 0.0f;
-			sampleMask = 0;
-			stencilRef = 0;
-			textureFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+	struct tSireShared {
+		tSireViewport viewport;
+		float fov;
+		float nearPlane;
+		float farPlane;
+		tRenderState renderStates;
+
+		tSireShared() {
+			viewport = { 0.0f, 0.0f, 640.0f, 480.0f, 0.0f, 1.0f };
+			fov = 60.0f;
+			nearPlane = 0.0f;
+			farPlane = 1.0f;
+			renderStates = { 0, SIRE_BLEND_SRC_ALPHA, SIRE_BLEND_INV_SRC_ALPHA, SIRE_BLEND_OP_ADD, SIRE_BLEND_ONE, SIRE_BLEND_ZERO, SIRE_BLEND_OP_ADD, SIRE_COLOR_WRITE_ENABLE_ALL, SIRE_CULL_NONE, SIRE_FILL_SOLID };
 		}
 
-		bool IsRendererActive() override {
-			if (initialised && swapchain && dev) {
-				HRESULT hr = dev->GetDeviceRemovedReason();
-				return SUCCEEDED(hr);
-			}
+		~tSireShared() {
 
-			return false;
 		}
+	};
 
-		void Init(uintptr_t* ptr) override {
-			if (initialised)
-				return;
+	// One batch as seen by the backend, vertices and indices live in the owner's arrays.
+	struct tDrawCommand {
+		eSirePrimitiveType primitiveType;
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+		uint32_t indexOffset;
+		uint32_t indexCount;
+		tConstBuff cb;
+		tRenderState renderStates;
+		uintptr_t* texture;
+		uintptr_t* mask;
+		uintptr_t* pixelShader;
+		uintptr_t* vertexShader;
+		uintptr_t* meshVertexBuffer;
+		uintptr_t* meshIndexBuffer;
+		uint64_t generations[2]; // Texture and mask contents
+		uint64_t sortKey;
+		const char* timingTag;
+	};
 
-			swapchain = reinterpret_cast<IDXGISwapChain*>(ptr);
-			HRESULT hResult = swapchain->GetDevice(__uuidof(ID3D10Device), (void**)&dev);
+	struct tCommandList {
+		std::vector<tVertex> vertices;
+		std::vector<uint16_t> indices;
+		std::vector<tDrawCommand> commands;
 
-			if (FAILED(hResult))
-				return;
+		void Clear() {
+			vertices.clear();
+			indices.clear();
+			commands.clear();
+		}
+	};
 
-			DXGI_SWAP_CHAIN_DESC swapChainDesc;
-			ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
-			swapchain->GetDesc(&swapChainDesc);
+	struct tSortItem {
+		uint64_t key;
+		uint32_t index;
+	};
 
-			textureFormat = swapChainDesc.BufferDesc.Format;
+	struct tLayerTarget {
+		SirePtr<tSireTexture2D> texture = nullptr;
+		SirePtr<tSireRenderTarget> target = nullptr;
+	};
 
-			hWnd = swapChainDesc.OutputWindow;
+	struct tLayer {
+		tSireFloat4 rect;
+		uint64_t hash;
+		uint64_t pendingHash;
+		tLayerTarget target;
+		tCommandList list;
 
-			D3D10_BUFFER_DESC bufferDesc;
-			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+		tLayer() {
+			rect = {};
+			hash = 0;
+			pendingHash = 0;
+		}
+	};
 
-			bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
-			bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
-			bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
-			bufferDesc.MiscFlags = 0;
-			bufferDesc.ByteWidth = sizeof(tVertex) * 65536;
+	struct tGlyph {
+		bool visible;
+		float x;
+		float y;
+		float w;
+		float h;
+		float u0;
+		float v0;
+		float u1;
+		float v1;
+		float advance;
+	};
 
-			// Vertex buffer
-			dev->CreateBuffer(&bufferDesc, nullptr, &vb);
+	struct tFont {
+		uintptr_t* face;
+		tSireGlyphRasterizer* rasterizer;
+		tSireFontMetrics metrics;
+		std::unordered_map<uint32_t, tGlyph> glyphs;
+	};
 
-			// Index buffer
-			bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
-			dev->CreateBuffer(&bufferDesc, nullptr, &ib);
+	// Quads relative to the top-left of the first line, 4 vertices each.
+	struct tTextLayout {
+		std::string text;
+		int32_t font;
+		float size;
+		tSireFloat2 extent;
+		std::vector<tVertex> vertices;
+	};
 
-			// Constant buffer
-			bufferDesc.BindFlags = D3D10_BIND_CONSTANT_BUFFER;
-			bufferDesc.ByteWidth = sizeof(tConstBuff);
+	// Shelf packed, glyphs are never moved so cached layouts stay valid.
+	struct tTextAtlas {
+		int32_t w;
+		int32_t h;
+		int32_t cursorX;
+		int32_t cursorY;
+		int32_t rowHeight;
+		bool dirty;
+		bool full;
+		std::vector<uint8_t> pixels;
+		SirePtr<tSireTexture2D> texture;
+
+		tTextAtlas() : texture(nullptr) {
+			w = SIRE_TEXT_ATLAS_SIZE;
+			h = SIRE_TEXT_ATLAS_SIZE;
+			cursorX = 0;
+			cursorY = 0;
+			rowHeight = 0;
+			dirty = false;
+			full = false;
+		}
+	};
 
-			D3D10_SUBRESOURCE_DATA initData;
-			ZeroMemory(&initData, sizeof(initData));
-			initData.pSysMem = &cb;
-			dev->CreateBuffer(&bufferDesc, &initData, &pb);
+	// One flattened subpath in pathPoints.
+	struct tPathContour {
+		uint32_t first;
+		uint32_t count;
+		bool closed;
+	};
 
-			D3D10_SAMPLER_DESC samplerDesc;
-			ZeroMemory(&samplerDesc, sizeof(samplerDesc));
-			samplerDesc.Filter = D3D10_FILTER_MIN_MAG_MIP_LINEAR;
-			samplerDesc.AddressU = D3D10_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.AddressV = D3D10_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.AddressW = D3D10_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.MipLODBias = 0.0f;
-			samplerDesc.MaxAnisotropy = 1;
-			samplerDesc.ComparisonFunc = D3D10_COMPARISON_NEVER;
-			samplerDesc.BorderColor[0] = 0.0f;
-			samplerDesc.BorderColor[1] = 0.0f;
-			samplerDesc.BorderColor[2] = 0.0f;
-			samplerDesc.BorderColor[3] = 0.0f;
-			samplerDesc.MinLOD = 0;
-			samplerDesc.MaxLOD = D3D10_FLOAT32_MAX;
-			dev->CreateSamplerState(&samplerDesc, &ss);
+	// Slice across a stroke, consecutive sections are joined by quads.
+	struct tPathSection {
+		tSireFloat2 left;
+		tSireFloat2 right;
+		tSireFloat2 leftFringe;
+		tSireFloat2 rightFringe;
+		float alpha;
+	};
 
-			// Init shaders
-			ID3DBlob* VS = CompileShader(hlslShader4_0, "VShader", "vs_4_0");
-			ID3DBlob* PS = CompileShader(hlslShader4_0, "PShader", "ps_4_0");
+	struct tPathEdge {
+		float x0;
+		float y0;
+		float x1;
+		float y1;
+		int32_t winding;
+	};
 
-			internalVertexShader = CreateVertexShader(VS->GetBufferPointer(), VS->GetBufferSize());
-			internalPixelShader = CreatePixelShader(PS->GetBufferPointer(), PS->GetBufferSize());
+	// Coverage is stored in the vertex alpha and multiplied with the draw color. Geometry with more than
+	// 65535 vertices or indices is kept unindexed so it can be drawn in several batches.
+	struct tPathGeometry {
+		std::vector<tVertex> vertices;
+		std::vector<uint16_t> indices;
+	};
 
-			// Init input layout
-			std::vector<D3D10_INPUT_ELEMENT_DESC> layout = {
-				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D10_INPUT_PER_VERTEX_DATA, 0 },
-				{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D10_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 28, D3D10_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D10_INPUT_PER_VERTEX_DATA, 0 },
-			};
+	// Packets are pushed onto a lock-free stack, the render thread takes the whole stack at once.
+	struct tPacketNode {
+		tSireDrawPacket packet;
+		tPacketNode* next;
+	};
+
+	// Persistent workers for ParallelFor, the calling thread takes part. Every thread starts on an even share of the
+	// range and takes grains from its front, idle threads steal the back half of the largest remaining range.
+	struct tThreadPool {
+		struct alignas(64) tRange {
+			std::atomic<uint64_t> bounds;
+		};
 
-			inputLayout = CreateInputLayout(&layout, VS->GetBufferPointer(), VS->GetBufferSize());
+		std::vector<std::thread> threads;
+		std::unique_ptr<tRange[]> ranges;
+		std::mutex mutex;
+		std::mutex jobMutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		uint64_t jobId;
+		uint32_t running;
+		bool quit;
 
-			Release(VS);
-			Release(PS);
+		void (*job)(void*, uint32_t, uint32_t);
+		void* context;
+		uint32_t grain;
 
-			initialised = true;
+		tThreadPool() {
+			jobId = 0;
+			running = 0;
+			quit = false;
+			job = nullptr;
+			context = nullptr;
+			grain = 1;
 		}
 
-		void Shutdown() override {
-			if (!initialised)
+		~tThreadPool() {
+			Stop();
+		}
+
+		static uint64_t Pack(uint32_t begin, uint32_t end) {
+			return (static_cast<uint64_t>(end) << 32) | begin;
+		}
+
+		void Start() {
+			if (ranges)
 				return;
 
-			Release(vb);
-			Release(ib);
-			Release(pb);
-			Release(ss);
-			Release(inputLayout);
-			Release(internalVertexShader);
-			Release(internalPixelShader);
+			uint32_t count = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u) - 1, 63u);
+			ranges.reset(new tRange[count + 1]);
+			for (uint32_t i = 0; i <= count; i++)
+				ranges[i].bounds.store(0);
 
-			vertexShader = nullptr;
-			pixelShader = nullptr;
+			for (uint32_t i = 0; i < count; i++)
+				threads.emplace_back([this, i] { Worker(i + 1); });
+		}
 
-			swapchain = nullptr;
-			dev = nullptr;
+		// Joins the workers, the next ParallelFor starts them again.
+		void Stop() {
+			std::lock_guard<std::mutex> jobLock(jobMutex);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
 
-			initialised = false;
-		}
+			wake.notify_all();
+			for (auto& it : threads)
+				it.join();
+			threads.clear();
+			ranges.reset();
 
-		void Begin() override {
-			dev->RSGetState(&rasterizerState);
-			dev->OMGetDepthStencilState(&depthStencilState, &stencilRef);
-			dev->OMGetBlendState(&blendState, blendFactor, &sampleMask);
+			jobId = 0;
+			quit = false;
 		}
 
-		void End() override {
-			// Fallback to internal shaders if unset.
-			if (!pixelShader && internalPixelShader)
-				pixelShader = internalPixelShader;
+		void Worker(uint32_t slot) {
+			SetProfileThreadName("Sire worker");
 
-			if (!vertexShader && internalVertexShader)
-				vertexShader = internalVertexShader;
-
-			// Update index/vertex buffers
-			void* out;
-			vb->Map(D3D10_MAP_WRITE_DISCARD, 0, &out);
-			memcpy(out, vertices.data(), vertices.size() * sizeof(tVertex));
-			vb->Unmap();
+			uint64_t seen = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [&] { return quit || jobId != seen; });
+					if (quit)
+						return;
 
-			ib->Map(D3D10_MAP_WRITE_DISCARD, 0, &out);
-			memcpy(out, indices.data(), numIndices * sizeof(uint16_t));
-			ib->Unmap();
+					seen = jobId;
+				}
 
-			// Update
-			tConstBuff tempcb = cb;
-			tempcb.matrix.Transpose();
+				Run(slot);
 
-			pb->Map(D3D10_MAP_WRITE_DISCARD, 0, &out);
-			memcpy(out, &tempcb, sizeof(tempcb));
-			pb->Unmap();
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--running == 0)
+					done.notify_one();
+			}
+		}
 
-			ID3D10InputLayout* prevInputLayout = nullptr;
-			dev->IAGetInputLayout(&prevInputLayout);
-			dev->IASetInputLayout(inputLayout);
+		bool TakeFront(uint32_t slot, uint32_t& begin, uint32_t& end) {
+			uint64_t current = ranges[slot].bounds.load(std::memory_order_acquire);
+			for (;;) {
+				uint32_t b = static_cast<uint32_t>(current);
+				uint32_t e = static_cast<uint32_t>(current >> 32);
+				if (b >= e)
+					return false;
 
-			auto prevRenderTargets = GetRenderTargets();
-			auto prevStencilView = GetDepthStencilView();
+				uint32_t next = b + (std::min)(grain, e - b);
+				if (ranges[slot].bounds.compare_exchange_weak(current, Pack(next, e), std::memory_order_acq_rel)) {
+					begin = b;
+					end = next;
+					return true;
+				}
+			}
+		}
 
-			if (currentRenderTargetView)
-				dev->OMSetRenderTargets(1, (ID3D10RenderTargetView**)&currentRenderTargetView, nullptr);
+		bool Steal(uint32_t slot) {
+			uint32_t numSlots = static_cast<uint32_t>(threads.size()) + 1;
+			for (;;) {
+				uint32_t victim = numSlots;
+				uint32_t largest = 0;
+				uint64_t current = 0;
+				for (uint32_t i = 0; i < numSlots; i++) {
+					if (i == slot)
+						continue;
+
+					uint64_t bounds = ranges[i].bounds.load(std::memory_order_acquire);
+					uint32_t b = static_cast<uint32_t>(bounds);
+					uint32_t e = static_cast<uint32_t>(bounds >> 32);
+					if (e > b && e - b > largest) {
+						largest = e - b;
+						victim = i;
+						current = bounds;
+					}
+				}
 
-			ID3D10VertexShader* prevVertexShader = nullptr;
-			dev->VSGetShader(&prevVertexShader);
-			dev->VSSetShader(vertexShader);
+				if (victim == numSlots)
+					return false;
 
-			ID3D10PixelShader* prevPixelShader = nullptr;
-			dev->PSGetShader(&prevPixelShader);
-			dev->PSSetShader(pixelShader);
+				uint32_t b = static_cast<uint32_t>(current);
+				uint32_t e = static_cast<uint32_t>(current >> 32);
+				uint32_t mid = e - b <= grain ? b : b + (e - b) / 2;
+				if (ranges[victim].bounds.compare_exchange_strong(current, Pack(b, mid), std::memory_order_acq_rel)) {
+					ranges[slot].bounds.store(Pack(mid, e), std::memory_order_release);
+					return true;
+				}
+			}
+		}
 
-			ID3D10Buffer* prevVertexConstantBuffer = nullptr;
-			dev->VSGetConstantBuffers(0, 1, &prevVertexConstantBuffer);
-			dev->VSSetConstantBuffers(0, 1, &pb);
+		void Run(uint32_t slot) {
+			SIRE_PROFILE_SCOPE("Sire::ParallelFor");
 
-			ID3D10Buffer* prevPixelConstantBuffer = nullptr;
-			dev->PSGetConstantBuffers(0, 1, &prevPixelConstantBuffer);
-			dev->PSSetConstantBuffers(0, 1, &pb);
+			for (;;) {
+				uint32_t begin = 0;
+				uint32_t end = 0;
+				if (TakeFront(slot, begin, end))
+					job(context, begin, end);
+				else if (!Steal(slot))
+					return;
+			}
+		}
 
-			// Set textures
-			ID3D10ShaderResourceView* prevVertexShaderResourceView0 = nullptr;
-			dev->VSGetShaderResources(0, 1, &prevVertexShaderResourceView0);
-			dev->VSSetShaderResources(0, 1, &tex);
+		// Calls fn(context, begin, end) over disjoint slices of [0, count) and returns once all of them ran.
+		// Calls from different threads run one after the other.
+		void ParallelFor(uint32_t count, uint32_t grainSize, void (*fn)(void*, uint32_t, uint32_t), void* ctx) {
+			if (!count)
+				return;
 
-			ID3D10ShaderResourceView* prevVertexShaderResourceView1 = nullptr;
-			dev->VSGetShaderResources(1, 1, &prevVertexShaderResourceView1);
-			dev->VSSetShaderResources(1, 1, &mask);
+			std::lock_guard<std::mutex> jobLock(jobMutex);
+			Start();
 
-			ID3D10ShaderResourceView* prevPixelShaderResourceView0 = nullptr;
-			dev->PSGetShaderResources(0, 1, &prevPixelShaderResourceView0);
-			dev->PSSetShaderResources(0, 1, &tex);
+			grain = (std::max)(grainSize, 1u);
+			if (threads.empty() || count <= grain) {
+				fn(ctx, 0, count);
+				return;
+			}
 
-			ID3D10ShaderResourceView* prevPixelShaderResourceView1 = nullptr;
-			dev->PSGetShaderResources(1, 1, &prevPixelShaderResourceView1);
-			dev->PSSetShaderResources(1, 1, &mask);
+			uint32_t numSlots = static_cast<uint32_t>(threads.size()) + 1;
+			for (uint32_t i = 0; i < numSlots; i++) {
+				uint32_t b = static_cast<uint32_t>(static_cast<uint64_t>(count) * i / numSlots);
+				uint32_t e = static_cast<uint32_t>(static_cast<uint64_t>(count) * (i + 1) / numSlots);
+				ranges[i].bounds.store(Pack(b, e), std::memory_order_relaxed);
+			}
 
-			ID3D10SamplerState* prevPixelSamplers = nullptr;
-			dev->PSGetSamplers(0, 1, &prevPixelSamplers);
-			dev->PSSetSamplers(0, 1, &ss);
+			job = fn;
+			context = ctx;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				running = static_cast<uint32_t>(threads.size());
+				jobId++;
+			}
 
-			ID3D10SamplerState* prevVertexSamplers = nullptr;
-			dev->GSGetSamplers(0, 1, &prevVertexSamplers);
-			dev->GSSetSamplers(0, 1, &ss);
+			wake.notify_all();
+			Run(0);
 
-			// Set index/vertex buffers
-			UINT stride = sizeof(tVertex);
-			UINT offset = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&] { return running == 0; });
+		}
+	};
 
-			UINT prevStride;
-			UINT prevVertexOffset;
-			ID3D10Buffer* prevVertexBuffers = nullptr;
-			dev->IAGetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
-			dev->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+	struct tTextureLoad {
+		tSireTexture2D* texture;
+		std::atomic<bool> cancelled;
+		std::string path;
+		std::vector<uint8_t> data;
+		std::vector<uint8_t> mipPixels;
+		int32_t width;
+		int32_t height;
+		uint32_t mipLevels;
+		eSirePixelFormat textureFormat;
+		eSireMipmaps mipmaps;
+		bool failed;
+
+		tTextureLoad() : cancelled(false) {
+			texture = nullptr;
+			width = 0;
+			height = 0;
+			mipLevels = 1;
+			textureFormat = SIRE_PIXEL_FORMAT_UNKNOWN;
+			mipmaps = SIRE_MIPMAPS_NONE;
+			failed = false;
+		}
+	};
 
-			ID3D10Buffer* prevIndexBuffers = nullptr;
-			DXGI_FORMAT prevFormat;
-			UINT prevIndexOffset;
-			dev->IAGetIndexBuffer(&prevIndexBuffers, &prevFormat, &prevIndexOffset);
-			dev->IASetIndexBuffer(ib, DXGI_FORMAT_R16_UINT, 0);
+	// Background threads that read and decode images for LoadTextureAsync, the render thread uploads what they finish.
+	struct tTextureLoader {
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<tTextureLoad*> queued;
+		std::deque<tTextureLoad*> decoded;
+		bool quit;
 
-			D3D_PRIMITIVE_TOPOLOGY type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-			switch (primitiveType) {
-				case SIRE_LINE:
-					type = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
-					break;
-				case SIRE_POINT:
-					type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-					break;
-				case SIRE_TRIANGLE:
-					type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-					break;
-			}
+		tTextureLoader() {
+			quit = false;
+		}
 
-			D3D_PRIMITIVE_TOPOLOGY prevType;
-			dev->IAGetPrimitiveTopology(&prevType);
-			dev->IASetPrimitiveTopology(type);
+		~tTextureLoader() {
+			Stop();
+		}
 
-			// Draw
-			dev->DrawIndexed(numIndices, 0, 0);
+		void Start() {
+			if (!threads.empty())
+				return;
 
-			// Restore shit
-			dev->OMSetRenderTargets(1, &prevRenderTargets[0], prevStencilView);
+			quit = false;
+			uint32_t count = (std::min)((std::max)(std::thread::hardware_concurrency() / 2, 1u), 4u);
+			for (uint32_t i = 0; i < count; i++)
+				threads.emplace_back([this] { Worker(); });
+		}
 
-			Release(prevRenderTargets, D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT);
-			Release(prevStencilView);
+		// Waits for the image being decoded, everything still queued is dropped.
+		void Stop() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
 
-			dev->IASetInputLayout(prevInputLayout);
-			Release(prevInputLayout);
+			wake.notify_all();
+			for (auto& it : threads)
+				it.join();
+			threads.clear();
 
-			dev->VSSetShader(prevVertexShader);
-			Release(prevVertexShader);
+			for (auto it : queued)
+				delete it;
+			for (auto it : decoded)
+				delete it;
+			queued.clear();
+			decoded.clear();
+		}
 
-			dev->PSSetShader(prevPixelShader);
-			Release(prevPixelShader);
+		void Push(tTextureLoad* load) {
+			Start();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queued.push_back(load);
+			}
 
-			dev->VSSetConstantBuffers(0, 1, &prevVertexConstantBuffer);
-			Release(prevVertexConstantBuffer);
+			wake.notify_one();
+		}
 
-			dev->PSSetConstantBuffers(0, 1, &prevPixelConstantBuffer);
-			Release(prevPixelConstantBuffer);
+		tTextureLoad* Pop() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (decoded.empty())
+				return nullptr;
 
-			dev->VSSetShaderResources(0, 1, &prevVertexShaderResourceView0);
-			Release(prevVertexShaderResourceView0);
+			tTextureLoad* out = decoded.front();
+			decoded.pop_front();
+			return out;
+		}
 
-			dev->VSSetShaderResources(1, 1, &prevVertexShaderResourceView1);
-			Release(prevVertexShaderResourceView1);
+		void Worker() {
+			SetProfileThreadName("Sire texture loader");
 
-			dev->PSSetShaderResources(0, 1, &prevPixelShaderResourceView0);
-			Release(prevPixelShaderResourceView0);
+			for (;;) {
+				tTextureLoad* load = nullptr;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [&] { return quit || !queued.empty(); });
+					if (quit)
+						return;
 
-			dev->PSSetShaderResources(1, 1, &prevPixelShaderResourceView1);
-			Release(prevPixelShaderResourceView1);
+					load = queued.front();
+					queued.pop_front();
+				}
 
-			dev->PSSetSamplers(0, 1, &prevPixelSamplers);
-			Release(prevPixelSamplers);
+				if (!load->cancelled.load(std::memory_order_relaxed))
+					DecodeTextureLoad(*load);
 
-			dev->GSSetSamplers(0, 1, &prevVertexSamplers);
-			Release(prevVertexSamplers);
+				std::lock_guard<std::mutex> lock(mutex);
+				decoded.push_back(load);
+			}
+		}
+	};
 
-			dev->IASetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
-			Release(prevVertexBuffers);
+#ifdef SIRE_PROFILE
+	struct tProfileEvent {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
 
-			dev->IASetIndexBuffer(prevIndexBuffers, prevFormat, prevIndexOffset);
-			Release(prevIndexBuffers);
+	// Events of one thread. Only the owner writes and it never waits, a dump copies the newest events and drops the
+	// ones the owner overwrote meanwhile.
+	struct tProfileRing {
+		static constexpr uint32_t SIRE_PROFILE_RING_SIZE = 1 << 15;
 
-			dev->IASetPrimitiveTopology(prevType);
+		tProfileEvent events[SIRE_PROFILE_RING_SIZE];
+		std::atomic<uint64_t> head;
+		std::atomic<const char*> name;
+		uint32_t tid;
+		tProfileRing* next;
 
-			dev->RSSetState(rasterizerState);
-			Release(rasterizerState);
+		tProfileRing() : head(0), name(nullptr) {
+			tid = 0;
+			next = nullptr;
+		}
+	};
+#endif
 
-			dev->OMSetDepthStencilState(depthStencilState, stencilRef);
-			Release(depthStencilState);
+	// Batch i of the frame is enclosed by the timestamps 2i and 2i + 1.
+	struct tTimingFrame {
+		std::vector<const char*> tags;
+		uint64_t frame;
+		bool pending;
 
-			dev->OMSetBlendState(blendState, blendFactor, sampleMask);
-			Release(blendState);
+		tTimingFrame() {
+			frame = 0;
+			pending = false;
 		}
+	};
 
-		void SetVertices(tVertex const& v) override {
+	enum eSireTraceCommand : uint8_t {
+		SIRE_TRACE_FRAME,
+		SIRE_TRACE_TEXTURE, // id, w, h, format, mip levels
+		SIRE_TRACE_TEXTURE_DATA, // id, size, every level back to back
+		SIRE_TRACE_RENDER_TARGET, // id, texture id
+		SIRE_TRACE_STATES, // tRenderState
+		SIRE_TRACE_CONSTANTS, // tConstBuff
+		SIRE_TRACE_VIEWPORT, // tSireViewport
+		SIRE_TRACE_BIND, // texture, mask and render target ids, 0 for none
+		SIRE_TRACE_DRAW, // primitive type, numIndices, vertex count, index count, vertices, indices
+	};
 
-		}
+	// Writes the command stream of every batch submitted through End. States are written only when they change and
+	// objects are referred to by ids, so a trace replays the same work without the host.
+	struct tTraceWriter {
+		static constexpr uint32_t SIRE_TRACE_MAGIC = 0x54524953; // "SIRT"
+		static constexpr uint32_t SIRE_TRACE_VERSION = 1;
+
+		struct tHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vertexSize;
+			uint32_t statesSize;
+			uint32_t constantsSize;
+			uint32_t viewportSize;
+		};
 
-		void SetRenderStates(tRenderState const& s) override {
-			D3D10_RASTERIZER_DESC rasterizerDesc;
-			ZeroMemory(&rasterizerDesc, sizeof(rasterizerDesc));
-			rasterizerDesc.CullMode = (D3D10_CULL_MODE)s.cullMode;
-			rasterizerDesc.FillMode = (D3D10_FILL_MODE)s.fillMode;
-			ID3D10RasterizerState* rasterizerState = nullptr;
-			dev->CreateRasterizerState(&rasterizerDesc, &rasterizerState);
-			dev->RSSetState(rasterizerState);
-			Release(rasterizerState);
+		FILE* file;
+		std::unordered_map<uintptr_t*, uint32_t> ids;
+		uint32_t nextId;
+		uint32_t frames;
 
-			D3D10_BLEND_DESC blendDesc;
-			ZeroMemory(&blendDesc, sizeof(blendDesc));
-			blendDesc.BlendEnable[0] = s.blendEnable;
-			blendDesc.SrcBlend = (D3D10_BLEND)s.srcBlend;
-			blendDesc.DestBlend = (D3D10_BLEND)s.dstBlend;
-			blendDesc.BlendOp = (D3D10_BLEND_OP)s.blendop;
-			blendDesc.SrcBlendAlpha = (D3D10_BLEND)s.srcBlendAlpha;
-			blendDesc.DestBlendAlpha = (D3D10_BLEND)s.destBlendAlpha;
-			blendDesc.BlendOpAlpha = (D3D10_BLEND_OP)s.blendOpAlpha;
-			blendDesc.RenderTargetWriteMask[0] = s.renderTargetWriteMask;
+		tRenderState states;
+		tConstBuff constants;
+		tSireViewport viewport;
+		uint32_t bound[3];
+		bool written;
 
-			ID3D10BlendState* blendState = nullptr;
-			dev->CreateBlendState(&blendDesc, &blendState);
-			float blendFactor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-			dev->OMSetBlendState(blendState, blendFactor, s.sampleMask);
-			blendState->Release();
+		tTraceWriter() {
+			file = nullptr;
+			nextId = 1;
+			frames = 0;
+			states = {};
+			constants = {};
+			viewport = {};
+			bound[0] = bound[1] = bound[2] = 0;
+			written = false;
 		}
 
-		void SetViewport(tSireViewport const& v) override {
-			D3D10_VIEWPORT vp = {};
-			vp.TopLeftX = v.x;
-			vp.TopLeftY = v.y;
-			vp.Width = v.w;
-			vp.Height = v.h;
-			vp.MinDepth = v.mind;
-			vp.MaxDepth = v.maxd;
-			dev->RSSetViewports(1, &vp);
-		}
+		bool Open(std::string const& path) {
+			Close();
 
-		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
-			dev->CopyResource(reinterpret_cast<ID3D10Resource*>(dst), reinterpret_cast<ID3D10Resource*>(src));
-		}
+			file = fopen(path.c_str(), "wb");
+			if (!file)
+				return false;
 
-		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
-			cb.hasTex = texture ? true : false;
-			cb.hasMask = textureMask ? true : false;
+			setvbuf(file, nullptr, _IOFBF, 1 << 20);
 
-			tex = nullptr;
-			mask = nullptr;
+			tHeader header = { SIRE_TRACE_MAGIC, SIRE_TRACE_VERSION, sizeof(tVertex), sizeof(tRenderState), sizeof(tConstBuff), sizeof(tSireViewport) };
+			Write(&header, sizeof(header));
+			return true;
+		}
 
-			if (texture)
-				tex = reinterpret_cast<ID3D10ShaderResourceView*>(texture);
+		void Close() {
+			if (file)
+				fclose(file);
 
-			if (textureMask)
-				mask = reinterpret_cast<ID3D10ShaderResourceView*>(textureMask);
+			file = nullptr;
+			ids.clear();
+			nextId = 1;
+			frames = 0;
+			written = false;
 		}
 
-		uint8_t* Lock(void* ptr) {
-			D3D10_MAPPED_TEXTURE2D map;
-			reinterpret_cast<ID3D10Texture2D*>(ptr)->Map(0, D3D10_MAP_READ, 0, &map);
-			return (uint8_t*)map.pData;
+		void Write(void const* data, size_t size) {
+			if (size)
+				fwrite(data, 1, size, file);
 		}
 
-		void Unlock(void* ptr) {
-			reinterpret_cast<ID3D10Texture2D*>(ptr)->Unmap(0);
+		template <typename T>
+		void Write(T const& value) {
+			Write(&value, sizeof(T));
 		}
 
-		void SetPixelShader(uintptr_t* ps) override {
-			pixelShader = (ID3D10PixelShader*)ps;
+		void Command(eSireTraceCommand command) {
+			Write(static_cast<uint8_t>(command));
 		}
 
-		void SetVertexShader(uintptr_t* vs) override {
-			vertexShader = (ID3D10VertexShader*)vs;
+		uint32_t GetId(uintptr_t* ptr, bool& created) {
+			created = false;
+			if (!ptr)
+				return 0;
+
+			auto it = ids.find(ptr);
+			if (it != ids.end())
+				return it->second;
+
+			created = true;
+			return ids[ptr] = nextId++;
 		}
+	};
 
-		uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVersion) override {
-			ID3DBlob* buf = CompileShader(shaderCode, "main", targetVersion);
-			return (uintptr_t*)CreatePixelShader(buf->GetBufferPointer(), buf->GetBufferSize());
+	// Bounds checked view over a trace loaded in memory.
+	struct tTraceReader {
+		uint8_t const* ptr;
+		uint8_t const* end;
+
+		bool Read(void* out, size_t size) {
+			if (static_cast<size_t>(end - ptr) < size)
+				return false;
+
+			memcpy(out, ptr, size);
+			ptr += size;
+			return true;
 		}
 
-		uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVersion) override {
-			ID3DBlob* buf = CompileShader(shaderCode, "main", targetVersion);
-			return (uintptr_t*)CreateVertexShader(buf->GetBufferPointer(), buf->GetBufferSize());
+		template <typename T>
+		bool Read(T& out) {
+			return Read(&out, sizeof(T));
 		}
 
-		// End virtual override	
+		uint8_t const* Skip(size_t size) {
+			if (static_cast<size_t>(end - ptr) < size)
+				return nullptr;
 
-		ID3D10RenderTargetView** GetRenderTargets() {
-			static ID3D10RenderTargetView* out[D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
-			memset(out, 0, sizeof(out));
-			dev->OMGetRenderTargets(D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT, out, nullptr);
+			uint8_t const* out = ptr;
+			ptr += size;
 			return out;
 		}
+	};
 
-		ID3D10DepthStencilView* GetDepthStencilView() {
-			static ID3D10DepthStencilView* out = {};
-			out = nullptr;
-			dev->OMGetRenderTargets(1, nullptr, &out);
-			return out;
-		}
+	struct SireGDIGlyphRasterizer : tSireGlyphRasterizer {
+		struct tFace {
+			HDC dc;
+			HFONT font;
+			HGDIOBJ prevFont;
+		};
 
-		ID3D10Texture2D* GetBackBuffer(uint32_t buffer) {
-			ID3D10Texture2D* out = nullptr;
-			swapchain->GetBuffer(buffer, __uuidof(ID3D10Texture2D), reinterpret_cast<void**>(&out));
-			return out;
-		}
+		uintptr_t* CreateFace(const char* name, int32_t pixelSize, bool bold, tSireFontMetrics& metrics) override {
+			HDC dc = CreateCompatibleDC(nullptr);
+			if (!dc)
+				return nullptr;
 
-		D3D10_TEXTURE2D_DESC GetDesc(ID3D10Texture2D* texture) {
-			D3D10_TEXTURE2D_DESC out = {};
-			texture->GetDesc(&out);
-			return out;
-		}
+			HFONT font = CreateFontA(-pixelSize, 0, 0, 0, bold ? FW_BOLD : FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_TT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH, name);
+			if (!font) {
+				DeleteDC(dc);
+				return nullptr;
+			}
 
-		ID3D10RenderTargetView* CreateRenderTarget(ID3D10Texture2D* texture) {
-			ID3D10RenderTargetView* out;
-			dev->CreateRenderTargetView(texture, nullptr, &out);
-			return out;
-		}
+			tFace* out = new tFace();
+			out->dc = dc;
+			out->font = font;
+			out->prevFont = SelectObject(dc, font);
 
-		ID3DBlob* CompileShader(std::string const str, const char* szEntrypoint, const char* szTarget) {
-			ID3DBlob* out = nullptr;
-			ID3DBlob* outerr = nullptr;
+			TEXTMETRICA tm = {};
+			GetTextMetricsA(dc, &tm);
+			metrics.ascent = static_cast<float>(tm.tmAscent);
+			metrics.descent = static_cast<float>(tm.tmDescent);
+			metrics.lineHeight = static_cast<float>(tm.tmHeight + tm.tmExternalLeading);
 
-			auto hr = D3DCompile(str.c_str(), str.length(), 0, nullptr, nullptr, szEntrypoint, szTarget, D3DCOMPILE_ENABLE_STRICTNESS, 0, &out, &outerr);
-			if (FAILED(hr)) {
-				if (outerr) {
-					char szError[256]{ 0 };
-					memcpy(szError, outerr->GetBufferPointer(), outerr->GetBufferSize());
-					MessageBoxA(nullptr, szError, "Error", MB_OK);
-				}
-				return outerr;
-			}
-			return out;
+			return reinterpret_cast<uintptr_t*>(out);
 		}
 
-		ID3D10VertexShader* CreateVertexShader(const void* buffer, size_t size) {
-			ID3D10VertexShader* out = nullptr;
-			dev->CreateVertexShader(buffer, size, &out);
-			return out;
-		}
+		void ReleaseFace(uintptr_t* face) override {
+			tFace* f = reinterpret_cast<tFace*>(face);
+			if (!f)
+				return;
 
-		ID3D10PixelShader* CreatePixelShader(const void* buffer, size_t size) {
-			ID3D10PixelShader* out = nullptr;
-			dev->CreatePixelShader(buffer, size, &out);
-			return out;
-		}
+			SelectObject(f->dc, f->prevFont);
+			DeleteObject(f->font);
+			DeleteDC(f->dc);
+			delete f;
+		}
+
+		bool Rasterize(uintptr_t* face, uint32_t codepoint, tSireGlyphBitmap& out) override {
+			tFace* f = reinterpret_cast<tFace*>(face);
+			if (!f)
+				return false;
+
+			GLYPHMETRICS gm = {};
+			MAT2 mat = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+			DWORD size = GetGlyphOutlineW(f->dc, codepoint, GGO_GRAY8_BITMAP, &gm, 0, nullptr, &mat);
+			if (size == GDI_ERROR)
+				return false;
+
+			out.advance = static_cast<float>(gm.gmCellIncX);
+			out.w = 0;
+			out.h = 0;
+			out.offsetX = 0;
+			out.offsetY = 0;
+			out.coverage.clear();
+
+			// Blank glyphs like the space only advance.
+			if (size == 0)
+				return true;
+
+			std::vector<uint8_t> buf(size);
+			if (GetGlyphOutlineW(f->dc, codepoint, GGO_GRAY8_BITMAP, &gm, size, buf.data(), &mat) == GDI_ERROR)
+				return false;
+
+			out.w = static_cast<int32_t>(gm.gmBlackBoxX);
+			out.h = static_cast<int32_t>(gm.gmBlackBoxY);
+			out.offsetX = gm.gmptGlyphOrigin.x;
+			out.offsetY = -gm.gmptGlyphOrigin.y;
+			out.coverage.resize(out.w * out.h);
+
+			// Rows are DWORD aligned, levels go from 0 to 64.
+			uint32_t pitch = (gm.gmBlackBoxX + 3) & ~3u;
+			for (int32_t y = 0; y < out.h; y++) {
+				for (int32_t x = 0; x < out.w; x++)
+					out.coverage[y * out.w + x] = static_cast<uint8_t>((std::min)(buf[y * pitch + x] * 4u, 255u));
+			}
 
-		ID3D10InputLayout* CreateInputLayout(std::vector<D3D10_INPUT_ELEMENT_DESC>* layout, const void* buffer, size_t size) {
-			ID3D10InputLayout* out = nullptr;
-			dev->CreateInputLayout(layout->data(), static_cast<uint32_t>(layout->size()), buffer, size, &out);
-			return out;
+			return true;
 		}
+	};
 
-		ID3D10ShaderResourceView* CreateShaderResourceView(ID3D10Texture2D* texture) {
-			ID3D10ShaderResourceView* out = nullptr;
-			dev->CreateShaderResourceView(texture, nullptr, &out);
-			return out;
-		}
+	struct SireRenderer {
+		bool initialised;
+		HWND hWnd;
+		eSirePixelFormat textureFormat;
 
-		ID3D10BlendState* GetBlendState(float* blendFactor, uint32_t* sampleMask) {
-			ID3D10BlendState* out;
-			dev->OMGetBlendState(&out, blendFactor, sampleMask);
-			return out;
-		}
+		virtual bool IsRendererActive() { return false; }
+		virtual void Init(uintptr_t* ptr) {}
+		virtual void Shutdown() {}
+		virtual void Begin() {}
+		virtual void End() {}
+		virtual void SetVertices(tVertex const& v) {}
+		virtual void SetRenderStates(tRenderState const& s) {}
+		virtual void SetViewport(tSireViewport const& v) {}
+		virtual void CopyResource(uintptr_t* dst, uintptr_t* src) {}
+		virtual void SetTexture(uintptr_t* tex, uintptr_t* mask) {}
+		virtual HWND GetWindow() { return hWnd; }
+		virtual uint8_t* Lock(void* ptr) { return nullptr; }
+		virtual void Unlock(void* ptr) {}
+		virtual void SetTextureFormat(eSirePixelFormat format) { textureFormat = format; }
+		virtual eSirePixelFormat GetTextureFormat() { return textureFormat; }
+		virtual void SetPixelShader(uintptr_t* ps) {}
+		virtual void SetVertexShader(uintptr_t* vs) {}
+		virtual uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVersion = "ps_3_0") { return nullptr; }
+		virtual uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVersion = "vs_3_0") { return nullptr; }
+		virtual bool CreateMesh(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, uintptr_t** vertexBuffer, uintptr_t** indexBuffer) { return false; }
+		virtual void DrawMesh(uintptr_t* vertexBuffer, uintptr_t* indexBuffer, uint32_t vertexCount, uint32_t indexCount) {}
+		virtual void ClearRenderTarget(uintptr_t* rtv, tSireFloat4 const& color) {}
+		virtual void UpdateTexture(uintptr_t* surface, uint32_t width, uint32_t height, uint8_t* pixels) {}
+		virtual bool SupportsTopology(eSirePrimitiveType type, bool restart) { return type <= SIRE_TRIANGLE && !restart; }
 
-		D3D10_BLEND_DESC GetBlendDesc(ID3D10BlendState* blendState) {
-			D3D10_BLEND_DESC out;
-			blendState->GetDesc(&out);
-			return out;
-		}
+		// Timestamp queries of up to SIRE_TIMING_FRAMES frames in flight, index counts the timestamps within a frame.
+		// ReadTimestamps never waits and returns false until the frame is finished, a frequency of 0 drops it.
+		virtual bool BeginTiming(uint32_t slot) { return false; }
+		virtual void WriteTimestamp(uint32_t slot, uint32_t index) {}
+		virtual void EndTiming(uint32_t slot) {}
+		virtual bool ReadTimestamps(uint32_t slot, uint32_t count, uint64_t* out, uint64_t& frequency) { return false; }
 
-		void SetBlendState(D3D10_BLEND_DESC* blendStateDesc, float* blendFactor, uint32_t sampleMask) {
-			ID3D10BlendState* blendState = nullptr;
-			dev->CreateBlendState(blendStateDesc, &blendState);
-			dev->OMSetBlendState(blendState, blendFactor, sampleMask);
-			Release(blendState);
-		}
+		// Called by Sire::EndFrame once everything of the frame was drawn.
+		virtual void EndFrame() {}
 
-		void SetShaders(ID3D10VertexShader* v, ID3D10PixelShader* p) {
-			vertexShader = v;
-			pixelShader = p;
+		static constexpr uint32_t SIRE_TIMING_FRAMES = 4;
+
+		SireRenderer() {
+			initialised = false;
+			hWnd = nullptr;
+			textureFormat = SIRE_PIXEL_FORMAT_RGBA8;
 		}
 
-		D3D10_VIEWPORT GetViewport() {
-			uint32_t numViewport = D3D10_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
-			D3D10_VIEWPORT out[D3D10_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		virtual ~SireRenderer() {}
 
-			dev->RSGetViewports(&numViewport, out);
-			return out[0];
+		bool operator==(const SireRenderer& other) const {
+			return false;
 		}
+	};
 
-		ID3D10Texture2D* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels) {
-			ID3D10Texture2D* out = nullptr;
-			D3D10_TEXTURE2D_DESC desc;
-			ZeroMemory(&desc, sizeof(desc));
-			desc.Width = width;
-			desc.Height = height;
-			desc.MipLevels = 1;
-			desc.ArraySize = 1;
-			desc.Format = (DXGI_FORMAT)textureFormat;
-			desc.SampleDesc.Count = 1;
-			desc.Usage = D3D10_USAGE_DEFAULT;
-			desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
-			desc.CPUAccessFlags = 0;
-			desc.MiscFlags = 0;
-
-			HRESULT hr = dev->CreateTexture2D(&desc, nullptr, &out);
+#ifdef SIRE_DX9
+	struct SireD3DX9Compiler : tSireShaderCompiler {
+		uint64_t GetVersion() override {
+			return D3DX_SDK_VERSION;
+		}
 
-			if (SUCCEEDED(hr)) {
-				if (pixels) {
-					D3D10_TEXTURE2D_DESC desc;
-					out->GetDesc(&desc);
-					dev->UpdateSubresource(out, 0, nullptr, pixels, desc.Width * sizeof(UINT), 0);
+		bool Compile(std::string const& source, const char* entryPoint, const char* target, uint32_t flags, std::vector<uint8_t>& out) override {
+			ID3DXBuffer* buf = nullptr;
+			ID3DXBuffer* err = nullptr;
+			HRESULT hr = D3DXCompileShader(source.c_str(), static_cast<uint32_t>(source.size()), NULL, NULL, entryPoint, target, flags, &buf, &err, NULL);
+			if (FAILED(hr)) {
+				if (err) {
+					char szError[256]{ 0 };
+					memcpy(szError, err->GetBufferPointer(), (std::min)(static_cast<size_t>(err->GetBufferSize()), sizeof(szError) - 1));
+					MessageBoxA(nullptr, szError, "Error", MB_OK);
 				}
+				Release(err);
+				return false;
 			}
 
-			return out;
+			const uint8_t* data = static_cast<const uint8_t*>(buf->GetBufferPointer());
+			out.assign(data, data + buf->GetBufferSize());
+			Release(buf);
+			Release(err);
+			return true;
 		}
 	};
-#endif
 
-#ifdef SIRE_DX11
-	struct SireDirectX11 : SireRenderer {
-		IDXGISwapChain* swapchain;
-		ID3D11Device* dev;
-		ID3D11DeviceContext* devcon;
-		ID3D11Buffer* vb;
-		ID3D11Buffer* ib;
-		ID3D11Buffer* pb;
-		ID3D11SamplerState* ss;
-		ID3D11InputLayout* inputLayout;
-		ID3D11VertexShader* vertexShader;
-		ID3D11PixelShader* pixelShader;
-		ID3D11VertexShader* internalVertexShader;
-		ID3D11PixelShader* internalPixelShader;
-		ID3D11ShaderResourceView* tex;
-		ID3D11ShaderResourceView* mask;
-		ID3D11RasterizerState* rasterizerState;
-		ID3D11DepthStencilState* depthStencilState;
-		ID3D11BlendState* blendState;
-		FLOAT blendFactor[4];
-		UINT sampleMask;
-		UINT stencilRef;
+	struct SireDirectX9 SIRE_FINAL : SireRenderer {
+		IDirect3DDevice9* dev;
+		IDirect3DVertexBuffer9* vb;
+		IDirect3DIndexBuffer9* ib;
+		IDirect3DTexture9* tex;
+		IDirect3DTexture9* mask;
+		IDirect3DVertexDeclaration9* vertexDeclaration;
+		IDirect3DPixelShader9* pixelShader;
+		IDirect3DVertexShader9* vertexShader;
+		ID3DXConstantTable* pct;
+		ID3DXConstantTable* vct;
+		IDirect3DPixelShader9* internalPixelShader;
+		IDirect3DVertexShader9* internalVertexShader;
+		IDirect3DStateBlock9* stateBlock;
+		SireD3DX9Compiler compiler;
 
-		SireDirectX11() : SireRenderer() {
-			swapchain = nullptr;
+		SireDirectX9() : SireRenderer() {
 			dev = nullptr;
-			devcon = nullptr;
 			vb = nullptr;
 			ib = nullptr;
-			pb = nullptr;
-			ss = nullptr;
-			inputLayout = nullptr;
-			vertexShader = nullptr;
-			pixelShader = nullptr;
-			internalVertexShader = nullptr;
-			internalPixelShader = nullptr;
 			tex = nullptr;
 			mask = nullptr;
-			rasterizerState = nullptr;
-			depthStencilState = nullptr;
-			blendState = nullptr;
-			blendFactor[0] = 0.0f;
-			blendFactor[1] = 0.0f;
-			blendFactor[2] = 0.0f;
-			blendFactor[3] = 0.0f;
-			sampleMask = 0;
-			stencilRef = 0;
-			textureFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+			vertexDeclaration = nullptr;
+			pixelShader = nullptr;
+			vertexShader = nullptr;
+			pct = nullptr;
+			vct = nullptr;
+			internalPixelShader = nullptr;
+			internalVertexShader = nullptr;
+			stateBlock = nullptr;
+			textureFormat = SIRE_PIXEL_FORMAT_BGRA8;
+		}
+
+		// D3D9 has no sRGB formats, that's a sampler state there.
+		static D3DFORMAT GetNativeFormat(eSirePixelFormat format) {
+			switch (format) {
+				case SIRE_PIXEL_FORMAT_RGBA8:
+				case SIRE_PIXEL_FORMAT_RGBA8_SRGB:
+					return D3DFMT_A8B8G8R8;
+				case SIRE_PIXEL_FORMAT_BGRA8:
+				case SIRE_PIXEL_FORMAT_BGRA8_SRGB:
+					return D3DFMT_A8R8G8B8;
+				case SIRE_PIXEL_FORMAT_BC1:
+					return D3DFMT_DXT1;
+				case SIRE_PIXEL_FORMAT_BC3:
+					return D3DFMT_DXT5;
+				default:
+					return D3DFMT_UNKNOWN;
+			}
+		}
+
+		static eSirePixelFormat GetPixelFormat(D3DFORMAT format) {
+			switch (format) {
+				case D3DFMT_A8B8G8R8:
+				case D3DFMT_X8B8G8R8:
+					return SIRE_PIXEL_FORMAT_RGBA8;
+				case D3DFMT_A8R8G8B8:
+				case D3DFMT_X8R8G8B8:
+					return SIRE_PIXEL_FORMAT_BGRA8;
+				case D3DFMT_DXT1:
+					return SIRE_PIXEL_FORMAT_BC1;
+				case D3DFMT_DXT5:
+					return SIRE_PIXEL_FORMAT_BC3;
+				default:
+					return SIRE_PIXEL_FORMAT_UNKNOWN;
+			}
 		}
 
 		// Start virtual override
 		bool IsRendererActive() override {
-			if (initialised && swapchain && dev && devcon) {
-				HRESULT hr = dev->GetDeviceRemovedReason();
+			if (initialised && dev) {
+				HRESULT hr = dev->TestCooperativeLevel();
 				return SUCCEEDED(hr);
 			}
 
 			return false;
 		}
 
-		void Init(uintptr_t* ptr) override {
+		void Init(uintptr_t* d) override {
 			if (initialised)
 				return;
 
-			swapchain = reinterpret_cast<IDXGISwapChain*>(ptr);
-			HRESULT hResult = swapchain->GetDevice(__uuidof(ID3D11Device), (void**)&dev);
+			dev = reinterpret_cast<IDirect3DDevice9*>(d);
 
-			if (FAILED(hResult)) {
-#ifdef SIRE_DX11ON12
-				if (!d3d11on12::InitD3D11on12Resources(swapchain)) {
-					currentRenderer = SIRE_RENDERER_NULL;
-					return;
-				}
-				else
-					dev = d3d11on12::d3d11Device.Get();
-#else
-				currentRenderer = SIRE_RENDERER_NULL;
-				return;
-#endif
-			}
+			IDirect3DSwapChain9* swapchain = nullptr;
+			dev->GetSwapChain(0, &swapchain);
 
-#ifdef SIRE_DX11ON12
-			if (d3d11on12::isD3D11on12)
-				devcon = d3d11on12::d3d11Context.Get();
-			else
-				dev->GetImmediateContext(&devcon);
-#else
-			dev->GetImmediateContext(&devcon);
-#endif
+			D3DPRESENT_PARAMETERS presentParams;
+			ZeroMemory(&presentParams, sizeof(presentParams));
+			swapchain->GetPresentParameters(&presentParams);
 
-			DXGI_SWAP_CHAIN_DESC swapChainDesc;
-			ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
-			swapchain->GetDesc(&swapChainDesc);
+			hWnd = presentParams.hDeviceWindow;
 
-			hWnd = swapChainDesc.OutputWindow;
-			textureFormat = swapChainDesc.BufferDesc.Format;
+			dev->CreateVertexBuffer(sizeof(tVertexLegacy) * 65536, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+									0, D3DPOOL_DEFAULT, &vb, nullptr);
 
-			D3D11_BUFFER_DESC bufferDesc;
-			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+			dev->CreateIndexBuffer(sizeof(uint16_t) * 65536, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+								   D3DFMT_INDEX16, D3DPOOL_DEFAULT, &ib, nullptr);
 
-			bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-			bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-			bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-			bufferDesc.MiscFlags = 0;
-			bufferDesc.ByteWidth = sizeof(tVertex) * 65536;
+			// Init shaders
+			std::vector<uint8_t> VS = CompileShader(hlslShader2_0, "VShader", "vs_2_0");
+			std::vector<uint8_t> PS = CompileShader(hlslShader2_0, "PShader", "ps_2_0");
 
-			// Vertex buffer
-			dev->CreateBuffer(&bufferDesc, nullptr, &vb);
+			if (VS.empty() || PS.empty())
+				return;
 
-			// Index buffer
-			bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-			dev->CreateBuffer(&bufferDesc, nullptr, &ib);
+			internalVertexShader = CreateVertexShader(VS.data(), static_cast<uint32_t>(VS.size()));
+			internalPixelShader = CreatePixelShader(PS.data(), static_cast<uint32_t>(PS.size()));
 
-			// Constant buffer
-			bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-			bufferDesc.ByteWidth = sizeof(tConstBuff);
-
-			D3D11_SUBRESOURCE_DATA initData;
-			ZeroMemory(&initData, sizeof(initData));
-			initData.pSysMem = &cb;
-			dev->CreateBuffer(&bufferDesc, &initData, &pb);
-
-			D3D11_SAMPLER_DESC samplerDesc;
-			ZeroMemory(&samplerDesc, sizeof(samplerDesc));
-			samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-			samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-			samplerDesc.MipLODBias = 0.0f;
-			samplerDesc.MaxAnisotropy = 1;
-			samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-			samplerDesc.BorderColor[0] = 0.0f;
-			samplerDesc.BorderColor[1] = 0.0f;
-			samplerDesc.BorderColor[2] = 0.0f;
-			samplerDesc.BorderColor[3] = 0.0f;
-			samplerDesc.MinLOD = 0;
-			samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-			dev->CreateSamplerState(&samplerDesc, &ss);
-
-			// Init shaders
-			ID3DBlob* VS = CompileShader(hlslShader5_0, "VShader", "vs_5_0");
-			ID3DBlob* PS = CompileShader(hlslShader5_0, "PShader", "ps_5_0");
-
-			internalVertexShader = CreateVertexShader(VS->GetBufferPointer(), VS->GetBufferSize());
-			internalPixelShader = CreatePixelShader(PS->GetBufferPointer(), PS->GetBufferSize());
+			D3DXGetShaderConstantTable(reinterpret_cast<const DWORD*>(VS.data()), &pct);
+			D3DXGetShaderConstantTable(reinterpret_cast<const DWORD*>(PS.data()), &vct);
 
-			// Init input layout
-			std::vector<D3D11_INPUT_ELEMENT_DESC> layout = {
-				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 28, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			D3DVERTEXELEMENT9 vertexElements[] = {
+				{ 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+				{ 0, sizeof(float[3]), D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_COLOR, 0 },
+				{ 0, sizeof(float[3]) + sizeof(D3DCOLOR), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0},
+				{ 0, sizeof(float[5]) + sizeof(D3DCOLOR), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1},
+				D3DDECL_END()
 			};
 
-			inputLayout = CreateInputLayout(&layout, VS->GetBufferPointer(), VS->GetBufferSize());
-
-			Release(VS);
-			Release(PS);
+			dev->CreateVertexDeclaration(vertexElements, &vertexDeclaration);
 
 			initialised = true;
 		}
@@ -1991,487 +2802,630 @@ private:
 
 			Release(vb);
 			Release(ib);
-			Release(pb);
-			Release(ss);
-			Release(inputLayout);
-			Release(internalVertexShader);
-			Release(internalPixelShader);
-
-			vertexShader = nullptr;
-			pixelShader = nullptr;
+			Release(vertexDeclaration);
+			Release(pct);
+			Release(vct);
 
-			swapchain = nullptr;
+			tex = nullptr;
+			mask = nullptr;
 			dev = nullptr;
-			devcon = nullptr;
 
 			initialised = false;
 		}
 
 		void Begin() override {
-			devcon->RSGetState(&rasterizerState);
-			devcon->OMGetDepthStencilState(&depthStencilState, &stencilRef);
-			devcon->OMGetBlendState(&blendState, blendFactor, &sampleMask);
+			dev->CreateStateBlock(D3DSBT_ALL, &stateBlock);
+			stateBlock->Capture();
 		}
 
 		void End() override {
-			// Fallback to internal shaders if unset.
-			if (!pixelShader && internalPixelShader)
-				pixelShader = internalPixelShader;
-
-			if (!vertexShader && internalVertexShader)
-				vertexShader = internalVertexShader;
+			// Convert straight into the locked buffer, no intermediate copy.
+			void* out = nullptr;
+			vb->Lock(0, 0, (void**)&out, 0);
+			tVertexLegacy* dst = static_cast<tVertexLegacy*>(out);
+			for (auto& it : vertices) {
+				dst->pos = it.pos;
+				dst->diff = D3DCOLOR_ARGB(
+					static_cast<uint32_t>(it.col.w * 255),
+					static_cast<uint32_t>(it.col.x * 255),
+					static_cast<uint32_t>(it.col.y * 255),
+					static_cast<uint32_t>(it.col.z * 255)
+				);
+				dst->uv0 = it.uv0;
+				dst->uv1 = it.uv1;
+				dst++;
+			}
+			vb->Unlock();
 
-			// Update index/vertex buffers
-			D3D11_MAPPED_SUBRESOURCE mappedResource;
-			devcon->Map(vb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-			memcpy(mappedResource.pData, vertices.data(), vertices.size() * sizeof(tVertex));
-			devcon->Unmap(vb, 0);
+			if (numIndices) {
+				ib->Lock(0, 0, (void**)&out, 0);
+				memcpy(out, indices.data(), numIndices * sizeof(uint16_t));
+				ib->Unlock();
+			}
 
-			ZeroMemory(&mappedResource, sizeof(mappedResource));
-			devcon->Map(ib, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-			memcpy(mappedResource.pData, indices.data(), numIndices * sizeof(uint16_t));
-			devcon->Unmap(ib, 0);
+			Draw(vb, ib, static_cast<uint32_t>(vertices.size()), numIndices);
+		}
 
-			// Update
-			tConstBuff tempcb = cb;
-			tempcb.matrix.Transpose();
+		void DrawMesh(uintptr_t* vertexBuffer, uintptr_t* indexBuffer, uint32_t vertexCount, uint32_t indexCount) override {
+			Draw(reinterpret_cast<IDirect3DVertexBuffer9*>(vertexBuffer), reinterpret_cast<IDirect3DIndexBuffer9*>(indexBuffer), vertexCount, indexCount);
+		}
 
-			ZeroMemory(&mappedResource, sizeof(mappedResource));
-			devcon->Map(pb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-			memcpy(mappedResource.pData, &tempcb, sizeof(tempcb));
-			devcon->Unmap(pb, 0);
+		bool CreateMesh(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, uintptr_t** vertexBuffer, uintptr_t** indexBuffer) override {
+			IDirect3DVertexBuffer9* meshVertexBuffer = nullptr;
+			IDirect3DIndexBuffer9* meshIndexBuffer = nullptr;
 
-			ID3D11InputLayout* prevInputLayout = nullptr;
-			devcon->IAGetInputLayout(&prevInputLayout);
-			devcon->IASetInputLayout(inputLayout);
+			// Managed pool, the runtime restores it after a device reset.
+			if (FAILED(dev->CreateVertexBuffer(sizeof(tVertexLegacy) * vertexCount, D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &meshVertexBuffer, nullptr)))
+				return false;
 
-			auto prevRenderTargets = GetRenderTargets();
-			auto prevStencilView = GetDepthStencilView();
+			void* out = nullptr;
+			meshVertexBuffer->Lock(0, 0, (void**)&out, 0);
+			tVertexLegacy* dst = static_cast<tVertexLegacy*>(out);
+			for (uint32_t n = 0; n < vertexCount; n++) {
+				dst->pos = v[n].pos;
+				dst->diff = D3DCOLOR_ARGB(
+					static_cast<uint32_t>(v[n].col.w * 255),
+					static_cast<uint32_t>(v[n].col.x * 255),
+					static_cast<uint32_t>(v[n].col.y * 255),
+					static_cast<uint32_t>(v[n].col.z * 255)
+				);
+				dst->uv0 = v[n].uv0;
+				dst->uv1 = v[n].uv1;
+				dst++;
+			}
+			meshVertexBuffer->Unlock();
 
-			if (currentRenderTargetView) {
-#ifdef SIRE_DX11ON12
-				if (!d3d11on12::isD3D11on12) {
-					devcon->OMSetRenderTargets(1, (ID3D11RenderTargetView**)&currentRenderTargetView, nullptr);
+			if (indexCount) {
+				if (FAILED(dev->CreateIndexBuffer(sizeof(uint16_t) * indexCount, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_MANAGED, &meshIndexBuffer, nullptr))) {
+					Release(meshVertexBuffer);
+					return false;
 				}
-#else
-				auto renderTarget = GetRenderTarget();
-				devcon->OMSetRenderTargets(1, (ID3D11RenderTargetView**)&Sire::currentRenderTargetView, nullptr);
-#endif
-			}
 
-			ID3D11VertexShader* prevVertexShader = nullptr;
-			devcon->VSGetShader(&prevVertexShader, nullptr, 0);
-			devcon->VSSetShader(vertexShader, nullptr, 0);
+				meshIndexBuffer->Lock(0, 0, (void**)&out, 0);
+				memcpy(out, i, sizeof(uint16_t) * indexCount);
+				meshIndexBuffer->Unlock();
+			}
 
-			ID3D11PixelShader* prevPixelShader = nullptr;
-			devcon->PSGetShader(&prevPixelShader, nullptr, 0);
-			devcon->PSSetShader(pixelShader, nullptr, 0);
+			*vertexBuffer = reinterpret_cast<uintptr_t*>(meshVertexBuffer);
+			*indexBuffer = reinterpret_cast<uintptr_t*>(meshIndexBuffer);
+			return true;
+		}
 
-			ID3D11Buffer* prevVertexConstantBuffer = nullptr;
-			devcon->VSGetConstantBuffers(0, 1, &prevVertexConstantBuffer);
-			devcon->VSSetConstantBuffers(0, 1, &pb);
+		void ClearRenderTarget(uintptr_t* rtv, tSireFloat4 const& color) override {
+			dev->ColorFill(reinterpret_cast<IDirect3DSurface9*>(rtv), nullptr, D3DCOLOR_COLORVALUE(color.x, color.y, color.z, color.w));
+		}
 
-			ID3D11Buffer* prevPixelConstantBuffer = nullptr;
-			devcon->PSGetConstantBuffers(0, 1, &prevPixelConstantBuffer);
-			devcon->PSSetConstantBuffers(0, 1, &pb);
+		void UpdateTexture(uintptr_t* surface, uint32_t width, uint32_t height, uint8_t* pixels) override {
+			IDirect3DSurface9* tempSurf = CreateSurface(width, height, pixels);
+			if (!tempSurf)
+				return;
 
-			// Set textures
-			ID3D11ShaderResourceView* prevVertexShaderResourceView0 = nullptr;
-			devcon->VSGetShaderResources(0, 1, &prevVertexShaderResourceView0);
-			devcon->VSSetShaderResources(0, 1, &tex);
+			CopyResource(surface, reinterpret_cast<uintptr_t*>(tempSurf));
+			Release(tempSurf);
+		}
 
-			ID3D11ShaderResourceView* prevVertexShaderResourceView1 = nullptr;
-			devcon->VSGetShaderResources(1, 1, &prevVertexShaderResourceView1);
-			devcon->VSSetShaderResources(1, 1, &mask);
+		// D3D9 has no strip cut index.
+		bool SupportsTopology(eSirePrimitiveType type, bool restart) override {
+			return !restart;
+		}
 
-			ID3D11ShaderResourceView* prevPixelShaderResourceView0 = nullptr;
-			devcon->PSGetShaderResources(0, 1, &prevPixelShaderResourceView0);
-			devcon->PSSetShaderResources(0, 1, &tex);
+		void SetRenderStates(tRenderState const& s) override {
+			// Set rasterizer state
+			dev->SetRenderState(D3DRS_CULLMODE, s.cullMode);
+			dev->SetRenderState(D3DRS_FILLMODE, s.fillMode);
 
-			ID3D11ShaderResourceView* prevPixelShaderResourceView1 = nullptr;
-			devcon->PSGetShaderResources(1, 1, &prevPixelShaderResourceView1);
-			devcon->PSSetShaderResources(1, 1, &mask);
+			// Set blend state
+			dev->SetRenderState(D3DRS_ALPHABLENDENABLE, s.blendEnable);
+			dev->SetRenderState(D3DRS_SRCBLEND, s.srcBlend);
+			dev->SetRenderState(D3DRS_DESTBLEND, s.dstBlend);
+			dev->SetRenderState(D3DRS_BLENDOP, s.blendop);
+			dev->SetRenderState(D3DRS_SRCBLENDALPHA, s.srcBlendAlpha);
+			dev->SetRenderState(D3DRS_DESTBLENDALPHA, s.destBlendAlpha);
+			dev->SetRenderState(D3DRS_BLENDOPALPHA, s.blendOpAlpha);
+			dev->SetRenderState(D3DRS_COLORWRITEENABLE, s.sampleMask);
+		}
 
-			ID3D11SamplerState* prevPixelSamplers = nullptr;
-			devcon->PSGetSamplers(0, 1, &prevPixelSamplers);
-			devcon->PSSetSamplers(0, 1, &ss);
+		void SetViewport(tSireViewport const& v) {
+			D3DVIEWPORT9 vp = {};
+			vp.X = static_cast<DWORD>(v.x);
+			vp.Y = static_cast<DWORD>(v.y);
+			vp.Width = static_cast<DWORD>(v.w);
+			vp.Height = static_cast<DWORD>(v.h);
+			vp.MinZ = v.mind;
+			vp.MaxZ = v.maxd;
+			dev->SetViewport(&vp);
+		}
 
-			ID3D11SamplerState* prevVertexSamplers = nullptr;
-			devcon->GSGetSamplers(0, 1, &prevVertexSamplers);
-			devcon->GSSetSamplers(0, 1, &ss);
+		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
+			cb.hasTex = texture ? true : false;
+			cb.hasMask = textureMask ? true : false;
 
-			// Set index/vertex buffers
-			UINT stride = sizeof(tVertex);
-			UINT offset = 0;
+			tex = nullptr;
+			mask = nullptr;
 
-			UINT prevStride;
-			UINT prevVertexOffset;
-			ID3D11Buffer* prevVertexBuffers = nullptr;
-			devcon->IAGetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
-			devcon->IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+			if (texture)
+				tex = reinterpret_cast<IDirect3DTexture9*>(texture);
 
-			ID3D11Buffer* prevIndexBuffers = nullptr;
-			DXGI_FORMAT prevFormat;
-			UINT prevIndexOffset;
-			devcon->IAGetIndexBuffer(&prevIndexBuffers, &prevFormat, &prevIndexOffset);
-			devcon->IASetIndexBuffer(ib, DXGI_FORMAT_R16_UINT, 0);
+			if (textureMask)
+				mask = reinterpret_cast<IDirect3DTexture9*>(textureMask);
+		}
 
-			D3D_PRIMITIVE_TOPOLOGY type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-			switch (primitiveType) {
-				case SIRE_LINE:
-					type = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
-					break;
-				case SIRE_POINT:
-					type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-					break;
-				case SIRE_TRIANGLE:
-					type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-					break;
-			}
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+			dev->StretchRect(reinterpret_cast<IDirect3DSurface9*>(src), nullptr, reinterpret_cast<IDirect3DSurface9*>(dst), nullptr, D3DTEXF_NONE);
+		}
 
-			D3D_PRIMITIVE_TOPOLOGY prevType;
-			devcon->IAGetPrimitiveTopology(&prevType);
-			devcon->IASetPrimitiveTopology(type);
+		uint8_t* Lock(void* ptr) override {
+			D3DLOCKED_RECT out;
+			if (FAILED(reinterpret_cast<IDirect3DSurface9*>(ptr)->LockRect(&out, nullptr, 0)))
+				return nullptr;
 
-			// Draw
-			devcon->DrawIndexed(numIndices, 0, 0);
+			return (uint8_t*)out.pBits;
+		}
 
-			// Restore shit
-			devcon->OMSetRenderTargets(1, &prevRenderTargets[0], prevStencilView);
+		void Unlock(void* ptr) override {
+			reinterpret_cast<IDirect3DSurface9*>(ptr)->UnlockRect();
+		}
 
-			Release(prevRenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
-			Release(prevStencilView);
+		void SetPixelShader(uintptr_t* ps) override {
+			pixelShader = (IDirect3DPixelShader9*)ps;
+		}
 
-			devcon->IASetInputLayout(prevInputLayout);
-			Release(prevInputLayout);
+		void SetVertexShader(uintptr_t* vs) override {
+			vertexShader = (IDirect3DVertexShader9*)vs;
+		}
 
-			devcon->VSSetShader(prevVertexShader, nullptr, 0);
-			Release(prevVertexShader);
+		uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVer) override {
+			std::vector<uint8_t> buf = CompileShader(shaderCode, "main", targetVer);
+			if (buf.empty())
+				return nullptr;
 
-			devcon->PSSetShader(prevPixelShader, nullptr, 0);
-			Release(prevPixelShader);
+			return (uintptr_t*)CreatePixelShader(buf.data(), static_cast<uint32_t>(buf.size()));
+		}
 
-			devcon->VSSetConstantBuffers(0, 1, &prevVertexConstantBuffer);
-			Release(prevVertexConstantBuffer);
+		uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVer) override {
+			std::vector<uint8_t> buf = CompileShader(shaderCode, "main", targetVer);
+			if (buf.empty())
+				return nullptr;
 
-			devcon->PSSetConstantBuffers(0, 1, &prevPixelConstantBuffer);
-			Release(prevPixelConstantBuffer);
+			return (uintptr_t*)CreateVertexShader(buf.data(), static_cast<uint32_t>(buf.size()));
+		}
 
-			devcon->VSSetShaderResources(0, 1, &prevVertexShaderResourceView0);
-			Release(prevVertexShaderResourceView0);
+		// End virtual override
 
-			devcon->VSSetShaderResources(1, 1, &prevVertexShaderResourceView1);
-			Release(prevVertexShaderResourceView1);
+		// Binds the given buffers with the current state, draws and restores the captured state block.
+		void Draw(IDirect3DVertexBuffer9* vertexBuffer, IDirect3DIndexBuffer9* indexBuffer, uint32_t vertexCount, uint32_t indexCount) {
+			// Fallback to internal shaders if unset.
+			if (!pixelShader && internalPixelShader)
+				pixelShader = internalPixelShader;
 
-			devcon->PSSetShaderResources(0, 1, &prevPixelShaderResourceView0);
-			Release(prevPixelShaderResourceView0);
+			if (!vertexShader && internalVertexShader)
+				vertexShader = internalVertexShader;
 
-			devcon->PSSetShaderResources(1, 1, &prevPixelShaderResourceView1);
-			Release(prevPixelShaderResourceView1);
+			tConstBuff tempcb = cb;
+			D3DXMATRIX m = tempcb.matrix.ToD3DXMATRIX();
+			pct->SetMatrix(dev, pct->GetConstantByName(NULL, "proj"), &m);
+			pct->SetMatrix(dev, vct->GetConstantByName(NULL, "proj"), &m);
 
-			devcon->PSSetSamplers(0, 1, &prevPixelSamplers);
-			Release(prevPixelSamplers);
+			pct->SetInt(dev, pct->GetConstantByName(NULL, "hasTex"), tempcb.hasTex);
+			pct->SetInt(dev, vct->GetConstantByName(NULL, "hasTex"), tempcb.hasTex);
 
-			devcon->GSSetSamplers(0, 1, &prevVertexSamplers);
-			Release(prevVertexSamplers);
-
-			devcon->IASetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
-			Release(prevVertexBuffers);
-
-			devcon->IASetIndexBuffer(prevIndexBuffers, prevFormat, prevIndexOffset);
-			Release(prevIndexBuffers);
-
-			devcon->IASetPrimitiveTopology(prevType);
+			pct->SetInt(dev, pct->GetConstantByName(NULL, "hasMask"), tempcb.hasMask);
+			pct->SetInt(dev, vct->GetConstantByName(NULL, "hasMask"), tempcb.hasMask);
 
-			devcon->RSSetState(rasterizerState);
-			Release(rasterizerState);
+			pct->SetInt(dev, pct->GetConstantByName(NULL, "texAlpha"), tempcb.texAlpha);
+			pct->SetInt(dev, vct->GetConstantByName(NULL, "texAlpha"), tempcb.texAlpha);
 
-			devcon->OMSetDepthStencilState(depthStencilState, stencilRef);
-			Release(depthStencilState);
+			pct->SetInt(dev, pct->GetConstantByName(NULL, "isSdf"), tempcb.isSdf);
+			pct->SetInt(dev, vct->GetConstantByName(NULL, "isSdf"), tempcb.isSdf);
 
-			devcon->OMSetBlendState(blendState, blendFactor, sampleMask);
-			Release(blendState);
+			pct->SetVector(dev, pct->GetConstantByName(NULL, "tint"), reinterpret_cast<const D3DXVECTOR4*>(&tempcb.tint));
+			pct->SetVector(dev, vct->GetConstantByName(NULL, "tint"), reinterpret_cast<const D3DXVECTOR4*>(&tempcb.tint));
 
-#ifdef SIRE_DX11ON12
-			if (d3d11on12::isD3D11on12) {
-				d3d11on12::d3d11On12Device->ReleaseWrappedResources(d3d11on12::d3d11WrappedBackBuffers[d3d11on12::bufferIndex].GetAddressOf(), 1);
-				d3d11on12::d3d11Context->Flush();
+			// Render targets are not part of the state block.
+			IDirect3DSurface9* prevRenderTarget = nullptr;
+			if (currentRenderTargetView) {
+				dev->GetRenderTarget(0, &prevRenderTarget);
+				dev->SetRenderTarget(0, (IDirect3DSurface9*)currentRenderTargetView);
 			}
-#endif
-		}
 
-		void SetRenderStates(tRenderState const& s) override {
-			D3D11_RASTERIZER_DESC rasterizerDesc;
-			ZeroMemory(&rasterizerDesc, sizeof(rasterizerDesc));
-			rasterizerDesc.CullMode = (D3D11_CULL_MODE)s.cullMode;
-			rasterizerDesc.FillMode = (D3D11_FILL_MODE)s.fillMode;
-			ID3D11RasterizerState* rasterizerState = nullptr;
-			dev->CreateRasterizerState(&rasterizerDesc, &rasterizerState);
-			devcon->RSSetState(rasterizerState);
-			Release(rasterizerState);
+			dev->SetVertexDeclaration(vertexDeclaration);
 
-			D3D11_BLEND_DESC blendDesc;
-			ZeroMemory(&blendDesc, sizeof(blendDesc));
-			blendDesc.RenderTarget[0].BlendEnable = s.blendEnable;
-			blendDesc.RenderTarget[0].SrcBlend = (D3D11_BLEND)s.srcBlend;
-			blendDesc.RenderTarget[0].DestBlend = (D3D11_BLEND)s.dstBlend;
-			blendDesc.RenderTarget[0].BlendOp = (D3D11_BLEND_OP)s.blendop;
-			blendDesc.RenderTarget[0].SrcBlendAlpha = (D3D11_BLEND)s.srcBlendAlpha;
-			blendDesc.RenderTarget[0].DestBlendAlpha = (D3D11_BLEND)s.destBlendAlpha;
-			blendDesc.RenderTarget[0].BlendOpAlpha = (D3D11_BLEND_OP)s.blendOpAlpha;
-			blendDesc.RenderTarget[0].RenderTargetWriteMask = s.renderTargetWriteMask;
+			dev->SetTexture(0, tex);
+			dev->SetTexture(1, mask);
 
-			ID3D11BlendState* blendState = nullptr;
-			dev->CreateBlendState(&blendDesc, &blendState);
-			float blendFactor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-			devcon->OMSetBlendState(blendState, blendFactor, s.sampleMask);
-			Release(blendState);
-		}
+			dev->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+			dev->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+			dev->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+			dev->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
 
-		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
-			devcon->CopyResource(reinterpret_cast<ID3D11Resource*>(dst), reinterpret_cast<ID3D11Resource*>(src));
-		}
+			dev->SetSamplerState(1, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+			dev->SetSamplerState(1, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+			dev->SetSamplerState(1, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+			dev->SetSamplerState(1, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
 
-		void SetViewport(tSireViewport const& v) override {
-			D3D11_VIEWPORT vp = {};
-			vp.TopLeftX = v.x;
-			vp.TopLeftY = v.y;
-			vp.Width = v.w;
-			vp.Height = v.h;
-			vp.MinDepth = v.mind;
-			vp.MaxDepth = v.maxd;
-			devcon->RSSetViewports(1, &vp);
-		}
+			dev->SetRenderState(D3DRS_WRAP0, 0);
+			dev->SetRenderState(D3DRS_WRAP1, 0);
 
-		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
-			cb.hasTex = texture ? true : false;
-			cb.hasMask = textureMask ? true : false;
+			dev->SetPixelShader(pixelShader);
+			dev->SetVertexShader(vertexShader);
 
-			tex = nullptr;
-			mask = nullptr;
+			dev->SetStreamSource(0, vertexBuffer, 0, sizeof(tVertexLegacy));
+			dev->SetIndices(indexBuffer);
 
-			if (texture)
-				tex = reinterpret_cast<ID3D11ShaderResourceView*>(texture);
+			D3DPRIMITIVETYPE type = D3DPT_POINTLIST;
+			switch (primitiveType) {
+				case SIRE_LINE:
+					type = D3DPT_LINELIST;
+					break;
+				case SIRE_POINT:
+					type = D3DPT_POINTLIST;
+					break;
+				case SIRE_TRIANGLE:
+					type = D3DPT_TRIANGLELIST;
+					break;
+				case SIRE_LINE_STRIP:
+					type = D3DPT_LINESTRIP;
+					break;
+				case SIRE_TRIANGLE_STRIP:
+					type = D3DPT_TRIANGLESTRIP;
+					break;
+				case SIRE_TRIANGLE_FAN:
+					type = D3DPT_TRIANGLEFAN;
+					break;
+			}
 
-			if (textureMask)
-				mask = reinterpret_cast<ID3D11ShaderResourceView*>(textureMask);
-		}
+			uint32_t primitiveCount = GetPrimitiveCount(primitiveType, indexCount ? indexCount : vertexCount);
+			if (indexCount)
+				dev->DrawIndexedPrimitive(type, 0, 0, vertexCount, 0, primitiveCount);
+			else
+				dev->DrawPrimitive(type, 0, primitiveCount);
 
+			if (prevRenderTarget) {
+				dev->SetRenderTarget(0, prevRenderTarget);
+				Release(prevRenderTarget);
+			}
 
-		uint8_t* Lock(void* ptr) override {
-			D3D11_MAPPED_SUBRESOURCE map;
-			devcon->Map(reinterpret_cast<ID3D11Texture2D*>(ptr), 0, D3D11_MAP_READ, 0, &map);
-			return (uint8_t*)map.pData;
+			stateBlock->Apply();
+			Release(stateBlock);
 		}
 
-		void Unlock(void* ptr) override {
-			devcon->Unmap(reinterpret_cast<ID3D11Texture2D*>(ptr), 0);
-		}
+		IDirect3DSurface9** GetRenderTargets() {
+			D3DCAPS9 caps;
+			dev->GetDeviceCaps(&caps);
+			UINT maxRTs = caps.NumSimultaneousRTs;
 
-		void SetPixelShader(uintptr_t* ps) override {
-			pixelShader = (ID3D11PixelShader*)ps;
-		}
+			static IDirect3DSurface9* out[8] = {};
+			memset(out, 0, sizeof(out));
 
-		void SetVertexShader(uintptr_t* vs) override {
-			vertexShader = (ID3D11VertexShader*)vs;
+			for (int32_t i = 0; i < maxRTs; i++) {
+				dev->GetRenderTarget(i, &out[i]);
+			}
+			return out;
 		}
 
-		uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVersion) override {
-			ID3DBlob* buf = CompileShader(shaderCode, "main", targetVersion);
-			return (uintptr_t*)CreatePixelShader(buf->GetBufferPointer(), buf->GetBufferSize());
+		IDirect3DSurface9* GetBackBufferSurface(uint32_t buffer) {
+			IDirect3DSurface9* out = nullptr;
+			dev->GetBackBuffer(0, buffer, D3DBACKBUFFER_TYPE_MONO, &out);
+			return out;
 		}
 
-		uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVersion) override {
-			ID3DBlob* buf = CompileShader(shaderCode, "main", targetVersion);
-			return (uintptr_t*)CreateVertexShader(buf->GetBufferPointer(), buf->GetBufferSize());
+		D3DSURFACE_DESC GetDesc(IDirect3DSurface9* surface) {
+			D3DSURFACE_DESC out = {};
+			surface->GetDesc(&out);
+			return out;
 		}
 
-		// End virtual override
-
-		ID3D11RenderTargetView** GetRenderTargets() {
-			static ID3D11RenderTargetView* out[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
-			memset(out, 0, sizeof(out));
-			devcon->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, out, nullptr);
+		IDirect3DSurface9* GetSurfaceLevel(IDirect3DTexture9* texture, uint32_t level) {
+			IDirect3DSurface9* out;
+			texture->GetSurfaceLevel(level, &out);
 			return out;
 		}
 
-		ID3D11DepthStencilView* GetDepthStencilView() {
-			static ID3D11DepthStencilView* out = {};
-			ID3D11RenderTargetView* rtv = {};
-			out = nullptr;
-			devcon->OMGetRenderTargets(1, &rtv, &out);
-			Release(rtv);
+		std::vector<uint8_t> CompileShader(const std::string& str, const char* szEntrypoint, const char* szTarget) {
+			std::vector<uint8_t> out;
+			shaderCache.Compile(GetShaderCompiler(&compiler), str, szEntrypoint, szTarget, 0, out);
 			return out;
 		}
 
-		ID3D11Texture2D* GetBackBuffer(uint32_t buffer) {
-			ID3D11Texture2D* out = nullptr;
-#ifdef SIRE_DX11ON12
-			if (d3d11on12::isD3D11on12)
-				d3d11on12::d3d11WrappedBackBuffers[d3d11on12::bufferIndex]->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&out);
-			else
-				swapchain->GetBuffer(buffer, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&out));
-#else
-			swapchain->GetBuffer(buffer, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&out));
-#endif
-			return out;
+		IDirect3DVertexShader9* CreateVertexShader(const void* buffer, uint32_t size) {
+			IDirect3DVertexShader9* pVertexShader = nullptr;
+			dev->CreateVertexShader(static_cast<const DWORD*>(buffer), &pVertexShader);
+			return pVertexShader;
 		}
 
-		D3D11_TEXTURE2D_DESC GetDesc(ID3D11Texture2D* texture) {
-			D3D11_TEXTURE2D_DESC out = {};
-			texture->GetDesc(&out);
-			return out;
+		IDirect3DPixelShader9* CreatePixelShader(const void* buffer, uint32_t size) {
+			IDirect3DPixelShader9* pPixelShader = nullptr;
+			dev->CreatePixelShader(static_cast<const DWORD*>(buffer), &pPixelShader);
+			return pPixelShader;
 		}
 
-		ID3D11RenderTargetView* CreateRenderTarget(ID3D11Texture2D* texture) {
-			ID3D11RenderTargetView* out;
-			dev->CreateRenderTargetView(texture, nullptr, &out);
-			return out;
+		const char* GetErrorString(HRESULT hr) {
+			switch (hr) {
+				case D3D_OK:
+					return "D3D_OK: No error.";
+				case D3DERR_NOTAVAILABLE:
+					return "D3DERR_NOTAVAILABLE: This device does not support the queried technique or method.";
+				case D3DERR_OUTOFVIDEOMEMORY:
+					return "D3DERR_OUTOFVIDEOMEMORY: Out of video memory.";
+				case D3DERR_INVALIDCALL:
+					return "D3DERR_INVALIDCALL: The method call is invalid.";
+				case D3DERR_DRIVERINTERNALERROR:
+					return "D3DERR_DRIVERINTERNALERROR: Internal driver error.";
+				case D3DERR_DEVICELOST:
+					return "D3DERR_DEVICELOST: The device is lost and needs to be reset.";
+				case D3DERR_INVALIDDEVICE:
+					return "D3DERR_INVALIDDEVICE: The requested device type is not valid.";
+				case D3DERR_MOREDATA:
+					return "D3DERR_MOREDATA: There is more data available.";
+				case D3DERR_NOTFOUND:
+					return "D3DERR_NOTFOUND: The requested item was not found.";
+				case D3DERR_DEVICEHUNG:
+					return "D3DERR_DEVICEHUNG: The device is hung and needs to be reset.";
+				case D3DERR_DEVICEREMOVED:
+					return "D3DERR_DEVICEREMOVED: The device has been removed.";
+				case D3DERR_DEVICENOTRESET:
+					return "D3DERR_DEVICENOTRESET: The device has not been reset.";
+				case D3DERR_WASSTILLDRAWING:
+					return "D3DERR_WASSTILLDRAWING: The previous rendering operation is still in progress.";
+				case D3DERR_UNSUPPORTEDALPHAARG:
+					return "D3DERR_UNSUPPORTEDALPHAARG: The alpha blending argument is not supported.";
+				case D3DERR_UNSUPPORTEDALPHAOPERATION:
+					return "D3DERR_UNSUPPORTEDALPHAOPERATION: The alpha blending operation is not supported.";
+				case D3DERR_UNSUPPORTEDCOLORARG:
+					return "D3DERR_UNSUPPORTEDCOLORARG: The color blending argument is not supported.";
+				case D3DERR_UNSUPPORTEDCOLOROPERATION:
+					return "D3DERR_UNSUPPORTEDCOLOROPERATION: The color blending operation is not supported.";
+				default:
+					return "Unknown error.";
+			}
 		}
 
-		ID3DBlob* CompileShader(std::string const str, const char* szEntrypoint, const char* szTarget) {
-			ID3DBlob* out = nullptr;
-			ID3DBlob* outerr = nullptr;
+		IDirect3DSurface9* CreateSurface(uint32_t width, uint32_t height, uint8_t* pixels) {
+			IDirect3DSurface9* out = nullptr;
+			HRESULT hr = dev->CreateOffscreenPlainSurface(width, height, GetNativeFormat(textureFormat), D3DPOOL_DEFAULT, &out, nullptr);
 
-			auto hr = D3DCompile(str.c_str(), str.length(), 0, nullptr, nullptr, szEntrypoint, szTarget, D3DCOMPILE_ENABLE_STRICTNESS, 0, &out, &outerr);
-			if (FAILED(hr)) {
-				if (outerr) {
-					char szError[256]{ 0 };
-					memcpy(szError, outerr->GetBufferPointer(), outerr->GetBufferSize());
-					MessageBoxA(nullptr, szError, "Error", MB_OK);
+			if (SUCCEEDED(hr)) {
+				if (pixels) {
+					uint8_t* texturePixels = Lock(out);
+					std::memcpy(texturePixels, pixels, width * height * 4);
+					Unlock(out);
 				}
-				return outerr;
 			}
-			return out;
-		}
+			else {
+				printf("%s", GetErrorString(hr));
+			}
 
-		ID3D11VertexShader* CreateVertexShader(const void* buffer, size_t size) {
-			ID3D11VertexShader* out = nullptr;
-			dev->CreateVertexShader(buffer, size, NULL, &out);
 			return out;
 		}
 
-		ID3D11PixelShader* CreatePixelShader(const void* buffer, size_t size) {
-			ID3D11PixelShader* out = nullptr;
-			dev->CreatePixelShader(buffer, size, NULL, &out);
+		// D3D9 has no BC7. blocks holds mipLevels levels back to back.
+		IDirect3DTexture9* CreateCompressedTexture(uint32_t width, uint32_t height, eSirePixelFormat format, uint8_t const* blocks, IDirect3DSurface9** sout, uint32_t mipLevels = 1) {
+			D3DFORMAT fmt = GetNativeFormat(format);
+			if (fmt == D3DFMT_UNKNOWN)
+				return nullptr;
+
+			IDirect3DTexture9* out = nullptr;
+			HRESULT hr = dev->CreateTexture(width, height, mipLevels, 0, fmt, D3DPOOL_MANAGED, &out, nullptr);
+			if (FAILED(hr)) {
+				printf("%s", GetErrorString(hr));
+				return nullptr;
+			}
+
+			for (uint32_t i = 0; i < mipLevels; i++) {
+				uint32_t rowSize = GetCompressedRowSize(format, width);
+				uint32_t rows = (height + 3) / 4;
+
+				D3DLOCKED_RECT rect;
+				if (SUCCEEDED(out->LockRect(i, &rect, nullptr, 0))) {
+					for (uint32_t y = 0; y < rows; y++)
+						memcpy(static_cast<uint8_t*>(rect.pBits) + y * rect.Pitch, blocks + y * rowSize, rowSize);
+					out->UnlockRect(i);
+				}
+
+				blocks += rowSize * rows;
+				width = (std::max)(width >> 1, 1u);
+				height = (std::max)(height >> 1, 1u);
+			}
+
+			if (sout)
+				*sout = GetSurfaceLevel(out, 0);
+
 			return out;
 		}
 
-		ID3D11InputLayout* CreateInputLayout(std::vector<D3D11_INPUT_ELEMENT_DESC>* layout, const void* buffer, size_t size) {
-			ID3D11InputLayout* out = nullptr;
-			dev->CreateInputLayout(layout->data(), static_cast<uint32_t>(layout->size()), buffer, size, &out);
-			return out;
-		}
+		// mipPixels holds levels 1 to mipLevels - 1 back to back.
+		IDirect3DTexture9* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels, IDirect3DSurface9** sout, uint32_t mipLevels = 1, uint8_t* mipPixels = nullptr, bool generateMips = false) {
+			IDirect3DTexture9* out = nullptr;
+			DWORD usage = D3DUSAGE_RENDERTARGET | (generateMips ? D3DUSAGE_AUTOGENMIPMAP : 0);
+			HRESULT hr = dev->CreateTexture(width, height, generateMips ? 0 : mipLevels, usage, GetNativeFormat(textureFormat), D3DPOOL_DEFAULT, &out, nullptr);
 
-		ID3D11ShaderResourceView* CreateShaderResourceView(ID3D11Texture2D* texture) {
-			ID3D11ShaderResourceView* out = nullptr;
-			dev->CreateShaderResourceView(texture, nullptr, &out);
-			return out;
-		}
+			if (SUCCEEDED(hr)) {
+				IDirect3DSurface9* surf = GetSurfaceLevel(out, 0);
 
-		ID3D11BlendState* GetBlendState(float* blendFactor, uint32_t* sampleMask) {
-			ID3D11BlendState* out;
-			devcon->OMGetBlendState(&out, blendFactor, sampleMask);
-			return out;
-		}
+				if (sout)
+					*sout = surf;
+
+				if (pixels) {
+					IDirect3DSurface9* tempSurf = CreateSurface(width, height, pixels);
+					CopyResource(reinterpret_cast<uintptr_t*>(surf), reinterpret_cast<uintptr_t*>(tempSurf));
+					Release(tempSurf);
+				}
+
+				if (mipPixels && !generateMips) {
+					for (uint32_t i = 1; i < mipLevels; i++) {
+						width = (std::max)(width >> 1, 1u);
+						height = (std::max)(height >> 1, 1u);
+
+						IDirect3DSurface9* level = GetSurfaceLevel(out, i);
+						IDirect3DSurface9* tempSurf = CreateSurface(width, height, mipPixels);
+						CopyResource(reinterpret_cast<uintptr_t*>(level), reinterpret_cast<uintptr_t*>(tempSurf));
+						Release(tempSurf);
+						Release(level);
+						mipPixels += width * height * 4;
+					}
+				}
+
+				if (generateMips)
+					out->GenerateMipSubLevels();
+			}
+			else {
+				printf("%s", GetErrorString(hr));
+			}
 
-		D3D11_BLEND_DESC GetBlendDesc(ID3D11BlendState* blendState) {
-			D3D11_BLEND_DESC out;
-			blendState->GetDesc(&out);
 			return out;
 		}
+	};
+#endif
 
-		void SetBlendState(D3D11_BLEND_DESC* blendStateDesc, float* blendFactor, uint32_t sampleMask) {
-			ID3D11BlendState* blendState = nullptr;
-			dev->CreateBlendState(blendStateDesc, &blendState);
-			devcon->OMSetBlendState(blendState, blendFactor, sampleMask);
-			Release(blendState);
+#if defined(SIRE_DX10) || defined(SIRE_DX11) || defined(SIRE_DX12)
+	static inline DXGI_FORMAT GetDxgiFormat(eSirePixelFormat format) {
+		switch (format) {
+			case SIRE_PIXEL_FORMAT_RGBA8:
+				return DXGI_FORMAT_R8G8B8A8_UNORM;
+			case SIRE_PIXEL_FORMAT_BGRA8:
+				return DXGI_FORMAT_B8G8R8A8_UNORM;
+			case SIRE_PIXEL_FORMAT_RGBA8_SRGB:
+				return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+			case SIRE_PIXEL_FORMAT_BGRA8_SRGB:
+				return DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+			case SIRE_PIXEL_FORMAT_BC1:
+				return DXGI_FORMAT_BC1_UNORM;
+			case SIRE_PIXEL_FORMAT_BC3:
+				return DXGI_FORMAT_BC3_UNORM;
+			case SIRE_PIXEL_FORMAT_BC7:
+				return DXGI_FORMAT_BC7_UNORM;
+			default:
+				return DXGI_FORMAT_UNKNOWN;
 		}
+	}
 
-		void SetShaders(ID3D11VertexShader* v, ID3D11PixelShader* p) {
-			vertexShader = v;
-			pixelShader = p;
+	static inline eSirePixelFormat GetPixelFormat(DXGI_FORMAT format, eSirePixelFormat fallback = SIRE_PIXEL_FORMAT_UNKNOWN) {
+		switch (format) {
+			case DXGI_FORMAT_R8G8B8A8_UNORM:
+				return SIRE_PIXEL_FORMAT_RGBA8;
+			case DXGI_FORMAT_B8G8R8A8_UNORM:
+			case DXGI_FORMAT_B8G8R8X8_UNORM:
+				return SIRE_PIXEL_FORMAT_BGRA8;
+			case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+				return SIRE_PIXEL_FORMAT_RGBA8_SRGB;
+			case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+				return SIRE_PIXEL_FORMAT_BGRA8_SRGB;
+			case DXGI_FORMAT_BC1_UNORM:
+				return SIRE_PIXEL_FORMAT_BC1;
+			case DXGI_FORMAT_BC3_UNORM:
+				return SIRE_PIXEL_FORMAT_BC3;
+			case DXGI_FORMAT_BC7_UNORM:
+				return SIRE_PIXEL_FORMAT_BC7;
+			default:
+				return fallback;
 		}
+	}
 
-		D3D11_VIEWPORT GetViewport() {
-			uint32_t numViewport = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
-			D3D11_VIEWPORT out[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+	struct SireD3DCompiler : tSireShaderCompiler {
+		uint64_t version = 0;
+
+		// D3D_COMPILER_VERSION doesn't change with DLL updates, so the loaded compiler is told apart by its image header.
+		uint64_t GetVersion() override {
+			if (version)
+				return version;
+
+			version = D3D_COMPILER_VERSION;
+			HMODULE module = GetModuleHandleA(D3DCOMPILER_DLL_A);
+			if (module) {
+				IMAGE_DOS_HEADER const* dos = reinterpret_cast<IMAGE_DOS_HEADER const*>(module);
+				IMAGE_NT_HEADERS const* nt = reinterpret_cast<IMAGE_NT_HEADERS const*>(reinterpret_cast<uint8_t const*>(module) + dos->e_lfanew);
+				uint32_t image[] = { nt->FileHeader.TimeDateStamp, nt->OptionalHeader.SizeOfImage, nt->OptionalHeader.CheckSum };
+				version = Hash64(image, sizeof(image), version);
+			}
 
-			devcon->RSGetViewports(&numViewport, out);
-			return out[0];
+			return version;
 		}
 
-		ID3D11Texture2D* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels) {
-			ID3D11Texture2D* out = nullptr;
-			D3D11_TEXTURE2D_DESC desc;
-			ZeroMemory(&desc, sizeof(desc));
-			desc.Width = width;
-			desc.Height = height;
-			desc.MipLevels = 1;
-			desc.ArraySize = 1;
-			desc.Format = (DXGI_FORMAT)textureFormat;
-			desc.SampleDesc.Count = 1;
-			desc.Usage = D3D11_USAGE_DEFAULT;
-			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-			desc.CPUAccessFlags = 0;
-			desc.MiscFlags = 0;
-
-			HRESULT hr = dev->CreateTexture2D(&desc, nullptr, &out);
+		bool Compile(std::string const& source, const char* entryPoint, const char* target, uint32_t flags, std::vector<uint8_t>& out) override {
+			ID3DBlob* buf = nullptr;
+			ID3DBlob* err = nullptr;
 
-			if (SUCCEEDED(hr)) {
-				if (pixels) {
-					D3D11_TEXTURE2D_DESC desc;
-					out->GetDesc(&desc);
-					devcon->UpdateSubresource(out, 0, nullptr, pixels, desc.Width * sizeof(UINT), 0);
+			auto hr = D3DCompile(source.c_str(), source.length(), 0, nullptr, nullptr, entryPoint, target, flags, 0, &buf, &err);
+			if (FAILED(hr)) {
+				if (err) {
+					char szError[256]{ 0 };
+					memcpy(szError, err->GetBufferPointer(), (std::min)(static_cast<size_t>(err->GetBufferSize()), sizeof(szError) - 1));
+					MessageBoxA(nullptr, szError, "Error", MB_OK);
 				}
+				Release(err);
+				return false;
 			}
 
-			return out;
+			const uint8_t* data = static_cast<const uint8_t*>(buf->GetBufferPointer());
+			out.assign(data, data + buf->GetBufferSize());
+			Release(buf);
+			Release(err);
+			return true;
 		}
-
 	};
 #endif
 
-#ifdef SIRE_DX12
-	struct SireDirectX12 : SireRenderer {
+#ifdef SIRE_DX10
+	struct SireDirectX10 SIRE_FINAL : SireRenderer {
 		IDXGISwapChain* swapchain;
-		ID3D12Device* dev;
-		ID3D12CommandQueue* commandQueue;
-		ID3D12CommandAllocator* commandAllocator;
-		ID3D12GraphicsCommandList* commandList;
-		ID3D12DescriptorHeap* descriptorHeap;
-		ID3D12Resource* vertexBuffer;
-		ID3D12Resource* indexBuffer;
-		ID3D12Resource* constantBuffer;
-		ID3D12DescriptorHeap* samplerHeap;
-		ID3D12RootSignature* rootSignature;
-		ID3D12PipelineState* pipelineState;
-		ID3D12ShaderReflection* vertexShader;
-		ID3D12ShaderReflection* pixelShader;
-		ID3D12ShaderReflection* internalVertexShader;
-		ID3D12ShaderReflection* internalPixelShader;
-		ID3D12Resource* tex;
-		ID3D12Resource* mask;
+		ID3D10Device* dev;
+		ID3D10Buffer* vb;
+		ID3D10Buffer* ib;
+		ID3D10Buffer* pb;
+		ID3D10SamplerState* ss;
+		ID3D10InputLayout* inputLayout;
+		ID3D10VertexShader* vertexShader;
+		ID3D10PixelShader* pixelShader;
+		ID3D10VertexShader* internalVertexShader;
+		ID3D10PixelShader* internalPixelShader;
+		ID3D10ShaderResourceView* tex;
+		ID3D10ShaderResourceView* mask;
+		ID3D10RasterizerState* rasterizerState;
+		ID3D10DepthStencilState* depthStencilState;
+		ID3D10BlendState* blendState;
+		FLOAT blendFactor[4];
+		UINT sampleMask;
+		UINT stencilRef;
+		ID3D10Query* timingDisjoint[SIRE_TIMING_FRAMES];
+		std::vector<ID3D10Query*> timestamps[SIRE_TIMING_FRAMES];
+		SireD3DCompiler compiler;
 
-		SireDirectX12() : SireRenderer() {
+		// Start virtual override
+		SireDirectX10() : SireRenderer() {
 			swapchain = nullptr;
 			dev = nullptr;
-			commandQueue = nullptr;
-			commandAllocator = nullptr;
-			commandList = nullptr;
-			descriptorHeap = nullptr;
-			vertexBuffer = nullptr;
-			indexBuffer = nullptr;
-			constantBuffer = nullptr;
-			samplerHeap = nullptr;
-			rootSignature = nullptr;
-			pipelineState = nullptr;
+			vb = nullptr;
+			ib = nullptr;
+			pb = nullptr;
+			ss = nullptr;
+			inputLayout = nullptr;
 			vertexShader = nullptr;
 			pixelShader = nullptr;
 			internalVertexShader = nullptr;
 			internalPixelShader = nullptr;
 			tex = nullptr;
 			mask = nullptr;
+			rasterizerState = nullptr;
+			depthStencilState = nullptr;
+			blendState = nullptr;
+			blendFactor[0] = 0.0f;
+			blendFactor[1] = 0.0f;
+			blendFactor[2] = 0.0f;
+			blendFactor[3] = 0.0f;
+			sampleMask = 0;
+			stencilRef = 0;
+			for (uint32_t i = 0; i < SIRE_TIMING_FRAMES; i++)
+				timingDisjoint[i] = nullptr;
+			textureFormat = SIRE_PIXEL_FORMAT_RGBA8;
+		}
+
+		bool IsRendererActive() override {
+			if (initialised && swapchain && dev) {
+				HRESULT hr = dev->GetDeviceRemovedReason();
+				return SUCCEEDED(hr);
+			}
+
+			return false;
 		}
 
 		void Init(uintptr_t* ptr) override {
@@ -2479,109 +3433,80 @@ private:
 				return;
 
 			swapchain = reinterpret_cast<IDXGISwapChain*>(ptr);
-			HRESULT hResult = swapchain->GetDevice(__uuidof(ID3D11Device), (void**)&dev);
+			HRESULT hResult = swapchain->GetDevice(__uuidof(ID3D10Device), (void**)&dev);
 
 			if (FAILED(hResult))
 				return;
 
-			dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, __uuidof(ID3D12CommandAllocator), (void**)&commandAllocator);
-
-			if (!commandAllocator)
-				return;
-
-			dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocator, nullptr, __uuidof(ID3D12GraphicsCommandList), (void**)&commandList);
-
-			commandList->Close();
-
 			DXGI_SWAP_CHAIN_DESC swapChainDesc;
 			ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
 			swapchain->GetDesc(&swapChainDesc);
 
+			textureFormat = GetPixelFormat(swapChainDesc.BufferDesc.Format, textureFormat);
+
 			hWnd = swapChainDesc.OutputWindow;
-			textureFormat = swapChainDesc.BufferDesc.Format;
 
-			D3D12_RESOURCE_DESC bufferDesc;
+			D3D10_BUFFER_DESC bufferDesc;
 			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
 
-			bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-			bufferDesc.Alignment = 0;
-			bufferDesc.Width = sizeof(tVertex) * 65536;
-			bufferDesc.Height = 1;
-			bufferDesc.DepthOrArraySize = 1;
-			bufferDesc.MipLevels = 1;
-			bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
-			bufferDesc.SampleDesc.Count = 1;
-			bufferDesc.SampleDesc.Quality = 0;
-			bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-			bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-			D3D12_HEAP_PROPERTIES heapProp;
-			ZeroMemory(&heapProp, sizeof(heapProp));
-			heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
+			bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
+			bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+			bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+			bufferDesc.MiscFlags = 0;
+			bufferDesc.ByteWidth = sizeof(tVertex) * 65536;
 
 			// Vertex buffer
-			dev->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-										 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, __uuidof(ID3D12Resource), (void**)&vertexBuffer);
+			dev->CreateBuffer(&bufferDesc, nullptr, &vb);
 
 			// Index buffer
-			bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-			dev->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-										 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, __uuidof(ID3D12Resource), (void**)&indexBuffer);
+			bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
+			dev->CreateBuffer(&bufferDesc, nullptr, &ib);
 
 			// Constant buffer
-			bufferDesc.Width = sizeof(tConstBuff);
-			dev->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-										 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, __uuidof(ID3D12Resource), (void**)&constantBuffer);
+			bufferDesc.BindFlags = D3D10_BIND_CONSTANT_BUFFER;
+			bufferDesc.ByteWidth = sizeof(tConstBuff);
 
-			D3D12_SAMPLER_DESC samplerDesc;
+			D3D10_SUBRESOURCE_DATA initData;
+			ZeroMemory(&initData, sizeof(initData));
+			initData.pSysMem = &cb;
+			dev->CreateBuffer(&bufferDesc, &initData, &pb);
+
+			D3D10_SAMPLER_DESC samplerDesc;
 			ZeroMemory(&samplerDesc, sizeof(samplerDesc));
-			samplerDesc.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
-			samplerDesc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-			samplerDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-			samplerDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+			samplerDesc.Filter = D3D10_FILTER_MIN_MAG_MIP_LINEAR;
+			samplerDesc.AddressU = D3D10_TEXTURE_ADDRESS_WRAP;
+			samplerDesc.AddressV = D3D10_TEXTURE_ADDRESS_WRAP;
+			samplerDesc.AddressW = D3D10_TEXTURE_ADDRESS_WRAP;
 			samplerDesc.MipLODBias = 0.0f;
 			samplerDesc.MaxAnisotropy = 1;
-			samplerDesc.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+			samplerDesc.ComparisonFunc = D3D10_COMPARISON_NEVER;
 			samplerDesc.BorderColor[0] = 0.0f;
 			samplerDesc.BorderColor[1] = 0.0f;
 			samplerDesc.BorderColor[2] = 0.0f;
 			samplerDesc.BorderColor[3] = 0.0f;
-			samplerDesc.MinLOD = 0.0f;
-			samplerDesc.MaxLOD = D3D12_FLOAT32_MAX;
-
-			dev->CreateSampler(&samplerDesc, samplerHeap->GetCPUDescriptorHandleForHeapStart());
+			samplerDesc.MinLOD = 0;
+			samplerDesc.MaxLOD = D3D10_FLOAT32_MAX;
+			dev->CreateSamplerState(&samplerDesc, &ss);
 
 			// Init shaders
-			ID3DBlob* VS = CompileShader(hlslShader5_0, "VShader", "vs_5_0");
-			ID3DBlob* PS = CompileShader(hlslShader5_0, "PShader", "ps_5_0");
+			std::vector<uint8_t> VS = CompileShader(hlslShader4_0, "VShader", "vs_4_0");
+			std::vector<uint8_t> PS = CompileShader(hlslShader4_0, "PShader", "ps_4_0");
 
-			internalVertexShader = CreateShaderReflection(VS->GetBufferPointer(), VS->GetBufferSize());
-			internalPixelShader = CreateShaderReflection(PS->GetBufferPointer(), PS->GetBufferSize());
-
-			D3D12_DESCRIPTOR_RANGE descriptorRange;
-			descriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-			descriptorRange.NumDescriptors = 1;
-			descriptorRange.BaseShaderRegister = 0;
-			descriptorRange.RegisterSpace = 0;
-			descriptorRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
+			if (VS.empty() || PS.empty())
+				return;
 
-			D3D12_ROOT_PARAMETER rootParameters[1];
-			rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-			rootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
-			rootParameters[0].DescriptorTable.pDescriptorRanges = &descriptorRange;
-			rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+			internalVertexShader = CreateVertexShader(VS.data(), VS.size());
+			internalPixelShader = CreatePixelShader(PS.data(), PS.size());
 
-			D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc;
-			rootSignatureDesc.NumParameters = 1;
-			rootSignatureDesc.pParameters = rootParameters;
-			rootSignatureDesc.NumStaticSamplers = 0;
-			rootSignatureDesc.pStaticSamplers = nullptr;
-			rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+			// Init input layout
+			std::vector<D3D10_INPUT_ELEMENT_DESC> layout = {
+				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+				{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 28, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+			};
 
-			ID3DBlob* signature;
-			ID3DBlob* error;
-			D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &signature, &error);
-			dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
+			inputLayout = CreateInputLayout(&layout, VS.data(), VS.size());
 
 			initialised = true;
 		}
@@ -2590,14 +3515,16 @@ private:
 			if (!initialised)
 				return;
 
-			Release(vertexBuffer);
-			Release(indexBuffer);
-			Release(constantBuffer);
-			Release(rootSignature);
-			Release(internalVertexShader);
-			Release(internalPixelShader);
-
-			vertexShader = nullptr;
+			Release(vb);
+			Release(ib);
+			Release(pb);
+			Release(ss);
+			Release(inputLayout);
+			Release(internalVertexShader);
+			Release(internalPixelShader);
+			ReleaseTiming();
+
+			vertexShader = nullptr;
 			pixelShader = nullptr;
 
 			swapchain = nullptr;
@@ -2607,1306 +3534,9730 @@ private:
 		}
 
 		void Begin() override {
-
+			dev->RSGetState(&rasterizerState);
+			dev->OMGetDepthStencilState(&depthStencilState, &stencilRef);
+			dev->OMGetBlendState(&blendState, blendFactor, &sampleMask);
 		}
 
 		void End() override {
-			// Fallback to internal shaders if unset.
-			if (!pixelShader && internalPixelShader)
-				pixelShader = internalPixelShader;
+			// Update index/vertex buffers
+			void* out;
+			vb->Map(D3D10_MAP_WRITE_DISCARD, 0, &out);
+			memcpy(out, vertices.data(), vertices.size() * sizeof(tVertex));
+			vb->Unmap();
 
-			if (!vertexShader && internalVertexShader)
-				vertexShader = internalVertexShader;
+			if (numIndices) {
+				ib->Map(D3D10_MAP_WRITE_DISCARD, 0, &out);
+				memcpy(out, indices.data(), numIndices * sizeof(uint16_t));
+				ib->Unmap();
+			}
 
+			Draw(vb, ib, static_cast<uint32_t>(vertices.size()), numIndices);
 		}
 
-		void SetRenderStates(tRenderState const& s) override {
+		void DrawMesh(uintptr_t* vertexBuffer, uintptr_t* indexBuffer, uint32_t vertexCount, uint32_t indexCount) override {
+			Draw(reinterpret_cast<ID3D10Buffer*>(vertexBuffer), reinterpret_cast<ID3D10Buffer*>(indexBuffer), vertexCount, indexCount);
+		}
+
+		bool CreateMesh(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, uintptr_t** vertexBuffer, uintptr_t** indexBuffer) override {
+			ID3D10Buffer* meshVertexBuffer = nullptr;
+			ID3D10Buffer* meshIndexBuffer = nullptr;
+
+			D3D10_BUFFER_DESC bufferDesc;
+			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+			bufferDesc.Usage = D3D10_USAGE_IMMUTABLE;
+			bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+			bufferDesc.ByteWidth = sizeof(tVertex) * vertexCount;
+
+			D3D10_SUBRESOURCE_DATA initData;
+			ZeroMemory(&initData, sizeof(initData));
+			initData.pSysMem = v;
+
+			if (FAILED(dev->CreateBuffer(&bufferDesc, &initData, &meshVertexBuffer)))
+				return false;
+
+			if (indexCount) {
+				bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
+				bufferDesc.ByteWidth = sizeof(uint16_t) * indexCount;
+				initData.pSysMem = i;
 
+				if (FAILED(dev->CreateBuffer(&bufferDesc, &initData, &meshIndexBuffer))) {
+					Release(meshVertexBuffer);
+					return false;
+				}
+			}
+
+			*vertexBuffer = reinterpret_cast<uintptr_t*>(meshVertexBuffer);
+			*indexBuffer = reinterpret_cast<uintptr_t*>(meshIndexBuffer);
+			return true;
 		}
 
-		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+		void ClearRenderTarget(uintptr_t* rtv, tSireFloat4 const& color) override {
+			dev->ClearRenderTargetView(reinterpret_cast<ID3D10RenderTargetView*>(rtv), &color.x);
+		}
+
+		void UpdateTexture(uintptr_t* surface, uint32_t width, uint32_t height, uint8_t* pixels) override {
+			dev->UpdateSubresource(reinterpret_cast<ID3D10Texture2D*>(surface), 0, nullptr, pixels, width * sizeof(UINT), 0);
+		}
+
+		// Fans were dropped in D3D10, 0xFFFF always cuts strips drawn with 16-bit indices.
+		bool SupportsTopology(eSirePrimitiveType type, bool restart) override {
+			return type != SIRE_TRIANGLE_FAN && (!restart || type == SIRE_LINE_STRIP || type == SIRE_TRIANGLE_STRIP);
+		}
+
+		void SetRenderStates(tRenderState const& s) override {
+			D3D10_RASTERIZER_DESC rasterizerDesc;
+			ZeroMemory(&rasterizerDesc, sizeof(rasterizerDesc));
+			rasterizerDesc.CullMode = (D3D10_CULL_MODE)s.cullMode;
+			rasterizerDesc.FillMode = (D3D10_FILL_MODE)s.fillMode;
+			ID3D10RasterizerState* rasterizerState = nullptr;
+			dev->CreateRasterizerState(&rasterizerDesc, &rasterizerState);
+			dev->RSSetState(rasterizerState);
+			Release(rasterizerState);
+
+			D3D10_BLEND_DESC blendDesc;
+			ZeroMemory(&blendDesc, sizeof(blendDesc));
+			blendDesc.BlendEnable[0] = s.blendEnable;
+			blendDesc.SrcBlend = (D3D10_BLEND)s.srcBlend;
+			blendDesc.DestBlend = (D3D10_BLEND)s.dstBlend;
+			blendDesc.BlendOp = (D3D10_BLEND_OP)s.blendop;
+			blendDesc.SrcBlendAlpha = (D3D10_BLEND)s.srcBlendAlpha;
+			blendDesc.DestBlendAlpha = (D3D10_BLEND)s.destBlendAlpha;
+			blendDesc.BlendOpAlpha = (D3D10_BLEND_OP)s.blendOpAlpha;
+			blendDesc.RenderTargetWriteMask[0] = s.renderTargetWriteMask;
 
+			ID3D10BlendState* blendState = nullptr;
+			dev->CreateBlendState(&blendDesc, &blendState);
+			float blendFactor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			dev->OMSetBlendState(blendState, blendFactor, s.sampleMask);
+			blendState->Release();
 		}
 
 		void SetViewport(tSireViewport const& v) override {
+			D3D10_VIEWPORT vp = {};
+			vp.TopLeftX = v.x;
+			vp.TopLeftY = v.y;
+			vp.Width = v.w;
+			vp.Height = v.h;
+			vp.MinDepth = v.mind;
+			vp.MaxDepth = v.maxd;
+			dev->RSSetViewports(1, &vp);
+		}
 
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+			dev->CopyResource(reinterpret_cast<ID3D10Resource*>(dst), reinterpret_cast<ID3D10Resource*>(src));
 		}
 
 		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
 			cb.hasTex = texture ? true : false;
 			cb.hasMask = textureMask ? true : false;
 
-			texture = nullptr;
-			textureMask = nullptr;
+			tex = nullptr;
+			mask = nullptr;
 
 			if (texture)
-				tex = reinterpret_cast<ID3D12Resource*>(texture);
+				tex = reinterpret_cast<ID3D10ShaderResourceView*>(texture);
 
 			if (textureMask)
-				mask = reinterpret_cast<ID3D12Resource*>(textureMask);
+				mask = reinterpret_cast<ID3D10ShaderResourceView*>(textureMask);
 		}
 
+		uint8_t* Lock(void* ptr) {
+			D3D10_MAPPED_TEXTURE2D map;
+			if (FAILED(reinterpret_cast<ID3D10Texture2D*>(ptr)->Map(0, D3D10_MAP_READ, 0, &map)))
+				return nullptr;
 
-		uint8_t* Lock(void* ptr) override {
-			return nullptr;
+			return (uint8_t*)map.pData;
 		}
 
-		void Unlock(void* ptr) override {
+		void Unlock(void* ptr) {
+			reinterpret_cast<ID3D10Texture2D*>(ptr)->Unmap(0);
+		}
+
+		void SetPixelShader(uintptr_t* ps) override {
+			pixelShader = (ID3D10PixelShader*)ps;
+		}
+
+		void SetVertexShader(uintptr_t* vs) override {
+			vertexShader = (ID3D10VertexShader*)vs;
+		}
+
+		uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVersion) override {
+			std::vector<uint8_t> buf = CompileShader(shaderCode, "main", targetVersion);
+			if (buf.empty())
+				return nullptr;
+
+			return (uintptr_t*)CreatePixelShader(buf.data(), buf.size());
+		}
+
+		uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVersion) override {
+			std::vector<uint8_t> buf = CompileShader(shaderCode, "main", targetVersion);
+			if (buf.empty())
+				return nullptr;
+
+			return (uintptr_t*)CreateVertexShader(buf.data(), buf.size());
+		}
+
+		// Timestamps are only valid when the disjoint query around the frame says so.
+		bool BeginTiming(uint32_t slot) override {
+			if (!timingDisjoint[slot]) {
+				D3D10_QUERY_DESC desc = { D3D10_QUERY_TIMESTAMP_DISJOINT, 0 };
+				if (FAILED(dev->CreateQuery(&desc, &timingDisjoint[slot])))
+					return false;
+			}
+
+			timingDisjoint[slot]->Begin();
+			return true;
+		}
+
+		void WriteTimestamp(uint32_t slot, uint32_t index) override {
+			std::vector<ID3D10Query*>& queries = timestamps[slot];
+			while (queries.size() <= index) {
+				ID3D10Query* query = nullptr;
+				D3D10_QUERY_DESC desc = { D3D10_QUERY_TIMESTAMP, 0 };
+				if (FAILED(dev->CreateQuery(&desc, &query)))
+					return;
+
+				queries.push_back(query);
+			}
+
+			queries[index]->End();
+		}
+
+		void EndTiming(uint32_t slot) override {
+			timingDisjoint[slot]->End();
+		}
+
+		bool ReadTimestamps(uint32_t slot, uint32_t count, uint64_t* out, uint64_t& frequency) override {
+			D3D10_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+			HRESULT hr = timingDisjoint[slot]->GetData(&disjoint, sizeof(disjoint), D3D10_ASYNC_GETDATA_DONOTFLUSH);
+			if (hr == S_FALSE)
+				return false;
 
+			frequency = SUCCEEDED(hr) && !disjoint.Disjoint && count <= timestamps[slot].size() ? disjoint.Frequency : 0;
+			for (uint32_t i = 0; i < count && frequency; i++) {
+				hr = timestamps[slot][i]->GetData(&out[i], sizeof(uint64_t), D3D10_ASYNC_GETDATA_DONOTFLUSH);
+				if (hr == S_FALSE)
+					return false;
+
+				if (FAILED(hr))
+					frequency = 0;
+			}
+
+			return true;
+		}
+
+		// End virtual override	
+
+		void ReleaseTiming() {
+			for (uint32_t i = 0; i < SIRE_TIMING_FRAMES; i++) {
+				Release(timingDisjoint[i]);
+				for (auto& it : timestamps[i])
+					Release(it);
+				timestamps[i].clear();
+			}
 		}
 
-		void SetPixelShader(uintptr_t* ps) override {
+		// Binds the given buffers with the current state, draws and restores the previous pipeline state.
+		void Draw(ID3D10Buffer* vertexBuffer, ID3D10Buffer* indexBuffer, uint32_t vertexCount, uint32_t indexCount) {
+			// Fallback to internal shaders if unset.
+			if (!pixelShader && internalPixelShader)
+				pixelShader = internalPixelShader;
+
+			if (!vertexShader && internalVertexShader)
+				vertexShader = internalVertexShader;
+
+			// Update
+			void* out;
+			tConstBuff tempcb = cb;
+			tempcb.matrix.Transpose();
+
+			pb->Map(D3D10_MAP_WRITE_DISCARD, 0, &out);
+			memcpy(out, &tempcb, sizeof(tempcb));
+			pb->Unmap();
+
+			ID3D10InputLayout* prevInputLayout = nullptr;
+			dev->IAGetInputLayout(&prevInputLayout);
+			dev->IASetInputLayout(inputLayout);
+
+			auto prevRenderTargets = GetRenderTargets();
+			auto prevStencilView = GetDepthStencilView();
+
+			if (currentRenderTargetView)
+				dev->OMSetRenderTargets(1, (ID3D10RenderTargetView**)&currentRenderTargetView, nullptr);
+
+			ID3D10VertexShader* prevVertexShader = nullptr;
+			dev->VSGetShader(&prevVertexShader);
+			dev->VSSetShader(vertexShader);
+
+			ID3D10PixelShader* prevPixelShader = nullptr;
+			dev->PSGetShader(&prevPixelShader);
+			dev->PSSetShader(pixelShader);
+
+			ID3D10Buffer* prevVertexConstantBuffer = nullptr;
+			dev->VSGetConstantBuffers(0, 1, &prevVertexConstantBuffer);
+			dev->VSSetConstantBuffers(0, 1, &pb);
+
+			ID3D10Buffer* prevPixelConstantBuffer = nullptr;
+			dev->PSGetConstantBuffers(0, 1, &prevPixelConstantBuffer);
+			dev->PSSetConstantBuffers(0, 1, &pb);
+
+			// Set textures
+			ID3D10ShaderResourceView* prevVertexShaderResourceView0 = nullptr;
+			dev->VSGetShaderResources(0, 1, &prevVertexShaderResourceView0);
+			dev->VSSetShaderResources(0, 1, &tex);
+
+			ID3D10ShaderResourceView* prevVertexShaderResourceView1 = nullptr;
+			dev->VSGetShaderResources(1, 1, &prevVertexShaderResourceView1);
+			dev->VSSetShaderResources(1, 1, &mask);
+
+			ID3D10ShaderResourceView* prevPixelShaderResourceView0 = nullptr;
+			dev->PSGetShaderResources(0, 1, &prevPixelShaderResourceView0);
+			dev->PSSetShaderResources(0, 1, &tex);
+
+			ID3D10ShaderResourceView* prevPixelShaderResourceView1 = nullptr;
+			dev->PSGetShaderResources(1, 1, &prevPixelShaderResourceView1);
+			dev->PSSetShaderResources(1, 1, &mask);
+
+			ID3D10SamplerState* prevPixelSamplers = nullptr;
+			dev->PSGetSamplers(0, 1, &prevPixelSamplers);
+			dev->PSSetSamplers(0, 1, &ss);
+
+			ID3D10SamplerState* prevVertexSamplers = nullptr;
+			dev->GSGetSamplers(0, 1, &prevVertexSamplers);
+			dev->GSSetSamplers(0, 1, &ss);
+
+			// Set index/vertex buffers
+			UINT stride = sizeof(tVertex);
+			UINT offset = 0;
+
+			UINT prevStride;
+			UINT prevVertexOffset;
+			ID3D10Buffer* prevVertexBuffers = nullptr;
+			dev->IAGetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
+			dev->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+
+			ID3D10Buffer* prevIndexBuffers = nullptr;
+			DXGI_FORMAT prevFormat;
+			UINT prevIndexOffset;
+			dev->IAGetIndexBuffer(&prevIndexBuffers, &prevFormat, &prevIndexOffset);
+			dev->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+
+			D3D_PRIMITIVE_TOPOLOGY type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+			switch (primitiveType) {
+				case SIRE_LINE:
+					type = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
+					break;
+				case SIRE_POINT:
+					type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+					break;
+				case SIRE_TRIANGLE:
+					type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+					break;
+				case SIRE_LINE_STRIP:
+					type = D3D_PRIMITIVE_TOPOLOGY_LINESTRIP;
+					break;
+				case SIRE_TRIANGLE_STRIP:
+					type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+					break;
+			}
+
+			D3D_PRIMITIVE_TOPOLOGY prevType;
+			dev->IAGetPrimitiveTopology(&prevType);
+			dev->IASetPrimitiveTopology(type);
+
+			// Draw
+			if (indexCount)
+				dev->DrawIndexed(indexCount, 0, 0);
+			else
+				dev->Draw(vertexCount, 0);
+
+			// Restore shit
+			dev->OMSetRenderTargets(1, &prevRenderTargets[0], prevStencilView);
+
+			Release(prevRenderTargets, D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT);
+			Release(prevStencilView);
+
+			dev->IASetInputLayout(prevInputLayout);
+			Release(prevInputLayout);
+
+			dev->VSSetShader(prevVertexShader);
+			Release(prevVertexShader);
+
+			dev->PSSetShader(prevPixelShader);
+			Release(prevPixelShader);
+
+			dev->VSSetConstantBuffers(0, 1, &prevVertexConstantBuffer);
+			Release(prevVertexConstantBuffer);
+
+			dev->PSSetConstantBuffers(0, 1, &prevPixelConstantBuffer);
+			Release(prevPixelConstantBuffer);
+
+			dev->VSSetShaderResources(0, 1, &prevVertexShaderResourceView0);
+			Release(prevVertexShaderResourceView0);
+
+			dev->VSSetShaderResources(1, 1, &prevVertexShaderResourceView1);
+			Release(prevVertexShaderResourceView1);
+
+			dev->PSSetShaderResources(0, 1, &prevPixelShaderResourceView0);
+			Release(prevPixelShaderResourceView0);
+
+			dev->PSSetShaderResources(1, 1, &prevPixelShaderResourceView1);
+			Release(prevPixelShaderResourceView1);
+
+			dev->PSSetSamplers(0, 1, &prevPixelSamplers);
+			Release(prevPixelSamplers);
+
+			dev->GSSetSamplers(0, 1, &prevVertexSamplers);
+			Release(prevVertexSamplers);
+
+			dev->IASetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
+			Release(prevVertexBuffers);
+
+			dev->IASetIndexBuffer(prevIndexBuffers, prevFormat, prevIndexOffset);
+			Release(prevIndexBuffers);
+
+			dev->IASetPrimitiveTopology(prevType);
+
+			dev->RSSetState(rasterizerState);
+			Release(rasterizerState);
+
+			dev->OMSetDepthStencilState(depthStencilState, stencilRef);
+			Release(depthStencilState);
+
+			dev->OMSetBlendState(blendState, blendFactor, sampleMask);
+			Release(blendState);
+		}
+
+		void SetVertices(tVertex const& v) override {
+
+		}
+
+		ID3D10RenderTargetView** GetRenderTargets() {
+			static ID3D10RenderTargetView* out[D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+			memset(out, 0, sizeof(out));
+			dev->OMGetRenderTargets(D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT, out, nullptr);
+			return out;
+		}
+
+		ID3D10DepthStencilView* GetDepthStencilView() {
+			static ID3D10DepthStencilView* out = {};
+			out = nullptr;
+			dev->OMGetRenderTargets(1, nullptr, &out);
+			return out;
+		}
+
+		ID3D10Texture2D* GetBackBuffer(uint32_t buffer) {
+			ID3D10Texture2D* out = nullptr;
+			swapchain->GetBuffer(buffer, __uuidof(ID3D10Texture2D), reinterpret_cast<void**>(&out));
+			return out;
+		}
+
+		D3D10_TEXTURE2D_DESC GetDesc(ID3D10Texture2D* texture) {
+			D3D10_TEXTURE2D_DESC out = {};
+			texture->GetDesc(&out);
+			return out;
+		}
+
+		ID3D10RenderTargetView* CreateRenderTarget(ID3D10Texture2D* texture) {
+			ID3D10RenderTargetView* out;
+			dev->CreateRenderTargetView(texture, nullptr, &out);
+			return out;
+		}
+
+		// Returns a copy of texture that can be bound as a render target, or nullptr when texture already can be or the copy fails.
+		ID3D10Texture2D* CreateRenderTargetCopy(ID3D10Texture2D* texture) {
+			D3D10_TEXTURE2D_DESC desc = GetDesc(texture);
+			if (desc.BindFlags & D3D10_BIND_RENDER_TARGET)
+				return nullptr;
+
+			desc.BindFlags |= D3D10_BIND_RENDER_TARGET;
+
+			ID3D10Texture2D* out = nullptr;
+			if (FAILED(dev->CreateTexture2D(&desc, nullptr, &out)))
+				return nullptr;
+
+			dev->CopyResource(out, texture);
+			return out;
+		}
+
+		std::vector<uint8_t> CompileShader(std::string const& str, const char* szEntrypoint, const char* szTarget) {
+			std::vector<uint8_t> out;
+			shaderCache.Compile(GetShaderCompiler(&compiler), str, szEntrypoint, szTarget, D3DCOMPILE_ENABLE_STRICTNESS, out);
+			return out;
+		}
+
+		ID3D10VertexShader* CreateVertexShader(const void* buffer, size_t size) {
+			ID3D10VertexShader* out = nullptr;
+			dev->CreateVertexShader(buffer, size, &out);
+			return out;
+		}
+
+		ID3D10PixelShader* CreatePixelShader(const void* buffer, size_t size) {
+			ID3D10PixelShader* out = nullptr;
+			dev->CreatePixelShader(buffer, size, &out);
+			return out;
+		}
+
+		ID3D10InputLayout* CreateInputLayout(std::vector<D3D10_INPUT_ELEMENT_DESC>* layout, const void* buffer, size_t size) {
+			ID3D10InputLayout* out = nullptr;
+			dev->CreateInputLayout(layout->data(), static_cast<uint32_t>(layout->size()), buffer, size, &out);
+			return out;
+		}
+
+		void GenerateMips(ID3D10ShaderResourceView* view) {
+			dev->GenerateMips(view);
+		}
+
+		ID3D10ShaderResourceView* CreateShaderResourceView(ID3D10Texture2D* texture) {
+			ID3D10ShaderResourceView* out = nullptr;
+			dev->CreateShaderResourceView(texture, nullptr, &out);
+			return out;
+		}
+
+		ID3D10BlendState* GetBlendState(float* blendFactor, uint32_t* sampleMask) {
+			ID3D10BlendState* out;
+			dev->OMGetBlendState(&out, blendFactor, sampleMask);
+			return out;
+		}
+
+		D3D10_BLEND_DESC GetBlendDesc(ID3D10BlendState* blendState) {
+			D3D10_BLEND_DESC out;
+			blendState->GetDesc(&out);
+			return out;
+		}
+
+		void SetBlendState(D3D10_BLEND_DESC* blendStateDesc, float* blendFactor, uint32_t sampleMask) {
+			ID3D10BlendState* blendState = nullptr;
+			dev->CreateBlendState(blendStateDesc, &blendState);
+			dev->OMSetBlendState(blendState, blendFactor, sampleMask);
+			Release(blendState);
+		}
+
+		void SetShaders(ID3D10VertexShader* v, ID3D10PixelShader* p) {
+			vertexShader = v;
+			pixelShader = p;
+		}
+
+		D3D10_VIEWPORT GetViewport() {
+			uint32_t numViewport = D3D10_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+			D3D10_VIEWPORT out[D3D10_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+
+			dev->RSGetViewports(&numViewport, out);
+			return out[0];
+		}
+
+		// BC7 came with D3D11. blocks holds mipLevels levels back to back.
+		ID3D10Texture2D* CreateCompressedTexture(uint32_t width, uint32_t height, eSirePixelFormat format, uint8_t const* blocks, uint32_t mipLevels = 1) {
+			D3D10_TEXTURE2D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = width;
+			desc.Height = height;
+			desc.MipLevels = mipLevels;
+			desc.ArraySize = 1;
+			desc.SampleDesc.Count = 1;
+			desc.Usage = D3D10_USAGE_IMMUTABLE;
+			desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+
+			if (format == SIRE_PIXEL_FORMAT_BC7)
+				return nullptr;
+
+			desc.Format = GetDxgiFormat(format);
+
+			std::vector<D3D10_SUBRESOURCE_DATA> data(mipLevels);
+			for (uint32_t i = 0; i < mipLevels; i++) {
+				data[i].pSysMem = blocks;
+				data[i].SysMemPitch = GetCompressedRowSize(format, width);
+				blocks += GetCompressedSize(format, width, height);
+				width = (std::max)(width >> 1, 1u);
+				height = (std::max)(height >> 1, 1u);
+			}
+
+			ID3D10Texture2D* out = nullptr;
+			dev->CreateTexture2D(&desc, data.data(), &out);
+			return out;
+		}
+
+		// mipPixels holds levels 1 to mipLevels - 1 back to back. With generateMips the chain is filled by GenerateMips once the view exists.
+		ID3D10Texture2D* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels, uint32_t mipLevels = 1, uint8_t* mipPixels = nullptr, bool generateMips = false) {
+			ID3D10Texture2D* out = nullptr;
+			D3D10_TEXTURE2D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = width;
+			desc.Height = height;
+			desc.MipLevels = generateMips ? 0 : mipLevels;
+			desc.ArraySize = 1;
+			desc.Format = GetDxgiFormat(textureFormat);
+			desc.SampleDesc.Count = 1;
+			desc.Usage = D3D10_USAGE_DEFAULT;
+			// GenerateMips renders the chain, other textures get render target binding from CreateRenderTargetView.
+			desc.BindFlags = D3D10_BIND_SHADER_RESOURCE | (generateMips ? D3D10_BIND_RENDER_TARGET : 0);
+			desc.CPUAccessFlags = 0;
+			desc.MiscFlags = generateMips ? D3D10_RESOURCE_MISC_GENERATE_MIPS : 0;
+
+			HRESULT hr = dev->CreateTexture2D(&desc, nullptr, &out);
+
+			if (SUCCEEDED(hr)) {
+				if (pixels) {
+					D3D10_TEXTURE2D_DESC desc;
+					out->GetDesc(&desc);
+					dev->UpdateSubresource(out, 0, nullptr, pixels, desc.Width * sizeof(UINT), 0);
+				}
+
+				if (mipPixels && !generateMips) {
+					for (uint32_t i = 1; i < mipLevels; i++) {
+						width = (std::max)(width >> 1, 1u);
+						height = (std::max)(height >> 1, 1u);
+
+						dev->UpdateSubresource(out, i, nullptr, mipPixels, width * sizeof(UINT), 0);
+						mipPixels += width * height * 4;
+					}
+				}
+			}
+
+			return out;
+		}
+	};
+#endif
+
+#ifdef SIRE_DX11
+	struct SireDirectX11 SIRE_FINAL : SireRenderer {
+		IDXGISwapChain* swapchain;
+		ID3D11Device* dev;
+		ID3D11DeviceContext* devcon;
+		ID3D11Buffer* vb;
+		ID3D11Buffer* ib;
+		ID3D11Buffer* pb;
+		ID3D11SamplerState* ss;
+		ID3D11InputLayout* inputLayout;
+		ID3D11VertexShader* vertexShader;
+		ID3D11PixelShader* pixelShader;
+		ID3D11VertexShader* internalVertexShader;
+		ID3D11PixelShader* internalPixelShader;
+		ID3D11ShaderResourceView* tex;
+		ID3D11ShaderResourceView* mask;
+		ID3D11RasterizerState* rasterizerState;
+		ID3D11DepthStencilState* depthStencilState;
+		ID3D11BlendState* blendState;
+		FLOAT blendFactor[4];
+		UINT sampleMask;
+		UINT stencilRef;
+		ID3D11Query* timingDisjoint[SIRE_TIMING_FRAMES];
+		std::vector<ID3D11Query*> timestamps[SIRE_TIMING_FRAMES];
+		SireD3DCompiler compiler;
+
+		SireDirectX11() : SireRenderer() {
+			swapchain = nullptr;
+			dev = nullptr;
+			devcon = nullptr;
+			vb = nullptr;
+			ib = nullptr;
+			pb = nullptr;
+			ss = nullptr;
+			inputLayout = nullptr;
+			vertexShader = nullptr;
+			pixelShader = nullptr;
+			internalVertexShader = nullptr;
+			internalPixelShader = nullptr;
+			tex = nullptr;
+			mask = nullptr;
+			rasterizerState = nullptr;
+			depthStencilState = nullptr;
+			blendState = nullptr;
+			blendFactor[0] = 0.0f;
+			blendFactor[1] = 0.0f;
+			blendFactor[2] = 0.0f;
+			blendFactor[3] = 0.0f;
+			sampleMask = 0;
+			stencilRef = 0;
+			for (uint32_t i = 0; i < SIRE_TIMING_FRAMES; i++)
+				timingDisjoint[i] = nullptr;
+			textureFormat = SIRE_PIXEL_FORMAT_RGBA8;
+		}
+
+		// Start virtual override
+		bool IsRendererActive() override {
+			if (initialised && swapchain && dev && devcon) {
+				HRESULT hr = dev->GetDeviceRemovedReason();
+				return SUCCEEDED(hr);
+			}
+
+			return false;
+		}
+
+		void Init(uintptr_t* ptr) override {
+			if (initialised)
+				return;
+
+			swapchain = reinterpret_cast<IDXGISwapChain*>(ptr);
+			HRESULT hResult = swapchain->GetDevice(__uuidof(ID3D11Device), (void**)&dev);
+
+			if (FAILED(hResult)) {
+#ifdef SIRE_DX11ON12
+				if (!d3d11on12::InitD3D11on12Resources(swapchain)) {
+					currentRenderer = SIRE_RENDERER_NULL;
+					return;
+				}
+				else
+					dev = d3d11on12::d3d11Device.Get();
+#else
+				currentRenderer = SIRE_RENDERER_NULL;
+				return;
+#endif
+			}
+
+#ifdef SIRE_DX11ON12
+			if (d3d11on12::isD3D11on12)
+				devcon = d3d11on12::d3d11Context.Get();
+			else
+				dev->GetImmediateContext(&devcon);
+#else
+			dev->GetImmediateContext(&devcon);
+#endif
+
+			DXGI_SWAP_CHAIN_DESC swapChainDesc;
+			ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
+			swapchain->GetDesc(&swapChainDesc);
+
+			hWnd = swapChainDesc.OutputWindow;
+			textureFormat = GetPixelFormat(swapChainDesc.BufferDesc.Format, textureFormat);
+
+			D3D11_BUFFER_DESC bufferDesc;
+			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+
+			bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+			bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+			bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			bufferDesc.MiscFlags = 0;
+			bufferDesc.ByteWidth = sizeof(tVertex) * 65536;
+
+			// Vertex buffer
+			dev->CreateBuffer(&bufferDesc, nullptr, &vb);
+
+			// Index buffer
+			bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+			dev->CreateBuffer(&bufferDesc, nullptr, &ib);
+
+			// Constant buffer
+			bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+			bufferDesc.ByteWidth = sizeof(tConstBuff);
+
+			D3D11_SUBRESOURCE_DATA initData;
+			ZeroMemory(&initData, sizeof(initData));
+			initData.pSysMem = &cb;
+			dev->CreateBuffer(&bufferDesc, &initData, &pb);
+
+			D3D11_SAMPLER_DESC samplerDesc;
+			ZeroMemory(&samplerDesc, sizeof(samplerDesc));
+			samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+			samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+			samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+			samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+			samplerDesc.MipLODBias = 0.0f;
+			samplerDesc.MaxAnisotropy = 1;
+			samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+			samplerDesc.BorderColor[0] = 0.0f;
+			samplerDesc.BorderColor[1] = 0.0f;
+			samplerDesc.BorderColor[2] = 0.0f;
+			samplerDesc.BorderColor[3] = 0.0f;
+			samplerDesc.MinLOD = 0;
+			samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+			dev->CreateSamplerState(&samplerDesc, &ss);
+
+			// Init shaders
+			std::vector<uint8_t> VS = CompileShader(hlslShader5_0, "VShader", "vs_5_0");
+			std::vector<uint8_t> PS = CompileShader(hlslShader5_0, "PShader", "ps_5_0");
+
+			if (VS.empty() || PS.empty())
+				return;
+
+			internalVertexShader = CreateVertexShader(VS.data(), VS.size());
+			internalPixelShader = CreatePixelShader(PS.data(), PS.size());
+
+			// Init input layout
+			std::vector<D3D11_INPUT_ELEMENT_DESC> layout = {
+				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 28, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			};
+
+			inputLayout = CreateInputLayout(&layout, VS.data(), VS.size());
+
+			initialised = true;
+		}
+
+		void Shutdown() override {
+			if (!initialised)
+				return;
+
+			Release(vb);
+			Release(ib);
+			Release(pb);
+			Release(ss);
+			Release(inputLayout);
+			Release(internalVertexShader);
+			Release(internalPixelShader);
+			ReleaseTiming();
+
+			vertexShader = nullptr;
+			pixelShader = nullptr;
+
+			swapchain = nullptr;
+			dev = nullptr;
+			devcon = nullptr;
+
+			initialised = false;
+		}
+
+		void Begin() override {
+			devcon->RSGetState(&rasterizerState);
+			devcon->OMGetDepthStencilState(&depthStencilState, &stencilRef);
+			devcon->OMGetBlendState(&blendState, blendFactor, &sampleMask);
+		}
+
+		void End() override {
+			// Update index/vertex buffers
+			D3D11_MAPPED_SUBRESOURCE mappedResource;
+			devcon->Map(vb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+			memcpy(mappedResource.pData, vertices.data(), vertices.size() * sizeof(tVertex));
+			devcon->Unmap(vb, 0);
+
+			if (numIndices) {
+				ZeroMemory(&mappedResource, sizeof(mappedResource));
+				devcon->Map(ib, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+				memcpy(mappedResource.pData, indices.data(), numIndices * sizeof(uint16_t));
+				devcon->Unmap(ib, 0);
+			}
+
+			Draw(vb, ib, static_cast<uint32_t>(vertices.size()), numIndices);
+		}
+
+		void DrawMesh(uintptr_t* vertexBuffer, uintptr_t* indexBuffer, uint32_t vertexCount, uint32_t indexCount) override {
+			Draw(reinterpret_cast<ID3D11Buffer*>(vertexBuffer), reinterpret_cast<ID3D11Buffer*>(indexBuffer), vertexCount, indexCount);
+		}
+
+		bool CreateMesh(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, uintptr_t** vertexBuffer, uintptr_t** indexBuffer) override {
+			ID3D11Buffer* meshVertexBuffer = nullptr;
+			ID3D11Buffer* meshIndexBuffer = nullptr;
+
+			D3D11_BUFFER_DESC bufferDesc;
+			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+			bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+			bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+			bufferDesc.ByteWidth = sizeof(tVertex) * vertexCount;
+
+			D3D11_SUBRESOURCE_DATA initData;
+			ZeroMemory(&initData, sizeof(initData));
+			initData.pSysMem = v;
+
+			if (FAILED(dev->CreateBuffer(&bufferDesc, &initData, &meshVertexBuffer)))
+				return false;
+
+			if (indexCount) {
+				bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+				bufferDesc.ByteWidth = sizeof(uint16_t) * indexCount;
+				initData.pSysMem = i;
+
+				if (FAILED(dev->CreateBuffer(&bufferDesc, &initData, &meshIndexBuffer))) {
+					Release(meshVertexBuffer);
+					return false;
+				}
+			}
+
+			*vertexBuffer = reinterpret_cast<uintptr_t*>(meshVertexBuffer);
+			*indexBuffer = reinterpret_cast<uintptr_t*>(meshIndexBuffer);
+			return true;
+		}
+
+		void ClearRenderTarget(uintptr_t* rtv, tSireFloat4 const& color) override {
+			devcon->ClearRenderTargetView(reinterpret_cast<ID3D11RenderTargetView*>(rtv), &color.x);
+		}
+
+		void UpdateTexture(uintptr_t* surface, uint32_t width, uint32_t height, uint8_t* pixels) override {
+			devcon->UpdateSubresource(reinterpret_cast<ID3D11Texture2D*>(surface), 0, nullptr, pixels, width * sizeof(UINT), 0);
+		}
+
+		// Fans were dropped in D3D10, 0xFFFF always cuts strips drawn with 16-bit indices.
+		bool SupportsTopology(eSirePrimitiveType type, bool restart) override {
+			return type != SIRE_TRIANGLE_FAN && (!restart || type == SIRE_LINE_STRIP || type == SIRE_TRIANGLE_STRIP);
+		}
+
+		void SetRenderStates(tRenderState const& s) override {
+			D3D11_RASTERIZER_DESC rasterizerDesc;
+			ZeroMemory(&rasterizerDesc, sizeof(rasterizerDesc));
+			rasterizerDesc.CullMode = (D3D11_CULL_MODE)s.cullMode;
+			rasterizerDesc.FillMode = (D3D11_FILL_MODE)s.fillMode;
+			ID3D11RasterizerState* rasterizerState = nullptr;
+			dev->CreateRasterizerState(&rasterizerDesc, &rasterizerState);
+			devcon->RSSetState(rasterizerState);
+			Release(rasterizerState);
+
+			D3D11_BLEND_DESC blendDesc;
+			ZeroMemory(&blendDesc, sizeof(blendDesc));
+			blendDesc.RenderTarget[0].BlendEnable = s.blendEnable;
+			blendDesc.RenderTarget[0].SrcBlend = (D3D11_BLEND)s.srcBlend;
+			blendDesc.RenderTarget[0].DestBlend = (D3D11_BLEND)s.dstBlend;
+			blendDesc.RenderTarget[0].BlendOp = (D3D11_BLEND_OP)s.blendop;
+			blendDesc.RenderTarget[0].SrcBlendAlpha = (D3D11_BLEND)s.srcBlendAlpha;
+			blendDesc.RenderTarget[0].DestBlendAlpha = (D3D11_BLEND)s.destBlendAlpha;
+			blendDesc.RenderTarget[0].BlendOpAlpha = (D3D11_BLEND_OP)s.blendOpAlpha;
+			blendDesc.RenderTarget[0].RenderTargetWriteMask = s.renderTargetWriteMask;
+
+			ID3D11BlendState* blendState = nullptr;
+			dev->CreateBlendState(&blendDesc, &blendState);
+			float blendFactor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			devcon->OMSetBlendState(blendState, blendFactor, s.sampleMask);
+			Release(blendState);
+		}
+
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+			devcon->CopyResource(reinterpret_cast<ID3D11Resource*>(dst), reinterpret_cast<ID3D11Resource*>(src));
+		}
+
+		void SetViewport(tSireViewport const& v) override {
+			D3D11_VIEWPORT vp = {};
+			vp.TopLeftX = v.x;
+			vp.TopLeftY = v.y;
+			vp.Width = v.w;
+			vp.Height = v.h;
+			vp.MinDepth = v.mind;
+			vp.MaxDepth = v.maxd;
+			devcon->RSSetViewports(1, &vp);
+		}
+
+		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
+			cb.hasTex = texture ? true : false;
+			cb.hasMask = textureMask ? true : false;
+
+			tex = nullptr;
+			mask = nullptr;
+
+			if (texture)
+				tex = reinterpret_cast<ID3D11ShaderResourceView*>(texture);
+
+			if (textureMask)
+				mask = reinterpret_cast<ID3D11ShaderResourceView*>(textureMask);
+		}
+
+
+		uint8_t* Lock(void* ptr) override {
+			D3D11_MAPPED_SUBRESOURCE map;
+			if (FAILED(devcon->Map(reinterpret_cast<ID3D11Texture2D*>(ptr), 0, D3D11_MAP_READ, 0, &map)))
+				return nullptr;
+
+			return (uint8_t*)map.pData;
+		}
+
+		void Unlock(void* ptr) override {
+			devcon->Unmap(reinterpret_cast<ID3D11Texture2D*>(ptr), 0);
+		}
+
+		void SetPixelShader(uintptr_t* ps) override {
+			pixelShader = (ID3D11PixelShader*)ps;
+		}
+
+		void SetVertexShader(uintptr_t* vs) override {
+			vertexShader = (ID3D11VertexShader*)vs;
+		}
+
+		uintptr_t* CreatePixelShader(std::string const& shaderCode, const char* targetVersion) override {
+			std::vector<uint8_t> buf = CompileShader(shaderCode, "main", targetVersion);
+			if (buf.empty())
+				return nullptr;
+
+			return (uintptr_t*)CreatePixelShader(buf.data(), buf.size());
+		}
+
+		uintptr_t* CreateVertexShader(std::string const& shaderCode, const char* targetVersion) override {
+			std::vector<uint8_t> buf = CompileShader(shaderCode, "main", targetVersion);
+			if (buf.empty())
+				return nullptr;
+
+			return (uintptr_t*)CreateVertexShader(buf.data(), buf.size());
+		}
+
+		// Timestamps are only valid when the disjoint query around the frame says so.
+		bool BeginTiming(uint32_t slot) override {
+			if (!timingDisjoint[slot]) {
+				D3D11_QUERY_DESC desc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+				if (FAILED(dev->CreateQuery(&desc, &timingDisjoint[slot])))
+					return false;
+			}
+
+			devcon->Begin(timingDisjoint[slot]);
+			return true;
+		}
+
+		void WriteTimestamp(uint32_t slot, uint32_t index) override {
+			std::vector<ID3D11Query*>& queries = timestamps[slot];
+			while (queries.size() <= index) {
+				ID3D11Query* query = nullptr;
+				D3D11_QUERY_DESC desc = { D3D11_QUERY_TIMESTAMP, 0 };
+				if (FAILED(dev->CreateQuery(&desc, &query)))
+					return;
+
+				queries.push_back(query);
+			}
+
+			devcon->End(queries[index]);
+		}
+
+		void EndTiming(uint32_t slot) override {
+			devcon->End(timingDisjoint[slot]);
+		}
+
+		bool ReadTimestamps(uint32_t slot, uint32_t count, uint64_t* out, uint64_t& frequency) override {
+			D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+			HRESULT hr = devcon->GetData(timingDisjoint[slot], &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+			if (hr == S_FALSE)
+				return false;
+
+			frequency = SUCCEEDED(hr) && !disjoint.Disjoint && count <= timestamps[slot].size() ? disjoint.Frequency : 0;
+			for (uint32_t i = 0; i < count && frequency; i++) {
+				hr = devcon->GetData(timestamps[slot][i], &out[i], sizeof(uint64_t), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+				if (hr == S_FALSE)
+					return false;
+
+				if (FAILED(hr))
+					frequency = 0;
+			}
+
+			return true;
+		}
+
+		// End virtual override
+
+		void ReleaseTiming() {
+			for (uint32_t i = 0; i < SIRE_TIMING_FRAMES; i++) {
+				Release(timingDisjoint[i]);
+				for (auto& it : timestamps[i])
+					Release(it);
+				timestamps[i].clear();
+			}
+		}
+
+		// Binds the given buffers with the current state, draws and restores the previous pipeline state.
+		void Draw(ID3D11Buffer* vertexBuffer, ID3D11Buffer* indexBuffer, uint32_t vertexCount, uint32_t indexCount) {
+			// Fallback to internal shaders if unset.
+			if (!pixelShader && internalPixelShader)
+				pixelShader = internalPixelShader;
+
+			if (!vertexShader && internalVertexShader)
+				vertexShader = internalVertexShader;
+
+			// Update
+			tConstBuff tempcb = cb;
+			tempcb.matrix.Transpose();
+
+			D3D11_MAPPED_SUBRESOURCE mappedResource;
+			ZeroMemory(&mappedResource, sizeof(mappedResource));
+			devcon->Map(pb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+			memcpy(mappedResource.pData, &tempcb, sizeof(tempcb));
+			devcon->Unmap(pb, 0);
+
+			ID3D11InputLayout* prevInputLayout = nullptr;
+			devcon->IAGetInputLayout(&prevInputLayout);
+			devcon->IASetInputLayout(inputLayout);
+
+			auto prevRenderTargets = GetRenderTargets();
+			auto prevStencilView = GetDepthStencilView();
+
+			if (currentRenderTargetView) {
+#ifdef SIRE_DX11ON12
+				if (!d3d11on12::isD3D11on12) {
+					devcon->OMSetRenderTargets(1, (ID3D11RenderTargetView**)&currentRenderTargetView, nullptr);
+				}
+#else
+				devcon->OMSetRenderTargets(1, (ID3D11RenderTargetView**)&Sire::currentRenderTargetView, nullptr);
+#endif
+			}
+
+			ID3D11VertexShader* prevVertexShader = nullptr;
+			devcon->VSGetShader(&prevVertexShader, nullptr, 0);
+			devcon->VSSetShader(vertexShader, nullptr, 0);
+
+			ID3D11PixelShader* prevPixelShader = nullptr;
+			devcon->PSGetShader(&prevPixelShader, nullptr, 0);
+			devcon->PSSetShader(pixelShader, nullptr, 0);
+
+			ID3D11Buffer* prevVertexConstantBuffer = nullptr;
+			devcon->VSGetConstantBuffers(0, 1, &prevVertexConstantBuffer);
+			devcon->VSSetConstantBuffers(0, 1, &pb);
+
+			ID3D11Buffer* prevPixelConstantBuffer = nullptr;
+			devcon->PSGetConstantBuffers(0, 1, &prevPixelConstantBuffer);
+			devcon->PSSetConstantBuffers(0, 1, &pb);
+
+			// Set textures
+			ID3D11ShaderResourceView* prevVertexShaderResourceView0 = nullptr;
+			devcon->VSGetShaderResources(0, 1, &prevVertexShaderResourceView0);
+			devcon->VSSetShaderResources(0, 1, &tex);
+
+			ID3D11ShaderResourceView* prevVertexShaderResourceView1 = nullptr;
+			devcon->VSGetShaderResources(1, 1, &prevVertexShaderResourceView1);
+			devcon->VSSetShaderResources(1, 1, &mask);
+
+			ID3D11ShaderResourceView* prevPixelShaderResourceView0 = nullptr;
+			devcon->PSGetShaderResources(0, 1, &prevPixelShaderResourceView0);
+			devcon->PSSetShaderResources(0, 1, &tex);
+
+			ID3D11ShaderResourceView* prevPixelShaderResourceView1 = nullptr;
+			devcon->PSGetShaderResources(1, 1, &prevPixelShaderResourceView1);
+			devcon->PSSetShaderResources(1, 1, &mask);
+
+			ID3D11SamplerState* prevPixelSamplers = nullptr;
+			devcon->PSGetSamplers(0, 1, &prevPixelSamplers);
+			devcon->PSSetSamplers(0, 1, &ss);
+
+			ID3D11SamplerState* prevVertexSamplers = nullptr;
+			devcon->GSGetSamplers(0, 1, &prevVertexSamplers);
+			devcon->GSSetSamplers(0, 1, &ss);
+
+			// Set index/vertex buffers
+			UINT stride = sizeof(tVertex);
+			UINT offset = 0;
+
+			UINT prevStride;
+			UINT prevVertexOffset;
+			ID3D11Buffer* prevVertexBuffers = nullptr;
+			devcon->IAGetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
+			devcon->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+
+			ID3D11Buffer* prevIndexBuffers = nullptr;
+			DXGI_FORMAT prevFormat;
+			UINT prevIndexOffset;
+			devcon->IAGetIndexBuffer(&prevIndexBuffers, &prevFormat, &prevIndexOffset);
+			devcon->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+
+			D3D_PRIMITIVE_TOPOLOGY type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+			switch (primitiveType) {
+				case SIRE_LINE:
+					type = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
+					break;
+				case SIRE_POINT:
+					type = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+					break;
+				case SIRE_TRIANGLE:
+					type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+					break;
+				case SIRE_LINE_STRIP:
+					type = D3D_PRIMITIVE_TOPOLOGY_LINESTRIP;
+					break;
+				case SIRE_TRIANGLE_STRIP:
+					type = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+					break;
+			}
+
+			D3D_PRIMITIVE_TOPOLOGY prevType;
+			devcon->IAGetPrimitiveTopology(&prevType);
+			devcon->IASetPrimitiveTopology(type);
+
+			// Draw
+			if (indexCount)
+				devcon->DrawIndexed(indexCount, 0, 0);
+			else
+				devcon->Draw(vertexCount, 0);
+
+			// Restore shit
+			devcon->OMSetRenderTargets(1, &prevRenderTargets[0], prevStencilView);
+
+			Release(prevRenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+			Release(prevStencilView);
+
+			devcon->IASetInputLayout(prevInputLayout);
+			Release(prevInputLayout);
+
+			devcon->VSSetShader(prevVertexShader, nullptr, 0);
+			Release(prevVertexShader);
+
+			devcon->PSSetShader(prevPixelShader, nullptr, 0);
+			Release(prevPixelShader);
+
+			devcon->VSSetConstantBuffers(0, 1, &prevVertexConstantBuffer);
+			Release(prevVertexConstantBuffer);
+
+			devcon->PSSetConstantBuffers(0, 1, &prevPixelConstantBuffer);
+			Release(prevPixelConstantBuffer);
+
+			devcon->VSSetShaderResources(0, 1, &prevVertexShaderResourceView0);
+			Release(prevVertexShaderResourceView0);
+
+			devcon->VSSetShaderResources(1, 1, &prevVertexShaderResourceView1);
+			Release(prevVertexShaderResourceView1);
+
+			devcon->PSSetShaderResources(0, 1, &prevPixelShaderResourceView0);
+			Release(prevPixelShaderResourceView0);
+
+			devcon->PSSetShaderResources(1, 1, &prevPixelShaderResourceView1);
+			Release(prevPixelShaderResourceView1);
+
+			devcon->PSSetSamplers(0, 1, &prevPixelSamplers);
+			Release(prevPixelSamplers);
+
+			devcon->GSSetSamplers(0, 1, &prevVertexSamplers);
+			Release(prevVertexSamplers);
+
+			devcon->IASetVertexBuffers(0, 1, &prevVertexBuffers, &prevStride, &prevVertexOffset);
+			Release(prevVertexBuffers);
+
+			devcon->IASetIndexBuffer(prevIndexBuffers, prevFormat, prevIndexOffset);
+			Release(prevIndexBuffers);
+
+			devcon->IASetPrimitiveTopology(prevType);
+
+			devcon->RSSetState(rasterizerState);
+			Release(rasterizerState);
+
+			devcon->OMSetDepthStencilState(depthStencilState, stencilRef);
+			Release(depthStencilState);
+
+			devcon->OMSetBlendState(blendState, blendFactor, sampleMask);
+			Release(blendState);
+
+#ifdef SIRE_DX11ON12
+			if (d3d11on12::isD3D11on12) {
+				d3d11on12::d3d11On12Device->ReleaseWrappedResources(d3d11on12::d3d11WrappedBackBuffers[d3d11on12::bufferIndex].GetAddressOf(), 1);
+				d3d11on12::d3d11Context->Flush();
+			}
+#endif
+		}
+
+		ID3D11RenderTargetView** GetRenderTargets() {
+			static ID3D11RenderTargetView* out[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+			memset(out, 0, sizeof(out));
+			devcon->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, out, nullptr);
+			return out;
+		}
+
+		ID3D11DepthStencilView* GetDepthStencilView() {
+			static ID3D11DepthStencilView* out = {};
+			ID3D11RenderTargetView* rtv = {};
+			out = nullptr;
+			devcon->OMGetRenderTargets(1, &rtv, &out);
+			Release(rtv);
+			return out;
+		}
+
+		ID3D11Texture2D* GetBackBuffer(uint32_t buffer) {
+			ID3D11Texture2D* out = nullptr;
+#ifdef SIRE_DX11ON12
+			if (d3d11on12::isD3D11on12)
+				d3d11on12::d3d11WrappedBackBuffers[d3d11on12::bufferIndex]->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&out);
+			else
+				swapchain->GetBuffer(buffer, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&out));
+#else
+			swapchain->GetBuffer(buffer, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&out));
+#endif
+			return out;
+		}
+
+		D3D11_TEXTURE2D_DESC GetDesc(ID3D11Texture2D* texture) {
+			D3D11_TEXTURE2D_DESC out = {};
+			texture->GetDesc(&out);
+			return out;
+		}
+
+		ID3D11RenderTargetView* CreateRenderTarget(ID3D11Texture2D* texture) {
+			ID3D11RenderTargetView* out;
+			dev->CreateRenderTargetView(texture, nullptr, &out);
+			return out;
+		}
+
+		// Returns a copy of texture that can be bound as a render target, or nullptr when texture already can be or the copy fails.
+		ID3D11Texture2D* CreateRenderTargetCopy(ID3D11Texture2D* texture) {
+			D3D11_TEXTURE2D_DESC desc = GetDesc(texture);
+			if (desc.BindFlags & D3D11_BIND_RENDER_TARGET)
+				return nullptr;
+
+			desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+
+			ID3D11Texture2D* out = nullptr;
+			if (FAILED(dev->CreateTexture2D(&desc, nullptr, &out)))
+				return nullptr;
+
+			devcon->CopyResource(out, texture);
+			return out;
+		}
+
+		std::vector<uint8_t> CompileShader(std::string const& str, const char* szEntrypoint, const char* szTarget) {
+			std::vector<uint8_t> out;
+			shaderCache.Compile(GetShaderCompiler(&compiler), str, szEntrypoint, szTarget, D3DCOMPILE_ENABLE_STRICTNESS, out);
+			return out;
+		}
+
+		ID3D11VertexShader* CreateVertexShader(const void* buffer, size_t size) {
+			ID3D11VertexShader* out = nullptr;
+			dev->CreateVertexShader(buffer, size, NULL, &out);
+			return out;
+		}
+
+		ID3D11PixelShader* CreatePixelShader(const void* buffer, size_t size) {
+			ID3D11PixelShader* out = nullptr;
+			dev->CreatePixelShader(buffer, size, NULL, &out);
+			return out;
+		}
+
+		ID3D11InputLayout* CreateInputLayout(std::vector<D3D11_INPUT_ELEMENT_DESC>* layout, const void* buffer, size_t size) {
+			ID3D11InputLayout* out = nullptr;
+			dev->CreateInputLayout(layout->data(), static_cast<uint32_t>(layout->size()), buffer, size, &out);
+			return out;
+		}
+
+		void GenerateMips(ID3D11ShaderResourceView* view) {
+			devcon->GenerateMips(view);
+		}
+
+		ID3D11ShaderResourceView* CreateShaderResourceView(ID3D11Texture2D* texture) {
+			ID3D11ShaderResourceView* out = nullptr;
+			dev->CreateShaderResourceView(texture, nullptr, &out);
+			return out;
+		}
+
+		ID3D11BlendState* GetBlendState(float* blendFactor, uint32_t* sampleMask) {
+			ID3D11BlendState* out;
+			devcon->OMGetBlendState(&out, blendFactor, sampleMask);
+			return out;
+		}
+
+		D3D11_BLEND_DESC GetBlendDesc(ID3D11BlendState* blendState) {
+			D3D11_BLEND_DESC out;
+			blendState->GetDesc(&out);
+			return out;
+		}
+
+		void SetBlendState(D3D11_BLEND_DESC* blendStateDesc, float* blendFactor, uint32_t sampleMask) {
+			ID3D11BlendState* blendState = nullptr;
+			dev->CreateBlendState(blendStateDesc, &blendState);
+			devcon->OMSetBlendState(blendState, blendFactor, sampleMask);
+			Release(blendState);
+		}
+
+		void SetShaders(ID3D11VertexShader* v, ID3D11PixelShader* p) {
+			vertexShader = v;
+			pixelShader = p;
+		}
+
+		D3D11_VIEWPORT GetViewport() {
+			uint32_t numViewport = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+			D3D11_VIEWPORT out[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+
+			devcon->RSGetViewports(&numViewport, out);
+			return out[0];
+		}
+
+		// blocks holds mipLevels levels back to back.
+		ID3D11Texture2D* CreateCompressedTexture(uint32_t width, uint32_t height, eSirePixelFormat format, uint8_t const* blocks, uint32_t mipLevels = 1) {
+			D3D11_TEXTURE2D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = width;
+			desc.Height = height;
+			desc.MipLevels = mipLevels;
+			desc.ArraySize = 1;
+			desc.SampleDesc.Count = 1;
+			desc.Usage = D3D11_USAGE_IMMUTABLE;
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+			desc.Format = GetDxgiFormat(format);
+
+			std::vector<D3D11_SUBRESOURCE_DATA> data(mipLevels);
+			for (uint32_t i = 0; i < mipLevels; i++) {
+				data[i].pSysMem = blocks;
+				data[i].SysMemPitch = GetCompressedRowSize(format, width);
+				blocks += GetCompressedSize(format, width, height);
+				width = (std::max)(width >> 1, 1u);
+				height = (std::max)(height >> 1, 1u);
+			}
+
+			ID3D11Texture2D* out = nullptr;
+			dev->CreateTexture2D(&desc, data.data(), &out);
+			return out;
+		}
+
+		// mipPixels holds levels 1 to mipLevels - 1 back to back. With generateMips the chain is filled by GenerateMips once the view exists.
+		ID3D11Texture2D* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels, uint32_t mipLevels = 1, uint8_t* mipPixels = nullptr, bool generateMips = false) {
+			ID3D11Texture2D* out = nullptr;
+			D3D11_TEXTURE2D_DESC desc;
+			ZeroMemory(&desc, sizeof(desc));
+			desc.Width = width;
+			desc.Height = height;
+			desc.MipLevels = generateMips ? 0 : mipLevels;
+			desc.ArraySize = 1;
+			desc.Format = GetDxgiFormat(textureFormat);
+			desc.SampleDesc.Count = 1;
+			desc.Usage = D3D11_USAGE_DEFAULT;
+			// GenerateMips renders the chain, other textures get render target binding from CreateRenderTargetView.
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | (generateMips ? D3D11_BIND_RENDER_TARGET : 0);
+			desc.CPUAccessFlags = 0;
+			desc.MiscFlags = generateMips ? D3D11_RESOURCE_MISC_GENERATE_MIPS : 0;
+
+			HRESULT hr = dev->CreateTexture2D(&desc, nullptr, &out);
+
+			if (SUCCEEDED(hr)) {
+				if (pixels) {
+					D3D11_TEXTURE2D_DESC desc;
+					out->GetDesc(&desc);
+					devcon->UpdateSubresource(out, 0, nullptr, pixels, desc.Width * sizeof(UINT), 0);
+				}
+
+				if (mipPixels && !generateMips) {
+					for (uint32_t i = 1; i < mipLevels; i++) {
+						width = (std::max)(width >> 1, 1u);
+						height = (std::max)(height >> 1, 1u);
+
+						devcon->UpdateSubresource(out, i, nullptr, mipPixels, width * sizeof(UINT), 0);
+						mipPixels += width * height * 4;
+					}
+				}
+			}
+
+			return out;
+		}
+
+	};
+#endif
+
+#ifdef SIRE_DX12
+	struct SireDirectX12 SIRE_FINAL : SireRenderer {
+		IDXGISwapChain* swapchain;
+		ID3D12Device* dev;
+		ID3D12CommandQueue* commandQueue;
+		ID3D12CommandAllocator* commandAllocator;
+		ID3D12GraphicsCommandList* commandList;
+		ID3D12DescriptorHeap* descriptorHeap;
+		ID3D12Resource* vertexBuffer;
+		ID3D12Resource* indexBuffer;
+		ID3D12Resource* constantBuffer;
+		ID3D12DescriptorHeap* samplerHeap;
+		ID3D12RootSignature* rootSignature;
+		ID3D12PipelineState* pipelineState;
+		ID3D12ShaderReflection* vertexShader;
+		ID3D12ShaderReflection* pixelShader;
+		ID3D12ShaderReflection* internalVertexShader;
+		ID3D12ShaderReflection* internalPixelShader;
+		ID3D12Resource* tex;
+		ID3D12Resource* mask;
+		SireD3DCompiler compiler;
+
+		SireDirectX12() : SireRenderer() {
+			swapchain = nullptr;
+			dev = nullptr;
+			commandQueue = nullptr;
+			commandAllocator = nullptr;
+			commandList = nullptr;
+			descriptorHeap = nullptr;
+			vertexBuffer = nullptr;
+			indexBuffer = nullptr;
+			constantBuffer = nullptr;
+			samplerHeap = nullptr;
+			rootSignature = nullptr;
+			pipelineState = nullptr;
+			vertexShader = nullptr;
+			pixelShader = nullptr;
+			internalVertexShader = nullptr;
+			internalPixelShader = nullptr;
+			tex = nullptr;
+			mask = nullptr;
+		}
+
+		void Init(uintptr_t* ptr) override {
+			if (initialised)
+				return;
+
+			swapchain = reinterpret_cast<IDXGISwapChain*>(ptr);
+			HRESULT hResult = swapchain->GetDevice(__uuidof(ID3D11Device), (void**)&dev);
+
+			if (FAILED(hResult))
+				return;
+
+			dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, __uuidof(ID3D12CommandAllocator), (void**)&commandAllocator);
+
+			if (!commandAllocator)
+				return;
+
+			dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocator, nullptr, __uuidof(ID3D12GraphicsCommandList), (void**)&commandList);
+
+			commandList->Close();
+
+			DXGI_SWAP_CHAIN_DESC swapChainDesc;
+			ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
+			swapchain->GetDesc(&swapChainDesc);
+
+			hWnd = swapChainDesc.OutputWindow;
+			textureFormat = GetPixelFormat(swapChainDesc.BufferDesc.Format, textureFormat);
+
+			D3D12_RESOURCE_DESC bufferDesc;
+			ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+
+			bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			bufferDesc.Alignment = 0;
+			bufferDesc.Width = sizeof(tVertex) * 65536;
+			bufferDesc.Height = 1;
+			bufferDesc.DepthOrArraySize = 1;
+			bufferDesc.MipLevels = 1;
+			bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+			bufferDesc.SampleDesc.Count = 1;
+			bufferDesc.SampleDesc.Quality = 0;
+			bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+			bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+			D3D12_HEAP_PROPERTIES heapProp;
+			ZeroMemory(&heapProp, sizeof(heapProp));
+			heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+			// Vertex buffer
+			dev->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+										 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, __uuidof(ID3D12Resource), (void**)&vertexBuffer);
+
+			// Index buffer
+			bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+			dev->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+										 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, __uuidof(ID3D12Resource), (void**)&indexBuffer);
+
+			// Constant buffer
+			bufferDesc.Width = sizeof(tConstBuff);
+			dev->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+										 D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, __uuidof(ID3D12Resource), (void**)&constantBuffer);
+
+			D3D12_SAMPLER_DESC samplerDesc;
+			ZeroMemory(&samplerDesc, sizeof(samplerDesc));
+			samplerDesc.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+			samplerDesc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+			samplerDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+			samplerDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+			samplerDesc.MipLODBias = 0.0f;
+			samplerDesc.MaxAnisotropy = 1;
+			samplerDesc.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+			samplerDesc.BorderColor[0] = 0.0f;
+			samplerDesc.BorderColor[1] = 0.0f;
+			samplerDesc.BorderColor[2] = 0.0f;
+			samplerDesc.BorderColor[3] = 0.0f;
+			samplerDesc.MinLOD = 0.0f;
+			samplerDesc.MaxLOD = D3D12_FLOAT32_MAX;
+
+			dev->CreateSampler(&samplerDesc, samplerHeap->GetCPUDescriptorHandleForHeapStart());
+
+			// Init shaders
+			std::vector<uint8_t> VS = CompileShader(hlslShader5_0, "VShader", "vs_5_0");
+			std::vector<uint8_t> PS = CompileShader(hlslShader5_0, "PShader", "ps_5_0");
+
+			if (VS.empty() || PS.empty())
+				return;
+
+			internalVertexShader = CreateShaderReflection(VS.data(), VS.size());
+			internalPixelShader = CreateShaderReflection(PS.data(), PS.size());
+
+			D3D12_DESCRIPTOR_RANGE descriptorRange;
+			descriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+			descriptorRange.NumDescriptors = 1;
+			descriptorRange.BaseShaderRegister = 0;
+			descriptorRange.RegisterSpace = 0;
+			descriptorRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
+
+			D3D12_ROOT_PARAMETER rootParameters[1];
+			rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			rootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
+			rootParameters[0].DescriptorTable.pDescriptorRanges = &descriptorRange;
+			rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+			D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc;
+			rootSignatureDesc.NumParameters = 1;
+			rootSignatureDesc.pParameters = rootParameters;
+			rootSignatureDesc.NumStaticSamplers = 0;
+			rootSignatureDesc.pStaticSamplers = nullptr;
+			rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+
+			ID3DBlob* signature;
+			ID3DBlob* error;
+			D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &signature, &error);
+			dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
+
+			initialised = true;
+		}
+
+		void Shutdown() override {
+			if (!initialised)
+				return;
+
+			Release(vertexBuffer);
+			Release(indexBuffer);
+			Release(constantBuffer);
+			Release(rootSignature);
+			Release(internalVertexShader);
+			Release(internalPixelShader);
+
+			vertexShader = nullptr;
+			pixelShader = nullptr;
+
+			swapchain = nullptr;
+			dev = nullptr;
+
+			initialised = false;
+		}
+
+		void Begin() override {
+
+		}
+
+		void End() override {
+			// Fallback to internal shaders if unset.
+			if (!pixelShader && internalPixelShader)
+				pixelShader = internalPixelShader;
+
+			if (!vertexShader && internalVertexShader)
+				vertexShader = internalVertexShader;
+
+		}
+
+		void SetRenderStates(tRenderState const& s) override {
+
+		}
+
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+
+		}
+
+		void SetViewport(tSireViewport const& v) override {
+
+		}
+
+		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
+			cb.hasTex = texture ? true : false;
+			cb.hasMask = textureMask ? true : false;
+
+			texture = nullptr;
+			textureMask = nullptr;
+
+			if (texture)
+				tex = reinterpret_cast<ID3D12Resource*>(texture);
+
+			if (textureMask)
+				mask = reinterpret_cast<ID3D12Resource*>(textureMask);
+		}
+
+
+		uint8_t* Lock(void* ptr) override {
+			return nullptr;
+		}
+
+		void Unlock(void* ptr) override {
+
+		}
+
+		void SetPixelShader(uintptr_t* ps) override {
+
+		}
+
+		void SetVertexShader(uintptr_t* vs) override {
+
+		}
+
+		// End virtual override
+
+		std::vector<uint8_t> CompileShader(std::string const& str, const char* szEntrypoint, const char* szTarget) {
+			std::vector<uint8_t> out;
+			shaderCache.Compile(GetShaderCompiler(&compiler), str, szEntrypoint, szTarget, D3DCOMPILE_ENABLE_STRICTNESS, out);
+			return out;
+		}
+
+		ID3D12ShaderReflection* CreateShaderReflection(const void* buffer, size_t size) {
+			ID3D12ShaderReflection* out = nullptr;
+			D3DReflect(buffer, size, IID_PPV_ARGS(&out));
+			return out;
+		}
+	};
+
+#endif
+
+#ifdef SIRE_OPENGL
+	struct SireOpenGL SIRE_FINAL : SireRenderer {
+		HDC con;
+		HGLRC conres;
+		uint32_t tex;
+		uint32_t mask;
+
+		uint32_t vbo;
+		uint32_t vao;
+
+		uint32_t ibo;
+
+		uint32_t vertexShader;
+		uint32_t pixelShader;
+
+		uint32_t shaderProgram;
+
+		std::vector<uint32_t> timestamps[SIRE_TIMING_FRAMES];
+
+		SireOpenGL() : SireRenderer() {
+			con = nullptr;
+			conres = nullptr;
+			tex = 0;
+			mask = 0;
+			vbo = 0;
+			vao = 0;
+			ibo = 0;
+
+			vertexShader = 0;
+			pixelShader = 0;
+
+			shaderProgram = 0;
+		}
+
+		// Start virtual override
+		bool IsRendererActive() override {
+			const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+			return con && conres && version;
+		}
+
+		void Init(uintptr_t* ptr) override {
+			if (initialised)
+				return;
+
+			con = reinterpret_cast<HDC>(ptr);
+			conres = wglCreateContext(con);
+
+			if (!gladLoadGL()) {
+				std::cout << "Glad error" << std::endl;
+			}
+
+			glGenBuffers(1, &vbo);
+			glGenBuffers(1, &ibo);
+			glGenVertexArrays(1, &vao);
+
+			glBindVertexArray(vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(tVertex) * 65536, nullptr, GL_DYNAMIC_DRAW);
+
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * 65536, nullptr, GL_DYNAMIC_DRAW);
+
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+			shaderProgram = glCreateProgram();
+
+			uint64_t programKey = shaderCache.GetKey(glslShader3_3_0, "main", "glsl_330", 0);
+			uint64_t programVersion = GetProgramBinaryVersion();
+
+			if (!LoadProgramBinary(programKey, programVersion)) {
+				uint32_t shader = glCreateShader(GL_VERTEX_SHADER);
+				const char* shaderSource = glslShader3_3_0.c_str();
+				glShaderSource(shader, 1, &shaderSource, NULL);
+				glCompileShader(shader);
+
+				glAttachShader(shaderProgram, shader);
+				glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+				glLinkProgram(shaderProgram);
+				glDeleteShader(shader);
+
+				StoreProgramBinary(programKey, programVersion);
+			}
+
+			glBindVertexArray(0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glUseProgram(0);
+
+			initialised = true;
+		}
+
+		void Shutdown() override {
+			if (!initialised)
+				return;
+
+			con = nullptr;
+
+			if (conres) {
+				wglDeleteContext(conres);
+				conres = nullptr;
+			}
+
+			tex = 0;
+			mask = 0;
+
+			glDeleteProgram(shaderProgram);
+
+			for (auto& it : timestamps) {
+				if (!it.empty())
+					glDeleteQueries(static_cast<int32_t>(it.size()), it.data());
+				it.clear();
+			}
+
+			glDeleteVertexArrays(1, &vao);
+			glDeleteBuffers(1, &vbo);
+			glDeleteBuffers(1, &ibo);
+
+			initialised = false;
+		}
+
+		void Begin() override {
+
+		}
+
+		void End() override {
+			if (vertices.empty())
+				throw std::runtime_error("Error End() method has been called before settings vertices.");
+
+			auto prevconres = wglGetCurrentContext();
+			wglMakeCurrent(con, conres);
+
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(tVertex), vertices.data());
+
+			if (numIndices) {
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(uint16_t), indices.data());
+			}
+
+			Draw(vbo, ibo, static_cast<uint32_t>(vertices.size()), numIndices);
+
+			wglMakeCurrent(con, prevconres);
+		}
+
+		void DrawMesh(uintptr_t* vertexBuffer, uintptr_t* indexBuffer, uint32_t vertexCount, uint32_t indexCount) override {
+			auto prevconres = wglGetCurrentContext();
+			wglMakeCurrent(con, conres);
+
+			Draw(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(vertexBuffer)), static_cast<uint32_t>(reinterpret_cast<uintptr_t>(indexBuffer)), vertexCount, indexCount);
+
+			wglMakeCurrent(con, prevconres);
+		}
+
+		bool CreateMesh(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, uintptr_t** vertexBuffer, uintptr_t** indexBuffer) override {
+			auto prevconres = wglGetCurrentContext();
+			wglMakeCurrent(con, conres);
+
+			uint32_t meshVertexBuffer = 0;
+			uint32_t meshIndexBuffer = 0;
+
+			glGenBuffers(1, &meshVertexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, meshVertexBuffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(tVertex) * vertexCount, v, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			if (indexCount) {
+				glGenBuffers(1, &meshIndexBuffer);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIndexBuffer);
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * indexCount, i, GL_STATIC_DRAW);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			}
+
+			wglMakeCurrent(con, prevconres);
+
+			// Buffer names are carried in the opaque pointers.
+			*vertexBuffer = reinterpret_cast<uintptr_t*>(static_cast<uintptr_t>(meshVertexBuffer));
+			*indexBuffer = reinterpret_cast<uintptr_t*>(static_cast<uintptr_t>(meshIndexBuffer));
+			return meshVertexBuffer != 0;
+		}
+
+		void SetVertices(tVertex const& v) override {
+
+		}
+
+		void SetRenderStates(tRenderState const& s) override {
+			if (s.blendEnable)
+				glEnable(GL_BLEND);
+			else
+				glDisable(GL_BLEND);
+
+			glBlendFunc(GL_SRC_ALPHA, SireToOpenGLBlendState(s.srcBlend));
+			glBlendFunc(GL_DST_ALPHA, SireToOpenGLBlendState(s.dstBlend));
+
+			glEnable(GL_CULL_FACE);
+			glCullFace(SireToOpenGLCullMode(s.cullMode));
+
+			glEnable(GL_DEPTH_TEST);
+			glDisable(GL_STENCIL_TEST);
+			glEnable(GL_SCISSOR_TEST);
+
+			glPolygonMode(GL_FRONT_AND_BACK, SireFillMode(s.fillMode));
+		}
+
+		void SetViewport(tSireViewport const& v) override {
+			glViewport(static_cast<int32_t>(v.x), static_cast<int32_t>(v.y), static_cast<int32_t>(v.w), static_cast<int32_t>(v.h));
+		}
+
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+
+		}
+
+		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
+			tex = texture ? reinterpret_cast<tTexture2D*>(texture)->id : 0;
+			mask = textureMask ? reinterpret_cast<tTexture2D*>(textureMask)->id : 0;
+		}
+
+		bool SupportsTopology(eSirePrimitiveType type, bool restart) override {
+			return true;
+		}
+
+		// GL timestamps are in nanoseconds and need no disjoint query.
+		bool BeginTiming(uint32_t slot) override {
+			return true;
+		}
+
+		void WriteTimestamp(uint32_t slot, uint32_t index) override {
+			auto prevconres = wglGetCurrentContext();
+			wglMakeCurrent(con, conres);
+
+			std::vector<uint32_t>& queries = timestamps[slot];
+			while (queries.size() <= index) {
+				uint32_t query = 0;
+				glGenQueries(1, &query);
+				queries.push_back(query);
+			}
+
+			glQueryCounter(queries[index], GL_TIMESTAMP);
+
+			wglMakeCurrent(con, prevconres);
+		}
+
+		// Queries complete in order, once the last one is available all of them are.
+		bool ReadTimestamps(uint32_t slot, uint32_t count, uint64_t* out, uint64_t& frequency) override {
+			std::vector<uint32_t>& queries = timestamps[slot];
+			if (count > queries.size()) {
+				frequency = 0;
+				return true;
+			}
+
+			auto prevconres = wglGetCurrentContext();
+			wglMakeCurrent(con, conres);
+
+			uint32_t available = 0;
+			glGetQueryObjectuiv(queries[count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				for (uint32_t i = 0; i < count; i++)
+					glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &out[i]);
+			}
+
+			wglMakeCurrent(con, prevconres);
+
+			frequency = 1000000000;
+			return available != 0;
+		}
+
+		// End virtual override
+
+		// Binds the given buffers with the current state and draws, the context must be current.
+		void Draw(uint32_t vertexBuffer, uint32_t indexBuffer, uint32_t vertexCount, uint32_t indexCount) {
+			glBindVertexArray(vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, pos));
+
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, col));
+
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, uv0));
+
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, uv1));
+
+			if (indexCount)
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+			glUseProgram(shaderProgram);
+
+			tConstBuff tempcb = cb;
+			tempcb.matrix.Transpose();
+			glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "proj"), 1, GL_FALSE, &tempcb.matrix.ToFloatArray()[0]);
+			glUniform1i(glGetUniformLocation(shaderProgram, "hasTex"), tempcb.hasTex);
+			glUniform1i(glGetUniformLocation(shaderProgram, "hasMask"), tempcb.hasMask);
+			glUniform1i(glGetUniformLocation(shaderProgram, "texAlpha"), tempcb.texAlpha);
+			glUniform1i(glGetUniformLocation(shaderProgram, "isSdf"), tempcb.isSdf);
+			glUniform4fv(glGetUniformLocation(shaderProgram, "tint"), 1, &tempcb.tint.x);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glUniform1i(glGetUniformLocation(shaderProgram, "tex0"), 0);
+
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, mask);
+			glUniform1i(glGetUniformLocation(shaderProgram, "mask0"), 1);
+
+			GLenum type = GL_POINTS;
+			switch (primitiveType) {
+				case SIRE_LINE:
+					type = GL_LINES;
+					break;
+				case SIRE_POINT:
+					type = GL_POINTS;
+					break;
+				case SIRE_TRIANGLE:
+					type = GL_TRIANGLES;
+					break;
+				case SIRE_LINE_STRIP:
+					type = GL_LINE_STRIP;
+					break;
+				case SIRE_TRIANGLE_STRIP:
+					type = GL_TRIANGLE_STRIP;
+					break;
+				case SIRE_TRIANGLE_FAN:
+					type = GL_TRIANGLE_FAN;
+					break;
+			}
+
+			if (indexCount) {
+				glEnable(GL_PRIMITIVE_RESTART);
+				glPrimitiveRestartIndex(SIRE_PRIMITIVE_RESTART_INDEX);
+				glDrawElements(type, indexCount, GL_UNSIGNED_SHORT, 0);
+				glDisable(GL_PRIMITIVE_RESTART);
+			}
+			else {
+				glDrawArrays(type, 0, vertexCount);
+			}
+
+			glBindVertexArray(0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glUseProgram(0);
+		}
+
+		// Program binaries are only valid for the driver that produced them.
+		uint64_t GetProgramBinaryVersion() {
+			uint64_t out = SIRE_HASH_SEED;
+			const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+			for (auto& it : names) {
+				const char* str = reinterpret_cast<const char*>(glGetString(it));
+				if (str)
+					out = Hash64(str, strlen(str), out);
+			}
+			return out;
+		}
+
+		bool LoadProgramBinary(uint64_t key, uint64_t version) {
+			std::vector<uint8_t> blob;
+			if (!shaderCache.Load(key, version, blob) || blob.size() <= sizeof(GLenum))
+				return false;
+
+			GLenum format = 0;
+			memcpy(&format, blob.data(), sizeof(format));
+			glProgramBinary(shaderProgram, format, blob.data() + sizeof(format), static_cast<GLsizei>(blob.size() - sizeof(format)));
+
+			GLint status = GL_FALSE;
+			glGetProgramiv(shaderProgram, GL_LINK_STATUS, &status);
+			return status == GL_TRUE;
+		}
+
+		void StoreProgramBinary(uint64_t key, uint64_t version) {
+			GLint size = 0;
+			glGetProgramiv(shaderProgram, GL_PROGRAM_BINARY_LENGTH, &size);
+			if (size <= 0)
+				return;
+
+			GLenum format = 0;
+			std::vector<uint8_t> blob(sizeof(format) + size);
+			glGetProgramBinary(shaderProgram, size, nullptr, &format, blob.data() + sizeof(format));
+			memcpy(blob.data(), &format, sizeof(format));
+
+			shaderCache.Store(key, version, blob);
+		}
+
+		uint32_t SireFillMode(int8_t mode) {
+			switch (mode) {
+				case SIRE_FILL_WIREFRAME:
+					return GL_LINE;
+				case SIRE_FILL_SOLID:
+					return GL_FILL;
+			}
+
+			return 0;
+		}
+
+		uint32_t SireToOpenGLCullMode(int8_t mode) {
+			switch (mode) {
+				case SIRE_CULL_NONE:
+					glDisable(GL_CULL_FACE);
+					return 0;
+				case SIRE_CULL_FRONT:
+					return GL_FRONT;
+				case SIRE_CULL_BACK:
+					return GL_BACK;
+			}
+
+			return 0;
+		}
+
+		uint32_t SireToOpenGLBlendState(int8_t blend) {
+			switch (blend) {
+				case SIRE_BLEND_ZERO:
+					return GL_ZERO;
+				case SIRE_BLEND_ONE:
+					return GL_ONE;
+				case SIRE_BLEND_SRC_COLOR:
+					return GL_SRC_COLOR;
+				case SIRE_BLEND_INV_SRC_COLOR:
+					return GL_ONE_MINUS_SRC_COLOR;
+				case SIRE_BLEND_SRC_ALPHA:
+					return GL_SRC_ALPHA;
+				case SIRE_BLEND_INV_SRC_ALPHA:
+					return GL_ONE_MINUS_SRC_ALPHA;
+				case SIRE_BLEND_DEST_ALPHA:
+					return GL_DST_ALPHA;
+				case SIRE_BLEND_INV_DEST_ALPHA:
+					return GL_ONE_MINUS_DST_ALPHA;
+				case SIRE_BLEND_DEST_COLOR:
+					return GL_DST_COLOR;
+				case SIRE_BLEND_INV_DEST_COLOR:
+					return GL_ONE_MINUS_DST_COLOR;
+				case SIRE_BLEND_SRC_ALPHA_SAT:
+					return GL_SRC_ALPHA_SATURATE;
+			}
+
+			return 0;
+		}
+
+		tTexture2D* GetBackBuffer(uint32_t buffer) {
+			int32_t w = 0;
+			int32_t h = 0;
+
+			HDC hdc = wglGetCurrentDC();
+			HDC hMemoryDC = CreateCompatibleDC(hdc);
+
+			RECT windowRect = {};
+			GetClientRect(WindowFromDC(hdc), &windowRect);
+
+			w = windowRect.right - windowRect.left;
+			h = windowRect.bottom - windowRect.top;
+
+			HBITMAP hBitmap = CreateCompatibleBitmap(hdc, w, h);
+			HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
+
+			BitBlt(hMemoryDC, 0, 0, w, h, hdc, 0, 0, SRCCOPY);
+
+			BITMAPINFO bitmapInfo = { 0 };
+			bitmapInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+			bitmapInfo.bmiHeader.biWidth = w;
+			bitmapInfo.bmiHeader.biHeight = -h;
+			bitmapInfo.bmiHeader.biPlanes = 1;
+			bitmapInfo.bmiHeader.biBitCount = 32;
+
+			tSireArenaVector<uint8_t> pixels;
+			pixels.resize(w * h * 4);
+
+			GetDIBits(hMemoryDC, hBitmap, 0, h, pixels.data(), &bitmapInfo, DIB_RGB_COLORS);
+
+			tTexture2D* out = CreateTexture(w, h, pixels.data());
+
+			return out;
+		}
+
+		// mipPixels holds levels 1 to mipLevels - 1 back to back.
+		tTexture2D* CreateTexture(int32_t width, int32_t height, uint8_t* pixels, uint32_t mipLevels = 1, uint8_t* mipPixels = nullptr, bool generateMips = false) {
+			tTexture2D* out = new tTexture2D();
+			glGenTextures(1, &out->id);
+			glBindTexture(GL_TEXTURE_2D, out->id);
+
+			bool mipmapped = generateMips || (mipPixels && mipLevels > 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			GLenum format = IsBgraFormat(textureFormat) ? GL_BGRA : GL_RGBA;
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+
+			if (generateMips) {
+				glGenerateMipmap(GL_TEXTURE_2D);
+			}
+			else if (mipPixels) {
+				int32_t w = width;
+				int32_t h = height;
+				for (uint32_t i = 1; i < mipLevels; i++) {
+					w = (std::max)(w >> 1, 1);
+					h = (std::max)(h >> 1, 1);
+
+					glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, w, h, 0, format, GL_UNSIGNED_BYTE, mipPixels);
+					mipPixels += w * h * 4;
+				}
+
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+			}
+
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			out->width = width;
+			out->height = height;
+
+			return out;
+		}
+
+		void CopyResources() {
+
+		}
+	};
+
+#endif
+
+#ifdef SIRE_VULKAN
+	struct SireVulkan SIRE_FINAL : SireRenderer {
+		SireVulkan() {
+
+		}
+
+		// Start virtual override
+
+		bool IsRendererActive() override {
+			return false;
+		}
+
+		void Init(uintptr_t* ptr) override {
+
+		}
+
+		void Shutdown() override {
+
+		}
+
+		void Begin() override {
+
+		}
+
+		void End() override {
+		}
+
+		void SetVertices(tVertex const& v) override {
+		}
+
+		void SetRenderStates(tRenderState const& s) override {
+
+		}
+
+		void SetViewport(tSireViewport const& v) override {
+
+		}
+
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+
+		}
+
+		void SetTexture(uintptr_t* tex, uintptr_t* mask) override {
+
+		}
+
+		// End virtual override	
+	};
+
+#endif
+
+#ifdef SIRE_SOFTWARE
+	// Textures, render targets and the back buffer of the software renderer, refcounted like the COM objects of the
+	// other backends. Pixels are RGBA8 and textures keep only their top level.
+	struct tSoftwareImage {
+		int32_t w;
+		int32_t h;
+		std::vector<uint8_t> pixels;
+		uint32_t refs;
+
+		tSoftwareImage(int32_t width, int32_t height) {
+			w = width;
+			h = height;
+			pixels.resize(static_cast<size_t>(width) * height * 4);
+			refs = 1;
+		}
+
+		void AddRef() {
+			refs++;
+		}
+
+		void Release() {
+			if (--refs == 0)
+				delete this;
+		}
+	};
+
+	struct tSoftwareBuffer {
+		std::vector<uint8_t> data;
+		uint32_t refs;
+
+		tSoftwareBuffer(void const* src, size_t size) {
+			data.assign(static_cast<uint8_t const*>(src), static_cast<uint8_t const*>(src) + size);
+			refs = 1;
+		}
+
+		void AddRef() {
+			refs++;
+		}
+
+		void Release() {
+			if (--refs == 0)
+				delete this;
+		}
+	};
+
+	// Vertex in target pixels, the attributes are premultiplied by invW for perspective correct interpolation.
+	struct tSoftwareVertex {
+		float x;
+		float y;
+		float invW;
+		float attr[8]; // col, uv0, uv1
+	};
+
+	// CPU rasterizer for headless runs such as trace replays in tests. It follows the internal shaders and the blend
+	// states, custom shaders, depth and stencil are ignored. Init takes a tSireSoftwareDesc, with framesInFlight
+	// set the calls only record and a raster thread draws each frame after EndFrame.
+	struct SireSoftware SIRE_FINAL : SireRenderer {
+		struct tClip {
+			int32_t x0, y0, x1, y1;
+		};
+
+		// Everything a draw reads besides its vertices, captured when the draw is recorded.
+		struct tRasterState {
+			tConstBuff cb;
+			tRenderState states;
+			tSireViewport viewport;
+			eSirePrimitiveType primitiveType;
+			tSoftwareImage* target;
+			tSoftwareImage* tex;
+			tSoftwareImage* mask;
+		};
+
+		enum eSoftwareCommand : uint8_t {
+			SIRE_SOFTWARE_DRAW,
+			SIRE_SOFTWARE_CLEAR,
+			SIRE_SOFTWARE_UPDATE,
+			SIRE_SOFTWARE_COPY, // Runs alone, it may resize the destination
+			SIRE_SOFTWARE_TIMESTAMP, // Runs alone, after everything before it
+			SIRE_SOFTWARE_BARRIER, // Reads that depend on earlier writes to other rows
+		};
+
+		struct tCommand {
+			eSoftwareCommand type;
+			uint32_t state; // Into tFrame::states
+			uint32_t vertexOffset; // Into tFrame::vertices, or the mesh buffer
+			uint32_t vertexCount;
+			uint32_t indexOffset;
+			uint32_t indexCount;
+			uint32_t transformedOffset;
+			tSoftwareBuffer* vertexBuffer;
+			tSoftwareBuffer* indexBuffer;
+			tSoftwareImage* image; // Cleared, updated or copied to
+			tSoftwareImage* source;
+			size_t dataOffset; // Into tFrame::data
+			size_t dataSize;
+			uint8_t color[4];
+			uint32_t slot; // Timestamps
+			uint32_t index;
+		};
+
+		// One recorded frame, it keeps a reference to every image and mesh it uses until it is retired.
+		struct tFrame {
+			std::vector<tCommand> commands;
+			std::vector<tRasterState> states;
+			std::vector<tVertex> vertices;
+			std::vector<uint16_t> indices;
+			std::vector<uint8_t> data;
+			std::vector<tSoftwareVertex> transformed;
+			std::vector<tSoftwareImage*> images;
+			std::vector<tSoftwareBuffer*> buffers;
+			uint32_t transformedCount;
+
+			tFrame() {
+				transformedCount = 0;
+			}
+		};
+
+		tSoftwareImage* backBuffer;
+		tSoftwareImage* tex;
+		tSoftwareImage* mask;
+		tRenderState states;
+		tSireViewport viewport;
+		std::vector<tSoftwareVertex> transformed;
+		std::vector<uint64_t> timestamps[SIRE_TIMING_FRAMES];
+
+		static constexpr uint32_t SIRE_SOFTWARE_SPAN = 64;
+
+		// Pipelined mode, frames[submitted % framesInFlight] is the one being recorded. submitted and completed count
+		// frames and are guarded by mutex.
+		uint32_t framesInFlight;
+		std::unique_ptr<tFrame[]> frames;
+		uint64_t submitted;
+		uint64_t completed;
+		uint64_t timingFrames[SIRE_TIMING_FRAMES];
+		std::vector<tSoftwareImage*> segmentReads;
+		std::vector<tSoftwareImage*> segmentWrites;
+		std::thread rasterThread;
+		std::mutex mutex;
+		std::condition_variable submittedSignal;
+		std::condition_variable completedSignal;
+		bool quit;
+		tThreadPool rasterPool;
+		uint32_t bands;
+
+		SireSoftware() : SireRenderer() {
+			backBuffer = nullptr;
+			tex = nullptr;
+			mask = nullptr;
+			states = {};
+			viewport = {};
+			framesInFlight = 0;
+			submitted = 0;
+			completed = 0;
+			for (uint32_t i = 0; i < SIRE_TIMING_FRAMES; i++)
+				timingFrames[i] = 0;
+			quit = false;
+			bands = 1;
+			textureFormat = SIRE_PIXEL_FORMAT_RGBA8;
+		}
+
+		// Start virtual override
+		bool IsRendererActive() override {
+			return initialised && backBuffer;
+		}
+
+		void Init(uintptr_t* ptr) override {
+			if (initialised)
+				return;
+
+			tSireSoftwareDesc const* desc = reinterpret_cast<tSireSoftwareDesc const*>(ptr);
+			if (!desc || desc->width <= 0 || desc->height <= 0 || desc->width > SIRE_MAX_IMAGE_DIMENSION || desc->height > SIRE_MAX_IMAGE_DIMENSION)
+				return;
+
+			backBuffer = new tSoftwareImage(desc->width, desc->height);
+			viewport = { 0.0f, 0.0f, static_cast<float>(desc->width), static_cast<float>(desc->height), 0.0f, 1.0f };
+
+			if (desc->framesInFlight >= 2) {
+				framesInFlight = (std::min)(desc->framesInFlight, 3u);
+				frames.reset(new tFrame[framesInFlight]);
+				submitted = 0;
+				completed = 0;
+				quit = false;
+				bands = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u) * 4, 64u);
+				rasterThread = std::thread([this] { RasterThread(); });
+			}
+
+			initialised = true;
+		}
+
+		void Shutdown() override {
+			if (!initialised)
+				return;
+
+			if (framesInFlight) {
+				Finish();
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					quit = true;
+				}
+
+				submittedSignal.notify_one();
+				rasterThread.join();
+
+				for (uint32_t i = 0; i < framesInFlight; i++)
+					Retire(frames[i]);
+
+				frames.reset();
+				framesInFlight = 0;
+			}
+
+			rasterPool.Stop();
+			Release(backBuffer);
+			tex = nullptr;
+			mask = nullptr;
+			for (auto& it : timestamps)
+				it.clear();
+
+			initialised = false;
+		}
+
+		void End() override {
+			if (framesInFlight)
+				return RecordDraw(vertices.data(), vertices.size(), numIndices ? indices.data() : nullptr, numIndices, nullptr, nullptr);
+
+			tRasterState rs = GetRasterState();
+			transformed.resize(vertices.size());
+			Transform(rs, vertices.data(), 0, vertices.size(), transformed.data());
+			Rasterize(rs, GetClip(rs), transformed.data(), vertices.size(), numIndices ? indices.data() : nullptr, numIndices);
+		}
+
+		void DrawMesh(uintptr_t* vertexBuffer, uintptr_t* indexBuffer, uint32_t vertexCount, uint32_t indexCount) override {
+			tSoftwareBuffer* vb = reinterpret_cast<tSoftwareBuffer*>(vertexBuffer);
+			tSoftwareBuffer* ib = reinterpret_cast<tSoftwareBuffer*>(indexBuffer);
+			tVertex const* v = reinterpret_cast<tVertex const*>(vb->data.data());
+			uint16_t const* i = ib ? reinterpret_cast<uint16_t const*>(ib->data.data()) : nullptr;
+
+			if (framesInFlight)
+				return RecordDraw(v, vertexCount, i, ib ? indexCount : 0, vb, ib);
+
+			tRasterState rs = GetRasterState();
+			transformed.resize(vertexCount);
+			Transform(rs, v, 0, vertexCount, transformed.data());
+			Rasterize(rs, GetClip(rs), transformed.data(), vertexCount, i, ib ? indexCount : 0);
+		}
+
+		bool CreateMesh(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, uintptr_t** vertexBuffer, uintptr_t** indexBuffer) override {
+			*vertexBuffer = reinterpret_cast<uintptr_t*>(new tSoftwareBuffer(v, vertexCount * sizeof(tVertex)));
+			*indexBuffer = indexCount ? reinterpret_cast<uintptr_t*>(new tSoftwareBuffer(i, indexCount * sizeof(uint16_t))) : nullptr;
+			return true;
+		}
+
+		void ClearRenderTarget(uintptr_t* rtv, tSireFloat4 const& color) override {
+			tCommand cmd = {};
+			cmd.type = SIRE_SOFTWARE_CLEAR;
+			cmd.image = rtv ? reinterpret_cast<tSoftwareImage*>(rtv) : backBuffer;
+
+			float const c[4] = { color.x, color.y, color.z, color.w };
+			for (int32_t i = 0; i < 4; i++)
+				cmd.color[i] = ToUnorm(c[i]);
+
+			if (framesInFlight)
+				return Record(cmd, nullptr, nullptr, cmd.image);
+
+			Execute(nullptr, cmd, 0, 1);
+		}
+
+		void UpdateTexture(uintptr_t* surface, uint32_t width, uint32_t height, uint8_t* pixels) override {
+			tCommand cmd = {};
+			cmd.type = SIRE_SOFTWARE_UPDATE;
+			cmd.image = reinterpret_cast<tSoftwareImage*>(surface);
+			cmd.dataSize = (std::min)(cmd.image->pixels.size(), static_cast<size_t>(width) * height * 4);
+
+			if (!framesInFlight) {
+				memcpy(cmd.image->pixels.data(), pixels, cmd.dataSize);
+				return;
+			}
+
+			tFrame& frame = GetRecordingFrame();
+			cmd.dataOffset = frame.data.size();
+			frame.data.insert(frame.data.end(), pixels, pixels + cmd.dataSize);
+			Record(cmd, nullptr, nullptr, cmd.image);
+		}
+
+		void SetRenderStates(tRenderState const& s) override {
+			states = s;
+		}
+
+		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+			tCommand cmd = {};
+			cmd.type = SIRE_SOFTWARE_COPY;
+			cmd.image = reinterpret_cast<tSoftwareImage*>(dst);
+			cmd.source = reinterpret_cast<tSoftwareImage*>(src);
+
+			if (framesInFlight)
+				return Record(cmd, nullptr, nullptr, nullptr);
+
+			Execute(nullptr, cmd, 0, 1);
+		}
+
+		void SetViewport(tSireViewport const& v) override {
+			viewport = v;
+		}
+
+		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
+			cb.hasTex = texture ? true : false;
+			cb.hasMask = textureMask ? true : false;
+
+			tex = reinterpret_cast<tSoftwareImage*>(texture);
+			mask = reinterpret_cast<tSoftwareImage*>(textureMask);
+		}
+
+		// The pixels are only current once every recorded frame has been rasterized.
+		uint8_t* Lock(void* ptr) override {
+			Finish();
+			return ptr ? reinterpret_cast<tSoftwareImage*>(ptr)->pixels.data() : nullptr;
+		}
+
+		// Blending happens on the stored values, so only the RGBA order is supported.
+		void SetTextureFormat(eSirePixelFormat format) override {
+			if (!IsBgraFormat(format))
+				textureFormat = format;
+		}
+
+		// Drawing is done when the calls return, so the CPU clock times the rasterizer. Pipelined frames take their
+		// timestamps on the raster thread.
+		bool BeginTiming(uint32_t slot) override {
+			timestamps[slot].clear();
+			return true;
+		}
+
+		void WriteTimestamp(uint32_t slot, uint32_t index) override {
+			if (timestamps[slot].size() <= index)
+				timestamps[slot].resize(index + 1);
+
+			if (!framesInFlight) {
+				timestamps[slot][index] = GetTime();
+				return;
+			}
+
+			tCommand cmd = {};
+			cmd.type = SIRE_SOFTWARE_TIMESTAMP;
+			cmd.slot = slot;
+			cmd.index = index;
+			Record(cmd, nullptr, nullptr, nullptr);
+			timingFrames[slot] = submitted;
+		}
+
+		bool ReadTimestamps(uint32_t slot, uint32_t count, uint64_t* out, uint64_t& frequency) override {
+			if (framesInFlight) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (completed <= timingFrames[slot])
+					return false;
+			}
+
+			frequency = count <= timestamps[slot].size() ? 1000000000 : 0;
+			if (frequency)
+				memcpy(out, timestamps[slot].data(), count * sizeof(uint64_t));
+
+			return true;
+		}
+
+		// Hands the frame to the raster thread, recording continues in the next slot once it is free.
+		void EndFrame() override {
+			if (framesInFlight)
+				Submit();
+		}
+
+		// End virtual override
+
+		tSoftwareImage* CreateTexture(uint32_t width, uint32_t height, uint8_t* pixels) {
+			tSoftwareImage* out = new tSoftwareImage(width, height);
+			if (pixels)
+				memcpy(out->pixels.data(), pixels, out->pixels.size());
+
+			return out;
+		}
+
+		tSoftwareImage* CreateCompressedTexture(uint32_t width, uint32_t height, eSirePixelFormat format, uint8_t const* blocks) {
+			std::vector<uint8_t> pixels;
+			if (!DecompressTexture(width, height, format, blocks, pixels))
+				return nullptr;
+
+			tSoftwareImage* out = new tSoftwareImage(0, 0);
+			out->w = width;
+			out->h = height;
+			out->pixels = std::move(pixels);
+			return out;
+		}
+
+		tSoftwareImage* GetBackBuffer() {
+			backBuffer->AddRef();
+			return backBuffer;
+		}
+
+		static uint64_t GetTime() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		tRasterState GetRasterState() {
+			// Zeroed first so recorded states can be compared with memcmp.
+			tRasterState rs;
+			memset(&rs, 0, sizeof(rs));
+			rs.cb = cb;
+			rs.states = states;
+			rs.viewport = viewport;
+			rs.primitiveType = primitiveType;
+			rs.target = currentRenderTargetView ? reinterpret_cast<tSoftwareImage*>(currentRenderTargetView) : backBuffer;
+			rs.tex = tex;
+			rs.mask = mask;
+			return rs;
+		}
+
+		tFrame& GetRecordingFrame() {
+			return frames[submitted % framesInFlight];
+		}
+
+		// Submits what was recorded so far and waits for the raster thread to finish it.
+		void Finish() {
+			if (!framesInFlight)
+				return;
+
+			Submit();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			completedSignal.wait(lock, [&] { return completed == submitted; });
+		}
+
+		void Submit() {
+			if (GetRecordingFrame().commands.empty())
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				submitted++;
+			}
+
+			submittedSignal.notify_one();
+			segmentReads.clear();
+			segmentWrites.clear();
+
+			// The slot held the frame framesInFlight frames back.
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				completedSignal.wait(lock, [&] { return submitted - completed < framesInFlight; });
+			}
+
+			Retire(GetRecordingFrame());
+		}
+
+		void Retire(tFrame& frame) {
+			for (auto& it : frame.images)
+				it->Release();
+
+			for (auto& it : frame.buffers)
+				it->Release();
+
+			frame.commands.clear();
+			frame.states.clear();
+			frame.vertices.clear();
+			frame.indices.clear();
+			frame.data.clear();
+			frame.images.clear();
+			frame.buffers.clear();
+			frame.transformedCount = 0;
+		}
+
+		void RasterThread() {
+			SetProfileThreadName("Sire raster");
+
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					submittedSignal.wait(lock, [&] { return quit || completed != submitted; });
+					if (completed == submitted)
+						return;
+				}
+
+				ExecuteFrame(frames[completed % framesInFlight]);
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					completed++;
+				}
+
+				completedSignal.notify_all();
+			}
+		}
+
+		// Rows of the image that band b of bands covers.
+		static void GetBandRows(tSoftwareImage const* image, uint32_t b, uint32_t bands, int32_t& y0, int32_t& y1) {
+			y0 = static_cast<int32_t>(static_cast<int64_t>(image->h) * b / bands);
+			y1 = static_cast<int32_t>(static_cast<int64_t>(image->h) * (b + 1) / bands);
+		}
+
+		// Commands of a frame run band by band, each band owns the same share of the rows of every image. Bands only
+		// meet where a command reads rows that another band may have written, the recording inserts a barrier there.
+		void Record(tCommand& cmd, tSoftwareImage* read0, tSoftwareImage* read1, tSoftwareImage* write) {
+			tFrame& frame = GetRecordingFrame();
+
+			auto contains = [](std::vector<tSoftwareImage*> const& list, tSoftwareImage* image) {
+				return image && std::find(list.begin(), list.end(), image) != list.end();
+			};
+
+			bool serial = cmd.type == SIRE_SOFTWARE_COPY || cmd.type == SIRE_SOFTWARE_TIMESTAMP;
+			if (serial || contains(segmentWrites, read0) || contains(segmentWrites, read1) || contains(segmentReads, write)) {
+				if (!serial) {
+					tCommand barrier = {};
+					barrier.type = SIRE_SOFTWARE_BARRIER;
+					frame.commands.push_back(barrier);
+				}
+
+				segmentReads.clear();
+				segmentWrites.clear();
+			}
+
+			for (tSoftwareImage* it : { read0, read1 }) {
+				if (it && !contains(segmentReads, it))
+					segmentReads.push_back(it);
+			}
+
+			if (write && !contains(segmentWrites, write))
+				segmentWrites.push_back(write);
+
+			for (tSoftwareImage* it : { cmd.image, cmd.source }) {
+				if (it) {
+					it->AddRef();
+					frame.images.push_back(it);
+				}
+			}
+
+			frame.commands.push_back(cmd);
+		}
+
+		void RecordDraw(tVertex const* v, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount, tSoftwareBuffer* vb, tSoftwareBuffer* ib) {
+			tFrame& frame = GetRecordingFrame();
+
+			tRasterState rs = GetRasterState();
+			if (frame.states.empty() || memcmp(&frame.states.back(), &rs, sizeof(rs))) {
+				frame.states.push_back(rs);
+				for (tSoftwareImage* it : { rs.target, rs.tex, rs.mask }) {
+					if (it) {
+						it->AddRef();
+						frame.images.push_back(it);
+					}
+				}
+			}
+
+			tCommand cmd = {};
+			cmd.type = SIRE_SOFTWARE_DRAW;
+			cmd.state = static_cast<uint32_t>(frame.states.size() - 1);
+			cmd.vertexCount = vertexCount;
+			cmd.indexCount = indexCount;
+			cmd.transformedOffset = frame.transformedCount;
+			frame.transformedCount += vertexCount;
+
+			// Meshes are immutable, the frame keeps a reference instead of a copy.
+			if (vb) {
+				cmd.vertexBuffer = vb;
+				cmd.indexBuffer = ib;
+				for (tSoftwareBuffer* it : { vb, ib }) {
+					if (it) {
+						it->AddRef();
+						frame.buffers.push_back(it);
+					}
+				}
+			}
+			else {
+				cmd.vertexOffset = static_cast<uint32_t>(frame.vertices.size());
+				cmd.indexOffset = static_cast<uint32_t>(frame.indices.size());
+				frame.vertices.insert(frame.vertices.end(), v, v + vertexCount);
+				if (i)
+					frame.indices.insert(frame.indices.end(), i, i + indexCount);
+			}
+
+			Record(cmd, rs.tex, rs.mask, rs.target);
+		}
+
+		static tVertex const* GetVertices(tFrame const& frame, tCommand const& cmd) {
+			return cmd.vertexBuffer ? reinterpret_cast<tVertex const*>(cmd.vertexBuffer->data.data()) : frame.vertices.data() + cmd.vertexOffset;
+		}
+
+		static uint16_t const* GetIndices(tFrame const& frame, tCommand const& cmd) {
+			if (!cmd.indexCount)
+				return nullptr;
+
+			return cmd.indexBuffer ? reinterpret_cast<uint16_t const*>(cmd.indexBuffer->data.data()) : frame.indices.data() + cmd.indexOffset;
+		}
+
+		// Runs on the raster thread. Every run of commands between barriers is transformed over all vertices and then
+		// rasterized over the bands, copies and timestamps run on their own.
+		void ExecuteFrame(tFrame& frame) {
+			SIRE_PROFILE_SCOPE("Sire::RasterFrame");
+
+			frame.transformed.resize(frame.transformedCount);
+
+			struct tContext {
+				SireSoftware* renderer;
+				tFrame* frame;
+				size_t begin;
+				size_t end;
+				std::vector<uint32_t> draws;
+			} context = { this, &frame, 0, 0, {} };
+
+			while (context.begin < frame.commands.size()) {
+				size_t end = context.begin;
+				while (end < frame.commands.size() && frame.commands[end].type <= SIRE_SOFTWARE_UPDATE)
+					end++;
+
+				context.end = end;
+				context.draws.clear();
+				for (size_t n = context.begin; n < end; n++) {
+					if (frame.commands[n].type == SIRE_SOFTWARE_DRAW && frame.commands[n].vertexCount)
+						context.draws.push_back(static_cast<uint32_t>(n));
+				}
+
+				if (!context.draws.empty()) {
+					tCommand const& first = frame.commands[context.draws.front()];
+					tCommand const& last = frame.commands[context.draws.back()];
+
+					// Vertices of a run are contiguous in tFrame::transformed.
+					rasterPool.ParallelFor(last.transformedOffset + last.vertexCount - first.transformedOffset, 4096, [](void* ptr, uint32_t begin, uint32_t end) {
+						tContext& c = *static_cast<tContext*>(ptr);
+						tFrame& f = *c.frame;
+						uint32_t base = f.commands[c.draws.front()].transformedOffset;
+						begin += base;
+						end += base;
+
+						auto it = std::upper_bound(c.draws.begin(), c.draws.end(), begin, [&](uint32_t v, uint32_t n) { return v < f.commands[n].transformedOffset; }) - 1;
+						for (; it != c.draws.end() && f.commands[*it].transformedOffset < end; ++it) {
+							tCommand const& cmd = f.commands[*it];
+							uint32_t from = (std::max)(begin, cmd.transformedOffset) - cmd.transformedOffset;
+							uint32_t to = (std::min)(end, cmd.transformedOffset + cmd.vertexCount) - cmd.transformedOffset;
+							Transform(f.states[cmd.state], GetVertices(f, cmd), from, to, f.transformed.data() + cmd.transformedOffset);
+						}
+					}, &context);
+				}
+
+				if (end > context.begin) {
+					rasterPool.ParallelFor(bands, 1, [](void* ptr, uint32_t begin, uint32_t end) {
+						tContext& c = *static_cast<tContext*>(ptr);
+						for (uint32_t b = begin; b < end; b++) {
+							for (size_t n = c.begin; n < c.end; n++)
+								c.renderer->Execute(c.frame, c.frame->commands[n], b, c.renderer->bands);
+						}
+					}, &context);
+				}
+
+				if (end < frame.commands.size())
+					Execute(&frame, frame.commands[end++], 0, 1);
+
+				context.begin = end;
+			}
+		}
+
+		// Runs a command over the rows of band b. Immediate mode runs everything as a single band without a frame.
+		void Execute(tFrame* frame, tCommand const& cmd, uint32_t b, uint32_t bands) {
+			switch (cmd.type) {
+				case SIRE_SOFTWARE_DRAW:
+				{
+					tRasterState const& rs = frame->states[cmd.state];
+					tClip clip = GetClip(rs);
+					int32_t y0, y1;
+					GetBandRows(rs.target, b, bands, y0, y1);
+					clip.y0 = (std::max)(clip.y0, y0);
+					clip.y1 = (std::min)(clip.y1, y1);
+					if (clip.y0 < clip.y1)
+						Rasterize(rs, clip, frame->transformed.data() + cmd.transformedOffset, cmd.vertexCount, GetIndices(*frame, cmd), cmd.indexCount);
+				} break;
+				case SIRE_SOFTWARE_CLEAR:
+				{
+					int32_t y0, y1;
+					GetBandRows(cmd.image, b, bands, y0, y1);
+					size_t end = static_cast<size_t>(y1) * cmd.image->w * 4;
+					for (size_t i = static_cast<size_t>(y0) * cmd.image->w * 4; i < end; i += 4)
+						memcpy(&cmd.image->pixels[i], cmd.color, 4);
+				} break;
+				case SIRE_SOFTWARE_UPDATE:
+				{
+					int32_t y0, y1;
+					GetBandRows(cmd.image, b, bands, y0, y1);
+					size_t size = (std::min)(cmd.dataSize, cmd.image->pixels.size());
+					size_t begin = (std::min)(static_cast<size_t>(y0) * cmd.image->w * 4, size);
+					size_t end = (std::min)(static_cast<size_t>(y1) * cmd.image->w * 4, size);
+					memcpy(cmd.image->pixels.data() + begin, frame->data.data() + cmd.dataOffset + begin, end - begin);
+				} break;
+				case SIRE_SOFTWARE_COPY:
+					cmd.image->w = cmd.source->w;
+					cmd.image->h = cmd.source->h;
+					cmd.image->pixels = cmd.source->pixels;
+					break;
+				case SIRE_SOFTWARE_TIMESTAMP:
+					timestamps[cmd.slot][cmd.index] = GetTime();
+					break;
+				default:
+					break;
+			}
+		}
+
+		static tClip GetClip(tRasterState const& rs) {
+			tClip clip;
+			clip.x0 = (std::max)(static_cast<int32_t>(std::floor(rs.viewport.x)), 0);
+			clip.y0 = (std::max)(static_cast<int32_t>(std::floor(rs.viewport.y)), 0);
+			clip.x1 = static_cast<int32_t>((std::min)(std::ceil(rs.viewport.x + rs.viewport.w), static_cast<float>(rs.target->w)));
+			clip.y1 = static_cast<int32_t>((std::min)(std::ceil(rs.viewport.y + rs.viewport.h), static_cast<float>(rs.target->h)));
+			return clip;
+		}
+
+		// VShader of the internal shaders followed by the viewport mapping, for the vertices [first, last).
+		static void Transform(tRasterState const& rs, tVertex const* v, uint32_t first, uint32_t last, tSoftwareVertex* out) {
+			tSireMatrix const& m = rs.cb.matrix;
+			tSireViewport const& vp = rs.viewport;
+			for (uint32_t n = first; n < last; n++) {
+				tSireFloat3 const& p = v[n].pos;
+				float x = p.x * m._11 + p.y * m._21 + p.z * m._31 + m._41;
+				float y = p.x * m._12 + p.y * m._22 + p.z * m._32 + m._42;
+				float w = p.x * m._14 + p.y * m._24 + p.z * m._34 + m._44;
+
+				// Vertices behind the eye drop their primitives, there's no clipping against the near plane.
+				tSoftwareVertex& o = out[n];
+				o.invW = w > 0.0f ? 1.0f / w : 0.0f;
+				o.x = vp.x + (x * o.invW + 1.0f) * 0.5f * vp.w;
+				o.y = vp.y + (1.0f - y * o.invW) * 0.5f * vp.h;
+				if (!std::isfinite(o.x) || !std::isfinite(o.y))
+					o.invW = 0.0f;
+
+				float const attr[8] = { v[n].col.x, v[n].col.y, v[n].col.z, v[n].col.w, v[n].uv0.x, v[n].uv0.y, v[n].uv1.x, v[n].uv1.y };
+				for (int32_t k = 0; k < 8; k++)
+					o.attr[k] = attr[k] * o.invW;
+			}
+		}
+
+		// Rasterizes transformed vertices into the target of rs, clipped to clip.
+		static void Rasterize(tRasterState const& rs, tClip const& clip, tSoftwareVertex const* tv, uint32_t vertexCount, uint16_t const* i, uint32_t indexCount) {
+			if (clip.x0 >= clip.x1 || clip.y0 >= clip.y1)
+				return;
+
+			uint32_t count = i ? indexCount : vertexCount;
+			auto get = [&](uint32_t n) -> tSoftwareVertex const* {
+				uint32_t index = i ? i[n] : n;
+				return index < vertexCount && tv[index].invW > 0.0f ? &tv[index] : nullptr;
+			};
+
+			switch (rs.primitiveType) {
+				case SIRE_POINT:
+					for (uint32_t n = 0; n < count; n++) {
+						if (tSoftwareVertex const* a = get(n))
+							DrawPoint(rs, clip, *a);
+					}
+					break;
+				case SIRE_LINE:
+					for (uint32_t n = 0; n + 1 < count; n += 2) {
+						tSoftwareVertex const* a = get(n);
+						tSoftwareVertex const* b = get(n + 1);
+						if (a && b)
+							DrawLine(rs, clip, *a, *b);
+					}
+					break;
+				case SIRE_TRIANGLE:
+					for (uint32_t n = 0; n + 2 < count; n += 3) {
+						tSoftwareVertex const* a = get(n);
+						tSoftwareVertex const* b = get(n + 1);
+						tSoftwareVertex const* c = get(n + 2);
+						if (a && b && c)
+							DrawTriangle(rs, clip, *a, *b, *c);
+					}
+					break;
+				default:
+					break;
+			}
+		}
+
+		static inline float Edge(tSoftwareVertex const& a, tSoftwareVertex const& b, float x, float y) {
+			return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+		}
+
+		// Top-left fill rule for the clockwise winding the triangles are sorted to.
+		static inline bool IsTopLeft(tSoftwareVertex const& a, tSoftwareVertex const& b) {
+			return b.y < a.y || (b.y == a.y && b.x > a.x);
+		}
+
+		static void DrawTriangle(tRasterState const& rs, tClip const& clip, tSoftwareVertex const& a, tSoftwareVertex const& b, tSoftwareVertex const& c) {
+			float area = Edge(a, b, c.x, c.y);
+			if (area == 0.0f || !std::isfinite(area))
+				return;
+
+			// Clockwise on screen is the front face, as in D3D.
+			if ((rs.states.cullMode == SIRE_CULL_FRONT && area > 0.0f) || (rs.states.cullMode == SIRE_CULL_BACK && area < 0.0f))
+				return;
+
+			if (rs.states.fillMode == SIRE_FILL_WIREFRAME) {
+				DrawLine(rs, clip, a, b);
+				DrawLine(rs, clip, b, c);
+				DrawLine(rs, clip, c, a);
+				return;
+			}
+
+			tSoftwareVertex const* v[3] = { &a, &b, &c };
+			if (area < 0.0f) {
+				std::swap(v[1], v[2]);
+				area = -area;
+			}
+
+			int32_t x0 = static_cast<int32_t>((std::max)(std::floor((std::min)({ a.x, b.x, c.x })), static_cast<float>(clip.x0)));
+			int32_t y0 = static_cast<int32_t>((std::max)(std::floor((std::min)({ a.y, b.y, c.y })), static_cast<float>(clip.y0)));
+			int32_t x1 = static_cast<int32_t>((std::min)(std::ceil((std::max)({ a.x, b.x, c.x })), static_cast<float>(clip.x1)));
+			int32_t y1 = static_cast<int32_t>((std::min)(std::ceil((std::max)({ a.y, b.y, c.y })), static_cast<float>(clip.y1)));
+
+			bool topLeft[3] = { IsTopLeft(*v[1], *v[2]), IsTopLeft(*v[2], *v[0]), IsTopLeft(*v[0], *v[1]) };
+			float invArea = 1.0f / area;
+
+			// Covered pixels of a row are shaded into a span and blended together.
+			float span[SIRE_SOFTWARE_SPAN * 4];
+			uint32_t count = 0;
+			int32_t spanX = 0;
+			auto flush = [&](int32_t y) {
+				if (count)
+					BlendSpan(rs.states, &rs.target->pixels[(static_cast<size_t>(y) * rs.target->w + spanX) * 4], span, count);
+
+				count = 0;
+			};
+
+			for (int32_t y = y0; y < y1; y++) {
+				float py = y + 0.5f;
+				for (int32_t x = x0; x < x1; x++) {
+					float px = x + 0.5f;
+					float w[3] = { Edge(*v[1], *v[2], px, py), Edge(*v[2], *v[0], px, py), Edge(*v[0], *v[1], px, py) };
+
+					bool inside = true;
+					for (int32_t k = 0; k < 3; k++)
+						inside &= w[k] > 0.0f || (w[k] == 0.0f && topLeft[k]);
+
+					if (!inside) {
+						flush(y);
+						continue;
+					}
+
+					float l0 = w[0] * invArea;
+					float l1 = w[1] * invArea;
+					float l2 = w[2] * invArea;
+					float invW = l0 * v[0]->invW + l1 * v[1]->invW + l2 * v[2]->invW;
+
+					float attr[8];
+					for (int32_t k = 0; k < 8; k++)
+						attr[k] = (l0 * v[0]->attr[k] + l1 * v[1]->attr[k] + l2 * v[2]->attr[k]) / invW;
+
+					if (!count)
+						spanX = x;
+
+					ShadePixel(rs, attr, &span[count * 4]);
+					if (++count == SIRE_SOFTWARE_SPAN)
+						flush(y);
+				}
+
+				flush(y);
+			}
+		}
+
+		// One pixel wide, the last pixel is left out like on the GPU. Only the steps inside the clip rect are walked.
+		static void DrawLine(tRasterState const& rs, tClip const& clip, tSoftwareVertex const& a, tSoftwareVertex const& b) {
+			float dx = b.x - a.x;
+			float dy = b.y - a.y;
+			float length = (std::min)(std::ceil((std::max)(std::fabs(dx), std::fabs(dy))), 16777216.0f);
+			if (length <= 0.0f)
+				return DrawPoint(rs, clip, a);
+
+			float t0 = 0.0f;
+			float t1 = 1.0f;
+			float const p[4] = { -dx, dx, -dy, dy };
+			float const q[4] = { a.x - clip.x0, clip.x1 - a.x, a.y - clip.y0, clip.y1 - a.y };
+			for (int32_t k = 0; k < 4; k++) {
+				if (p[k] == 0.0f) {
+					if (q[k] < 0.0f)
+						return;
+				}
+				else if (p[k] < 0.0f) {
+					t0 = (std::max)(t0, q[k] / p[k]);
+				}
+				else {
+					t1 = (std::min)(t1, q[k] / p[k]);
+				}
+			}
+
+			if (t0 > t1)
+				return;
+
+			int32_t steps = static_cast<int32_t>(length);
+			int32_t first = (std::max)(static_cast<int32_t>(std::floor(t0 * length)) - 1, 0);
+			int32_t last = (std::min)(static_cast<int32_t>(std::ceil(t1 * length)) + 1, steps);
+
+			for (int32_t s = first; s < last; s++) {
+				float t = s / length;
+				int32_t x = static_cast<int32_t>(std::floor(a.x + dx * t));
+				int32_t y = static_cast<int32_t>(std::floor(a.y + dy * t));
+				if (x < clip.x0 || y < clip.y0 || x >= clip.x1 || y >= clip.y1)
+					continue;
+
+				float invW = a.invW + (b.invW - a.invW) * t;
+
+				float attr[8];
+				for (int32_t k = 0; k < 8; k++)
+					attr[k] = (a.attr[k] + (b.attr[k] - a.attr[k]) * t) / invW;
+
+				float c[4];
+				ShadePixel(rs, attr, c);
+				BlendSpan(rs.states, &rs.target->pixels[(static_cast<size_t>(y) * rs.target->w + x) * 4], c, 1);
+			}
+		}
+
+		static void DrawPoint(tRasterState const& rs, tClip const& clip, tSoftwareVertex const& a) {
+			float fx = std::floor(a.x);
+			float fy = std::floor(a.y);
+			if (!(fx >= clip.x0 && fy >= clip.y0 && fx < clip.x1 && fy < clip.y1))
+				return;
+
+			float attr[8];
+			for (int32_t k = 0; k < 8; k++)
+				attr[k] = a.attr[k] / a.invW;
+
+			float c[4];
+			ShadePixel(rs, attr, c);
+			BlendSpan(rs.states, &rs.target->pixels[(static_cast<size_t>(fy) * rs.target->w + static_cast<int32_t>(fx)) * 4], c, 1);
+		}
+
+		// PShader of the internal shaders, c receives the unclamped output.
+		static void ShadePixel(tRasterState const& rs, float const* attr, float* c) {
+			for (int32_t k = 0; k < 4; k++)
+				c[k] = attr[k];
+
+			float t[4];
+
+			if (rs.cb.isSdf) {
+				Sample(rs.tex, attr[4], attr[5], t);
+				c[3] *= SmoothStep(0.5f - attr[6], 0.5f + attr[6], t[3]);
+			}
+			else if (rs.cb.hasTex) {
+				Sample(rs.tex, attr[4], attr[5], t);
+				for (int32_t k = 0; k < 4; k++)
+					c[k] *= t[k];
+
+				if (!rs.cb.texAlpha)
+					c[3] = (std::max)(c[3], attr[3]);
+			}
+
+			if (rs.cb.hasMask) {
+				Sample(rs.mask, attr[6], attr[7], t);
+				for (int32_t k = 0; k < 4; k++)
+					c[k] *= t[k];
+			}
+
+			c[0] *= rs.cb.tint.x;
+			c[1] *= rs.cb.tint.y;
+			c[2] *= rs.cb.tint.z;
+			c[3] *= rs.cb.tint.w;
+		}
+
+		static inline float SmoothStep(float e0, float e1, float x) {
+			if (e1 == e0)
+				return x < e0 ? 0.0f : 1.0f;
+
+			float t = (std::min)((std::max)((x - e0) / (e1 - e0), 0.0f), 1.0f);
+			return t * t * (3.0f - 2.0f * t);
+		}
+
+		// Bilinear with wrap addressing, unbound textures read as zero.
+		static inline void Sample(tSoftwareImage const* image, float u, float v, float* out) {
+			if (!image || image->w <= 0 || image->h <= 0 || !std::isfinite(u) || !std::isfinite(v)) {
+				out[0] = out[1] = out[2] = out[3] = 0.0f;
+				return;
+			}
+
+			float x = u * image->w - 0.5f;
+			float y = v * image->h - 0.5f;
+			x -= std::floor(x / image->w) * image->w;
+			y -= std::floor(y / image->h) * image->h;
+
+			int32_t x0 = (std::min)(static_cast<int32_t>(x), image->w - 1);
+			int32_t y0 = (std::min)(static_cast<int32_t>(y), image->h - 1);
+			int32_t x1 = x0 + 1 < image->w ? x0 + 1 : 0;
+			int32_t y1 = y0 + 1 < image->h ? y0 + 1 : 0;
+			float fx = x - x0;
+			float fy = y - y0;
+
+			uint8_t const* p = image->pixels.data();
+			uint8_t const* t00 = p + (static_cast<size_t>(y0) * image->w + x0) * 4;
+			uint8_t const* t10 = p + (static_cast<size_t>(y0) * image->w + x1) * 4;
+			uint8_t const* t01 = p + (static_cast<size_t>(y1) * image->w + x0) * 4;
+			uint8_t const* t11 = p + (static_cast<size_t>(y1) * image->w + x1) * 4;
+
+			for (int32_t k = 0; k < 4; k++) {
+				float top = t00[k] + (t10[k] - t00[k]) * fx;
+				float bottom = t01[k] + (t11[k] - t01[k]) * fx;
+				out[k] = (top + (bottom - top) * fy) * (1.0f / 255.0f);
+			}
+		}
+	};
+
+#endif
+
+	// The current renderer is reached through tBackend. With a single backend it's the final backend type itself, calls
+	// through it don't go through the vtable and inline into the per-vertex path.
+#if defined(SIRE_STATIC_DISPATCH) && defined(SIRE_DX9)
+	typedef SireDirectX9 tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_DX9;
+#elif defined(SIRE_STATIC_DISPATCH) && defined(SIRE_DX10)
+	typedef SireDirectX10 tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_DX10;
+#elif defined(SIRE_STATIC_DISPATCH) && defined(SIRE_DX11)
+	typedef SireDirectX11 tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_DX11;
+#elif defined(SIRE_STATIC_DISPATCH) && defined(SIRE_DX12)
+	typedef SireDirectX12 tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_DX12;
+#elif defined(SIRE_STATIC_DISPATCH) && defined(SIRE_OPENGL)
+	typedef SireOpenGL tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_OPENGL;
+#elif defined(SIRE_STATIC_DISPATCH) && defined(SIRE_VULKAN)
+	typedef SireVulkan tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_VULKAN;
+#elif defined(SIRE_STATIC_DISPATCH) && defined(SIRE_SOFTWARE)
+	typedef SireSoftware tBackend;
+	static constexpr eSireRenderer SIRE_STATIC_RENDERER = SIRE_RENDERER_SOFTWARE;
+#else
+	typedef SireRenderer tBackend;
+#endif
+
+	static constexpr auto SIRE_NUM_MAX_POOLED_LAYER_TARGETS = 8;
+	static constexpr auto SIRE_NUM_MAX_TEXT_LAYOUTS = 4096;
+	static constexpr uint16_t SIRE_PRIMITIVE_RESTART_INDEX = 0xFFFF;
+	static constexpr auto SIRE_TEXT_ATLAS_SIZE = 1024;
+	static constexpr auto SIRE_TEXT_SDF_SIZE = 32;
+	static constexpr auto SIRE_TEXT_SDF_SPREAD = 4;
+	static constexpr auto SIRE_NUM_MAX_PATH_GEOMETRIES = 1024;
+	// Max distance in pixels between a curve or round join and its flattened polyline.
+	static constexpr float SIRE_PATH_TOLERANCE = 0.25f;
+	static constexpr float SIRE_PATH_FRINGE = 1.0f;
+	static constexpr auto SIRE_MAX_IMAGE_DIMENSION = 32768;
+	static constexpr uint32_t SIRE_PERF_BASELINE_VERSION = 1;
+
+	static inline tSireShared shared = {};
+
+	static inline tSireFrameArena frameArena = {};
+	static inline bool frameArenaAutoReset = true;
+
+	static inline eSirePrimitiveType primitiveType = SIRE_TRIANGLE;
+	static inline tSireArenaVector<tVertex> vertices = {};
+	static inline tSireFloat4 color = {};
+	static inline tSireFloat2 uv0 = {};
+	static inline tSireFloat2 uv1 = {};
+
+	static inline tSireArenaVector<uint16_t> indices = {};
+	static inline uint32_t numIndices = 0;
+	static inline bool autoIndex = false;
+
+	static inline std::array<SireRenderer*, SIRE_NUM_RENDERERS> renderers = {};
+	static inline eSireRenderer currentRenderer = SIRE_RENDERER_NULL;
+	static inline uintptr_t* currentRendererMainPtr = nullptr;
+	static inline bool renderersInitialised = false;
+
+	static inline tConstBuff cb = { {}, false, false, false, false, { 1.0f, 1.0f, 1.0f, 1.0f } };
+
+	static inline uintptr_t* currentRenderTargetView = nullptr;
+	static inline uintptr_t* currentTexture = nullptr;
+	static inline uintptr_t* currentMask = nullptr;
+	static inline uint64_t currentTextureId = 0;
+	static inline uint64_t currentMaskId = 0;
+	static inline uint64_t currentRenderTargetTexture = 0;
+	static inline uint64_t textureGeneration = 0;
+	static inline uint64_t textureIds = 0;
+	// Declared before the pools below so that it outlives the textures they hold.
+	static inline std::unordered_map<uint64_t, tSireTexture2D*> texturesById = {};
+	static inline uintptr_t* currentPixelShader = nullptr;
+	static inline uintptr_t* currentVertexShader = nullptr;
+
+	static inline std::unordered_map<uint32_t, tLayer> layers = {};
+	static inline std::vector<tLayerTarget> layerTargetPool = {};
+	static inline tLayer* currentLayer = nullptr;
+
+	static inline bool sortedSubmission = false;
+	static inline uint8_t sortLayer = 0;
+	static inline int32_t sortDepth = -1;
+	static inline uint32_t sortSequence = 0;
+	static inline tCommandList sortedDraws = {};
+	static inline std::vector<tSortItem> sortItems = {};
+	static inline std::vector<tSortItem> sortScratch = {};
+	static inline std::unordered_map<uint64_t, uint32_t> shaderSortIds = {};
+	static inline std::unordered_map<uint64_t, uint32_t> blendSortIds = {};
+	static inline std::unordered_map<uint64_t, uint32_t> textureSortIds = {};
+
+	static inline SireGDIGlyphRasterizer gdiGlyphRasterizer = {};
+	static inline tSireGlyphRasterizer* glyphRasterizer = nullptr;
+	static inline std::vector<tFont> fonts = {};
+	static inline tTextAtlas textAtlas = {};
+	static inline std::unordered_map<uint64_t, tTextLayout> textLayouts = {};
+	static inline std::vector<tVertex> textVertices = {};
+	static inline std::vector<uint16_t> textIndices = {};
+	static inline bool textBatchActive = false;
+
+	static inline std::unordered_map<uint64_t, tPathGeometry> pathGeometries = {};
+	static inline std::vector<tSireFloat2> pathPoints = {};
+	static inline std::vector<tPathContour> pathContours = {};
+	static inline std::vector<tPathSection> pathSections = {};
+	static inline std::vector<tPathEdge> pathEdges = {};
+	static inline std::vector<uint32_t> pathActiveEdges = {};
+	static inline std::vector<float> pathScanlines = {};
+	static inline std::vector<uint32_t> pathIndices = {};
+
+	static inline std::atomic<tPacketNode*> packetQueue = nullptr;
+	static inline tThreadPool threadPool = {};
+
+	static inline tTextureLoader textureLoader = {};
+	static inline std::unordered_map<tSireTexture2D*, tTextureLoad*> textureLoads = {};
+	static inline SirePtr<tSireTexture2D> placeholderTexture = nullptr;
+	static inline float textureUploadBudget = 2.0f;
+
+	static inline tTraceWriter traceWriter = {};
+
+#ifdef SIRE_PROFILE
+	static inline std::atomic<tProfileRing*> profileRings = nullptr;
+	static inline std::atomic<uint32_t> profileThreads = 0;
+	static inline std::atomic<uint64_t> profileClearTime = 0;
+	static inline thread_local tProfileRing* profileRing = nullptr;
+#endif
+
+	static inline tSireFrameStats frameStats = {};
+	static inline tSireFrameStats lastFrameStats = {};
+
+	static inline bool gpuTiming = false;
+	static inline const char* timingTag = nullptr;
+	static inline tTimingFrame timingFrames[SireRenderer::SIRE_TIMING_FRAMES] = {};
+	static inline int32_t timingSlot = -1;
+	static inline bool timingSkipped = false;
+	static inline std::vector<uint64_t> timingTimestamps = {};
+	static inline tSireGpuFrameTiming gpuFrameTiming = {};
+	static inline bool gpuFrameTimingValid = false;
+
+	static inline tSireTextureStats textureStats = {};
+	static inline tSireTexture2D* textureLruHead = nullptr;
+	static inline tSireTexture2D* textureLruTail = nullptr;
+	static inline uint64_t frameCount = 0;
+
+	static inline tSireShaderCache shaderCache = {};
+	static inline tSireShaderCompiler* shaderCompiler = nullptr;
+
+	static inline std::string glslShader3_3_0 = R"(
+	#version 330 core
+
+	layout(std140) uniform ConstantBuffer
+	{
+		mat4 proj;
+		int hasTex;
+		int hasMask;
+		int texAlpha;
+		int isSdf;
+		vec4 tint;
+	};
+
+	uniform sampler2D tex0;
+	uniform sampler2D mask0;
+
+	layout(location = 0) in vec4 position;
+	layout(location = 1) in vec4 color;
+	layout(location = 2) in vec2 uv0;
+	layout(location = 3) in vec2 uv1;
+
+	out vec4 FragColor;
+
+	void main()
+	{
+		gl_Position = proj * position;
+		FragColor = color;
+
+		// Distance field glyphs, uv1.x holds the edge smoothing.
+		if (isSdf != 0)
+		{
+			FragColor.a *= smoothstep(0.5 - uv1.x, 0.5 + uv1.x, texture(tex0, uv0).a);
+		}
+		else if (hasTex )
+		{
+			FragColor *= texture(tex0, uv0);
+
+			if (texAlpha == 0)
+				FragColor.a = max(FragColor.a, color.a);
+		}
+
+		if (hasMask)
+		{
+			FragColor *= texture(mask0, uv1);
+		}
+
+		FragColor *= tint;
+	}
+	)";
+
+	static inline std::string hlslShader2_0 = R"(
+	matrix proj;
+	int hasTex;
+	int hasMask;
+	int texAlpha;
+	int isSdf;
+	float4 tint;
+	
+	sampler2D tex0 : register(s0);
+	sampler2D mask0 : register(s1);
+	
+	struct VOut
+	{
+		float4 position : POSITION;
+		float4 color : COLOR;
+		float2 uv0 : TEXCOORD0;
+		float2 uv1 : TEXCOORD1;
+	};
+	
+	VOut VShader(float4 position : POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1)
+	{
+		VOut output;
+	
+		output.position = mul(position, proj);
+		output.color = color;
+		output.uv0 = uv0;
+		output.uv1 = uv1;
+	
+		return output;
+	}
+	
+	float4 PShader(VOut input) : COLOR
+	{
+		float4 c = input.color;
+
+		// Distance field glyphs, uv1.x holds the edge smoothing.
+		if (isSdf)
+		{
+			c.a *= smoothstep(0.5 - input.uv1.x, 0.5 + input.uv1.x, tex2D(tex0, input.uv0).a);
+		}
+		else if (hasTex)
+		{   
+			c *= tex2D(tex0, input.uv0);
+
+			if (!texAlpha)
+				c.a = max(c.a, input.color.a);
+		}
+		
+		if (hasMask)
+		{
+			c *= tex2D(mask0, input.uv1);
+		}
+
+		c *= tint;
+		
+		return c;
+	}
+	)";
+
+	static inline std::string hlslShader4_0 = R"(
+	cbuffer ConstantBuffer : register(b0)
+	{
+		matrix proj;
+		int hasTex;
+		int hasMask;
+		int texAlpha;
+		int isSdf;
+		float4 tint;
+	};
+	
+	Texture2D tex0 : register(t0);
+	Texture2D mask0 : register(t1);
+	SamplerState sampler0 : register(s0);
+	
+	struct VOut
+	{
+		float4 position : POSITION;
+		float4 color : COLOR;
+		float2 uv0 : TEXCOORD0;
+		float2 uv1 : TEXCOORD1;
+	};
+	
+	VOut VShader(float4 position : POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1)
+	{
+		VOut output;
+	
+		output.position = mul(position, proj);
+		output.color = color;
+		output.uv0 = uv0;
+		output.uv1 = uv1;
+	
+		return output;
+	}
+	
+	float4 PShader(VOut input) : SV_Target
+	{
+		float4 c = input.color;
+	
+		// Distance field glyphs, uv1.x holds the edge smoothing.
+		if (isSdf)
+		{
+			c.a *= smoothstep(0.5 - input.uv1.x, 0.5 + input.uv1.x, tex0.Sample(sampler0, input.uv0).a);
+		}
+		else if (hasTex)
+		{
+			c *= tex0.Sample(sampler0, input.uv0);
+
+			if (!texAlpha)
+				c.a = max(c.a, input.color.a);
+		}
+	
+		if (hasMask)
+		{
+			c *= mask0.Sample(sampler0, input.uv1);
+		}
+
+		c *= tint;
+	
+		return c;
+	}
+	)";
+
+
+	static inline std::string hlslShader5_0 = R"(
+	cbuffer ConstantBuffer : register(b0)
+	{
+		matrix proj;
+		int hasTex;
+		int hasMask;
+		int texAlpha;
+		int isSdf;
+		float4 tint;
+	};
+	
+	Texture2D tex0 : register(t0);
+	Texture2D mask0 : register(t1);
+	SamplerState sampler0 : register(s0);
+	
+	struct VOut
+	{
+		float4 position : SV_POSITION;
+		float4 color : COLOR;
+		float2 uv0 : TEXCOORD0;
+		float2 uv1 : TEXCOORD1;
+	};
+	
+	VOut VShader(float4 position : POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1)
+	{
+		VOut output;
+	
+		output.position = mul(position, proj);
+		output.color = color;
+		output.uv0 = uv0;
+		output.uv1 = uv1;
+	
+		return output;
+	}
+	
+	float4 PShader(float4 position : SV_POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1) : SV_TARGET
+	{
+		float4 c = color;
+	
+		// Distance field glyphs, uv1.x holds the edge smoothing.
+		if (isSdf)
+		{
+			c.a *= smoothstep(0.5 - uv1.x, 0.5 + uv1.x, tex0.Sample(sampler0, uv0).a);
+		}
+		else if (hasTex)
+		{   
+			c *= tex0.Sample(sampler0, uv0);
+
+			if (!texAlpha)
+				c.a = max(c.a, color.a);
+		}
+		
+		if (hasMask)
+		{
+			c *= mask0.Sample(sampler0, uv1);
+		}
+
+		c *= tint;
+		
+		return c;
+	}
+	)";
+
+	// Skips the padding before sampleMask.
+	static inline uint64_t HashDrawState(tRenderState const& states, uint64_t seed = SIRE_HASH_SEED) {
+		uint64_t out = Hash64(&states, offsetof(tRenderState, stencilEnable) + 1, seed);
+		return Hash64(&states.sampleMask, sizeof(states.sampleMask), out);
+	}
+
+	static inline uint64_t HashDrawCommand(tDrawCommand const& cmd, uint64_t seed) {
+		uint64_t out = Hash64(&cmd.primitiveType, sizeof(cmd.primitiveType), seed);
+		out = Hash64(&cmd.vertexCount, sizeof(cmd.vertexCount), out);
+		out = Hash64(&cmd.indexCount, sizeof(cmd.indexCount), out);
+		out = Hash64(&cmd.cb, sizeof(cmd.cb), out);
+
+		out = HashDrawState(cmd.renderStates, out);
+
+		uintptr_t* ptrs[] = { cmd.texture, cmd.mask, cmd.pixelShader, cmd.vertexShader, cmd.meshVertexBuffer, cmd.meshIndexBuffer };
+		out = Hash64(ptrs, sizeof(ptrs), out);
+		return Hash64(cmd.generations, sizeof(cmd.generations), out);
+	}
+
+	static inline tDrawCommand& RecordDrawCommand(tCommandList& list, uintptr_t* meshVertexBuffer, uintptr_t* meshIndexBuffer, uint32_t vertexCount, uint32_t indexCount) {
+		tDrawCommand cmd = {};
+		cmd.primitiveType = primitiveType;
+		cmd.vertexOffset = static_cast<uint32_t>(list.vertices.size());
+		cmd.vertexCount = vertexCount;
+		cmd.indexOffset = static_cast<uint32_t>(list.indices.size());
+		cmd.indexCount = indexCount;
+		cmd.cb = cb;
+		cmd.renderStates = shared.renderStates;
+		cmd.texture = currentTexture;
+		cmd.mask = currentMask;
+		cmd.pixelShader = currentPixelShader;
+		cmd.vertexShader = currentVertexShader;
+		cmd.meshVertexBuffer = meshVertexBuffer;
+		cmd.meshIndexBuffer = meshIndexBuffer;
+		cmd.timingTag = timingTag;
+
+		tSireTexture2D const* sources[] = { FindTexture(currentTextureId), FindTexture(currentMaskId) };
+		for (uint32_t i = 0; i < 2; i++) {
+			if (sources[i])
+				cmd.generations[i] = sources[i]->generation;
+		}
+
+		if (!meshVertexBuffer) {
+			list.vertices.insert(list.vertices.end(), vertices.begin(), vertices.begin() + vertexCount);
+			list.indices.insert(list.indices.end(), indices.begin(), indices.begin() + indexCount);
+		}
+
+		list.commands.push_back(cmd);
+		return list.commands.back();
+	}
+
+	// Records into the open layer, or into the sorted queue.
+	static inline void RecordDraw(uintptr_t* meshVertexBuffer, uintptr_t* meshIndexBuffer, uint32_t vertexCount, uint32_t indexCount) {
+		if (currentLayer) {
+			tLayer& layer = *currentLayer;
+			tDrawCommand& cmd = RecordDrawCommand(layer.list, meshVertexBuffer, meshIndexBuffer, vertexCount, indexCount);
+
+			if (!meshVertexBuffer) {
+				layer.pendingHash = Hash64(vertices.data(), vertexCount * sizeof(tVertex), layer.pendingHash);
+				layer.pendingHash = Hash64(indices.data(), indexCount * sizeof(uint16_t), layer.pendingHash);
+			}
+
+			layer.pendingHash = HashDrawCommand(cmd, layer.pendingHash);
+			return;
+		}
+
+		// The depth field is exhausted, submit what we have to keep the order.
+		bool blended = shared.renderStates.blendEnable != 0;
+		if (blended && sortDepth < 0 && sortSequence >= 0xFFFE)
+			FlushSortedDraws();
+
+		tDrawCommand& cmd = RecordDrawCommand(sortedDraws, meshVertexBuffer, meshIndexBuffer, vertexCount, indexCount);
+
+		// Blended draws take odd depths in order, opaque draws the even depth between the blended draws around them.
+		// They only reorder among the opaque draws of the same gap.
+		uint64_t depth = sortDepth >= 0 ? static_cast<uint64_t>(sortDepth) : sortSequence;
+		if (blended && sortDepth < 0) {
+			depth = sortSequence + 1;
+			sortSequence += 2;
+		}
+		uint64_t shader = GetSortId(shaderSortIds, reinterpret_cast<uintptr_t>(cmd.pixelShader) * 31 + reinterpret_cast<uintptr_t>(cmd.vertexShader));
+		uint64_t blend = GetSortId(blendSortIds, HashDrawState(cmd.renderStates));
+		uint64_t texture = GetSortId(textureSortIds, reinterpret_cast<uintptr_t>(cmd.texture) * 31 + reinterpret_cast<uintptr_t>(cmd.mask));
+
+		cmd.sortKey = (static_cast<uint64_t>(sortLayer) << 56) | ((depth & 0xFFFF) << 40) | ((shader & 0xFFF) << 28) | ((blend & 0xFFF) << 16) | (texture & 0xFFFF);
+	}
+
+	static inline tLayerTarget AcquireLayerTarget(int32_t width, int32_t height) {
+		for (auto it = layerTargetPool.begin(); it != layerTargetPool.end(); ++it) {
+			if (it->texture->w == width && it->texture->h == height) {
+				tLayerTarget out = std::move(*it);
+				layerTargetPool.erase(it);
+				return out;
+			}
+		}
+
+		tLayerTarget out;
+		out.texture = CreateTexture(width, height, nullptr);
+		if (!out.texture || !out.texture->ptrs.texture)
+			return tLayerTarget();
+
+		out.target = CreateRenderTargetView(out.texture);
+		if (!out.target || !out.target->renderTargetView)
+			return tLayerTarget();
+
+		return out;
+	}
+
+	static inline void ReleaseLayerTarget(tLayerTarget& target) {
+		if (!target.texture)
+			return;
+
+		if (layerTargetPool.size() >= SIRE_NUM_MAX_POOLED_LAYER_TARGETS)
+			layerTargetPool.erase(layerTargetPool.begin());
+
+		layerTargetPool.push_back(std::move(target));
+		target = tLayerTarget();
+	}
+
+	// Replays the recorded batches, into the layer target when given or straight to the current target otherwise.
+	static inline void ReplayLayer(tLayer& layer, uintptr_t* renderTargetView) {
+		tBackend* renderer = GetRenderer();
+
+		tConstBuff prevcb = cb;
+		eSirePrimitiveType prevType = primitiveType;
+		uintptr_t* prevRenderTargetView = currentRenderTargetView;
+
+		tSireMatrix remap;
+		remap.Identity();
+
+		if (renderTargetView) {
+			float rw = static_cast<float>(layer.target.texture->w);
+			float rh = static_cast<float>(layer.target.texture->h);
+			tSireViewport const& vp = shared.viewport;
+
+			// Maps the layer rect of the viewport onto the whole target.
+			remap._11 = vp.w / rw;
+			remap._22 = vp.h / rh;
+			remap._41 = (vp.w + 2.0f * (vp.x - layer.rect.x)) / rw - 1.0f;
+			remap._42 = 1.0f - (2.0f * (vp.y - layer.rect.y) + vp.h) / rh;
+
+			currentRenderTargetView = renderTargetView;
+			renderer->ClearRenderTarget(renderTargetView, { 0.0f, 0.0f, 0.0f, 0.0f });
+			renderer->SetViewport({ 0.0f, 0.0f, rw, rh, vp.mind, vp.maxd });
+		}
+
+		for (auto& it : layer.list.commands) {
+			renderer->SetTexture(it.texture, it.mask);
+			renderer->SetPixelShader(it.pixelShader);
+			renderer->SetVertexShader(it.vertexShader);
+
+			cb = it.cb;
+			cb.matrix = it.cb.matrix * remap;
+			primitiveType = it.primitiveType;
+
+			// Accumulate coverage in the target alpha, the cached texture is then composited as premultiplied.
+			tRenderState states = it.renderStates;
+			if (renderTargetView) {
+				states.srcBlendAlpha = SIRE_BLEND_ONE;
+				states.destBlendAlpha = SIRE_BLEND_INV_SRC_ALPHA;
+			}
+
+			renderer->Begin();
+			ApplyRenderStates(renderer, states);
+
+			CountDraw(it.vertexCount, it.indexCount, !it.meshVertexBuffer);
+
+			if (it.meshVertexBuffer) {
+				BeginBatchTiming(renderer, it.timingTag);
+				renderer->DrawMesh(it.meshVertexBuffer, it.meshIndexBuffer, it.vertexCount, it.indexCount);
+			}
+			else {
+				vertices.assign(layer.list.vertices.data() + it.vertexOffset, it.vertexCount);
+				indices.assign(layer.list.indices.data() + it.indexOffset, it.indexCount);
+				numIndices = it.indexCount;
+				BeginBatchTiming(renderer, it.timingTag);
+				renderer->End();
+			}
+
+			EndBatchTiming(renderer);
+		}
+
+		renderer->SetTexture(currentTexture, currentMask);
+		renderer->SetPixelShader(currentPixelShader);
+		renderer->SetVertexShader(currentVertexShader);
+		renderer->SetViewport(shared.viewport);
+
+		cb = prevcb;
+		primitiveType = prevType;
+		currentRenderTargetView = prevRenderTargetView;
+
+		vertices.clear();
+		indices.clear();
+		numIndices = 0;
+	}
+
+	static inline uint32_t GetSortId(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t value) {
+		auto it = ids.find(value);
+		if (it != ids.end())
+			return it->second;
+
+		uint32_t out = static_cast<uint32_t>(ids.size());
+		ids.emplace(value, out);
+		return out;
+	}
+
+	// Stable LSD radix sort, bytes shared by every key are skipped.
+	static inline void SortDrawCommands() {
+		uint32_t count = static_cast<uint32_t>(sortedDraws.commands.size());
+		sortItems.resize(count);
+		sortScratch.resize(count);
+
+		for (uint32_t i = 0; i < count; i++)
+			sortItems[i] = { sortedDraws.commands[i].sortKey, i };
+
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			uint32_t histogram[256] = {};
+			for (auto& it : sortItems)
+				histogram[(it.key >> shift) & 0xFF]++;
+
+			if (histogram[(sortItems[0].key >> shift) & 0xFF] == count)
+				continue;
+
+			uint32_t offset = 0;
+			for (auto& it : histogram) {
+				uint32_t n = it;
+				it = offset;
+				offset += n;
+			}
+
+			for (auto& it : sortItems)
+				sortScratch[histogram[(it.key >> shift) & 0xFF]++] = it;
+
+			sortItems.swap(sortScratch);
+		}
+	}
+
+	static inline uint32_t GetPrimitiveCount(eSirePrimitiveType type, uint32_t count) {
+		switch (type) {
+			case SIRE_POINT:
+				return count;
+			case SIRE_LINE:
+				return count / 2;
+			case SIRE_TRIANGLE:
+				return count / 3;
+			case SIRE_LINE_STRIP:
+				return count > 1 ? count - 1 : 0;
+			case SIRE_TRIANGLE_STRIP:
+			case SIRE_TRIANGLE_FAN:
+				return count > 2 ? count - 2 : 0;
+		}
+
+		return 0;
+	}
+
+	static inline eSirePrimitiveType GetListTopology(eSirePrimitiveType type) {
+		switch (type) {
+			case SIRE_LINE_STRIP:
+				return SIRE_LINE;
+			case SIRE_TRIANGLE_STRIP:
+			case SIRE_TRIANGLE_FAN:
+				return SIRE_TRIANGLE;
+			default:
+				return type;
+		}
+	}
+
+	// Rewrites strips and fans as the matching list, restart indices split the input into separate primitives.
+	// src can be null for unindexed input. Stops at the last whole primitive that fits in capacity.
+	static inline uint32_t ExpandTopology(eSirePrimitiveType type, uint16_t const* src, uint32_t count, uint16_t* out, uint32_t capacity) {
+		auto index = [src](uint32_t i) -> uint16_t { return src ? src[i] : static_cast<uint16_t>(i); };
+
+		uint32_t n = 0;
+		uint32_t start = 0;
+		while (start < count) {
+			uint32_t end = start;
+			while (end < count && (!src || src[end] != SIRE_PRIMITIVE_RESTART_INDEX))
+				end++;
+
+			for (uint32_t i = start; i < end; i++) {
+				switch (type) {
+					case SIRE_LINE_STRIP:
+						if (i < start + 1)
+							break;
+						if (n + 2 > capacity)
+							return n;
+						out[n++] = index(i - 1);
+						out[n++] = index(i);
+						break;
+					case SIRE_TRIANGLE_STRIP:
+						if (i < start + 2)
+							break;
+						if (n + 3 > capacity)
+							return n;
+						// Every other triangle is flipped to keep the winding consistent.
+						out[n++] = index((i - start) & 1 ? i - 1 : i - 2);
+						out[n++] = index((i - start) & 1 ? i - 2 : i - 1);
+						out[n++] = index(i);
+						break;
+					case SIRE_TRIANGLE_FAN:
+						if (i < start + 2)
+							break;
+						if (n + 3 > capacity)
+							return n;
+						out[n++] = index(start);
+						out[n++] = index(i - 1);
+						out[n++] = index(i);
+						break;
+					default:
+						if (n + 1 > capacity)
+							return n;
+						out[n++] = index(i);
+						break;
+				}
+			}
+
+			start = end + 1;
+		}
+
+		return n;
+	}
+
+	// Lists are drawn as is, restart indices only mean something to strips and fans.
+	static inline bool HasPrimitiveRestart(eSirePrimitiveType type, uint16_t const* src, uint32_t count) {
+		if (!src || type <= SIRE_TRIANGLE)
+			return false;
+
+		for (uint32_t i = 0; i < count; i++) {
+			if (src[i] == SIRE_PRIMITIVE_RESTART_INDEX)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Expands the current batch into out when the backend can't draw its topology, returns false when it can.
+	// The list can hold up to three times the indices of the batch, more than one draw takes.
+	static inline bool ExpandBatchTopology(tSireArenaVector<uint16_t>& out) {
+		uint16_t const* src = numIndices ? indices.data() : nullptr;
+		uint32_t count = numIndices ? numIndices : vertices.size();
+		if (GetRenderer()->SupportsTopology(primitiveType, HasPrimitiveRestart(primitiveType, src, count)))
+			return false;
+
+		out.resize(count * 3);
+		out.resize(ExpandTopology(primitiveType, src, count, out.data(), out.size()));
+		primitiveType = GetListTopology(primitiveType);
+
+		// Nothing was left to draw, don't fall back to the unindexed path.
+		if (out.empty())
+			vertices.clear();
+
+		return true;
+	}
+
+	static inline bool CanMergeDrawCommands(tDrawCommand const& a, tDrawCommand const& b) {
+		if (a.meshVertexBuffer || b.meshVertexBuffer)
+			return false;
+
+		// Strips and fans can't be concatenated without restart indices.
+		if (a.primitiveType > SIRE_TRIANGLE)
+			return false;
+
+		if (a.primitiveType != b.primitiveType || a.texture != b.texture || a.mask != b.mask || a.pixelShader != b.pixelShader || a.vertexShader != b.vertexShader)
+			return false;
+
+		if (HashDrawState(a.renderStates) != HashDrawState(b.renderStates))
+			return false;
+
+		return memcmp(&a.cb, &b.cb, sizeof(tConstBuff)) == 0;
+	}
+
+	// Submits the sorted queue, consecutive draws with the same state are merged into one batch.
+	static inline void SubmitSortedDraws() {
+		tBackend* renderer = GetRenderer();
+
+		tConstBuff prevcb = cb;
+		eSirePrimitiveType prevType = primitiveType;
+
+		uintptr_t* boundTexture = currentTexture;
+		uintptr_t* boundMask = currentMask;
+		uintptr_t* boundPixelShader = currentPixelShader;
+		uintptr_t* boundVertexShader = currentVertexShader;
+
+		uint32_t count = static_cast<uint32_t>(sortItems.size());
+		for (uint32_t i = 0; i < count;) {
+			tDrawCommand const& first = sortedDraws.commands[sortItems[i].index];
+
+			uint32_t end = i + 1;
+			uint32_t vertexCount = first.vertexCount;
+			uint32_t indexCount = first.indexCount ? first.indexCount : first.vertexCount;
+			bool indexed = first.indexCount != 0;
+
+			for (; end < count; end++) {
+				tDrawCommand const& next = sortedDraws.commands[sortItems[end].index];
+				uint32_t nextIndexCount = next.indexCount ? next.indexCount : next.vertexCount;
+
+				if (!CanMergeDrawCommands(first, next) || vertexCount + next.vertexCount > 65536 || indexCount + nextIndexCount > 65536)
+					break;
+
+				vertexCount += next.vertexCount;
+				indexCount += nextIndexCount;
+				indexed |= next.indexCount != 0;
+			}
+
+			if (first.texture != boundTexture || first.mask != boundMask) {
+				renderer->SetTexture(first.texture, first.mask);
+				boundTexture = first.texture;
+				boundMask = first.mask;
+			}
+
+			if (first.pixelShader != boundPixelShader) {
+				renderer->SetPixelShader(first.pixelShader);
+				boundPixelShader = first.pixelShader;
+			}
+
+			if (first.vertexShader != boundVertexShader) {
+				renderer->SetVertexShader(first.vertexShader);
+				boundVertexShader = first.vertexShader;
+			}
+
+			cb = first.cb;
+			primitiveType = first.primitiveType;
+
+			renderer->Begin();
+			ApplyRenderStates(renderer, first.renderStates);
+
+			if (first.meshVertexBuffer) {
+				CountDraw(first.vertexCount, first.indexCount, false);
+				BeginBatchTiming(renderer, first.timingTag);
+				renderer->DrawMesh(first.meshVertexBuffer, first.meshIndexBuffer, first.vertexCount, first.indexCount);
+			}
+			else {
+				vertices.clear();
+				indices.clear();
+				vertices.reserve(vertexCount);
+				if (indexed)
+					indices.reserve(indexCount);
+
+				for (uint32_t j = i; j < end; j++) {
+					tDrawCommand const& cmd = sortedDraws.commands[sortItems[j].index];
+					uint32_t base = vertices.size();
+
+					vertices.resize(base + cmd.vertexCount);
+					memcpy(vertices.data() + base, sortedDraws.vertices.data() + cmd.vertexOffset, cmd.vertexCount * sizeof(tVertex));
+
+					if (!indexed)
+						continue;
+
+					// Unindexed draws merged into an indexed batch get a sequential range.
+					if (cmd.indexCount) {
+						for (uint32_t n = 0; n < cmd.indexCount; n++)
+							indices.push_back(static_cast<uint16_t>(base + sortedDraws.indices[cmd.indexOffset + n]));
+					}
+					else {
+						for (uint32_t n = 0; n < cmd.vertexCount; n++)
+							indices.push_back(static_cast<uint16_t>(base + n));
+					}
+				}
+
+				numIndices = indexed ? indices.size() : 0;
+				CountDraw(vertices.size(), numIndices, true);
+				BeginBatchTiming(renderer, first.timingTag);
+				renderer->End();
+			}
+
+			EndBatchTiming(renderer);
+			i = end;
+		}
+
+		if (boundTexture != currentTexture || boundMask != currentMask)
+			renderer->SetTexture(currentTexture, currentMask);
+
+		if (boundPixelShader != currentPixelShader)
+			renderer->SetPixelShader(currentPixelShader);
+
+		if (boundVertexShader != currentVertexShader)
+			renderer->SetVertexShader(currentVertexShader);
+
+		cb = prevcb;
+		primitiveType = prevType;
+
+		vertices.clear();
+		indices.clear();
+		numIndices = 0;
+	}
+
+	// Returns the next codepoint and advances i, invalid sequences map to '?'.
+	static inline uint32_t DecodeUTF8(std::string const& text, size_t& i) {
+		uint8_t c = static_cast<uint8_t>(text[i++]);
+		if (c < 0x80)
+			return c;
+
+		int32_t n = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : (c >= 0xC0 ? 1 : -1));
+		if (n < 0 || i + n > text.size())
+			return '?';
+
+		uint32_t out = c & (0x3F >> n);
+		for (int32_t k = 0; k < n; k++) {
+			uint8_t next = static_cast<uint8_t>(text[i]);
+			if ((next & 0xC0) != 0x80)
+				return '?';
+
+			out = (out << 6) | (next & 0x3F);
+			i++;
+		}
+		return out;
+	}
+
+	// Brute force search of the nearest texel across the edge, cheap enough at glyph sizes.
+	static inline void GenerateGlyphSdf(tSireGlyphBitmap const& bitmap, std::vector<uint8_t>& out) {
+		const int32_t spread = SIRE_TEXT_SDF_SPREAD;
+		int32_t w = bitmap.w + spread * 2;
+		int32_t h = bitmap.h + spread * 2;
+		out.resize(w * h);
+
+		auto inside = [&](int32_t x, int32_t y) {
+			x -= spread;
+			y -= spread;
+			return x >= 0 && y >= 0 && x < bitmap.w && y < bitmap.h && bitmap.coverage[y * bitmap.w + x] >= 128;
+		};
+
+		for (int32_t y = 0; y < h; y++) {
+			for (int32_t x = 0; x < w; x++) {
+				bool in = inside(x, y);
+				int32_t best = spread * spread * 2;
+
+				for (int32_t dy = -spread; dy <= spread; dy++) {
+					for (int32_t dx = -spread; dx <= spread; dx++) {
+						int32_t d = dx * dx + dy * dy;
+						if (d < best && inside(x + dx, y + dy) != in)
+							best = d;
+					}
+				}
+
+				float dist = (std::min)(sqrtf(static_cast<float>(best)) - 0.5f, static_cast<float>(spread));
+				float value = 0.5f + (in ? dist : -dist) / (2.0f * spread);
+				out[y * w + x] = static_cast<uint8_t>((std::max)(0.0f, (std::min)(value, 1.0f)) * 255.0f);
+			}
+		}
+	}
+
+	static inline bool PackTextAtlas(int32_t w, int32_t h, int32_t& x, int32_t& y) {
+		if (textAtlas.pixels.empty())
+			textAtlas.pixels.resize(textAtlas.w * textAtlas.h * 4);
+
+		if (textAtlas.cursorX + w + 1 > textAtlas.w) {
+			textAtlas.cursorX = 0;
+			textAtlas.cursorY += textAtlas.rowHeight + 1;
+			textAtlas.rowHeight = 0;
+		}
+
+		if (textAtlas.cursorY + h + 1 > textAtlas.h || w + 1 > textAtlas.w) {
+			textAtlas.full = true;
+			return false;
+		}
+
+		x = textAtlas.cursorX + 1;
+		y = textAtlas.cursorY + 1;
+		textAtlas.cursorX += w + 1;
+		textAtlas.rowHeight = (std::max)(textAtlas.rowHeight, h);
+		return true;
+	}
+
+	static inline tGlyph const& GetGlyph(tFont& font, uint32_t codepoint) {
+		auto it = font.glyphs.find(codepoint);
+		if (it != font.glyphs.end())
+			return it->second;
+
+		tGlyph glyph = {};
+		tSireGlyphBitmap bitmap = {};
+		if (font.rasterizer->Rasterize(font.face, codepoint, bitmap)) {
+			glyph.advance = bitmap.advance;
+
+			std::vector<uint8_t> sdf;
+			int32_t x = 0;
+			int32_t y = 0;
+			int32_t w = bitmap.w + SIRE_TEXT_SDF_SPREAD * 2;
+			int32_t h = bitmap.h + SIRE_TEXT_SDF_SPREAD * 2;
+
+			if (bitmap.w > 0 && bitmap.h > 0 && PackTextAtlas(w, h, x, y)) {
+				GenerateGlyphSdf(bitmap, sdf);
+
+				// Same value in every channel, the channel order of the texture format doesn't matter.
+				for (int32_t row = 0; row < h; row++) {
+					uint8_t* dst = &textAtlas.pixels[((y + row) * textAtlas.w + x) * 4];
+					for (int32_t col = 0; col < w; col++)
+						memset(dst + col * 4, sdf[row * w + col], 4);
+				}
+
+				glyph.visible = true;
+				glyph.x = static_cast<float>(bitmap.offsetX - SIRE_TEXT_SDF_SPREAD);
+				glyph.y = font.metrics.ascent + static_cast<float>(bitmap.offsetY - SIRE_TEXT_SDF_SPREAD);
+				glyph.w = static_cast<float>(w);
+				glyph.h = static_cast<float>(h);
+				glyph.u0 = static_cast<float>(x) / textAtlas.w;
+				glyph.v0 = static_cast<float>(y) / textAtlas.h;
+				glyph.u1 = static_cast<float>(x + w) / textAtlas.w;
+				glyph.v1 = static_cast<float>(y + h) / textAtlas.h;
+				textAtlas.dirty = true;
+			}
+		}
+
+		return font.glyphs[codepoint] = glyph;
+	}
+
+	static inline tTextLayout const& GetTextLayout(int32_t font, std::string const& text, float size) {
+		uint64_t key = Hash64(text.data(), text.size());
+		key = Hash64(&font, sizeof(font), key);
+		key = Hash64(&size, sizeof(size), key);
+
+		auto it = textLayouts.find(key);
+		if (it != textLayouts.end() && it->second.font == font && it->second.size == size && it->second.text == text)
+			return it->second;
+
+		if (textLayouts.size() >= SIRE_NUM_MAX_TEXT_LAYOUTS)
+			textLayouts.clear();
+
+		tTextLayout& layout = textLayouts[key];
+		layout.text = text;
+		layout.font = font;
+		layout.size = size;
+		layout.extent = { 0.0f, 0.0f };
+		layout.vertices.clear();
+
+		tFont& f = fonts[font];
+		float scale = size / SIRE_TEXT_SDF_SIZE;
+		float smoothing = 0.25f / (SIRE_TEXT_SDF_SPREAD * scale);
+		float penX = 0.0f;
+		float penY = 0.0f;
+
+		for (size_t i = 0; i < text.size();) {
+			uint32_t codepoint = DecodeUTF8(text, i);
+			if (codepoint == '\n') {
+				layout.extent.x = (std::max)(layout.extent.x, penX);
+				penX = 0.0f;
+				penY += f.metrics.lineHeight * scale;
+				continue;
+			}
+
+			tGlyph const& glyph = GetGlyph(f, codepoint);
+			if (glyph.visible) {
+				float x0 = penX + glyph.x * scale;
+				float y0 = penY + glyph.y * scale;
+				float x1 = x0 + glyph.w * scale;
+				float y1 = y0 + glyph.h * scale;
+
+				layout.vertices.push_back({ { x0, y0, 0.0f }, {}, { glyph.u0, glyph.v0 }, { smoothing, 0.0f } });
+				layout.vertices.push_back({ { x1, y0, 0.0f }, {}, { glyph.u1, glyph.v0 }, { smoothing, 0.0f } });
+				layout.vertices.push_back({ { x1, y1, 0.0f }, {}, { glyph.u1, glyph.v1 }, { smoothing, 0.0f } });
+				layout.vertices.push_back({ { x0, y1, 0.0f }, {}, { glyph.u0, glyph.v1 }, { smoothing, 0.0f } });
+			}
+
+			penX += glyph.advance * scale;
+		}
+
+		layout.extent.x = (std::max)(layout.extent.x, penX);
+		layout.extent.y = penY + f.metrics.lineHeight * scale;
+		return layout;
+	}
+
+	static inline void FlushTextBatch() {
+		if (textVertices.empty())
+			return;
+
+		if (textAtlas.dirty) {
+			if (!textAtlas.texture)
+				textAtlas.texture = CreateTexture(textAtlas.w, textAtlas.h, textAtlas.pixels.data());
+			else
+				UpdateTexture(textAtlas.texture, textAtlas.pixels.data());
+
+			textAtlas.dirty = false;
+		}
+
+		if (!textAtlas.texture || !textAtlas.texture->ptrs.texture) {
+			textVertices.clear();
+			textIndices.clear();
+			return;
+		}
+
+		tConstBuff prevcb = cb;
+		uintptr_t* prevTexture = currentTexture;
+		uintptr_t* prevMask = currentMask;
+		uint64_t prevTextureId = currentTextureId;
+		uint64_t prevMaskId = currentMaskId;
+
+		TraceTextureBind(textAtlas.texture.Get());
+		currentTexture = textAtlas.texture->ptrs.texture;
+		currentMask = nullptr;
+		currentTextureId = textAtlas.texture->id;
+		currentMaskId = 0;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		cb.isSdf = true;
+
+		Begin(SIRE_TRIANGLE);
+		vertices.assign(textVertices.data(), static_cast<uint32_t>(textVertices.size()));
+		indices.assign(textIndices.data(), static_cast<uint32_t>(textIndices.size()));
+		End();
+
+		currentTexture = prevTexture;
+		currentMask = prevMask;
+		currentTextureId = prevTextureId;
+		currentMaskId = prevMaskId;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		cb = prevcb;
+
+		textVertices.clear();
+		textIndices.clear();
+	}
+
+	static inline void ReleaseText() {
+		textBatchActive = false;
+		textVertices.clear();
+		textIndices.clear();
+		textLayouts.clear();
+
+		for (auto& it : fonts)
+			it.rasterizer->ReleaseFace(it.face);
+		fonts.clear();
+
+		textAtlas = tTextAtlas();
+	}
+
+	static inline void BeginPathContour(tSireFloat2 const& p) {
+		pathContours.push_back({ static_cast<uint32_t>(pathPoints.size()), 0, false });
+		AddPathPoint(p);
+	}
+
+	static inline void AddPathPoint(tSireFloat2 const& p) {
+		tPathContour& contour = pathContours.back();
+		if (contour.count) {
+			tSireFloat2 const& last = pathPoints.back();
+			if (fabsf(last.x - p.x) < 1e-4f && fabsf(last.y - p.y) < 1e-4f)
+				return;
+		}
+
+		pathPoints.push_back(p);
+		contour.count++;
+	}
+
+	// d is the length of the curve's second difference scaled to the chord error bound.
+	static inline uint32_t GetCurveSegments(float d) {
+		float n = ceilf(sqrtf(d / SIRE_PATH_TOLERANCE));
+		return static_cast<uint32_t>((std::min)((std::max)(n, 1.0f), 128.0f));
+	}
+
+	static inline uint32_t GetArcSegments(float radius, float angle) {
+		float step = radius > SIRE_PATH_TOLERANCE ? 2.0f * acosf(1.0f - SIRE_PATH_TOLERANCE / radius) : 1.5708f;
+		float n = ceilf(fabsf(angle) / (std::max)(step, 0.01f));
+		return static_cast<uint32_t>((std::min)((std::max)(n, 1.0f), 64.0f));
+	}
+
+	// Flattens the path into pathPoints, one contour per subpath.
+	static inline void FlattenPath(tSirePath const& path) {
+		pathPoints.clear();
+		pathContours.clear();
+
+		tSireFloat2 pen = { 0.0f, 0.0f };
+		tSireFloat2 start = pen;
+		bool open = false;
+		size_t p = 0;
+
+		for (auto verb : path.verbs) {
+			size_t needed = verb == tSirePath::CLOSE ? 0 : (verb == tSirePath::QUADRATIC ? 2 : (verb == tSirePath::CUBIC ? 3 : 1));
+			if (p + needed > path.points.size())
+				break;
+
+			if (verb != tSirePath::MOVE && verb != tSirePath::CLOSE && !open) {
+				BeginPathContour(pen);
+				start = pen;
+				open = true;
+			}
+
+			switch (verb) {
+				case tSirePath::MOVE:
+					pen = path.points[p++];
+					BeginPathContour(pen);
+					start = pen;
+					open = true;
+					break;
+				case tSirePath::LINE:
+					pen = path.points[p++];
+					AddPathPoint(pen);
+					break;
+				case tSirePath::QUADRATIC: {
+					tSireFloat2 c = path.points[p];
+					tSireFloat2 e = path.points[p + 1];
+					p += 2;
+
+					float ddx = pen.x - 2.0f * c.x + e.x;
+					float ddy = pen.y - 2.0f * c.y + e.y;
+					uint32_t n = GetCurveSegments(sqrtf(ddx * ddx + ddy * ddy) * 0.25f);
+					for (uint32_t i = 1; i <= n; i++) {
+						float t = static_cast<float>(i) / n;
+						float mt = 1.0f - t;
+						AddPathPoint({
+							mt * mt * pen.x + 2.0f * mt * t * c.x + t * t * e.x,
+							mt * mt * pen.y + 2.0f * mt * t * c.y + t * t * e.y
+						});
+					}
+
+					pen = e;
+					break;
+				}
+				case tSirePath::CUBIC: {
+					tSireFloat2 c1 = path.points[p];
+					tSireFloat2 c2 = path.points[p + 1];
+					tSireFloat2 e = path.points[p + 2];
+					p += 3;
+
+					float d1x = pen.x - 2.0f * c1.x + c2.x;
+					float d1y = pen.y - 2.0f * c1.y + c2.y;
+					float d2x = c1.x - 2.0f * c2.x + e.x;
+					float d2y = c1.y - 2.0f * c2.y + e.y;
+					float dd = (std::max)(d1x * d1x + d1y * d1y, d2x * d2x + d2y * d2y);
+					uint32_t n = GetCurveSegments(sqrtf(dd) * 0.75f);
+					for (uint32_t i = 1; i <= n; i++) {
+						float t = static_cast<float>(i) / n;
+						float mt = 1.0f - t;
+						float a = mt * mt * mt;
+						float b = 3.0f * mt * mt * t;
+						float c = 3.0f * mt * t * t;
+						float d = t * t * t;
+						AddPathPoint({
+							a * pen.x + b * c1.x + c * c2.x + d * e.x,
+							a * pen.y + b * c1.y + c * c2.y + d * e.y
+						});
+					}
+
+					pen = e;
+					break;
+				}
+				case tSirePath::CLOSE:
+					if (open)
+						pathContours.back().closed = true;
+
+					pen = start;
+					open = false;
+					break;
+			}
+		}
+
+		// The closing segment is implicit.
+		for (auto& it : pathContours) {
+			if (!it.closed || it.count < 2)
+				continue;
+
+			tSireFloat2 const& a = pathPoints[it.first];
+			tSireFloat2 const& b = pathPoints[it.first + it.count - 1];
+			if (fabsf(a.x - b.x) < 1e-4f && fabsf(a.y - b.y) < 1e-4f)
+				it.count--;
+		}
+	}
+
+	static inline uint32_t AddPathVertex(tPathGeometry& out, tSireFloat2 const& p, float alpha) {
+		tVertex v = {};
+		v.pos = { p.x, p.y, 0.0f };
+		v.col = { 1.0f, 1.0f, 1.0f, alpha };
+		out.vertices.push_back(v);
+		return static_cast<uint32_t>(out.vertices.size() - 1);
+	}
+
+	static inline void AddPathQuad(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+		const uint32_t quad[] = { a, b, c, a, c, d };
+		pathIndices.insert(pathIndices.end(), quad, quad + 6);
+	}
+
+	// dl and dr point from p to the left and right edge of the stroke, scaled like a miter.
+	static inline void AddPathSection(tSireFloat2 const& p, tSireFloat2 const& dl, tSireFloat2 const& dr, float halfWidth, float fringe, float alpha) {
+		tPathSection s = {};
+		s.left = { p.x + dl.x * halfWidth, p.y + dl.y * halfWidth };
+		s.right = { p.x + dr.x * halfWidth, p.y + dr.y * halfWidth };
+		s.leftFringe = { p.x + dl.x * (halfWidth + fringe), p.y + dl.y * (halfWidth + fringe) };
+		s.rightFringe = { p.x + dr.x * (halfWidth + fringe), p.y + dr.y * (halfWidth + fringe) };
+		s.alpha = alpha;
+		pathSections.push_back(s);
+	}
+
+	// d points along the stroke, away from the cap for the start cap and into it for the end cap.
+	static inline void AddPathCap(tSireFloat2 p, tSireFloat2 const& d, bool end, tSireStrokeStyle const& style, float halfWidth, float fringe, float alpha) {
+		tSireFloat2 n = { -d.y, d.x };
+		tSireFloat2 nr = { d.y, -d.x };
+		float s = end ? 1.0f : -1.0f;
+
+		if (style.cap == SIRE_LINE_CAP_ROUND) {
+			uint32_t steps = GetArcSegments(halfWidth + fringe, 1.5708f);
+			for (uint32_t i = 0; i <= steps; i++) {
+				float t = static_cast<float>(end ? i : steps - i) / steps;
+				float cs = cosf(t * 1.5708f);
+				float sn = sinf(t * 1.5708f) * s;
+				AddPathSection(p, { n.x * cs + d.x * sn, n.y * cs + d.y * sn }, { nr.x * cs + d.x * sn, nr.y * cs + d.y * sn }, halfWidth, fringe, alpha);
+			}
+			return;
+		}
+
+		if (style.cap == SIRE_LINE_CAP_SQUARE) {
+			p.x += d.x * s * style.width * 0.5f;
+			p.y += d.y * s * style.width * 0.5f;
+		}
+
+		// Butt and square ends fade out over the fringe as well.
+		if (!end && fringe > 0.0f)
+			AddPathSection({ p.x - d.x * fringe, p.y - d.y * fringe }, n, nr, halfWidth, fringe, 0.0f);
+
+		AddPathSection(p, n, nr, halfWidth, fringe, alpha);
+
+		if (end && fringe > 0.0f)
+			AddPathSection({ p.x + d.x * fringe, p.y + d.y * fringe }, n, nr, halfWidth, fringe, 0.0f);
+	}
+
+	// d0 and d1 are the unit directions of the segments meeting at p, l0 and l1 their lengths.
+	static inline void AddPathJoin(tSireFloat2 const& p, tSireFloat2 const& d0, tSireFloat2 const& d1, float l0, float l1, tSireStrokeStyle const& style, float halfWidth, float fringe, float alpha) {
+		tSireFloat2 n0 = { -d0.y, d0.x };
+		tSireFloat2 n1 = { -d1.y, d1.x };
+		float cross = d0.x * d1.y - d0.y * d1.x;
+		float dot = d0.x * d1.x + d0.y * d1.y;
+
+		if (fabsf(cross) < 1e-4f && dot > 0.0f) {
+			AddPathSection(p, n0, { -n0.x, -n0.y }, halfWidth, fringe, alpha);
+			return;
+		}
+
+		// Miter direction, its length is 1 / cos(angle / 2).
+		float scale = 1.0f / (std::max)(1.0f + dot, 1e-4f);
+		tSireFloat2 m = { (n0.x + n1.x) * scale, (n0.y + n1.y) * scale };
+		float length = sqrtf(m.x * m.x + m.y * m.y);
+
+		// The inner corner can't go past the shorter segment, otherwise short segments fold over.
+		float inner = (std::min)(1.0f, (std::min)(l0, l1) / ((halfWidth + fringe) * length));
+		tSireFloat2 mi = { m.x * inner, m.y * inner };
+
+		bool outerLeft = cross < 0.0f;
+		if (style.join == SIRE_LINE_JOIN_MITER && length <= style.miterLimit) {
+			AddPathSection(p, outerLeft ? m : mi, outerLeft ? tSireFloat2{ -mi.x, -mi.y } : tSireFloat2{ -m.x, -m.y }, halfWidth, fringe, alpha);
+			return;
+		}
+
+		tSireFloat2 o0 = outerLeft ? n0 : tSireFloat2{ -n0.x, -n0.y };
+		tSireFloat2 o1 = outerLeft ? n1 : tSireFloat2{ -n1.x, -n1.y };
+		tSireFloat2 in = outerLeft ? tSireFloat2{ -mi.x, -mi.y } : mi;
+
+		if (style.join == SIRE_LINE_JOIN_ROUND) {
+			float a0 = atan2f(o0.y, o0.x);
+			float da = atan2f(o1.y, o1.x) - a0;
+			if (da > 3.14159265f)
+				da -= 6.28318531f;
+			else if (da < -3.14159265f)
+				da += 6.28318531f;
+
+			uint32_t steps = GetArcSegments(halfWidth + fringe, da);
+			for (uint32_t i = 0; i <= steps; i++) {
+				float a = a0 + da * i / steps;
+				tSireFloat2 o = { cosf(a), sinf(a) };
+				AddPathSection(p, outerLeft ? o : in, outerLeft ? in : o, halfWidth, fringe, alpha);
+			}
+			return;
+		}
+
+		AddPathSection(p, outerLeft ? o0 : in, outerLeft ? in : o0, halfWidth, fringe, alpha);
+		AddPathSection(p, outerLeft ? o1 : in, outerLeft ? in : o1, halfWidth, fringe, alpha);
+	}
+
+	static inline void StrokePathContours(tSireStrokeStyle const& style, bool antiAlias, tPathGeometry& out) {
+		float fringe = antiAlias ? SIRE_PATH_FRINGE : 0.0f;
+		float width = style.width;
+		float alpha = 1.0f;
+
+		// Strokes thinner than the fringe fade out instead of getting thinner.
+		if (antiAlias && width < fringe) {
+			alpha = (std::max)(width, 0.0f) / fringe;
+			width = fringe;
+		}
+
+		// The fringe is centered on the edge.
+		float halfWidth = (width - fringe) * 0.5f;
+
+		for (auto& contour : pathContours) {
+			tSireFloat2 const* pts = &pathPoints[contour.first];
+			uint32_t n = contour.count;
+			if (n < 2)
+				continue;
+
+			bool closed = contour.closed && n > 2;
+			auto segment = [&](uint32_t i, tSireFloat2& d) -> float {
+				tSireFloat2 const& a = pts[i];
+				tSireFloat2 const& b = pts[(i + 1) % n];
+				float length = sqrtf((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+				d = { (b.x - a.x) / length, (b.y - a.y) / length };
+				return length;
+			};
+
+			pathSections.clear();
+			for (uint32_t i = 0; i < n; i++) {
+				tSireFloat2 d0, d1;
+				if (!closed && i == 0) {
+					segment(0, d1);
+					AddPathCap(pts[0], d1, false, style, halfWidth, fringe, alpha);
+				}
+				else if (!closed && i == n - 1) {
+					segment(n - 2, d0);
+					AddPathCap(pts[n - 1], d0, true, style, halfWidth, fringe, alpha);
+				}
+				else {
+					float l0 = segment((i + n - 1) % n, d0);
+					float l1 = segment(i, d1);
+					AddPathJoin(pts[i], d0, d1, l0, l1, style, halfWidth, fringe, alpha);
+				}
+			}
+
+			uint32_t columns = fringe > 0.0f ? 4 : 2;
+			uint32_t base = static_cast<uint32_t>(out.vertices.size());
+			for (auto& it : pathSections) {
+				if (fringe > 0.0f)
+					AddPathVertex(out, it.leftFringe, 0.0f);
+
+				AddPathVertex(out, it.left, it.alpha);
+				AddPathVertex(out, it.right, it.alpha);
+
+				if (fringe > 0.0f)
+					AddPathVertex(out, it.rightFringe, 0.0f);
+			}
+
+			uint32_t count = static_cast<uint32_t>(pathSections.size());
+			for (uint32_t i = 0; i < (closed ? count : count - 1); i++) {
+				uint32_t a = base + i * columns;
+				uint32_t b = base + ((i + 1) % count) * columns;
+				for (uint32_t c = 0; c < columns - 1; c++)
+					AddPathQuad(a + c, a + c + 1, b + c + 1, b + c);
+			}
+		}
+	}
+
+	// Single convex contours are fanned, everything else is cut into horizontal trapezoids.
+	static inline bool IsPathConvex() {
+		if (pathContours.size() != 1 || pathContours[0].count < 3)
+			return false;
+
+		tSireFloat2 const* pts = &pathPoints[pathContours[0].first];
+		uint32_t n = pathContours[0].count;
+		float sign = 0.0f;
+		float turning = 0.0f;
+		for (uint32_t i = 0; i < n; i++) {
+			tSireFloat2 const& a = pts[i];
+			tSireFloat2 const& b = pts[(i + 1) % n];
+			tSireFloat2 const& c = pts[(i + 2) % n];
+			float cross = (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+			float dot = (b.x - a.x) * (c.x - b.x) + (b.y - a.y) * (c.y - b.y);
+			if (cross * sign < 0.0f)
+				return false;
+
+			if (cross != 0.0f)
+				sign = cross;
+
+			turning += atan2f(cross, dot);
+		}
+
+		// Stars turn more than once.
+		return fabsf(turning) < 6.2832f + 0.01f;
+	}
+
+	static inline void FillPathContours(eSireFillRule rule, bool antiAlias, tPathGeometry& out) {
+		if (IsPathConvex()) {
+			uint32_t base = static_cast<uint32_t>(out.vertices.size());
+			uint32_t n = pathContours[0].count;
+			for (uint32_t i = 0; i < n; i++)
+				AddPathVertex(out, pathPoints[pathContours[0].first + i], 1.0f);
+
+			for (uint32_t i = 1; i + 1 < n; i++) {
+				const uint32_t tri[] = { base, base + i, base + i + 1 };
+				pathIndices.insert(pathIndices.end(), tri, tri + 3);
+			}
+		}
+		else {
+			pathEdges.clear();
+			pathScanlines.clear();
+			for (auto& contour : pathContours) {
+				if (contour.count < 3)
+					continue;
+
+				for (uint32_t i = 0; i < contour.count; i++) {
+					tSireFloat2 const& a = pathPoints[contour.first + i];
+					tSireFloat2 const& b = pathPoints[contour.first + (i + 1) % contour.count];
+					pathScanlines.push_back(a.y);
+					if (a.y < b.y)
+						pathEdges.push_back({ a.x, a.y, b.x, b.y, 1 });
+					else if (a.y > b.y)
+						pathEdges.push_back({ b.x, b.y, a.x, a.y, -1 });
+				}
+			}
+
+			std::sort(pathScanlines.begin(), pathScanlines.end());
+			pathScanlines.erase(std::unique(pathScanlines.begin(), pathScanlines.end()), pathScanlines.end());
+			std::sort(pathEdges.begin(), pathEdges.end(), [](tPathEdge const& a, tPathEdge const& b) { return a.y0 < b.y0; });
+
+			auto getX = [](tPathEdge const& e, float y) {
+				return e.x0 + (e.x1 - e.x0) * (y - e.y0) / (e.y1 - e.y0);
+			};
+
+			// Every vertex is on a scanline, so edges span whole slabs. Self intersections inside a slab are not split.
+			pathActiveEdges.clear();
+			size_t next = 0;
+			for (size_t s = 0; s + 1 < pathScanlines.size(); s++) {
+				float y0 = pathScanlines[s];
+				float y1 = pathScanlines[s + 1];
+
+				while (next < pathEdges.size() && pathEdges[next].y0 <= y0)
+					pathActiveEdges.push_back(static_cast<uint32_t>(next++));
+
+				pathActiveEdges.erase(std::remove_if(pathActiveEdges.begin(), pathActiveEdges.end(), [&](uint32_t e) { return pathEdges[e].y1 <= y0; }), pathActiveEdges.end());
+
+				float ym = (y0 + y1) * 0.5f;
+				std::sort(pathActiveEdges.begin(), pathActiveEdges.end(), [&](uint32_t a, uint32_t b) { return getX(pathEdges[a], ym) < getX(pathEdges[b], ym); });
+
+				int32_t winding = 0;
+				uint32_t left = 0;
+				for (auto e : pathActiveEdges) {
+					bool wasInside = rule == SIRE_FILL_RULE_EVENODD ? (winding & 1) != 0 : winding != 0;
+					winding += pathEdges[e].winding;
+					bool inside = rule == SIRE_FILL_RULE_EVENODD ? (winding & 1) != 0 : winding != 0;
+
+					if (!wasInside && inside) {
+						left = e;
+					}
+					else if (wasInside && !inside) {
+						tPathEdge const& l = pathEdges[left];
+						tPathEdge const& r = pathEdges[e];
+						uint32_t a = AddPathVertex(out, { getX(l, y0), y0 }, 1.0f);
+						uint32_t b = AddPathVertex(out, { getX(r, y0), y0 }, 1.0f);
+						uint32_t c = AddPathVertex(out, { getX(r, y1), y1 }, 1.0f);
+						uint32_t d = AddPathVertex(out, { getX(l, y1), y1 }, 1.0f);
+						AddPathQuad(a, b, c, d);
+					}
+				}
+			}
+		}
+
+		if (!antiAlias)
+			return;
+
+		// Fringe going outwards from every edge, holes wound the other way get it on the inside.
+		for (auto& contour : pathContours) {
+			tSireFloat2 const* pts = &pathPoints[contour.first];
+			uint32_t n = contour.count;
+			if (n < 3)
+				continue;
+
+			float area = 0.0f;
+			for (uint32_t i = 0; i < n; i++)
+				area += pts[i].x * pts[(i + 1) % n].y - pts[(i + 1) % n].x * pts[i].y;
+
+			float sign = area < 0.0f ? -1.0f : 1.0f;
+			auto normal = [&](tSireFloat2 const& a, tSireFloat2 const& b) -> tSireFloat2 {
+				float length = (std::max)(sqrtf((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y)), 1e-6f);
+				return { sign * (b.y - a.y) / length, -sign * (b.x - a.x) / length };
+			};
+
+			uint32_t base = static_cast<uint32_t>(out.vertices.size());
+			for (uint32_t i = 0; i < n; i++) {
+				tSireFloat2 n0 = normal(pts[(i + n - 1) % n], pts[i]);
+				tSireFloat2 n1 = normal(pts[i], pts[(i + 1) % n]);
+				float scale = 1.0f / (std::max)(1.0f + n0.x * n1.x + n0.y * n1.y, 1e-4f);
+				tSireFloat2 m = { (n0.x + n1.x) * scale, (n0.y + n1.y) * scale };
+
+				// Sharp corners would spike out.
+				float length = sqrtf(m.x * m.x + m.y * m.y);
+				if (length > 4.0f) {
+					m.x *= 4.0f / length;
+					m.y *= 4.0f / length;
+				}
+
+				AddPathVertex(out, pts[i], 1.0f);
+				AddPathVertex(out, { pts[i].x + m.x * SIRE_PATH_FRINGE, pts[i].y + m.y * SIRE_PATH_FRINGE }, 0.0f);
+			}
+
+			for (uint32_t i = 0; i < n; i++) {
+				uint32_t a = base + i * 2;
+				uint32_t b = base + ((i + 1) % n) * 2;
+				AddPathQuad(a, a + 1, b + 1, b);
+			}
+		}
+	}
+
+	// Geometry is kept indexed while it fits one batch, below the restart index. Larger geometry is unrolled so it can
+	// be split into batches without remapping indices.
+	static inline void FinishPathGeometry(tPathGeometry& out) {
+		if (out.vertices.size() < 65536 && pathIndices.size() < 65536) {
+			out.indices.assign(pathIndices.begin(), pathIndices.end());
+			return;
+		}
+
+		std::vector<tVertex> unrolled;
+		unrolled.reserve(pathIndices.size());
+		for (auto it : pathIndices)
+			unrolled.push_back(out.vertices[it]);
+
+		out.vertices.swap(unrolled);
+	}
+
+	static inline tPathGeometry& GetPathGeometry(uint64_t key, bool& cached) {
+		auto it = pathGeometries.find(key);
+		cached = it != pathGeometries.end();
+		if (cached)
+			return it->second;
+
+		if (pathGeometries.size() >= SIRE_NUM_MAX_PATH_GEOMETRIES)
+			pathGeometries.clear();
+
+		return pathGeometries[key];
+	}
+
+	static inline tPathGeometry const& GetFillGeometry(tSirePath const& path, eSireFillRule rule, bool antiAlias) {
+		const uint32_t params[] = { 0, static_cast<uint32_t>(rule), antiAlias };
+		uint64_t key = Hash64(params, sizeof(params), path.Hash());
+
+		bool cached = false;
+		tPathGeometry& out = GetPathGeometry(key, cached);
+		if (cached)
+			return out;
+
+		FlattenPath(path);
+		pathIndices.clear();
+		FillPathContours(rule, antiAlias, out);
+		FinishPathGeometry(out);
+		return out;
+	}
+
+	static inline tPathGeometry const& GetStrokeGeometry(tSirePath const& path, tSireStrokeStyle const& style, bool antiAlias) {
+		const uint32_t params[] = { 1, static_cast<uint32_t>(style.join), static_cast<uint32_t>(style.cap), antiAlias };
+		const float metrics[] = { style.width, style.miterLimit };
+		uint64_t key = Hash64(params, sizeof(params), path.Hash());
+		key = Hash64(metrics, sizeof(metrics), key);
+
+		bool cached = false;
+		tPathGeometry& out = GetPathGeometry(key, cached);
+		if (cached)
+			return out;
+
+		FlattenPath(path);
+		pathIndices.clear();
+		StrokePathContours(style, antiAlias, out);
+		FinishPathGeometry(out);
+		return out;
+	}
+
+	static inline void DrawPathGeometry(tPathGeometry const& geometry, tSireFloat4 const& col, tSireFloat2 const& offset) {
+		uint32_t count = static_cast<uint32_t>(geometry.vertices.size());
+		uint32_t batch = geometry.indices.empty() ? 65535 : count;
+
+		for (uint32_t first = 0; first < count; first += batch) {
+			uint32_t n = (std::min)(batch, count - first);
+
+			Begin(SIRE_TRIANGLE);
+			vertices.resize(n);
+			if (vertices.size() != n)
+				return;
+
+			tVertex* dst = vertices.data();
+			tVertex const* src = geometry.vertices.data() + first;
+			for (uint32_t i = 0; i < n; i++) {
+				dst[i] = src[i];
+				dst[i].pos.x += offset.x;
+				dst[i].pos.y += offset.y;
+				dst[i].col = { col.x, col.y, col.z, col.w * src[i].col.w };
+			}
+
+			if (!geometry.indices.empty())
+				indices.assign(geometry.indices.data(), static_cast<uint32_t>(geometry.indices.size()));
+
+			End();
+		}
+	}
+
+	static inline void ReleasePaths() {
+		pathGeometries.clear();
+		pathPoints.clear();
+		pathContours.clear();
+		pathSections.clear();
+		pathEdges.clear();
+		pathActiveEdges.clear();
+		pathScanlines.clear();
+		pathIndices.clear();
+	}
+
+	static inline void DrawPacket(tSireDrawPacket const& packet) {
+		if (packet.vertices.empty() || packet.vertices.size() > 65536 || packet.indices.size() > 65536)
+			return;
+
+		tConstBuff prevcb = cb;
+		tRenderState prevRenderStates = shared.renderStates;
+		uintptr_t* prevTexture = currentTexture;
+		uintptr_t* prevMask = currentMask;
+		uint64_t prevTextureId = currentTextureId;
+		uint64_t prevMaskId = currentMaskId;
+		uintptr_t* prevRenderTargetView = currentRenderTargetView;
+		uint64_t prevRenderTargetTexture = currentRenderTargetTexture;
+		bool prevSortedSubmission = sortedSubmission;
+
+		// Queued draws don't keep their target, they are flushed and these are drawn right away.
+		if (packet.target) {
+			if (sortedSubmission) {
+				FlushSortedDraws();
+				sortedSubmission = false;
+			}
+
+			currentRenderTargetView = packet.target->renderTargetView;
+			currentRenderTargetTexture = packet.target->textureId;
+		}
+
+		UseTexture(packet.texture);
+		UseTexture(packet.mask);
+		TraceTextureBind(packet.texture);
+		TraceTextureBind(packet.mask);
+		currentTexture = packet.texture ? packet.texture->ptrs.texture : nullptr;
+		currentMask = packet.mask ? packet.mask->ptrs.texture : nullptr;
+		currentTextureId = packet.texture ? packet.texture->id : 0;
+		currentMaskId = packet.mask ? packet.mask->id : 0;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		cb.tint = packet.tint;
+
+		for (auto& it : packet.renderStates)
+			SetRenderState(it.first, it.second);
+
+		Begin(packet.primitiveType);
+		vertices.assign(packet.vertices.data(), static_cast<uint32_t>(packet.vertices.size()));
+		indices.assign(packet.indices.data(), static_cast<uint32_t>(packet.indices.size()));
+		End();
+
+		currentTexture = prevTexture;
+		currentMask = prevMask;
+		currentTextureId = prevTextureId;
+		currentMaskId = prevMaskId;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		cb = prevcb;
+		shared.renderStates = prevRenderStates;
+		currentRenderTargetView = prevRenderTargetView;
+		currentRenderTargetTexture = prevRenderTargetTexture;
+		sortedSubmission = prevSortedSubmission;
+	}
+
+	static inline void ReleasePackets() {
+		tPacketNode* node = packetQueue.exchange(nullptr, std::memory_order_acquire);
+		while (node) {
+			tPacketNode* next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+
+	static inline uint32_t GetCompressedBlockSize(eSirePixelFormat format) {
+		return format == SIRE_PIXEL_FORMAT_BC1 ? 8 : 16;
+	}
+
+	static inline uint32_t GetCompressedRowSize(eSirePixelFormat format, uint32_t width) {
+		return (width + 3) / 4 * GetCompressedBlockSize(format);
+	}
+
+	static inline uint16_t PackRGB565(int32_t r, int32_t g, int32_t b) {
+		return static_cast<uint16_t>((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+	}
+
+	static inline void UnpackRGB565(uint16_t c, int32_t* out) {
+		int32_t r = (c >> 11) & 31;
+		int32_t g = (c >> 5) & 63;
+		int32_t b = c & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	// Per channel min and max of the 16 pixels of a block.
+	static inline void GetBlockBounds(uint8_t const* block, uint8_t* lo, uint8_t* hi) {
+#if defined(SIRE_SSE2)
+		__m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+		__m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+		__m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32));
+		__m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 48));
+		__m128i mn = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+		__m128i mx = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+		mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+		mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+		mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+		mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+		int32_t a = _mm_cvtsi128_si32(mn);
+		int32_t b = _mm_cvtsi128_si32(mx);
+		memcpy(lo, &a, 4);
+		memcpy(hi, &b, 4);
+#elif defined(SIRE_NEON)
+		uint8x16_t mn = vminq_u8(vminq_u8(vld1q_u8(block), vld1q_u8(block + 16)), vminq_u8(vld1q_u8(block + 32), vld1q_u8(block + 48)));
+		uint8x16_t mx = vmaxq_u8(vmaxq_u8(vld1q_u8(block), vld1q_u8(block + 16)), vmaxq_u8(vld1q_u8(block + 32), vld1q_u8(block + 48)));
+		uint8x8_t mn8 = vmin_u8(vget_low_u8(mn), vget_high_u8(mn));
+		uint8x8_t mx8 = vmax_u8(vget_low_u8(mx), vget_high_u8(mx));
+		mn8 = vmin_u8(mn8, vext_u8(mn8, mn8, 4));
+		mx8 = vmax_u8(mx8, vext_u8(mx8, mx8, 4));
+		uint8_t a[8], b[8];
+		vst1_u8(a, mn8);
+		vst1_u8(b, mx8);
+		memcpy(lo, a, 4);
+		memcpy(hi, b, 4);
+#else
+		for (int32_t c = 0; c < 4; c++) {
+			lo[c] = 255;
+			hi[c] = 0;
+		}
+
+		for (int32_t i = 0; i < 16; i++) {
+			for (int32_t c = 0; c < 4; c++) {
+				lo[c] = (std::min)(lo[c], block[i * 4 + c]);
+				hi[c] = (std::max)(hi[c], block[i * 4 + c]);
+			}
+		}
+#endif
+	}
+
+	// Endpoints are the corners of the bounding box along its dominant diagonal, inset by 1/16 of the range.
+	// Blocks with pixels under half alpha use the 3 color mode with transparent black when allowed.
+	static inline void EncodeColorBlock(uint8_t const* block, bool allowTransparent, uint8_t* out) {
+		bool transparent = false;
+		if (allowTransparent) {
+			for (int32_t i = 0; i < 16; i++)
+				transparent |= block[i * 4 + 3] < 128;
+		}
+
+		uint8_t lo[4], hi[4];
+		if (transparent) {
+			lo[0] = lo[1] = lo[2] = 255;
+			hi[0] = hi[1] = hi[2] = 0;
+			for (int32_t i = 0; i < 16; i++) {
+				if (block[i * 4 + 3] < 128)
+					continue;
+
+				for (int32_t c = 0; c < 3; c++) {
+					lo[c] = (std::min)(lo[c], block[i * 4 + c]);
+					hi[c] = (std::max)(hi[c], block[i * 4 + c]);
+				}
+			}
+
+			if (lo[0] > hi[0]) {
+				lo[0] = lo[1] = lo[2] = 0;
+				hi[0] = hi[1] = hi[2] = 0;
+			}
+		}
+		else {
+			GetBlockBounds(block, lo, hi);
+		}
+
+		int32_t mn[3], mx[3];
+		int32_t center[3];
+		for (int32_t c = 0; c < 3; c++) {
+			int32_t inset = (hi[c] - lo[c]) >> 4;
+			mn[c] = lo[c] + inset;
+			mx[c] = hi[c] - inset;
+			center[c] = (lo[c] + hi[c]) >> 1;
+		}
+
+		// Flip red and blue when they fall while green rises.
+		int32_t covRG = 0;
+		int32_t covBG = 0;
+		for (int32_t i = 0; i < 16; i++) {
+			if (transparent && block[i * 4 + 3] < 128)
+				continue;
+
+			int32_t g = block[i * 4 + 1] - center[1];
+			covRG += (block[i * 4 + 0] - center[0]) * g;
+			covBG += (block[i * 4 + 2] - center[2]) * g;
+		}
+
+		if (covRG < 0)
+			std::swap(mn[0], mx[0]);
+		if (covBG < 0)
+			std::swap(mn[2], mx[2]);
+
+		uint16_t c0 = PackRGB565(mx[0], mx[1], mx[2]);
+		uint16_t c1 = PackRGB565(mn[0], mn[1], mn[2]);
+
+		// 4 color mode needs c0 > c1, 3 color mode c0 <= c1.
+		if ((c0 < c1) != transparent && c0 != c1)
+			std::swap(c0, c1);
+
+		int32_t palette[4][3];
+		UnpackRGB565(c0, palette[0]);
+		UnpackRGB565(c1, palette[1]);
+		int32_t numColors = transparent ? 3 : 4;
+		for (int32_t c = 0; c < 3; c++) {
+			if (transparent) {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			}
+			else {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+		}
+
+		uint32_t indices = 0;
+		if (c0 != c1 || transparent) {
+			for (int32_t i = 0; i < 16; i++) {
+				uint8_t const* p = block + i * 4;
+				uint32_t best = 0;
+				if (transparent && p[3] < 128) {
+					best = 3;
+				}
+				else {
+					int32_t bestDist = INT32_MAX;
+					for (int32_t k = 0; k < numColors; k++) {
+						int32_t dr = p[0] - palette[k][0];
+						int32_t dg = p[1] - palette[k][1];
+						int32_t db = p[2] - palette[k][2];
+						int32_t dist = dr * dr + dg * dg + db * db;
+						if (dist < bestDist) {
+							bestDist = dist;
+							best = k;
+						}
+					}
+				}
+
+				indices |= best << (i * 2);
+			}
+		}
+
+		out[0] = static_cast<uint8_t>(c0);
+		out[1] = static_cast<uint8_t>(c0 >> 8);
+		out[2] = static_cast<uint8_t>(c1);
+		out[3] = static_cast<uint8_t>(c1 >> 8);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	// 8 value mode, a0 is the largest alpha and a1 the smallest.
+	static inline void EncodeAlphaBlock(uint8_t const* block, uint8_t* out) {
+		int32_t a0 = 0;
+		int32_t a1 = 255;
+		for (int32_t i = 0; i < 16; i++) {
+			a0 = (std::max)(a0, static_cast<int32_t>(block[i * 4 + 3]));
+			a1 = (std::min)(a1, static_cast<int32_t>(block[i * 4 + 3]));
+		}
+
+		uint64_t bits = 0;
+		if (a0 != a1) {
+			int32_t range = a0 - a1;
+			for (int32_t i = 0; i < 16; i++) {
+				int32_t t = ((a0 - block[i * 4 + 3]) * 7 + range / 2) / range;
+				uint64_t index = t == 0 ? 0 : (t == 7 ? 1 : t + 1);
+				bits |= index << (i * 3);
+			}
+		}
+
+		out[0] = static_cast<uint8_t>(a0);
+		out[1] = static_cast<uint8_t>(a1);
+		for (int32_t i = 0; i < 6; i++)
+			out[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+	}
+
+	static inline void DecodeColorBlock(uint8_t const* in, bool fourColors, uint8_t* out) {
+		uint16_t c0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+		uint16_t c1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+
+		int32_t palette[4][4];
+		UnpackRGB565(c0, palette[0]);
+		UnpackRGB565(c1, palette[1]);
+		palette[0][3] = 255;
+		palette[1][3] = 255;
+		palette[2][3] = 255;
+		palette[3][3] = 255;
+
+		for (int32_t c = 0; c < 3; c++) {
+			if (c0 > c1 || fourColors) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		if (c0 <= c1 && !fourColors)
+			palette[3][3] = 0;
+
+		uint32_t indices;
+		memcpy(&indices, in + 4, 4);
+		for (int32_t i = 0; i < 16; i++) {
+			int32_t const* p = palette[(indices >> (i * 2)) & 3];
+			for (int32_t c = 0; c < 4; c++)
+				out[i * 4 + c] = static_cast<uint8_t>(p[c]);
+		}
+	}
+
+	static inline void DecodeAlphaBlock(uint8_t const* in, uint8_t* out) {
+		int32_t palette[8];
+		palette[0] = in[0];
+		palette[1] = in[1];
+		if (palette[0] > palette[1]) {
+			for (int32_t i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+		}
+		else {
+			for (int32_t i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t bits = 0;
+		for (int32_t i = 0; i < 6; i++)
+			bits |= static_cast<uint64_t>(in[2 + i]) << (i * 8);
+
+		for (int32_t i = 0; i < 16; i++)
+			out[i * 4 + 3] = static_cast<uint8_t>(palette[(bits >> (i * 3)) & 7]);
+	}
+
+	static inline bool IsCompressedFormat(eSirePixelFormat format) {
+		return format == SIRE_PIXEL_FORMAT_BC1 || format == SIRE_PIXEL_FORMAT_BC3 || format == SIRE_PIXEL_FORMAT_BC7;
+	}
+
+	static inline bool IsBgraFormat(eSirePixelFormat format) {
+		return format == SIRE_PIXEL_FORMAT_BGRA8 || format == SIRE_PIXEL_FORMAT_BGRA8_SRGB;
+	}
+
+	static inline uint32_t GetPixelSize(eSirePixelFormat format) {
+		switch (format) {
+			case SIRE_PIXEL_FORMAT_RGBA8:
+			case SIRE_PIXEL_FORMAT_BGRA8:
+			case SIRE_PIXEL_FORMAT_RGBA8_SRGB:
+			case SIRE_PIXEL_FORMAT_BGRA8_SRGB:
+				return 4;
+			case SIRE_PIXEL_FORMAT_RGB8:
+				return 3;
+			default:
+				return 0;
+		}
+	}
+
+	// Rounded c * a / 255.
+	static inline uint8_t PremultiplyChannel(uint32_t c, uint32_t a) {
+		uint32_t t = c * a + 128;
+		return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+	}
+
+	struct tConvertContext {
+		uint8_t const* src;
+		uint8_t* dst;
+		uint32_t count;
+		bool rgb;
+		bool swap;
+		bool premultiply;
+	};
+
+	static inline void ConvertPixelRange(void* ptr, uint32_t begin, uint32_t end) {
+		tConvertContext& c = *static_cast<tConvertContext*>(ptr);
+		uint32_t srcSize = c.rgb ? 3 : 4;
+		uint8_t const* src = c.src + static_cast<size_t>(begin) * srcSize;
+		uint8_t* dst = c.dst + static_cast<size_t>(begin) * 4;
+		uint32_t i = begin;
+
+#if defined(SIRE_SSE2)
+		__m128i alpha = _mm_set1_epi32(static_cast<int32_t>(0xFF000000));
+		__m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+		__m128i lowByte = _mm_set1_epi32(0xFF);
+		__m128i green = _mm_set1_epi32(static_cast<int32_t>(0xFF00FF00));
+		__m128i zero = _mm_setzero_si128();
+		__m128i half = _mm_set1_epi16(128);
+
+		// 3 byte pixels are read 4 bytes at a time, keep the last one for the scalar loop.
+		uint32_t last = c.rgb ? (std::min)(end, c.count - 1) : end;
+		for (; i + 4 <= last; i += 4, src += srcSize * 4, dst += 16) {
+			__m128i v;
+			if (c.rgb) {
+				uint32_t p[4];
+				for (int32_t k = 0; k < 4; k++)
+					memcpy(&p[k], src + k * 3, 4);
+				v = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), alpha);
+			}
+			else {
+				v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			}
+
+			if (c.swap) {
+				__m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), lowByte);
+				__m128i b = _mm_slli_epi32(_mm_and_si128(v, lowByte), 16);
+				v = _mm_or_si128(_mm_and_si128(v, green), _mm_or_si128(r, b));
+			}
+
+			if (c.premultiply) {
+				__m128i lo = _mm_unpacklo_epi8(v, zero);
+				__m128i hi = _mm_unpackhi_epi8(v, zero);
+				__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+				__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+				lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), half);
+				hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), half);
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+				v = _mm_or_si128(_mm_and_si128(_mm_packus_epi16(lo, hi), rgbMask), _mm_and_si128(v, alpha));
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+		}
+#elif defined(SIRE_NEON)
+		for (; i + 16 <= end; i += 16, src += srcSize * 16, dst += 64) {
+			uint8x16x4_t v;
+			if (c.rgb) {
+				uint8x16x3_t t = vld3q_u8(src);
+				v.val[0] = t.val[0];
+				v.val[1] = t.val[1];
+				v.val[2] = t.val[2];
+				v.val[3] = vdupq_n_u8(255);
+			}
+			else {
+				v = vld4q_u8(src);
+			}
+
+			if (c.swap)
+				std::swap(v.val[0], v.val[2]);
+
+			if (c.premultiply) {
+				for (int32_t k = 0; k < 3; k++) {
+					uint16x8_t lo = vmull_u8(vget_low_u8(v.val[k]), vget_low_u8(v.val[3]));
+					uint16x8_t hi = vmull_u8(vget_high_u8(v.val[k]), vget_high_u8(v.val[3]));
+					v.val[k] = vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+				}
+			}
+
+			vst4q_u8(dst, v);
+		}
+#endif
+
+		for (; i < end; i++, src += srcSize, dst += 4) {
+			uint8_t r = src[0];
+			uint8_t g = src[1];
+			uint8_t b = src[2];
+			uint8_t a = c.rgb ? 255 : src[3];
+
+			if (c.swap)
+				std::swap(r, b);
+
+			if (c.premultiply) {
+				r = PremultiplyChannel(r, a);
+				g = PremultiplyChannel(g, a);
+				b = PremultiplyChannel(b, a);
+			}
+
+			dst[0] = r;
+			dst[1] = g;
+			dst[2] = b;
+			dst[3] = a;
+		}
+	}
+
+	static inline uint8_t ToUnorm(float v) {
+		return static_cast<uint8_t>((std::min)((std::max)(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	// Output merger blending on the CPU. The scalar functions are the reference, the SIMD paths hold a pixel per 4 lanes
+	// and match it as long as the compiler doesn't fuse multiply-adds. The blend factor is bound as zero by the GPU
+	// backends, without dual source blending SRC1 reads the only output.
+	static inline float GetBlendFactor(uint8_t blend, float const* s, float const* d, int32_t k) {
+		switch (blend) {
+			case SIRE_BLEND_ZERO: return 0.0f;
+			case SIRE_BLEND_ONE: return 1.0f;
+			case SIRE_BLEND_SRC_COLOR: return s[k];
+			case SIRE_BLEND_INV_SRC_COLOR: return 1.0f - s[k];
+			case SIRE_BLEND_SRC_ALPHA: return s[3];
+			case SIRE_BLEND_INV_SRC_ALPHA: return 1.0f - s[3];
+			case SIRE_BLEND_DEST_ALPHA: return d[3];
+			case SIRE_BLEND_INV_DEST_ALPHA: return 1.0f - d[3];
+			case SIRE_BLEND_DEST_COLOR: return d[k];
+			case SIRE_BLEND_INV_DEST_COLOR: return 1.0f - d[k];
+			case SIRE_BLEND_SRC_ALPHA_SAT: return k == 3 ? 1.0f : (std::min)(s[3], 1.0f - d[3]);
+			case SIRE_BLEND_BLEND_FACTOR: return 0.0f;
+			case SIRE_BLEND_INV_BLEND_FACTOR: return 1.0f;
+			case SIRE_BLEND_SRC1_COLOR: return s[k];
+			case SIRE_BLEND_INV_SRC1_COLOR: return 1.0f - s[k];
+			case SIRE_BLEND_SRC1_ALPHA: return s[3];
+			case SIRE_BLEND_INV_SRC1_ALPHA: return 1.0f - s[3];
+		}
+
+		return 0.0f;
+	}
+
+	static inline float ApplyBlendOp(uint8_t op, float s, float d, float fs, float fd) {
+		switch (op) {
+			case SIRE_BLEND_OP_SUBTRACT: return s * fs - d * fd;
+			case SIRE_BLEND_OP_REV_SUBTRACT: return d * fd - s * fs;
+			case SIRE_BLEND_OP_MIN: return (std::min)(s, d);
+			case SIRE_BLEND_OP_MAX: return (std::max)(s, d);
+		}
+
+		return s * fs + d * fd;
+	}
+
+	static inline void BlendPixel(tRenderState const& states, float const* s, float const* d, float* out) {
+		for (int32_t k = 0; k < 4; k++)
+			out[k] = s[k];
+
+		if (states.blendEnable) {
+			for (int32_t k = 0; k < 3; k++)
+				out[k] = ApplyBlendOp(states.blendop, s[k], d[k], GetBlendFactor(states.srcBlend, s, d, k), GetBlendFactor(states.dstBlend, s, d, k));
+
+			out[3] = ApplyBlendOp(states.blendOpAlpha, s[3], d[3], GetBlendFactor(states.srcBlendAlpha, s, d, 3), GetBlendFactor(states.destBlendAlpha, s, d, 3));
+		}
+
+		for (int32_t k = 0; k < 4; k++) {
+			if (!(states.renderTargetWriteMask & (1 << k)))
+				out[k] = d[k];
+		}
+	}
+
+#ifdef SIRE_SIMD
+	// Operands are ordered so that min and max match std::min and std::max of the reference.
+	static inline tSimd4f GetBlendFactor(uint8_t blend, tSimd4f s, tSimd4f d, tSimd4f one) {
+		switch (blend) {
+			case SIRE_BLEND_ONE:
+			case SIRE_BLEND_INV_BLEND_FACTOR: return one;
+			case SIRE_BLEND_SRC_COLOR:
+			case SIRE_BLEND_SRC1_COLOR: return s;
+			case SIRE_BLEND_INV_SRC_COLOR:
+			case SIRE_BLEND_INV_SRC1_COLOR: return SimdSub(one, s);
+			case SIRE_BLEND_SRC_ALPHA:
+			case SIRE_BLEND_SRC1_ALPHA: return SimdSplatW(s);
+			case SIRE_BLEND_INV_SRC_ALPHA:
+			case SIRE_BLEND_INV_SRC1_ALPHA: return SimdSub(one, SimdSplatW(s));
+			case SIRE_BLEND_DEST_ALPHA: return SimdSplatW(d);
+			case SIRE_BLEND_INV_DEST_ALPHA: return SimdSub(one, SimdSplatW(d));
+			case SIRE_BLEND_DEST_COLOR: return d;
+			case SIRE_BLEND_INV_DEST_COLOR: return SimdSub(one, d);
+			case SIRE_BLEND_SRC_ALPHA_SAT: return SimdSelect(SimdLaneMask(8), one, SimdMin(SimdSub(one, SimdSplatW(d)), SimdSplatW(s)));
+		}
+
+		return SimdSet(0.0f);
+	}
+
+	static inline tSimd4f ApplyBlendOp(uint8_t op, tSimd4f s, tSimd4f d, tSimd4f fs, tSimd4f fd) {
+		switch (op) {
+			case SIRE_BLEND_OP_SUBTRACT: return SimdSub(SimdMul(s, fs), SimdMul(d, fd));
+			case SIRE_BLEND_OP_REV_SUBTRACT: return SimdSub(SimdMul(d, fd), SimdMul(s, fs));
+			case SIRE_BLEND_OP_MIN: return SimdMin(d, s);
+			case SIRE_BLEND_OP_MAX: return SimdMax(d, s);
+		}
+
+		return SimdAdd(SimdMul(s, fs), SimdMul(d, fd));
+	}
+
+	// alphaLane selects the alpha channel, writeMask the channels in renderTargetWriteMask.
+	static inline tSimd4f BlendPixel(tRenderState const& states, tSimd4f s, tSimd4f d, tSimd4f alphaLane, tSimd4f writeMask) {
+		tSimd4f out = s;
+		if (states.blendEnable) {
+			tSimd4f one = SimdSet(1.0f);
+			tSimd4f fs = SimdSelect(alphaLane, GetBlendFactor(states.srcBlendAlpha, s, d, one), GetBlendFactor(states.srcBlend, s, d, one));
+			tSimd4f fd = SimdSelect(alphaLane, GetBlendFactor(states.destBlendAlpha, s, d, one), GetBlendFactor(states.dstBlend, s, d, one));
+			out = ApplyBlendOp(states.blendop, s, d, fs, fd);
+			if (states.blendOpAlpha != states.blendop)
+				out = SimdSelect(alphaLane, ApplyBlendOp(states.blendOpAlpha, s, d, fs, fd), out);
+		}
+
+		return SimdSelect(writeMask, out, d);
+	}
+#endif
+
+#ifdef SIRE_AVX2
+	// Two pixels per register, the alpha splats stay within each pixel.
+	static inline __m256 GetBlendFactor(uint8_t blend, __m256 s, __m256 d, __m256 one) {
+		switch (blend) {
+			case SIRE_BLEND_ONE:
+			case SIRE_BLEND_INV_BLEND_FACTOR: return one;
+			case SIRE_BLEND_SRC_COLOR:
+			case SIRE_BLEND_SRC1_COLOR: return s;
+			case SIRE_BLEND_INV_SRC_COLOR:
+			case SIRE_BLEND_INV_SRC1_COLOR: return _mm256_sub_ps(one, s);
+			case SIRE_BLEND_SRC_ALPHA:
+			case SIRE_BLEND_SRC1_ALPHA: return _mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3));
+			case SIRE_BLEND_INV_SRC_ALPHA:
+			case SIRE_BLEND_INV_SRC1_ALPHA: return _mm256_sub_ps(one, _mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3)));
+			case SIRE_BLEND_DEST_ALPHA: return _mm256_permute_ps(d, _MM_SHUFFLE(3, 3, 3, 3));
+			case SIRE_BLEND_INV_DEST_ALPHA: return _mm256_sub_ps(one, _mm256_permute_ps(d, _MM_SHUFFLE(3, 3, 3, 3)));
+			case SIRE_BLEND_DEST_COLOR: return d;
+			case SIRE_BLEND_INV_DEST_COLOR: return _mm256_sub_ps(one, d);
+			case SIRE_BLEND_SRC_ALPHA_SAT:
+			{
+				__m256 sat = _mm256_min_ps(_mm256_sub_ps(one, _mm256_permute_ps(d, _MM_SHUFFLE(3, 3, 3, 3))), _mm256_permute_ps(s, _MM_SHUFFLE(3, 3, 3, 3)));
+				return _mm256_blend_ps(sat, one, 0x88);
+			}
+		}
+
+		return _mm256_setzero_ps();
+	}
+
+	static inline __m256 ApplyBlendOp(uint8_t op, __m256 s, __m256 d, __m256 fs, __m256 fd) {
+		switch (op) {
+			case SIRE_BLEND_OP_SUBTRACT: return _mm256_sub_ps(_mm256_mul_ps(s, fs), _mm256_mul_ps(d, fd));
+			case SIRE_BLEND_OP_REV_SUBTRACT: return _mm256_sub_ps(_mm256_mul_ps(d, fd), _mm256_mul_ps(s, fs));
+			case SIRE_BLEND_OP_MIN: return _mm256_min_ps(d, s);
+			case SIRE_BLEND_OP_MAX: return _mm256_max_ps(d, s);
+		}
+
+		return _mm256_add_ps(_mm256_mul_ps(s, fs), _mm256_mul_ps(d, fd));
+	}
+
+	static inline __m256 BlendPixels(tRenderState const& states, __m256 s, __m256 d, __m256 writeMask) {
+		__m256 out = s;
+		if (states.blendEnable) {
+			__m256 one = _mm256_set1_ps(1.0f);
+			__m256 fs = _mm256_blend_ps(GetBlendFactor(states.srcBlend, s, d, one), GetBlendFactor(states.srcBlendAlpha, s, d, one), 0x88);
+			__m256 fd = _mm256_blend_ps(GetBlendFactor(states.dstBlend, s, d, one), GetBlendFactor(states.destBlendAlpha, s, d, one), 0x88);
+			out = ApplyBlendOp(states.blendop, s, d, fs, fd);
+			if (states.blendOpAlpha != states.blendop)
+				out = _mm256_blend_ps(out, ApplyBlendOp(states.blendOpAlpha, s, d, fs, fd), 0x88);
+		}
+
+		return _mm256_blendv_ps(d, out, writeMask);
+	}
+
+	static inline __m256 GetWriteMask8(uint8_t bits) {
+		__m128 m = SimdLaneMask(bits);
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(m), m, 1);
+	}
+#endif
+
+	// Blends count RGBA pixels of src into an RGBA8 span, src is clamped like the output of a UNORM target.
+	static inline void BlendSpan(tRenderState const& states, uint8_t* dst, float const* src, uint32_t count) {
+		uint32_t i = 0;
+
+#ifdef SIRE_AVX2
+		__m256 zero8 = _mm256_setzero_ps();
+		__m256 one8 = _mm256_set1_ps(1.0f);
+		__m256 mask8 = GetWriteMask8(states.renderTargetWriteMask);
+		for (; i + 2 <= count; i += 2) {
+			__m256 s = _mm256_min_ps(one8, _mm256_max_ps(zero8, _mm256_loadu_ps(src + i * 4)));
+			__m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dst + i * 4)));
+			__m256 d = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), _mm256_set1_ps(1.0f / 255.0f));
+
+			__m256 out = _mm256_min_ps(one8, _mm256_max_ps(zero8, BlendPixels(states, s, d, mask8)));
+			__m256i v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(out, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+			__m128i w = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(w, w));
+		}
+#endif
+
+#ifdef SIRE_SIMD
+		tSimd4f zero = SimdSet(0.0f);
+		tSimd4f one = SimdSet(1.0f);
+		tSimd4f alphaLane = SimdLaneMask(8);
+		tSimd4f mask = SimdLaneMask(states.renderTargetWriteMask);
+		for (; i < count; i++) {
+			tSimd4f s = SimdMin(one, SimdMax(zero, SimdLoad(src + i * 4)));
+			SimdStoreUnorm8(dst + i * 4, BlendPixel(states, s, SimdLoadUnorm8(dst + i * 4), alphaLane, mask));
+		}
+#endif
+
+		for (; i < count; i++) {
+			float s[4];
+			float d[4];
+			float out[4];
+			for (int32_t k = 0; k < 4; k++) {
+				s[k] = (std::min)((std::max)(src[i * 4 + k], 0.0f), 1.0f);
+				d[k] = dst[i * 4 + k] * (1.0f / 255.0f);
+			}
+
+			BlendPixel(states, s, d, out);
+			for (int32_t k = 0; k < 4; k++)
+				dst[i * 4 + k] = ToUnorm(out[k]);
+		}
+	}
+
+	// Float targets are neither clamped before nor after blending.
+	static inline void BlendSpan(tRenderState const& states, float* dst, float const* src, uint32_t count) {
+		uint32_t i = 0;
+
+#ifdef SIRE_AVX2
+		__m256 mask8 = GetWriteMask8(states.renderTargetWriteMask);
+		for (; i + 2 <= count; i += 2)
+			_mm256_storeu_ps(dst + i * 4, BlendPixels(states, _mm256_loadu_ps(src + i * 4), _mm256_loadu_ps(dst + i * 4), mask8));
+#endif
+
+#ifdef SIRE_SIMD
+		tSimd4f alphaLane = SimdLaneMask(8);
+		tSimd4f mask = SimdLaneMask(states.renderTargetWriteMask);
+		for (; i < count; i++)
+			SimdStore(dst + i * 4, BlendPixel(states, SimdLoad(src + i * 4), SimdLoad(dst + i * 4), alphaLane, mask));
+#endif
+
+		for (; i < count; i++) {
+			float out[4];
+			BlendPixel(states, src + i * 4, dst + i * 4, out);
+			memcpy(dst + i * 4, out, sizeof(out));
+		}
+	}
+
+	static inline uint32_t GetMipLevelCount(int32_t width, int32_t height) {
+		uint32_t levels = 1;
+		for (int32_t size = (std::max)(width, height); size > 1; size >>= 1)
+			levels++;
+
+		return levels;
+	}
+
+	struct tSrgbTables {
+		float toLinear[256];
+		uint8_t toSrgb[4096];
+
+		tSrgbTables() {
+			for (int32_t i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (int32_t i = 0; i < 4096; i++) {
+				float c = i / 4095.0f;
+				c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<uint8_t>(c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	static inline tSrgbTables const& GetSrgbTables() {
+		static tSrgbTables tables;
+		return tables;
+	}
+
+	struct tMipContext {
+		uint8_t const* src;
+		int32_t srcWidth;
+		int32_t srcHeight;
+		uint8_t* dst;
+		int32_t dstWidth;
+		bool srgb;
+	};
+
+	// Each destination pixel averages a 2x2 source quad, odd last rows and columns are dropped.
+	static inline void DownsampleRows(void* ptr, uint32_t begin, uint32_t end) {
+		tMipContext& c = *static_cast<tMipContext*>(ptr);
+		tSrgbTables const& tables = GetSrgbTables();
+
+		for (uint32_t y = begin; y < end; y++) {
+			uint8_t const* r0 = c.src + static_cast<size_t>((std::min)(static_cast<int32_t>(y) * 2, c.srcHeight - 1)) * c.srcWidth * 4;
+			uint8_t const* r1 = c.src + static_cast<size_t>((std::min)(static_cast<int32_t>(y) * 2 + 1, c.srcHeight - 1)) * c.srcWidth * 4;
+			uint8_t* dst = c.dst + static_cast<size_t>(y) * c.dstWidth * 4;
+			int32_t x = 0;
+
+			if (c.srgb) {
+				for (; x < c.dstWidth; x++) {
+					int32_t x0 = (std::min)(x * 2, c.srcWidth - 1) * 4;
+					int32_t x1 = (std::min)(x * 2 + 1, c.srcWidth - 1) * 4;
+					uint8_t const* quad[4] = { r0 + x0, r0 + x1, r1 + x0, r1 + x1 };
+
+					float sum[4];
+#ifdef SIRE_SIMD
+					tSimd4f acc = SimdSet(0.0f);
+					for (int32_t i = 0; i < 4; i++) {
+						float px[4] = { tables.toLinear[quad[i][0]], tables.toLinear[quad[i][1]], tables.toLinear[quad[i][2]], static_cast<float>(quad[i][3]) };
+						acc = SimdAdd(acc, SimdLoad(px));
+					}
+					SimdStore(sum, SimdMul(acc, SimdSet(0.25f)));
+#else
+					for (int32_t k = 0; k < 3; k++)
+						sum[k] = (tables.toLinear[quad[0][k]] + tables.toLinear[quad[1][k]] + tables.toLinear[quad[2][k]] + tables.toLinear[quad[3][k]]) * 0.25f;
+					sum[3] = (quad[0][3] + quad[1][3] + quad[2][3] + quad[3][3]) * 0.25f;
+#endif
+					for (int32_t k = 0; k < 3; k++)
+						dst[x * 4 + k] = tables.toSrgb[static_cast<int32_t>(sum[k] * 4095.0f + 0.5f)];
+					dst[x * 4 + 3] = static_cast<uint8_t>(sum[3] + 0.5f);
+				}
+				continue;
+			}
+
+			if (c.srcWidth > 1) {
+#if defined(SIRE_SSE2)
+				__m128i zero = _mm_setzero_si128();
+				__m128i two = _mm_set1_epi16(2);
+				for (; x + 4 <= c.dstWidth; x += 4) {
+					__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x * 8));
+					__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x * 8 + 16));
+					__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x * 8));
+					__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x * 8 + 16));
+
+					// Vertical sums as 16 bit, two source pixels per register half.
+					__m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+					__m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+					__m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+					__m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+					__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23));
+					__m128i s1 = _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67));
+					s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+					s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(s0, s1));
+				}
+#elif defined(SIRE_NEON)
+				for (; x + 8 <= c.dstWidth; x += 8) {
+					uint8x16x4_t a = vld4q_u8(r0 + x * 8);
+					uint8x16x4_t b = vld4q_u8(r1 + x * 8);
+					uint8x8x4_t o;
+					for (int32_t k = 0; k < 4; k++)
+						o.val[k] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[k]), vpaddlq_u8(b.val[k])), 2);
+					vst4_u8(dst + x * 4, o);
+				}
+#endif
+			}
+
+			for (; x < c.dstWidth; x++) {
+				int32_t x0 = (std::min)(x * 2, c.srcWidth - 1) * 4;
+				int32_t x1 = (std::min)(x * 2 + 1, c.srcWidth - 1) * 4;
+				for (int32_t k = 0; k < 4; k++)
+					dst[x * 4 + k] = static_cast<uint8_t>((r0[x0 + k] + r0[x1 + k] + r1[x0 + k] + r1[x1 + k] + 2) >> 2);
+			}
+		}
+	}
+
+	static inline uint32_t ReadLE16(uint8_t const* p) {
+		return p[0] | (p[1] << 8);
+	}
+
+	static inline uint32_t ReadLE32(uint8_t const* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+	}
+
+	static inline uint32_t ReadBE16(uint8_t const* p) {
+		return (p[0] << 8) | p[1];
+	}
+
+	static inline uint32_t ReadBE32(uint8_t const* p) {
+		return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
+	// LSB first bit stream for inflate, reads past the end return zeros and set Overrun.
+	struct tBitReader {
+		uint8_t const* data;
+		size_t size;
+		size_t pos;
+		uint64_t bits;
+		uint32_t count;
+
+		void Refill() {
+			while (count <= 56) {
+				uint64_t byte = pos < size ? data[pos] : 0;
+				bits |= byte << count;
+				count += 8;
+				pos++;
+			}
+		}
+
+		uint32_t Peek(uint32_t n) {
+			if (count < n)
+				Refill();
+
+			return static_cast<uint32_t>(bits & ((1ull << n) - 1));
+		}
+
+		void Consume(uint32_t n) {
+			bits >>= n;
+			count -= n;
+		}
+
+		uint32_t Read(uint32_t n) {
+			uint32_t out = Peek(n);
+			Consume(n);
+			return out;
+		}
+
+		bool Overrun() const {
+			return pos * 8 - count > size * 8;
+		}
+	};
+
+	// Canonical Huffman code, codes up to 9 bits resolve with one table lookup.
+	struct tHuffman {
+		uint16_t fast[512];
+		uint16_t counts[16];
+		uint16_t symbols[288];
+
+		bool Build(uint8_t const* lengths, uint32_t n) {
+			memset(counts, 0, sizeof(counts));
+			for (uint32_t i = 0; i < n; i++)
+				counts[lengths[i]]++;
+			counts[0] = 0;
+
+			int32_t left = 1;
+			for (int32_t len = 1; len < 16; len++) {
+				left = (left << 1) - counts[len];
+				if (left < 0)
+					return false;
+			}
+
+			uint16_t offsets[16] = {};
+			for (int32_t len = 1; len < 15; len++)
+				offsets[len + 1] = offsets[len] + counts[len];
+
+			for (uint32_t i = 0; i < n; i++) {
+				if (lengths[i])
+					symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+			}
+
+			memset(fast, 0, sizeof(fast));
+			uint32_t code = 0;
+			uint32_t index = 0;
+			for (uint32_t len = 1; len <= 9; len++) {
+				for (uint32_t k = 0; k < counts[len]; k++, code++) {
+					uint32_t reversed = 0;
+					for (uint32_t b = 0; b < len; b++)
+						reversed |= ((code >> b) & 1) << (len - 1 - b);
+
+					for (uint32_t j = reversed; j < 512; j += 1u << len)
+						fast[j] = static_cast<uint16_t>((symbols[index] << 4) | len);
+					index++;
+				}
+				code <<= 1;
+			}
+
+			return true;
+		}
+
+		int32_t Decode(tBitReader& br) const {
+			uint32_t bits = br.Peek(15);
+			uint32_t entry = fast[bits & 511];
+			if (entry) {
+				br.Consume(entry & 15);
+				return entry >> 4;
+			}
+
+			int32_t code = 0;
+			int32_t first = 0;
+			int32_t index = 0;
+			for (uint32_t len = 1; len < 16; len++) {
+				code |= (bits >> (len - 1)) & 1;
+				int32_t count = counts[len];
+				if (code - first < count) {
+					br.Consume(len);
+					return symbols[index + code - first];
+				}
+
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+
+			return -1;
+		}
+	};
+
+	// Raw DEFLATE stream, appends to out.
+	static inline bool Inflate(uint8_t const* data, size_t size, std::vector<uint8_t>& out) {
+		static constexpr uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static constexpr uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static constexpr uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static constexpr uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		static constexpr uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		tBitReader br = { data, size, 0, 0, 0 };
+		tHuffman lit;
+		tHuffman dist;
+
+		for (bool last = false; !last;) {
+			last = br.Read(1) != 0;
+			uint32_t type = br.Read(2);
+
+			if (type == 0) {
+				br.Consume(br.count & 7);
+				uint32_t len = br.Read(16);
+				if ((len ^ 0xFFFF) != br.Read(16))
+					return false;
+
+				for (uint32_t i = 0; i < len; i++)
+					out.push_back(static_cast<uint8_t>(br.Read(8)));
+			}
+			else if (type == 1) {
+				uint8_t lengths[318];
+				memset(lengths, 8, 144);
+				memset(lengths + 144, 9, 112);
+				memset(lengths + 256, 7, 24);
+				memset(lengths + 280, 8, 8);
+				memset(lengths + 288, 5, 30);
+				lit.Build(lengths, 288);
+				dist.Build(lengths + 288, 30);
+			}
+			else if (type == 2) {
+				uint32_t numLit = br.Read(5) + 257;
+				uint32_t numDist = br.Read(5) + 1;
+				uint32_t numCodeLengths = br.Read(4) + 4;
+				if (numLit > 286 || numDist > 30)
+					return false;
+
+				uint8_t codeLengths[19] = {};
+				for (uint32_t i = 0; i < numCodeLengths; i++)
+					codeLengths[codeLengthOrder[i]] = static_cast<uint8_t>(br.Read(3));
+
+				tHuffman codeLengthCode;
+				if (!codeLengthCode.Build(codeLengths, 19))
+					return false;
+
+				uint8_t lengths[318] = {};
+				for (uint32_t i = 0; i < numLit + numDist;) {
+					int32_t sym = codeLengthCode.Decode(br);
+					if (sym < 0)
+						return false;
+
+					if (sym < 16) {
+						lengths[i++] = static_cast<uint8_t>(sym);
+						continue;
+					}
+
+					uint8_t value = 0;
+					uint32_t repeat = 0;
+					if (sym == 16) {
+						if (i == 0)
+							return false;
+
+						value = lengths[i - 1];
+						repeat = 3 + br.Read(2);
+					}
+					else if (sym == 17) {
+						repeat = 3 + br.Read(3);
+					}
+					else {
+						repeat = 11 + br.Read(7);
+					}
+
+					if (i + repeat > numLit + numDist)
+						return false;
+
+					while (repeat--)
+						lengths[i++] = value;
+				}
+
+				if (!lit.Build(lengths, numLit) || !dist.Build(lengths + numLit, numDist))
+					return false;
+			}
+			else {
+				return false;
+			}
+
+			while (type != 0) {
+				int32_t sym = lit.Decode(br);
+				if (sym < 0 || br.Overrun())
+					return false;
+
+				if (sym < 256) {
+					out.push_back(static_cast<uint8_t>(sym));
+					continue;
+				}
+
+				if (sym == 256)
+					break;
+
+				sym -= 257;
+				if (sym >= 29)
+					return false;
+
+				uint32_t len = lengthBase[sym] + br.Read(lengthExtra[sym]);
+				int32_t d = dist.Decode(br);
+				if (d < 0 || d >= 30)
+					return false;
+
+				size_t distance = distBase[d] + br.Read(distExtra[d]);
+				if (distance > out.size())
+					return false;
+
+				// Copies byte by byte, the source may overlap what is being written.
+				size_t start = out.size();
+				out.resize(start + len);
+				uint8_t* p = out.data() + start;
+				for (uint32_t k = 0; k < len; k++)
+					p[k] = p[static_cast<ptrdiff_t>(k) - static_cast<ptrdiff_t>(distance)];
+			}
+
+			if (br.Overrun())
+				return false;
+		}
+
+		return true;
+	}
+
+	static inline bool UnfilterPngRow(uint8_t filter, uint8_t* row, uint8_t const* prev, size_t stride, uint32_t bpp) {
+		switch (filter) {
+			case 0:
+				break;
+			case 1:
+				for (size_t i = bpp; i < stride; i++)
+					row[i] += row[i - bpp];
+				break;
+			case 2:
+				for (size_t i = 0; i < stride; i++)
+					row[i] += prev[i];
+				break;
+			case 3:
+				for (size_t i = 0; i < stride; i++)
+					row[i] += static_cast<uint8_t>(((i >= bpp ? row[i - bpp] : 0) + prev[i]) >> 1);
+				break;
+			case 4:
+				for (size_t i = 0; i < stride; i++) {
+					int32_t a = i >= bpp ? row[i - bpp] : 0;
+					int32_t b = prev[i];
+					int32_t c = i >= bpp ? prev[i - bpp] : 0;
+					int32_t pa = abs(b - c);
+					int32_t pb = abs(a - c);
+					int32_t pc = abs(a + b - 2 * c);
+					row[i] += static_cast<uint8_t>(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+				}
+				break;
+			default:
+				return false;
+		}
+
+		return true;
+	}
+
+	// Sample index of a row at any bit depth, 16 bit samples keep their full value.
+	static inline uint32_t GetPngSample(uint8_t const* row, uint32_t index, uint32_t depth) {
+		switch (depth) {
+			case 8:
+				return row[index];
+			case 16:
+				return ReadBE16(row + index * 2);
+			default:
+			{
+				uint32_t bit = index * depth;
+				return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1u << depth) - 1);
+			}
+		}
+	}
+
+	static inline uint8_t ScalePngSample(uint32_t value, uint32_t depth) {
+		if (depth == 16)
+			return static_cast<uint8_t>(value >> 8);
+
+		return static_cast<uint8_t>(depth == 8 ? value : value * 255 / ((1u << depth) - 1));
+	}
+
+	// Non interlaced and Adam7 images at every bit depth and color type, output is RGBA8.
+	static inline bool DecodePng(uint8_t const* data, size_t size, std::vector<uint8_t>& out, int32_t& width, int32_t& height) {
+		uint32_t w = 0;
+		uint32_t h = 0;
+		uint32_t depth = 0;
+		uint32_t colorType = 0;
+		uint32_t interlace = 0;
+		uint8_t palette[256 * 4] = {};
+		uint32_t paletteSize = 0;
+		bool hasKey = false;
+		uint32_t key[3] = {};
+		std::vector<uint8_t> compressed;
+
+		for (uint32_t i = 0; i < 256; i++)
+			palette[i * 4 + 3] = 255;
+
+		size_t pos = 8;
+		while (pos + 12 <= size) {
+			uint32_t length = ReadBE32(data + pos);
+			uint8_t const* type = data + pos + 4;
+			uint8_t const* chunk = data + pos + 8;
+			if (length > size - pos - 12)
+				return false;
+
+			if (!memcmp(type, "IHDR", 4)) {
+				if (length < 13 || chunk[10] != 0 || chunk[11] != 0)
+					return false;
+
+				w = ReadBE32(chunk);
+				h = ReadBE32(chunk + 4);
+				depth = chunk[8];
+				colorType = chunk[9];
+				interlace = chunk[12];
+			}
+			else if (!memcmp(type, "PLTE", 4)) {
+				paletteSize = (std::min)(length / 3, 256u);
+				for (uint32_t i = 0; i < paletteSize; i++)
+					memcpy(palette + i * 4, chunk + i * 3, 3);
+			}
+			else if (!memcmp(type, "tRNS", 4)) {
+				if (colorType == 3) {
+					for (uint32_t i = 0; i < (std::min)(length, 256u); i++)
+						palette[i * 4 + 3] = chunk[i];
+				}
+				else if (colorType == 0 && length >= 2) {
+					hasKey = true;
+					key[0] = ReadBE16(chunk);
+				}
+				else if (colorType == 2 && length >= 6) {
+					hasKey = true;
+					for (int32_t k = 0; k < 3; k++)
+						key[k] = ReadBE16(chunk + k * 2);
+				}
+			}
+			else if (!memcmp(type, "IDAT", 4)) {
+				compressed.insert(compressed.end(), chunk, chunk + length);
+			}
+			else if (!memcmp(type, "IEND", 4)) {
+				break;
+			}
+
+			pos += 12 + static_cast<size_t>(length);
+		}
+
+		uint32_t channels = 0;
+		switch (colorType) {
+			case 0:
+				channels = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16 ? 1 : 0;
+				break;
+			case 2:
+			case 4:
+			case 6:
+				channels = depth == 8 || depth == 16 ? (colorType == 2 ? 3 : (colorType == 4 ? 2 : 4)) : 0;
+				break;
+			case 3:
+				channels = paletteSize && depth <= 8 && depth != 0 && (8 % depth) == 0 ? 1 : 0;
+				break;
+		}
+
+		if (!channels || interlace > 1 || !w || !h || w > SIRE_MAX_IMAGE_DIMENSION || h > SIRE_MAX_IMAGE_DIMENSION)
+			return false;
+
+		// zlib header, the method has to be deflate.
+		if (compressed.size() < 2 || (compressed[0] & 15) != 8)
+			return false;
+
+		static constexpr uint32_t passes[8][4] = { { 0, 0, 1, 1 }, { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+		uint32_t firstPass = interlace ? 1 : 0;
+		uint32_t lastPass = interlace ? 8 : 1;
+		uint32_t bitsPerPixel = channels * depth;
+		uint32_t bpp = (std::max)(bitsPerPixel / 8, 1u);
+
+		size_t expected = 0;
+		for (uint32_t p = firstPass; p < lastPass; p++) {
+			size_t pw = w > passes[p][0] ? (w - passes[p][0] + passes[p][2] - 1) / passes[p][2] : 0;
+			size_t ph = h > passes[p][1] ? (h - passes[p][1] + passes[p][3] - 1) / passes[p][3] : 0;
+			if (pw && ph)
+				expected += ph * (1 + (pw * bitsPerPixel + 7) / 8);
+		}
+
+		std::vector<uint8_t> raw;
+		raw.reserve(expected);
+		if (!Inflate(compressed.data() + 2, compressed.size() - 2, raw) || raw.size() < expected)
+			return false;
+
+		out.resize(static_cast<size_t>(w) * h * 4);
+		uint8_t* src = raw.data();
+		std::vector<uint8_t> zero;
+
+		for (uint32_t p = firstPass; p < lastPass; p++) {
+			uint32_t pw = w > passes[p][0] ? (w - passes[p][0] + passes[p][2] - 1) / passes[p][2] : 0;
+			uint32_t ph = h > passes[p][1] ? (h - passes[p][1] + passes[p][3] - 1) / passes[p][3] : 0;
+			if (!pw || !ph)
+				continue;
+
+			size_t stride = (static_cast<size_t>(pw) * bitsPerPixel + 7) / 8;
+			zero.assign(stride, 0);
+			uint8_t const* prev = zero.data();
+
+			for (uint32_t y = 0; y < ph; y++, src += 1 + stride) {
+				uint8_t* row = src + 1;
+				if (!UnfilterPngRow(src[0], row, prev, stride, bpp))
+					return false;
+				prev = row;
+
+				uint8_t* dst = out.data() + ((static_cast<size_t>(passes[p][1] + y * passes[p][3])) * w + passes[p][0]) * 4;
+				for (uint32_t x = 0; x < pw; x++, dst += passes[p][2] * 4) {
+					switch (colorType) {
+						case 0:
+						{
+							uint32_t v = GetPngSample(row, x, depth);
+							dst[0] = dst[1] = dst[2] = ScalePngSample(v, depth);
+							dst[3] = hasKey && v == key[0] ? 0 : 255;
+						} break;
+						case 2:
+						{
+							uint32_t v[3];
+							for (int32_t k = 0; k < 3; k++) {
+								v[k] = GetPngSample(row, x * 3 + k, depth);
+								dst[k] = ScalePngSample(v[k], depth);
+							}
+							dst[3] = hasKey && v[0] == key[0] && v[1] == key[1] && v[2] == key[2] ? 0 : 255;
+						} break;
+						case 3:
+							memcpy(dst, palette + GetPngSample(row, x, depth) * 4, 4);
+							break;
+						case 4:
+							dst[0] = dst[1] = dst[2] = ScalePngSample(GetPngSample(row, x * 2, depth), depth);
+							dst[3] = ScalePngSample(GetPngSample(row, x * 2 + 1, depth), depth);
+							break;
+						case 6:
+							for (int32_t k = 0; k < 4; k++)
+								dst[k] = ScalePngSample(GetPngSample(row, x * 4 + k, depth), depth);
+							break;
+					}
+				}
+			}
+		}
+
+		width = static_cast<int32_t>(w);
+		height = static_cast<int32_t>(h);
+		return true;
+	}
+
+	// Uncompressed and RLE true color and grayscale images, output is BGRA8.
+	static inline bool DecodeTga(uint8_t const* data, size_t size, std::vector<uint8_t>& out, int32_t& width, int32_t& height) {
+		if (size < 18)
+			return false;
+
+		uint32_t imageType = data[2];
+		uint32_t w = ReadLE16(data + 12);
+		uint32_t h = ReadLE16(data + 14);
+		uint32_t depth = data[16];
+		uint32_t descriptor = data[17];
+		bool gray = imageType == 3 || imageType == 11;
+		bool rle = imageType == 10 || imageType == 11;
+
+		if (data[1] != 0 || (imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11))
+			return false;
+
+		if (gray ? depth != 8 : (depth != 24 && depth != 32))
+			return false;
+
+		if (!w || !h || w > SIRE_MAX_IMAGE_DIMENSION || h > SIRE_MAX_IMAGE_DIMENSION)
+			return false;
+
+		uint32_t pixelSize = depth / 8;
+		bool hasAlpha = depth == 32 && (descriptor & 15) != 0;
+		bool topDown = (descriptor & 0x20) != 0;
+		size_t pos = 18 + static_cast<size_t>(data[0]);
+		size_t count = static_cast<size_t>(w) * h;
+		out.resize(count * 4);
+
+		uint8_t pixel[4] = { 0, 0, 0, 255 };
+		for (size_t i = 0; i < count;) {
+			uint32_t run = 1;
+			bool repeat = false;
+			if (rle) {
+				if (pos >= size)
+					return false;
+
+				run = (data[pos] & 127) + 1;
+				repeat = (data[pos] & 128) != 0;
+				pos++;
+			}
+
+			for (uint32_t k = 0; k < run && i < count; k++, i++) {
+				if (k == 0 || !repeat) {
+					if (pos + pixelSize > size)
+						return false;
+
+					if (gray) {
+						pixel[0] = pixel[1] = pixel[2] = data[pos];
+					}
+					else {
+						memcpy(pixel, data + pos, pixelSize);
+						if (!hasAlpha)
+							pixel[3] = 255;
+					}
+					pos += pixelSize;
+				}
+
+				size_t y = i / w;
+				size_t x = i % w;
+				memcpy(out.data() + ((topDown ? y : h - 1 - y) * w + x) * 4, pixel, 4);
+			}
+		}
+
+		width = static_cast<int32_t>(w);
+		height = static_cast<int32_t>(h);
+		return true;
+	}
+
+	// Position and width of a BMP channel mask.
+	static inline uint8_t ExtractMaskedChannel(uint32_t value, uint32_t mask, uint8_t fallback) {
+		if (!mask)
+			return fallback;
+
+		uint32_t shift = 0;
+		while (!((mask >> shift) & 1))
+			shift++;
+
+		uint32_t bits = 0;
+		while (shift + bits < 32 && ((mask >> (shift + bits)) & 1))
+			bits++;
+
+		uint32_t v = (value & mask) >> shift;
+		return static_cast<uint8_t>(bits >= 8 ? v >> (bits - 8) : v * 255 / ((1u << bits) - 1));
+	}
+
+	// 8 bit palettized, 24 bit and 32 bit (with or without bit fields) uncompressed bitmaps, output is BGRA8.
+	static inline bool DecodeBmp(uint8_t const* data, size_t size, std::vector<uint8_t>& out, int32_t& width, int32_t& height) {
+		if (size < 26)
+			return false;
+
+		uint32_t offset = ReadLE32(data + 10);
+		uint32_t headerSize = ReadLE32(data + 14);
+		int32_t w = 0;
+		int32_t h = 0;
+		uint32_t bitCount = 0;
+		uint32_t compression = 0;
+		uint32_t numColors = 0;
+
+		if (headerSize == 12) {
+			w = static_cast<int16_t>(ReadLE16(data + 18));
+			h = static_cast<int16_t>(ReadLE16(data + 20));
+			bitCount = ReadLE16(data + 24);
+		}
+		else if (headerSize >= 40 && size >= 54) {
+			w = static_cast<int32_t>(ReadLE32(data + 18));
+			h = static_cast<int32_t>(ReadLE32(data + 22));
+			bitCount = ReadLE16(data + 28);
+			compression = ReadLE32(data + 30);
+			numColors = ReadLE32(data + 46);
+		}
+		else {
+			return false;
+		}
+
+		bool topDown = h < 0;
+		h = abs(h);
+		if (w <= 0 || h <= 0 || w > SIRE_MAX_IMAGE_DIMENSION || h > SIRE_MAX_IMAGE_DIMENSION)
+			return false;
+
+		// BI_RGB, or BI_BITFIELDS for 32 bit.
+		if (!(compression == 0 && (bitCount == 8 || bitCount == 24 || bitCount == 32)) && !(compression == 3 && bitCount == 32))
+			return false;
+
+		uint32_t masks[4] = { 0x00FF0000, 0x0000FF00, 0x000000FF, 0 };
+		if (compression == 3) {
+			if (size < 66)
+				return false;
+
+			for (int32_t k = 0; k < 3; k++)
+				masks[k] = ReadLE32(data + 54 + k * 4);
+			masks[3] = headerSize >= 56 && size >= 70 ? ReadLE32(data + 66) : 0;
+		}
+
+		uint8_t const* palette = data + 14 + headerSize;
+		uint32_t paletteEntrySize = headerSize == 12 ? 3 : 4;
+		if (bitCount == 8) {
+			numColors = numColors && numColors <= 256 ? numColors : 256;
+			if (14 + static_cast<size_t>(headerSize) + numColors * paletteEntrySize > size)
+				return false;
+		}
+
+		size_t rowSize = (static_cast<size_t>(w) * bitCount + 31) / 32 * 4;
+		if (offset > size || rowSize * h > size - offset)
+			return false;
+
+		out.resize(static_cast<size_t>(w) * h * 4);
+		bool anyAlpha = false;
+
+		for (int32_t y = 0; y < h; y++) {
+			uint8_t const* src = data + offset + rowSize * (topDown ? y : h - 1 - y);
+			uint8_t* dst = out.data() + static_cast<size_t>(y) * w * 4;
+
+			for (int32_t x = 0; x < w; x++, dst += 4) {
+				if (bitCount == 8) {
+					uint32_t index = src[x];
+					if (index < numColors)
+						memcpy(dst, palette + index * paletteEntrySize, 3);
+					else
+						dst[0] = dst[1] = dst[2] = 0;
+					dst[3] = 255;
+				}
+				else if (bitCount == 24) {
+					memcpy(dst, src + x * 3, 3);
+					dst[3] = 255;
+				}
+				else if (compression == 0) {
+					memcpy(dst, src + x * 4, 4);
+					anyAlpha |= dst[3] != 0;
+				}
+				else {
+					uint32_t v = ReadLE32(src + x * 4);
+					dst[0] = ExtractMaskedChannel(v, masks[2], 0);
+					dst[1] = ExtractMaskedChannel(v, masks[1], 0);
+					dst[2] = ExtractMaskedChannel(v, masks[0], 0);
+					dst[3] = ExtractMaskedChannel(v, masks[3], 255);
+				}
+			}
+		}
+
+		// The fourth byte of BI_RGB is reserved, writers that don't use it for alpha leave it zero.
+		if (bitCount == 32 && compression == 0 && !anyAlpha) {
+			for (size_t i = 3; i < out.size(); i += 4)
+				out[i] = 255;
+		}
+
+		width = w;
+		height = h;
+		return true;
+	}
+
+	static inline bool ReadFileData(std::string const& path, std::vector<uint8_t>& out) {
+		FILE* f = fopen(path.c_str(), "rb");
+		if (!f)
+			return false;
+
+		bool result = fseek(f, 0, SEEK_END) == 0;
+		long size = result ? ftell(f) : -1;
+		result = size >= 0 && fseek(f, 0, SEEK_SET) == 0;
+		if (result) {
+			out.resize(static_cast<size_t>(size));
+			result = fread(out.data(), 1, out.size(), f) == out.size();
+		}
+		fclose(f);
+
+		return result;
+	}
+
+	// 32 bit top-down TGA from RGBA8 pixels.
+	static inline bool WriteTga(std::string const& path, int32_t width, int32_t height, uint8_t const* pixels) {
+		if (!pixels || width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF)
+			return false;
+
+		std::vector<uint8_t> data(18 + static_cast<size_t>(width) * height * 4);
+		data[2] = 2;
+		data[12] = static_cast<uint8_t>(width);
+		data[13] = static_cast<uint8_t>(width >> 8);
+		data[14] = static_cast<uint8_t>(height);
+		data[15] = static_cast<uint8_t>(height >> 8);
+		data[16] = 32;
+		data[17] = 0x28;
+		ConvertPixels(pixels, SIRE_PIXEL_FORMAT_RGBA8, data.data() + 18, SIRE_PIXEL_FORMAT_BGRA8, static_cast<uint32_t>(width) * height);
+
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f)
+			return false;
+
+		bool result = fwrite(data.data(), 1, data.size(), f) == data.size();
+		fclose(f);
+
+		return result;
+	}
+
+	// Read-only view of a whole file, nullptr when it's missing or empty.
+	static inline uint8_t const* MapFileData(std::string const& path, size_t& size) {
+		size = 0;
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER fileSize = {};
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+
+		if (!mapping)
+			return nullptr;
+
+		// The view keeps the mapping and the file open.
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+
+		if (!view)
+			return nullptr;
+
+		size = static_cast<size_t>(fileSize.QuadPart);
+		return static_cast<uint8_t const*>(view);
+	}
+
+	static inline void UnmapFileData(uint8_t const* data) {
+		UnmapViewOfFile(data);
+	}
+
+	// Bytes of an image with its mip levels back to back.
+	static inline uint64_t GetImageDataSize(eSirePixelFormat format, int32_t width, int32_t height, uint32_t mipLevels) {
+		uint64_t out = 0;
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			if (IsCompressedFormat(format))
+				out += GetCompressedSize(format, width, height);
+			else
+				out += static_cast<uint64_t>(width) * height * GetPixelSize(format);
+
+			width = (std::max)(width >> 1, 1);
+			height = (std::max)(height >> 1, 1);
+		}
+
+		return out;
+	}
+
+	// Loader thread, leaves the pixels in the texture format with their mip chain in data and mipPixels.
+	static inline void DecodeTextureLoad(tTextureLoad& load) {
+		SIRE_PROFILE_SCOPE("Sire::DecodeTexture");
+
+		if (!load.path.empty() && !ReadFileData(load.path, load.data)) {
+			load.failed = true;
+			return;
+		}
+
+		std::vector<uint8_t> pixels;
+		eSirePixelFormat format = SIRE_PIXEL_FORMAT_UNKNOWN;
+		if (!DecodeImage(load.data.data(), load.data.size(), pixels, load.width, load.height, format)) {
+			load.failed = true;
+			load.data.clear();
+			return;
+		}
+
+		if (IsBgraFormat(format) != IsBgraFormat(load.textureFormat))
+			ConvertPixels(pixels.data(), format, pixels.data(), load.textureFormat, static_cast<uint32_t>(load.width * load.height), false, false);
+
+		if (load.mipmaps == SIRE_MIPMAPS_BOX || load.mipmaps == SIRE_MIPMAPS_BOX_SRGB)
+			load.mipLevels = GenerateMipChain(load.width, load.height, pixels.data(), load.mipmaps == SIRE_MIPMAPS_BOX_SRGB, load.mipPixels, false);
+
+		load.data = std::move(pixels);
+	}
+
+	static inline SirePtr<tSireTexture2D> QueueTextureLoad(std::string const& path, uint8_t const* data, size_t size, eSireMipmaps mipmaps) {
+		if (!IsRendererActive())
+			return nullptr;
+
+		if (!placeholderTexture) {
+			uint8_t grey[4] = { 128, 128, 128, 255 };
+			placeholderTexture = CreateTexture(1, 1, grey, SIRE_MIPMAPS_NONE, SIRE_PIXEL_FORMAT_RGBA8);
+		}
+
+		// Borrows the placeholder, a holder without an owner doesn't release its pointers.
+		SirePtr<tSireTexture2D> out(new tSireTexture2D);
+		out->format = GetRenderer()->GetTextureFormat();
+		out->state = SIRE_TEXTURE_LOADING;
+		if (placeholderTexture) {
+			out->ptrs.texture = placeholderTexture->ptrs.texture;
+			out->ptrs.surface = placeholderTexture->ptrs.surface;
+		}
+		out->ptrs.owner = SIRE_RENDERER_NULL;
+
+		tTextureLoad* load = new tTextureLoad();
+		load->texture = out.Get();
+		load->path = path;
+		if (data)
+			load->data.assign(data, data + size);
+		load->textureFormat = out->format;
+		load->mipmaps = mipmaps;
+
+		textureLoads[out.Get()] = load;
+		textureLoader.Push(load);
+
+		return out;
+	}
+
+	static inline void FinishTextureLoad(tTextureLoad* load) {
+		tSireTexture2D* texture = load->texture;
+		if (!texture || load->cancelled.load(std::memory_order_relaxed))
+			return;
+
+		textureLoads.erase(texture);
+
+		SirePtr<tSireTexture2D> result = nullptr;
+		if (!load->failed)
+			result = UploadTexture(load->width, load->height, load->data.data(), load->textureFormat, load->mipLevels, load->mipPixels.data(), load->mipmaps == SIRE_MIPMAPS_GPU);
+
+		texture->ptrs.texture = nullptr;
+		texture->ptrs.surface = nullptr;
+
+		if (!result || !result->ptrs.texture) {
+			texture->state = SIRE_TEXTURE_FAILED;
+			return;
+		}
+
+		AdoptTexture(texture, result.Get());
+	}
+
+	// Called when a texture is destroyed while loading, the decode result gets dropped.
+	static inline void CancelTextureLoad(tSireTexture2D* texture) {
+		auto it = textureLoads.find(texture);
+		if (it == textureLoads.end())
+			return;
+
+		it->second->cancelled.store(true, std::memory_order_relaxed);
+		it->second->texture = nullptr;
+		textureLoads.erase(it);
+	}
+
+	static inline void ReleaseTextureLoads() {
+		textureLoader.Stop();
+
+		for (auto& it : textureLoads) {
+			it.first->ptrs.texture = nullptr;
+			it.first->ptrs.surface = nullptr;
+			it.first->state = SIRE_TEXTURE_FAILED;
+		}
+		textureLoads.clear();
+
+		placeholderTexture.Reset();
+	}
+
+	static inline bool IsTextureLinked(tSireTexture2D* texture) {
+		return texture->lruPrev || textureLruHead == texture;
+	}
+
+	static inline void LinkTexture(tSireTexture2D* texture) {
+		texture->lruPrev = nullptr;
+		texture->lruNext = textureLruHead;
+		if (textureLruHead)
+			textureLruHead->lruPrev = texture;
+		else
+			textureLruTail = texture;
+		textureLruHead = texture;
+
+		textureStats.evictableBytes += texture->bytes;
+	}
+
+	static inline void UnlinkTexture(tSireTexture2D* texture) {
+		if (!IsTextureLinked(texture))
+			return;
+
+		if (texture->lruPrev)
+			texture->lruPrev->lruNext = texture->lruNext;
+		else
+			textureLruHead = texture->lruNext;
+
+		if (texture->lruNext)
+			texture->lruNext->lruPrev = texture->lruPrev;
+		else
+			textureLruTail = texture->lruPrev;
+
+		texture->lruPrev = nullptr;
+		texture->lruNext = nullptr;
+		textureStats.evictableBytes -= texture->bytes;
+	}
+
+	// Called by tSireTexture2D::Set, every texture that owns GPU memory is counted.
+	static inline void TrackTexture(tSireTexture2D* texture, uint64_t bytes) {
+		UntrackTexture(texture);
+
+		texture->bytes = bytes;
+		texture->tracked = true;
+		texture->lastUsedFrame = frameCount;
+		textureStats.bytes += bytes;
+		textureStats.numTextures++;
+
+		if (texture->reloader)
+			LinkTexture(texture);
+
+		EnforceTextureBudget();
+	}
+
+	static inline void UntrackTexture(tSireTexture2D* texture) {
+		if (!texture->tracked)
+			return;
+
+		UnlinkTexture(texture);
+
+		if (texture->state == SIRE_TEXTURE_EVICTED)
+			textureStats.numEvicted--;
+		else
+			textureStats.bytes -= texture->bytes;
+
+		textureStats.numTextures--;
+		texture->tracked = false;
+	}
+
+	// The handle stays valid, w, h and format are kept for the reload.
+	static inline void EvictTexture(tSireTexture2D* texture) {
+		UnlinkTexture(texture);
+		texture->ptrs.Release();
+		texture->state = SIRE_TEXTURE_EVICTED;
+
+		textureStats.bytes -= texture->bytes;
+		textureStats.numEvicted++;
+		textureStats.evictions++;
+	}
+
+	// Moves the GPU objects and their accounting from src into dst, src is left empty.
+	static inline void AdoptTexture(tSireTexture2D* dst, tSireTexture2D* src) {
+		uint64_t bytes = src->bytes;
+		UntrackTexture(src);
+		UntrackTexture(dst);
+
+		dst->w = src->w;
+		dst->h = src->h;
+		dst->format = src->format;
+		dst->ptrs.texture = src->ptrs.texture;
+		dst->ptrs.surface = src->ptrs.surface;
+		dst->ptrs.owner = src->ptrs.owner;
+		dst->state = SIRE_TEXTURE_READY;
+		src->ptrs.texture = nullptr;
+		src->ptrs.surface = nullptr;
+
+		TouchTexture(dst);
+		TrackTexture(dst, bytes);
+	}
+
+	// Moves texture to new GPU objects with the same contents. Queued draws and the current binding still refer to the
+	// old view, so those are flushed and rebound.
+	static inline void SwapTextureViews(tSireTexture2D* texture, uintptr_t* view, uintptr_t* surface) {
+		FlushSortedDraws();
+
+		uintptr_t* prevView = texture->ptrs.texture;
+		texture->ptrs.Release();
+		texture->ptrs.texture = view;
+		texture->ptrs.surface = surface;
+		texture->ptrs.owner = GetCurrentRenderer();
+
+		if (currentTexture == prevView || currentMask == prevView) {
+			if (currentTexture == prevView)
+				currentTexture = view;
+			if (currentMask == prevView)
+				currentMask = view;
+			GetRenderer()->SetTexture(currentTexture, currentMask);
+		}
+
+		TouchTexture(texture);
+	}
+
+	static inline void ReloadTexture(tSireTexture2D* texture) {
+		SirePtr<tSireTexture2D> result = texture->reloader->Reload(texture, texture->reloadKey);
+		if (!result || !result->ptrs.texture) {
+			UntrackTexture(texture);
+			texture->state = SIRE_TEXTURE_FAILED;
+			return;
+		}
+
+		AdoptTexture(texture, result.Get());
+		textureStats.reloads++;
+	}
+
+	// Called whenever the contents of a texture change.
+	static inline void TouchTexture(tSireTexture2D* texture) {
+		texture->generation = ++textureGeneration;
+	}
+
+	// Null once the texture is released.
+	static inline tSireTexture2D* FindTexture(uint64_t id) {
+		auto it = texturesById.find(id);
+		return it != texturesById.end() ? it->second : nullptr;
+	}
+
+	static inline void TouchRenderTarget() {
+		if (tSireTexture2D* texture = FindTexture(currentRenderTargetTexture))
+			TouchTexture(texture);
+	}
+
+	// Everything that hands a texture to the backend goes through here, evicted textures are reloaded first.
+	static inline void UseTexture(tSireTexture2D* texture) {
+		if (!texture)
+			return;
+
+		if (texture->state == SIRE_TEXTURE_EVICTED)
+			ReloadTexture(texture);
+
+		texture->lastUsedFrame = frameCount;
+		if (texture->lruPrev) {
+			UnlinkTexture(texture);
+			LinkTexture(texture);
+		}
+	}
+
+	// Evicts least recently used textures until the budget is met. Textures used this frame or still bound are kept,
+	// pending draws may reference them.
+	static inline void EnforceTextureBudget() {
+		if (!textureStats.budget)
+			return;
+
+		tSireTexture2D* it = textureLruTail;
+		while (it && textureStats.bytes > textureStats.budget && it->lastUsedFrame != frameCount) {
+			tSireTexture2D* prev = it->lruPrev;
+			if (it->ptrs.texture != currentTexture && it->ptrs.texture != currentMask)
+				EvictTexture(it);
+			it = prev;
+		}
+	}
+
+	// Creates the texture from pixels already in textureFormat, mipPixels holds levels 1 to mipLevels - 1.
+	static inline SirePtr<tSireTexture2D> UploadTexture(int32_t width, int32_t height, uint8_t* pixels, eSirePixelFormat textureFormat, uint32_t mipLevels, uint8_t* mipPixels, bool generateMips) {
+		SIRE_PROFILE_SCOPE("Sire::UploadTexture");
+
+		SirePtr<tSireTexture2D> out(new tSireTexture2D);
+
+		switch (GetCurrentRenderer()) {
+#ifdef SIRE_DX9
+			case SIRE_RENDERER_DX9:
+			{
+				IDirect3DSurface9* sout = nullptr;
+				auto result = GetRenderers<SireDirectX9>(GetCurrentRenderer())->CreateTexture(width, height, pixels, &sout, mipLevels, mipPixels, generateMips);
+
+				if (result)
+					out->Set(width, height, textureFormat, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(sout), generateMips ? GetMipLevelCount(width, height) : mipLevels);
+			} break;
+#endif
+#ifdef SIRE_DX10
+			case SIRE_RENDERER_DX10:
+			{
+				auto tex = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateTexture(width, height, pixels, mipLevels, mipPixels, generateMips);
+
+				if (tex) {
+					auto result = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+
+					if (result) {
+						if (generateMips)
+							GetRenderers<SireDirectX10>(GetCurrentRenderer())->GenerateMips(result);
+
+						out->Set(width, height, textureFormat, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex), generateMips ? GetMipLevelCount(width, height) : mipLevels);
+					}
+				}
+			} break;
+#endif
+#ifdef SIRE_DX11
+			case SIRE_RENDERER_DX11:
+			{
+				auto tex = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateTexture(width, height, pixels, mipLevels, mipPixels, generateMips);
+
+				if (tex) {
+					auto result = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+
+					if (result) {
+						if (generateMips)
+							GetRenderers<SireDirectX11>(GetCurrentRenderer())->GenerateMips(result);
+
+						out->Set(width, height, textureFormat, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex), generateMips ? GetMipLevelCount(width, height) : mipLevels);
+					}
+				}
+			} break;
+#endif
+#ifdef SIRE_DX12
+			case SIRE_RENDERER_DX12:
+				break;
+#endif
+#ifdef SIRE_OPENGL
+			case SIRE_RENDERER_OPENGL:
+			{
+			} break;
+#endif
+#ifdef SIRE_SOFTWARE
+			case SIRE_RENDERER_SOFTWARE:
+			{
+				auto result = GetRenderers<SireSoftware>(GetCurrentRenderer())->CreateTexture(width, height, pixels);
+				result->AddRef();
+				out->Set(width, height, textureFormat, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(result), generateMips ? GetMipLevelCount(width, height) : mipLevels);
+			} break;
+#endif
+		}
+
+		if (pixels) {
+			size_t size = static_cast<size_t>(width) * height * 4;
+			bool mips = mipPixels && mipLevels > 1 && !generateMips;
+			frameStats.uploadBytes += mips ? GetImageDataSize(textureFormat, width, height, mipLevels) : size;
+			TraceTextureData(out.Get(), pixels, size, mips ? mipPixels : nullptr, mips ? static_cast<size_t>(GetImageDataSize(textureFormat, width, height, mipLevels)) - size : 0);
+		}
+
+		return out;
+	}
+
+	// Called by tSireTexture2D::Set, the backend pointer gets a new id as it may be reused after a release.
+	static inline void TraceTexture(tSireTexture2D const* texture, uint32_t mipLevels) {
+		if (!traceWriter.file || !texture->ptrs.texture)
+			return;
+
+		uint32_t id = traceWriter.nextId++;
+		traceWriter.ids[texture->ptrs.texture] = id;
+
+		traceWriter.Command(SIRE_TRACE_TEXTURE);
+		traceWriter.Write(id);
+		traceWriter.Write(texture->w);
+		traceWriter.Write(texture->h);
+		traceWriter.Write(static_cast<uint32_t>(texture->format));
+		traceWriter.Write(mipLevels);
+	}
+
+	static inline void TraceTextureData(tSireTexture2D const* texture, uint8_t const* data, size_t size, uint8_t const* mipData = nullptr, size_t mipSize = 0) {
+		if (!traceWriter.file || !texture->ptrs.texture || !data)
+			return;
+
+		if (traceWriter.ids.find(texture->ptrs.texture) == traceWriter.ids.end())
+			TraceTexture(texture, 1);
+
+		traceWriter.Command(SIRE_TRACE_TEXTURE_DATA);
+		traceWriter.Write(traceWriter.ids[texture->ptrs.texture]);
+		traceWriter.Write(static_cast<uint64_t>(size + (mipData ? mipSize : 0)));
+		traceWriter.Write(data, size);
+		if (mipData)
+			traceWriter.Write(mipData, mipSize);
+	}
+
+	// Textures created before the capture started are declared on their first bind, with the contents read back
+	// through Lock. Compressed textures and those the backend can't lock replay blank.
+	static inline void TraceTextureBind(tSireTexture2D* texture) {
+		if (!traceWriter.file || !texture || !texture->ptrs.texture || traceWriter.ids.find(texture->ptrs.texture) != traceWriter.ids.end())
+			return;
+
+		TraceTexture(texture, 1);
+		if (texture->w <= 0 || texture->h <= 0 || IsCompressedFormat(texture->format) || GetPixelSize(texture->format) != 4)
+			return;
+
+		uint8_t* pixels = GetRenderer()->Lock(texture->ptrs.surface);
+		if (!pixels)
+			return;
+
+		TraceTextureData(texture, pixels, static_cast<size_t>(texture->w) * texture->h * 4);
+		GetRenderer()->Unlock(texture->ptrs.surface);
+	}
+
+	static inline void TraceRenderTarget(uintptr_t* renderTargetView, uintptr_t* texture) {
+		if (!traceWriter.file || !renderTargetView)
+			return;
+
+		uint32_t textureId = TraceId(texture, false);
+		uint32_t id = traceWriter.nextId++;
+		traceWriter.ids[renderTargetView] = id;
+
+		traceWriter.Command(SIRE_TRACE_RENDER_TARGET);
+		traceWriter.Write(id);
+		traceWriter.Write(textureId);
+	}
+
+	// Objects not declared yet, like render targets created before the capture started, replay blank.
+	static inline uint32_t TraceId(uintptr_t* ptr, bool renderTarget) {
+		bool created = false;
+		uint32_t id = traceWriter.GetId(ptr, created);
+		if (!created)
+			return id;
+
+		if (renderTarget) {
+			traceWriter.Command(SIRE_TRACE_RENDER_TARGET);
+			traceWriter.Write(id);
+			traceWriter.Write(static_cast<uint32_t>(0));
+		}
+		else {
+			traceWriter.Command(SIRE_TRACE_TEXTURE);
+			traceWriter.Write(id);
+			traceWriter.Write(static_cast<int32_t>(0));
+			traceWriter.Write(static_cast<int32_t>(0));
+			traceWriter.Write(static_cast<uint32_t>(SIRE_PIXEL_FORMAT_UNKNOWN));
+			traceWriter.Write(static_cast<uint32_t>(1));
+		}
+
+		return id;
+	}
+
+	// Perf runs on headless renderers start every frame from the same back buffer.
+	static inline void ClearPerfBackBuffer() {
+#ifdef SIRE_SOFTWARE
+		if (GetCurrentRenderer() == SIRE_RENDERER_SOFTWARE)
+			GetRenderer()->ClearRenderTarget(nullptr, { 0.0f, 0.0f, 0.0f, 0.0f });
+#endif
+	}
+
+	static inline bool ReadPerfBackBuffer(std::vector<uint8_t>& out, int32_t& width, int32_t& height) {
+#ifdef SIRE_SOFTWARE
+		if (GetCurrentRenderer() == SIRE_RENDERER_SOFTWARE) {
+			SireSoftware* renderer = GetRenderers<SireSoftware>(GetCurrentRenderer());
+			renderer->Finish();
+
+			tSoftwareImage* backBuffer = renderer->backBuffer;
+			out = backBuffer->pixels;
+			width = backBuffer->w;
+			height = backBuffer->h;
+			return true;
+		}
+#endif
+		return false;
+	}
+
+	// Called wherever a batch or mesh reaches the backend, uploaded batches also send their vertices and indices.
+	static inline void CountDraw(uint32_t vertexCount, uint32_t indexCount, bool uploaded) {
+		frameStats.draws++;
+		frameStats.vertices += vertexCount;
+		if (uploaded)
+			frameStats.uploadBytes += static_cast<uint64_t>(vertexCount) * sizeof(tVertex) + static_cast<uint64_t>(indexCount) * sizeof(uint16_t);
+	}
+
+	// Every batch reaches the backend states through here.
+	static inline void ApplyRenderStates(tBackend* renderer, tRenderState const& states) {
+		SIRE_PROFILE_SCOPE("Sire::SetRenderStates");
+		renderer->SetRenderStates(states);
+	}
+
+	// Called around every batch that reaches the backend. The first one opens the frame's queries unless the GPU is
+	// still behind on all SIRE_TIMING_FRAMES slots, then the frame goes untimed instead of waiting.
+	static inline void BeginBatchTiming(tBackend* renderer, const char* tag) {
+		if (!gpuTiming || timingSkipped)
+			return;
+
+		if (timingSlot < 0) {
+			uint32_t slot = static_cast<uint32_t>(frameCount % SireRenderer::SIRE_TIMING_FRAMES);
+			tTimingFrame& frame = timingFrames[slot];
+			if (frame.pending)
+				ResolveTimingFrame(renderer, slot);
+
+			if (frame.pending || !renderer->BeginTiming(slot)) {
+				timingSkipped = true;
+				return;
+			}
+
+			frame.tags.clear();
+			frame.frame = frameCount;
+			timingSlot = static_cast<int32_t>(slot);
+		}
+
+		tTimingFrame& frame = timingFrames[timingSlot];
+		renderer->WriteTimestamp(timingSlot, static_cast<uint32_t>(frame.tags.size()) * 2);
+		frame.tags.push_back(tag);
+	}
+
+	static inline void EndBatchTiming(tBackend* renderer) {
+		if (timingSlot < 0)
+			return;
+
+		renderer->WriteTimestamp(timingSlot, static_cast<uint32_t>(timingFrames[timingSlot].tags.size()) * 2 - 1);
+	}
+
+	static inline float GetTimingMs(uint64_t begin, uint64_t end, uint64_t frequency) {
+		return end > begin ? static_cast<float>(static_cast<double>(end - begin) * 1000.0 / frequency) : 0.0f;
+	}
+
+	// Returns false while the GPU hasn't finished the frame. Disjoint frames are dropped.
+	static inline bool ResolveTimingFrame(tBackend* renderer, uint32_t slot) {
+		tTimingFrame& frame = timingFrames[slot];
+		uint32_t count = static_cast<uint32_t>(frame.tags.size()) * 2;
+		uint64_t frequency = 0;
+
+		timingTimestamps.resize(count);
+		if (!renderer->ReadTimestamps(slot, count, timingTimestamps.data(), frequency))
+			return false;
+
+		frame.pending = false;
+		if (!frequency || (gpuFrameTimingValid && gpuFrameTiming.frame > frame.frame))
+			return true;
+
+		tSireGpuFrameTiming& out = gpuFrameTiming;
+		out.frame = frame.frame;
+		out.gpuMs = GetTimingMs(timingTimestamps[0], timingTimestamps[count - 1], frequency);
+		out.tags.clear();
+
+		for (uint32_t i = 0; i < frame.tags.size(); i++) {
+			const char* tag = frame.tags[i];
+			auto it = std::find_if(out.tags.begin(), out.tags.end(), [&](tSireGpuTiming const& t) {
+				return t.tag == tag || (t.tag && tag && !strcmp(t.tag, tag));
+			});
+
+			if (it == out.tags.end())
+				it = out.tags.insert(out.tags.end(), { tag, 0, 0.0f });
+
+			it->batches++;
+			it->gpuMs += GetTimingMs(timingTimestamps[i * 2], timingTimestamps[i * 2 + 1], frequency);
+		}
+
+		gpuFrameTimingValid = true;
+		return true;
+	}
+
+	// Called by EndFrame, closes the frame's queries and picks up the frames the GPU has finished since.
+	static inline void EndTimingFrame() {
+		timingSkipped = false;
+		if (!IsRendererActive())
+			return;
+
+		tBackend* renderer = GetRenderer();
+		if (timingSlot >= 0) {
+			renderer->EndTiming(timingSlot);
+			timingFrames[timingSlot].pending = true;
+			timingSlot = -1;
+		}
+
+		for (uint32_t i = 1; i <= SireRenderer::SIRE_TIMING_FRAMES; i++) {
+			uint32_t slot = static_cast<uint32_t>((frameCount + i) % SireRenderer::SIRE_TIMING_FRAMES);
+			if (timingFrames[slot].pending && !ResolveTimingFrame(renderer, slot))
+				break;
+		}
+	}
+
+	static inline void ResetTiming() {
+		for (auto& it : timingFrames)
+			it = tTimingFrame();
+
+		timingSlot = -1;
+		timingSkipped = false;
+		gpuFrameTiming = {};
+		gpuFrameTimingValid = false;
+	}
+
+#ifdef SIRE_PROFILE
+	static inline uint64_t GetProfileTime() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Rings are created on the first event of a thread and kept for the lifetime of the process, so the events of
+	// threads that already exited still show up in the dump.
+	static inline tProfileRing* GetProfileRing() {
+		if (!profileRing) {
+			tProfileRing* ring = new tProfileRing();
+			ring->tid = ++profileThreads;
+			ring->next = profileRings.load(std::memory_order_relaxed);
+			while (!profileRings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {}
+			profileRing = ring;
+		}
+
+		return profileRing;
+	}
+
+	static inline void WriteProfileEvent(const char* name, uint64_t start, uint64_t end) {
+		tProfileRing* ring = GetProfileRing();
+		uint64_t head = ring->head.load(std::memory_order_relaxed);
+		ring->events[head & (tProfileRing::SIRE_PROFILE_RING_SIZE - 1)] = { name, start, end };
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+	// Copies the events of a ring oldest first. The owner may keep writing, the slots it could have reused during the
+	// copy are dropped afterwards.
+	static inline void ReadProfileEvents(tProfileRing* ring, std::vector<tProfileEvent>& out) {
+		const uint64_t size = tProfileRing::SIRE_PROFILE_RING_SIZE;
+
+		out.clear();
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t first = head > size ? head - size : 0;
+		for (uint64_t i = first; i < head; i++)
+			out.push_back(ring->events[i & (size - 1)]);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = ring->head.load(std::memory_order_relaxed);
+		if (after >= first + size) {
+			uint64_t lost = (std::min)(after - (first + size) + 1, head - first);
+			out.erase(out.begin(), out.begin() + lost);
+		}
+
+		uint64_t clearTime = profileClearTime.load(std::memory_order_relaxed);
+		out.erase(std::remove_if(out.begin(), out.end(), [&](tProfileEvent const& e) { return e.start < clearTime; }), out.end());
+	}
+
+	static inline void WriteJsonString(std::string& out, const char* str) {
+		out += '"';
+		for (; *str; str++) {
+			char c = *str;
+			if (c == '"' || c == '\\') {
+				out += '\\';
+				out += c;
+			}
+			else if (static_cast<uint8_t>(c) < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				out += buf;
+			}
+			else
+				out += c;
+		}
+		out += '"';
+	}
+
+	// Complete events, ts and dur are in microseconds.
+	static inline void WriteChromeProfile(std::string& out) {
+		std::vector<tProfileEvent> events;
+		char buf[128];
+		bool first = true;
+
+		out += "{\"traceEvents\":[";
+		for (tProfileRing* ring = profileRings.load(std::memory_order_acquire); ring; ring = ring->next) {
+			if (const char* name = ring->name.load(std::memory_order_relaxed)) {
+				snprintf(buf, sizeof(buf), "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",", ring->tid);
+				out += buf;
+				WriteJsonString(out, name);
+				out += "}}";
+				first = false;
+			}
+
+			ReadProfileEvents(ring, events);
+			for (auto& it : events) {
+				snprintf(buf, sizeof(buf), "%s\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", first ? "" : ",", ring->tid, it.start / 1000.0, (it.end - it.start) / 1000.0);
+				out += buf;
+				WriteJsonString(out, it.name ? it.name : "");
+				out += '}';
+				first = false;
+			}
+		}
+		out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+	}
+
+	static inline void WriteProtoVarint(std::string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out += static_cast<char>(value | 0x80);
+			value >>= 7;
+		}
+		out += static_cast<char>(value);
+	}
+
+	static inline void WriteProtoField(std::string& out, uint32_t field, uint64_t value) {
+		WriteProtoVarint(out, static_cast<uint64_t>(field) << 3);
+		WriteProtoVarint(out, value);
+	}
+
+	static inline void WriteProtoField(std::string& out, uint32_t field, std::string const& bytes) {
+		WriteProtoVarint(out, (static_cast<uint64_t>(field) << 3) | 2);
+		WriteProtoVarint(out, bytes.size());
+		out += bytes;
+	}
+
+	// TracePacket with a TrackEvent, slices of a track have to be nested so they are written as begin/end pairs.
+	static inline void WritePerfettoSlice(std::string& out, uint64_t timestamp, uint64_t track, const char* name) {
+		std::string event;
+		WriteProtoField(event, 9, name ? 1 : 2); // type, SLICE_BEGIN or SLICE_END
+		WriteProtoField(event, 11, track); // track_uuid
+		if (name)
+			WriteProtoField(event, 23, std::string(name)); // name
+
+		std::string packet;
+		WriteProtoField(packet, 8, timestamp); // timestamp
+		WriteProtoField(packet, 10, 1); // trusted_packet_sequence_id
+		WriteProtoField(packet, 11, event); // track_event
+		WriteProtoField(out, 1, packet); // Trace.packet
+	}
+
+	static inline void WritePerfettoProfile(std::string& out) {
+		const uint64_t trackBase = 0x5349524500000000ull; // "SIRE"
+
+		std::vector<tProfileEvent> events;
+		std::vector<uint64_t> open;
+		bool first = true;
+
+		for (tProfileRing* ring = profileRings.load(std::memory_order_acquire); ring; ring = ring->next) {
+			uint64_t track = trackBase | ring->tid;
+
+			std::string thread;
+			WriteProtoField(thread, 1, 1); // pid
+			WriteProtoField(thread, 2, ring->tid); // tid
+			if (const char* name = ring->name.load(std::memory_order_relaxed))
+				WriteProtoField(thread, 5, std::string(name)); // thread_name
+
+			std::string descriptor;
+			WriteProtoField(descriptor, 1, track); // uuid
+			WriteProtoField(descriptor, 4, thread); // thread
+
+			std::string packet;
+			WriteProtoField(packet, 10, 1); // trusted_packet_sequence_id
+			if (first)
+				WriteProtoField(packet, 13, 1); // sequence_flags, SEQ_INCREMENTAL_STATE_CLEARED
+			WriteProtoField(packet, 60, descriptor); // track_descriptor
+			WriteProtoField(out, 1, packet);
+			first = false;
+
+			// Outer scopes first when they start together.
+			ReadProfileEvents(ring, events);
+			std::sort(events.begin(), events.end(), [](tProfileEvent const& a, tProfileEvent const& b) {
+				return a.start != b.start ? a.start < b.start : a.end > b.end;
+			});
+
+			open.clear();
+			for (auto& it : events) {
+				while (!open.empty() && open.back() <= it.start) {
+					WritePerfettoSlice(out, open.back(), track, nullptr);
+					open.pop_back();
+				}
+
+				WritePerfettoSlice(out, it.start, track, it.name ? it.name : "");
+				open.push_back((std::max)(it.end, it.start));
+			}
+
+			while (!open.empty()) {
+				WritePerfettoSlice(out, open.back(), track, nullptr);
+				open.pop_back();
+			}
+		}
+	}
+#endif
+
+	// Called by End before the batch topology is expanded, replaying runs the same End.
+	static inline void TraceDraw() {
+		tTraceWriter& t = traceWriter;
+
+		uint32_t bound[3] = { TraceId(currentTexture, false), TraceId(currentMask, false), TraceId(currentRenderTargetView, true) };
+
+		if (!t.written || memcmp(&t.states, &shared.renderStates, sizeof(tRenderState))) {
+			t.states = shared.renderStates;
+			t.Command(SIRE_TRACE_STATES);
+			t.Write(t.states);
+		}
+
+		if (!t.written || memcmp(&t.constants, &cb, sizeof(tConstBuff))) {
+			t.constants = cb;
+			t.Command(SIRE_TRACE_CONSTANTS);
+			t.Write(t.constants);
+		}
+
+		if (!t.written || memcmp(&t.viewport, &shared.viewport, sizeof(tSireViewport))) {
+			t.viewport = shared.viewport;
+			t.Command(SIRE_TRACE_VIEWPORT);
+			t.Write(t.viewport);
+		}
+
+		if (!t.written || memcmp(t.bound, bound, sizeof(bound))) {
+			memcpy(t.bound, bound, sizeof(bound));
+			t.Command(SIRE_TRACE_BIND);
+			t.Write(t.bound);
+		}
+
+		t.written = true;
+
+		t.Command(SIRE_TRACE_DRAW);
+		t.Write(static_cast<uint8_t>(primitiveType));
+		t.Write(static_cast<uint32_t>(numIndices));
+		t.Write(static_cast<uint32_t>(vertices.size()));
+		t.Write(static_cast<uint32_t>(indices.size()));
+		t.Write(vertices.data(), vertices.size() * sizeof(tVertex));
+		t.Write(indices.data(), indices.size() * sizeof(uint16_t));
+	}
+
+public:
+	static inline eSireRenderer const GetCurrentRenderer() {
+		return currentRenderer;
+	}
+
+	template <typename T = SireRenderer>
+	static inline T* const GetRenderers(eSireRenderer re) {
+		return reinterpret_cast<T*>(renderers.at(re));
+	}
+
+	// Only valid while a renderer is initialised.
+	static inline tBackend* const GetRenderer() {
+#ifdef SIRE_STATIC_DISPATCH
+		return static_cast<tBackend*>(renderers[SIRE_STATIC_RENDERER]);
+#else
+		return renderers.at(currentRenderer);
+#endif
+	}
+
+	static inline bool IsRendererActive(eSireRenderer renderer) {
+		return renderer != SIRE_RENDERER_NULL && GetRenderers(renderer)->IsRendererActive();
+	}
+
+	static inline bool IsRendererActive() {
+		return GetCurrentRenderer() != SIRE_RENDERER_NULL && GetRenderer()->IsRendererActive();
+	}
+
+	// Marks the frame boundary, temporaries from the previous frame are released.
+	static inline void BeginFrame() {
+		frameArenaAutoReset = false;
+		frameArena.Reset();
+	}
+
+	static inline void EndFrame() {
+		SIRE_PROFILE_SCOPE("Sire::EndFrame");
+
+		ProcessTextureUploads();
+		DrainPackets();
+		FlushSortedDraws();
+		EnforceTextureBudget();
+		EndTimingFrame();
+		if (IsRendererActive())
+			GetRenderer()->EndFrame();
+
+		frameCount++;
+
+		lastFrameStats = frameStats;
+		frameStats = {};
+
+		if (traceWriter.file)
+			traceWriter.Command(SIRE_TRACE_FRAME);
+	}
+
+	// The only call that is safe from any thread, the packet is drawn by the next DrainPackets on the render thread.
+	// EndFrame drains the queue, packets stay queued until then if the host never calls it or DrainPackets.
+	static inline void SubmitPacket(tSireDrawPacket packet) {
+		tPacketNode* node = new tPacketNode{ std::move(packet), nullptr };
+		node->next = packetQueue.load(std::memory_order_relaxed);
+		while (!packetQueue.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+
+	// Render thread only, called by EndFrame. Packets from one thread are drawn in the order they were submitted.
+	static inline void DrainPackets() {
+		SIRE_PROFILE_SCOPE("Sire::DrainPackets");
+
+		if (currentLayer)
+			return;
+
+		tPacketNode* node = packetQueue.exchange(nullptr, std::memory_order_acquire);
+
+		// The stack is newest first.
+		tPacketNode* ordered = nullptr;
+		while (node) {
+			tPacketNode* next = node->next;
+			node->next = ordered;
+			ordered = node;
+			node = next;
+		}
+
+		bool active = IsRendererActive();
+		while (ordered) {
+			tPacketNode* next = ordered->next;
+			if (active)
+				DrawPacket(ordered->packet);
+
+			delete ordered;
+			ordered = next;
+		}
+	}
+
+	// Runs fn(i, out) for every item on the worker threads, out points at the item's verticesPerItem vertices.
+	// The range is generated in the frame arena and submitted in as few batches as the 65536 vertex buffers allow.
+	// Strips repeat the vertices of the primitive crossing a batch boundary, fans repeat the centre and the last vertex.
+	template <typename F>
+	static inline void ParallelGenerate(uint32_t count, uint32_t verticesPerItem, F&& fn, eSirePrimitiveType type = SIRE_TRIANGLE) {
+		if (!IsRendererActive())
+			return;
+
+		uint64_t total = static_cast<uint64_t>(count) * verticesPerItem;
+		if (!total || total > 0xFFFFFFFF)
+			return;
+
+		// One reset for the whole range, the batches below must not drop the storage.
+		bool prevAutoReset = frameArenaAutoReset;
+		if (frameArenaAutoReset)
+			frameArena.Reset();
+		frameArenaAutoReset = false;
+
+		tVertex* out = nullptr;
+		if (total <= 65536) {
+			Begin(type);
+			vertices.resize(static_cast<uint32_t>(total));
+			if (vertices.size() == total)
+				out = vertices.data();
+		}
+		else {
+			out = frameArena.Allocate<tVertex>(static_cast<size_t>(total));
+		}
+
+		if (!out) {
+			frameArenaAutoReset = prevAutoReset;
+			return;
+		}
+
+		struct tContext {
+			F* fn;
+			tVertex* out;
+			uint32_t verticesPerItem;
+		} context = { &fn, out, verticesPerItem };
+
+		threadPool.ParallelFor(count, (std::max)(1024 / verticesPerItem, 1u), [](void* ptr, uint32_t begin, uint32_t end) {
+			tContext& c = *static_cast<tContext*>(ptr);
+			for (uint32_t i = begin; i < end; i++)
+				(*c.fn)(i, c.out + static_cast<size_t>(i) * c.verticesPerItem);
+		}, &context);
+
+		if (total <= 65536) {
+			End();
+		}
+		else {
+			// Strips and fans the backend expands to lists are cut so their 65536 list indices still fit.
+			uint32_t batch = 65536;
+			if (type >= SIRE_LINE_STRIP && !GetRenderer()->SupportsTopology(type, false))
+				batch = type == SIRE_LINE_STRIP ? 32768 : 21846;
+			else if (type <= SIRE_TRIANGLE)
+				batch -= 65536 % (type == SIRE_TRIANGLE ? 3 : (type == SIRE_LINE ? 2 : 1));
+
+			// Every fan batch is the centre followed by the rim from the last vertex of the previous batch on.
+			if (type == SIRE_TRIANGLE_FAN) {
+				for (uint64_t first = 1; first + 1 < total; first += batch - 2) {
+					Begin(type);
+					vertices.assign(out + first - 1, static_cast<uint32_t>((std::min)(static_cast<uint64_t>(batch - 1), total - first) + 1));
+					vertices.data()[0] = out[0];
+					End();
+				}
+
+				frameArenaAutoReset = prevAutoReset;
+				return;
+			}
+
+			// Strips step by an even count, so the first triangle of every batch keeps its winding.
+			uint32_t overlap = type == SIRE_TRIANGLE_STRIP ? 2 : (type == SIRE_LINE_STRIP ? 1 : 0);
+			for (uint64_t first = 0; first + overlap < total; first += batch - overlap) {
+				Begin(type);
+				vertices.assign(out + first, static_cast<uint32_t>((std::min)(static_cast<uint64_t>(batch), total - first)));
+				End();
+			}
+		}
+
+		frameArenaAutoReset = prevAutoReset;
+	}
+
+	// Moves every live particle and ages it by dt seconds, then drops the ones that ran out of life.
+	static inline void UpdateParticles(tSireParticles& particles, float dt) {
+		uint32_t count = particles.count;
+		float damping = (std::max)(1.0f - particles.drag * dt, 0.0f);
+		float gx = particles.gravity.x * dt;
+		float gy = particles.gravity.y * dt;
+		float gz = particles.gravity.z * dt;
+		float grow = particles.growth * dt;
+
+		float* px = particles.px.data();
+		float* py = particles.py.data();
+		float* pz = particles.pz.data();
+		float* vx = particles.vx.data();
+		float* vy = particles.vy.data();
+		float* vz = particles.vz.data();
+		float* life = particles.life.data();
+		float* size = particles.size.data();
+
+		uint32_t i = 0;
+#ifdef SIRE_SIMD
+		// Arrays are padded to a multiple of four, the extra lanes are dead and get overwritten on spawn.
+		tSimd4f vdt = SimdSet(dt);
+		tSimd4f vdamping = SimdSet(damping);
+		tSimd4f vgx = SimdSet(gx);
+		tSimd4f vgy = SimdSet(gy);
+		tSimd4f vgz = SimdSet(gz);
+		tSimd4f vgrow = SimdSet(grow);
+		tSimd4f zero = SimdSet(0.0f);
+		for (; i < count; i += 4) {
+			tSimd4f x = SimdMulAdd(SimdLoad(vx + i), vdamping, vgx);
+			tSimd4f y = SimdMulAdd(SimdLoad(vy + i), vdamping, vgy);
+			tSimd4f z = SimdMulAdd(SimdLoad(vz + i), vdamping, vgz);
+			SimdStore(vx + i, x);
+			SimdStore(vy + i, y);
+			SimdStore(vz + i, z);
+			SimdStore(px + i, SimdMulAdd(x, vdt, SimdLoad(px + i)));
+			SimdStore(py + i, SimdMulAdd(y, vdt, SimdLoad(py + i)));
+			SimdStore(pz + i, SimdMulAdd(z, vdt, SimdLoad(pz + i)));
+			SimdStore(life + i, SimdSub(SimdLoad(life + i), vdt));
+			SimdStore(size + i, SimdMax(SimdAdd(SimdLoad(size + i), vgrow), zero));
+		}
+#endif
+		for (; i < count; i++) {
+			vx[i] = vx[i] * damping + gx;
+			vy[i] = vy[i] * damping + gy;
+			vz[i] = vz[i] * damping + gz;
+			px[i] += vx[i] * dt;
+			py[i] += vy[i] * dt;
+			pz[i] += vz[i] * dt;
+			life[i] -= dt;
+			size[i] = (std::max)(size[i] + grow, 0.0f);
+		}
+
+		for (uint32_t j = 0; j < particles.count;) {
+			if (life[j] > 0.0f) {
+				j++;
+				continue;
+			}
+
+			uint32_t last = --particles.count;
+			for (auto it : { &particles.px, &particles.py, &particles.pz, &particles.vx, &particles.vy, &particles.vz, &particles.r, &particles.g, &particles.b, &particles.a, &particles.life, &particles.invLifetime, &particles.size })
+				(*it)[j] = (*it)[last];
+		}
+	}
+
+	// Spawns a burst of count particles.
+	static inline void SpawnParticles(tSireParticles& particles, tSireParticleEmitter& emitter, uint32_t count) {
+		if (!count)
+			return;
+
+		if (particles.count + count > particles.px.size())
+			particles.Reserve((std::max)(particles.count + count, static_cast<uint32_t>(particles.px.size()) * 2));
+
+		// xorshift32, [-1, 1]
+		auto random = [&emitter]() {
+			uint32_t x = emitter.seed;
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			emitter.seed = x;
+			return static_cast<float>(x) * (2.0f / 4294967295.0f) - 1.0f;
+		};
+
+		for (uint32_t n = 0; n < count; n++) {
+			uint32_t i = particles.count++;
+			particles.px[i] = emitter.position.x + emitter.positionVariance.x * random();
+			particles.py[i] = emitter.position.y + emitter.positionVariance.y * random();
+			particles.pz[i] = emitter.position.z + emitter.positionVariance.z * random();
+			particles.vx[i] = emitter.velocity.x + emitter.velocityVariance.x * random();
+			particles.vy[i] = emitter.velocity.y + emitter.velocityVariance.y * random();
+			particles.vz[i] = emitter.velocity.z + emitter.velocityVariance.z * random();
+			particles.r[i] = emitter.color.x + emitter.colorVariance.x * random();
+			particles.g[i] = emitter.color.y + emitter.colorVariance.y * random();
+			particles.b[i] = emitter.color.z + emitter.colorVariance.z * random();
+			particles.a[i] = emitter.color.w + emitter.colorVariance.w * random();
+
+			float lifetime = (std::max)(emitter.lifetime + emitter.lifetimeVariance * random(), 1e-3f);
+			particles.life[i] = lifetime;
+			particles.invLifetime[i] = 1.0f / lifetime;
+			particles.size[i] = (std::max)(emitter.size + emitter.sizeVariance * random(), 0.0f);
+		}
+	}
+
+	static inline void EmitParticles(tSireParticles& particles, tSireParticleEmitter& emitter, float dt) {
+		emitter.accumulator += emitter.rate * dt;
+
+		uint32_t count = static_cast<uint32_t>(emitter.accumulator);
+		emitter.accumulator -= static_cast<float>(count);
+		SpawnParticles(particles, emitter, count);
+	}
+
+	// Expands every particle into a size x size quad facing right and up, uv0 spans the whole texture.
+	// The defaults face the screen under the orthographic projection. Drawn in batches of 10922 particles.
+	static inline void DrawParticles(tSireParticles const& particles, tSireFloat3 const& right = { 1.0f, 0.0f, 0.0f }, tSireFloat3 const& up = { 0.0f, 1.0f, 0.0f }) {
+		if (!IsRendererActive())
+			return;
+
+		const uint32_t perBatch = 65536 / 6;
+		for (uint32_t first = 0; first < particles.count; first += perBatch) {
+			uint32_t count = (std::min)(perBatch, particles.count - first);
+
+			Begin(SIRE_TRIANGLE);
+			vertices.resize(count * 4);
+			indices.resize(count * 6);
+			if (vertices.size() != count * 4 || indices.size() != count * 6)
+				return;
+
+			tVertex* v = vertices.data();
+			uint16_t* idx = indices.data();
+			for (uint32_t n = 0; n < count; n++, v += 4, idx += 6) {
+				uint32_t i = first + n;
+				float h = particles.size[i] * 0.5f;
+				float rx = right.x * h, ry = right.y * h, rz = right.z * h;
+				float ux = up.x * h, uy = up.y * h, uz = up.z * h;
+				float x = particles.px[i], y = particles.py[i], z = particles.pz[i];
+				float alpha = particles.a[i] * (particles.fadeOut ? particles.life[i] * particles.invLifetime[i] : 1.0f);
+				tSireFloat4 col = { particles.r[i], particles.g[i], particles.b[i], alpha };
+
+				v[0] = { { x - rx - ux, y - ry - uy, z - rz - uz }, col, { 0.0f, 0.0f }, { 0.0f, 0.0f } };
+				v[1] = { { x + rx - ux, y + ry - uy, z + rz - uz }, col, { 1.0f, 0.0f }, { 1.0f, 0.0f } };
+				v[2] = { { x + rx + ux, y + ry + uy, z + rz + uz }, col, { 1.0f, 1.0f }, { 1.0f, 1.0f } };
+				v[3] = { { x - rx + ux, y - ry + uy, z - rz + uz }, col, { 0.0f, 1.0f }, { 0.0f, 1.0f } };
+
+				uint16_t base = static_cast<uint16_t>(n * 4);
+				idx[0] = base;
+				idx[1] = base + 1;
+				idx[2] = base + 2;
+				idx[3] = base;
+				idx[4] = base + 2;
+				idx[5] = base + 3;
+			}
+
+			End();
+		}
+	}
+
+	static inline tSireFrameArena& GetFrameArena() {
+		return frameArena;
+	}
+
+	static inline tSireFrameArenaStats GetFrameArenaStats() {
+		return frameArena.GetStats();
+	}
+
+	// Pass nullptr to restore the default heap allocator.
+	static inline void SetFrameArenaAllocator(tSireAllocator* allocator) {
+		frameArena.SetUpstream(allocator);
+	}
+
+	static inline void Begin(eSirePrimitiveType type) {
+		SIRE_PROFILE_SCOPE("Sire::Begin");
+
+		if (!IsRendererActive())
+			return;
+
+		// Without BeginFrame every draw is its own frame.
+		if (frameArenaAutoReset)
+			frameArena.Reset();
+
+		primitiveType = type;
+		vertices.clear();
+		indices.clear();
+		numIndices = 0;
+		autoIndex = false;
+
+		color = { 1.0f, 1.0f, 1.0f, 1.0f };
+		uv0 = { 0.0f, 0.0f };
+		uv1 = { 0.0f, 0.0f };
+
+		// Recorded batches capture the backend state when they are replayed.
+		if (currentLayer || sortedSubmission)
+			return;
+
+		return GetRenderer()->Begin();
+	}
+
+	static inline void End() {
+		SIRE_PROFILE_SCOPE("Sire::End");
+
+		if (!IsRendererActive())
+			return;
+
+		// Batches without indices are drawn straight from the vertex buffer.
+		if (numIndices == 0)
+			numIndices = indices.size();
+
+		if (traceWriter.file)
+			TraceDraw();
+
+		if (!currentLayer)
+			TouchRenderTarget();
+
+		// Recorded batches are already in a topology the backend can replay.
+		tSireArenaVector<uint16_t> expanded;
+		if (!ExpandBatchTopology(expanded))
+			return SubmitBatch();
+
+		// The dynamic index buffers hold 65536 indices, longer lists are split into several draws. 65532 is a multiple of
+		// both 2 and 3 so every draw ends on a whole line or triangle.
+		uint32_t total = expanded.size();
+		uint32_t first = 0;
+		do {
+			numIndices = (std::min)(total - first, 65532u);
+			indices.assign(expanded.data() + first, numIndices);
+			SubmitBatch();
+			first += numIndices;
+		} while (first < total);
+	}
+
+	static inline void SubmitBatch() {
+		if (currentLayer || sortedSubmission)
+			return RecordDraw(nullptr, nullptr, vertices.size(), numIndices);
+
+		tBackend* renderer = GetRenderer();
+		CountDraw(vertices.size(), numIndices, true);
+		ApplyRenderStates(renderer, shared.renderStates);
+		BeginBatchTiming(renderer, timingTag);
+		renderer->End();
+		EndBatchTiming(renderer);
+	}
+
+	static inline void SetColor4f(float r, float g, float b, float a) {
+		if (!IsRendererActive())
+			return;
+
+		color = { r, g, b, a };
+	}
+
+	static inline void SetColor3f(float r, float g, float b) {
+		if (!IsRendererActive())
+			return;
+
+		SetColor4f(r, g, b, 1.0f);
+	}
+
+	static inline void SetTexCoords4f(float x1, float y1, float x2, float y2) {
+		if (!IsRendererActive())
+			return;
+
+		uv0 = { x1, y1 };
+		uv1 = { x2, y2 };
+	}
+
+	static inline void SetTexCoords2f(float x, float y) {
+		if (!IsRendererActive())
+			return;
+
+		SetTexCoords4f(x, y, x, y);
+	}
+
+	static inline void SetVertex3f(float x, float y, float z) {
+		if (!IsRendererActive())
+			return;
+
+		tVertex v = {};
+		v.pos.x = x;
+		v.pos.y = y;
+		v.pos.z = z;
+		v.col = color;
+		v.uv0 = uv0;
+		v.uv1 = uv1;
+
+		// Once a restart was set every vertex needs its own index.
+		if (autoIndex)
+			indices.push_back(static_cast<uint16_t>(vertices.size()));
+
+		vertices.push_back(v);
+
+		return GetRenderer()->SetVertices(v);
+	}
+
+	static inline void SetVertex2f(float x, float y) {
+		if (!IsRendererActive())
+			return;
+
+		SetVertex3f(x, y, 0.0f);
+	}
+
+	static inline void SetIndex1i(uint16_t i) {
+		if (!IsRendererActive())
+			return;
+
+		indices.push_back(i);
+	}
+
+	// Starts a new strip or fan inside the current batch. Unindexed batches switch to generated indices from here on.
+	static inline void RestartPrimitive() {
+		if (!IsRendererActive())
+			return;
+
+		if (primitiveType <= SIRE_TRIANGLE)
+			return;
+
+		if (!autoIndex && indices.empty()) {
+			for (uint32_t i = 0; i < vertices.size(); i++)
+				indices.push_back(static_cast<uint16_t>(i));
+
+			autoIndex = true;
+		}
+
+		indices.push_back(SIRE_PRIMITIVE_RESTART_INDEX);
+	}
+
+	static inline void SetIndices(std::vector<uint16_t> const& i, int32_t n) {
+		if (!IsRendererActive())
+			return;
+
+		indices.assign(i.data(), static_cast<uint32_t>(i.size()));
+		numIndices = n;
+	}
+
+	static inline void SetRenderState(eSireRenderState state, uint32_t value) {
+		if (!IsRendererActive())
+			return;
+
+		switch (state) {
+			case SIRE_BLEND_ALPHATESTENABLE:
+				shared.renderStates.blendEnable = value;
+				break;
+			case SIRE_BLEND_SRCBLEND:
+				shared.renderStates.srcBlend = value;
+				break;
+			case SIRE_BLEND_DESTBLEND:
+				shared.renderStates.destBlendAlpha = value;
+				break;
+			case SIRE_BLEND_BLENDOP:
+				shared.renderStates.blendop = value;
+				break;
+			case SIRE_BLEND_SRCBLENDALPHA:
+				shared.renderStates.srcBlendAlpha = value;
+				break;
+			case SIRE_BLEND_DESTBLENDALPHA:
+				shared.renderStates.destBlendAlpha = value;
+				break;
+			case SIRE_BLEND_BLENDOPALPHA:
+				shared.renderStates.blendOpAlpha = value;
+				break;
+			case SIRE_BLEND_WRITEMASK:
+				shared.renderStates.renderTargetWriteMask = value;
+				break;
+			case SIRE_BLEND_CULLMODE:
+				shared.renderStates.cullMode = value;
+				break;
+			case SIRE_BLEND_FILLMODE:
+				shared.renderStates.fillMode = value;
+				break;
+			case SIRE_BLEND_STENCILENABLE:
+				shared.renderStates.stencilEnable = value;
+				break;
+			case SIRE_BLEND_COLORWRITEENABLE:
+				shared.renderStates.sampleMask = value;
+				break;
+		}
+	}
+
+	static inline void SetPixelShader(uintptr_t* ps) {
+		if (!IsRendererActive())
+			return;
+
+		currentPixelShader = ps;
+		GetRenderer()->SetPixelShader(ps);
+	}
+
+	static inline void SetVertexShader(uintptr_t* vs) {
+		if (!IsRendererActive())
+			return;
+
+		currentVertexShader = vs;
+		GetRenderer()->SetVertexShader(vs);
+	}
+
+	static inline void SetTextureStage(uint32_t stage, SirePtr<tSireTexture2D> texture) {
+
+	}
+
+	static inline void SetShaderConstantFloat() {
+
+	}
+
+	static inline void SetShaderConstantInt() {
+
+	}
+
+	template <typename T>
+	static inline void Init(eSireRenderer re, T* ptr) {
+		if (currentRenderer != SIRE_RENDERER_NULL)
+			return;
+
+		if (!renderersInitialised) {
+			if (!renderers.at(re)) {
+				SireRenderer* renderer = nullptr;
+
+				switch (re) {
+					case SIRE_RENDERER_NULL:
+						break;
+#ifdef SIRE_DX9
+					case SIRE_RENDERER_DX9:
+						renderer = new SireDirectX9();
+						break;
+#endif
+#ifdef SIRE_DX10
+					case SIRE_RENDERER_DX10:
+						renderer = new SireDirectX10();
+						break;
+#endif
+#ifdef SIRE_DX11
+					case SIRE_RENDERER_DX11:
+						renderer = new SireDirectX11();
+						break;
+#endif
+#ifdef SIRE_DX12
+					case SIRE_RENDERER_DX12:
+						renderer = new SireDirectX12();
+						break;
+#endif
+#ifdef SIRE_OPENGL
+					case SIRE_RENDERER_OPENGL:
+						renderer = new SireOpenGL();
+						break;
+#endif
+#ifdef SIRE_VULKAN
+					case SIRE_RENDERER_VULKAN:
+						renderer = new SireVulkan();
+						break;
+#endif
+#ifdef SIRE_SOFTWARE
+					case SIRE_RENDERER_SOFTWARE:
+						renderer = new SireSoftware();
+						break;
+#endif
+				}
+
+				renderers.at(re) = renderer;
+			}
+			renderersInitialised = true;
+		}
+
+		currentRenderer = re;
+		currentRendererMainPtr = reinterpret_cast<uintptr_t*>(ptr);
+
+		GetRenderer()->Init(currentRendererMainPtr);
+
+		SetRenderState(SIRE_BLEND_ALPHATESTENABLE, true);
+		SetRenderState(SIRE_BLEND_SRCBLEND, SIRE_BLEND_SRC_ALPHA);
+		SetRenderState(SIRE_BLEND_DESTBLEND, SIRE_BLEND_INV_SRC_ALPHA);
+		SetRenderState(SIRE_BLEND_BLENDOP, SIRE_BLEND_OP_ADD);
+		SetRenderState(SIRE_BLEND_SRCBLENDALPHA, SIRE_BLEND_ONE);
+		SetRenderState(SIRE_BLEND_DESTBLENDALPHA, SIRE_BLEND_ZERO);
+		SetRenderState(SIRE_BLEND_BLENDOPALPHA, SIRE_BLEND_OP_ADD);
+		SetRenderState(SIRE_BLEND_WRITEMASK, SIRE_COLOR_WRITE_ENABLE_ALL);
+		SetRenderState(SIRE_BLEND_CULLMODE, SIRE_CULL_NONE);
+		SetRenderState(SIRE_BLEND_FILLMODE, SIRE_FILL_SOLID);
+		SetRenderState(SIRE_BLEND_STENCILENABLE, FALSE);
+		SetRenderState(SIRE_BLEND_COLORWRITEENABLE, 0xFFFFFFFF);
+
+		auto windowSize = GetWindowSize();
+		SetViewport(0.0f, 0.0f, static_cast<float>(windowSize.x), static_cast<float>(windowSize.y));
+	}
 
-		}
+	static inline void Shutdown() {
+		if (currentRenderer == SIRE_RENDERER_NULL)
+			return;
 
-		void SetVertexShader(uintptr_t* vs) override {
+		sortedSubmission = false;
+		FlushSortedDraws();
 
-		}
+		ReleaseLayers();
+		ReleaseText();
+		ReleasePaths();
+		ReleasePackets();
+		ReleaseTextureLoads();
+		traceWriter.Close();
+		ResetTiming();
+		threadPool.Stop();
 
-		// End virtual override
+		GetRenderer()->Shutdown();
 
-		ID3DBlob* CompileShader(std::string const str, const char* szEntrypoint, const char* szTarget) {
-			ID3DBlob* out = nullptr;
-			ID3DBlob* outerr = nullptr;
+		vertices.clear();
+		indices.clear();
+		frameArena.Release();
 
-			auto hr = D3DCompile(str.c_str(), str.length(), 0, nullptr, nullptr, szEntrypoint, szTarget, D3DCOMPILE_ENABLE_STRICTNESS, 0, &out, &outerr);
-			if (FAILED(hr)) {
-				if (outerr) {
-					char szError[256]{ 0 };
-					memcpy(szError, outerr->GetBufferPointer(), outerr->GetBufferSize());
-					MessageBoxA(nullptr, szError, "Error", MB_OK);
+		if (renderersInitialised) {
+			for (auto& it : renderers) {
+				if (it) {
+					delete it;
+					it = nullptr;
 				}
-				return outerr;
 			}
-			return out;
-		}
 
-		ID3D12ShaderReflection* CreateShaderReflection(const void* buffer, size_t size) {
-			ID3D12ShaderReflection* out = nullptr;
-			D3DReflect(buffer, size, IID_PPV_ARGS(&out));
-			return out;
+			renderersInitialised = false;
 		}
-	};
 
-#endif
-
-#ifdef SIRE_OPENGL
-	struct SireOpenGL : SireRenderer {
-		HDC con;
-		HGLRC conres;
-		uint32_t tex;
-		uint32_t mask;
-
-		uint32_t vbo;
-		uint32_t vao;
-
-		uint32_t ibo;
+		currentRenderer = SIRE_RENDERER_NULL;
+		currentRendererMainPtr = nullptr;
 
-		uint32_t vertexShader;
-		uint32_t pixelShader;
+#ifdef SIRE_DX11ON12
+		if (d3d11on12::isD3D11on12)
+			d3d11on12::ReleaseViewsBuffersAndContext();
+#endif
+	}
 
-		uint32_t shaderProgram;
+	template<typename T>
+	static inline void Release(T*& res) {
+		if (res) {
+			res->Release();
+			res = nullptr;
+		}
+	}
 
-		SireOpenGL() : SireRenderer() {
-			con = nullptr;
-			conres = nullptr;
-			tex = 0;
-			mask = 0;
-			vbo = 0;
-			vao = 0;
-			ibo = 0;
+	template<typename T>
+	static inline void Release(T**& res, int32_t count) {
+		if (res) {
+			for (int32_t i = 0; i < count; i++) {
+				if (res[i]) {
+					res[i]->Release();
+					res[i] = nullptr;
+				}
+			}
+		}
+	}
 
-			vertexShader = 0;
-			pixelShader = 0;
+	static constexpr uint64_t SIRE_HASH_SEED = 14695981039346656037ull;
 
-			shaderProgram = 0;
+	// FNV-1a, chain calls by passing the previous result as seed.
+	static inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = SIRE_HASH_SEED) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t out = seed;
+		for (size_t i = 0; i < size; i++) {
+			out ^= bytes[i];
+			out *= 1099511628211ull;
 		}
+		return out;
+	}
 
-		// Start virtual override
-		bool IsRendererActive() override {
-			const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
-			return con && conres && version;
+	// Compiled shaders are cached in this directory, missing parents are created too. Pass an empty string to disable it.
+	static inline void SetShaderCacheDirectory(std::string const& directory) {
+		shaderCache.directory = directory;
+
+		// CreateDirectoryA makes one level at a time, existing ones just fail.
+		for (size_t i = 1; i <= directory.size(); i++) {
+			if (i == directory.size() || directory[i] == '\\' || directory[i] == '/') {
+				if (directory[i - 1] != ':' && directory[i - 1] != '\\' && directory[i - 1] != '/')
+					CreateDirectoryA(directory.substr(0, i).c_str(), nullptr);
+			}
 		}
+	}
 
-		void Init(uintptr_t* ptr) override {
-			if (initialised)
-				return;
+	// Replaces the backend compiler, pass nullptr to restore it.
+	static inline void SetShaderCompiler(tSireShaderCompiler* compiler) {
+		shaderCompiler = compiler;
+	}
 
-			con = reinterpret_cast<HDC>(ptr);
-			conres = wglCreateContext(con);
+	static inline tSireShaderCompiler* GetShaderCompiler(tSireShaderCompiler* fallback) {
+		return shaderCompiler ? shaderCompiler : fallback;
+	}
 
-			if (!gladLoadGL()) {
-				std::cout << "Glad error" << std::endl;
-			}
+	static inline HWND GetHWND() {
+		return GetRenderer()->GetWindow();
+	}
 
-			glGenBuffers(1, &vbo);
-			glGenBuffers(1, &ibo);
-			glGenVertexArrays(1, &vao);
+	static inline tSireInt2 GetWindowSize() {
+#ifdef SIRE_SOFTWARE
+		// There's no window, the back buffer size is used instead.
+		if (GetCurrentRenderer() == SIRE_RENDERER_SOFTWARE) {
+			tSoftwareImage* backBuffer = GetRenderers<SireSoftware>(GetCurrentRenderer())->backBuffer;
+			return backBuffer ? tSireInt2{ backBuffer->w, backBuffer->h } : tSireInt2{ 0, 0 };
+		}
+#endif
 
-			glBindVertexArray(vao);
+		RECT windowRect;
+		GetClientRect((HWND)GetHWND(), &windowRect);
 
-			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(tVertex) * 65536, nullptr, GL_DYNAMIC_DRAW);
+		tSireInt2 out;
+		out.x = static_cast<int32_t>(windowRect.right - windowRect.left);
+		out.y = static_cast<int32_t>(windowRect.bottom - windowRect.top);
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * 65536, nullptr, GL_DYNAMIC_DRAW);
+		return out;
+	}
 
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// These 2 works for old devices but process it's too slow to be used each frame.
+	static inline void _GetClosestPowerOfTwoSize(uint32_t& width, uint32_t& height) {
+		height = static_cast<uint32_t>(std::pow(2, std::ceil(std::log2(height))));
+		width = height;
+	}
 
-			uint32_t shader = glCreateShader(GL_VERTEX_SHADER);
-			const char* shaderSource = glslShader3_3_0.c_str();
-			glShaderSource(shader, 1, &shaderSource, NULL);
-			glCompileShader(shader);
+	// Writes into the frame arena, the other overload returns an owning copy.
+	static inline void _ResizePixels(uint8_t* srcPixels, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, tSireArenaVector<uint8_t>& resizedPixels) {
+		float scaleX = static_cast<float>(dstWidth) / static_cast<float>(srcWidth);
+		float scaleY = static_cast<float>(dstHeight) / static_cast<float>(srcHeight);
 
-			shaderProgram = glCreateProgram();
-			glAttachShader(shaderProgram, shader);
-			glLinkProgram(shaderProgram);
-			glDeleteShader(shader);
+		resizedPixels.resize(dstWidth * dstHeight * 4);
+		memset(resizedPixels.data(), 0, resizedPixels.size());
 
-			glBindVertexArray(0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glUseProgram(0);
+		for (uint32_t y = 0; y < dstHeight; ++y) {
+			for (uint32_t x = 0; x < dstWidth; ++x) {
+				uint32_t srcX = static_cast<int>(x / scaleX);
+				uint32_t srcY = static_cast<int>(y / scaleY);
+				uint32_t srcIndex = (srcY * srcWidth + srcX) * 4;
+				uint32_t dstIndex = (y * dstWidth + x) * 4;
 
-			initialised = true;
+				if (srcX < srcWidth && srcY < srcHeight) {
+					resizedPixels[dstIndex] = srcPixels[srcIndex];
+					resizedPixels[dstIndex + 1] = srcPixels[srcIndex + 1];
+					resizedPixels[dstIndex + 2] = srcPixels[srcIndex + 2];
+					resizedPixels[dstIndex + 3] = srcPixels[srcIndex + 3];
+				}
+			}
 		}
+	}
 
-		void Shutdown() override {
-			if (!initialised)
-				return;
+	static inline std::vector<uint8_t> _ResizePixels(uint8_t* srcPixels, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight) {
+		tSireArenaVector<uint8_t> resizedPixels;
+		_ResizePixels(srcPixels, srcWidth, srcHeight, dstWidth, dstHeight, resizedPixels);
+		return std::vector<uint8_t>(resizedPixels.begin(), resizedPixels.end());
+	}
+	//
 
-			con = nullptr;
+	// Use only if device has non power of 2 support.
+	static inline SirePtr<tSireTexture2D> GetFakeBackBuffer(uint32_t buffer) {
+		HWND wnd = GetHWND();
+		auto windowSize = GetWindowSize();
 
-			if (conres) {
-				wglDeleteContext(conres);
-				conres = nullptr;
-			}
+		uint32_t fileSize = (windowSize.x * windowSize.y * 4);
+		tSireArenaVector<uint8_t> data;
+		data.resize(fileSize);
 
-			tex = 0;
-			mask = 0;
+		HDC dc = GetDC(GetHWND());
+		static HDC compdc = nullptr;
+		static HBITMAP bmp = nullptr;
+		static tSireInt2 size = { 0, 0 };
 
-			glDeleteProgram(shaderProgram);
+		if (size.x != windowSize.x || size.y != windowSize.y) {
+			if (bmp)
+				DeleteObject(bmp);
 
-			glDeleteVertexArrays(1, &vao);
-			glDeleteBuffers(1, &vbo);
-			glDeleteBuffers(1, &ibo);
+			if (compdc)
+				DeleteDC(compdc);
 
-			initialised = false;
+			compdc = CreateCompatibleDC(dc);
+			bmp = CreateCompatibleBitmap(dc, windowSize.x, windowSize.y);
+			size = windowSize;
 		}
 
-		void Begin() override {
+		HBITMAP bmpOld = static_cast<HBITMAP>(SelectObject(compdc, bmp));
 
-		}
+		BitBlt(compdc, 0, 0, windowSize.x, windowSize.y, dc, 0, 0, SRCCOPY);
+		GetBitmapBits(bmp, fileSize, data.data());
 
-		void End() override {
-			if (vertices.empty())
-				throw std::runtime_error("Error End() method has been called before settings vertices.");
+		// GDI bitmaps are BGRA.
+		auto out = CreateTexture(windowSize.x, windowSize.y, data.data(), SIRE_MIPMAPS_NONE, SIRE_PIXEL_FORMAT_BGRA8);
 
-			auto prevconres = wglGetCurrentContext();
-			wglMakeCurrent(con, conres);
+		SelectObject(compdc, bmpOld);
+		ReleaseDC(wnd, dc);
 
-			glBindVertexArray(vao);
+		return out;
+	}
 
-			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(tVertex), vertices.data());
+	static inline uint8_t* Lock(tSireTexture2D* surface) {
+		SIRE_PROFILE_SCOPE("Sire::Lock");
 
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, pos));
+		UseTexture(surface);
+		return GetRenderer()->Lock(surface->ptrs.surface);
+	}
 
-			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, col));
+	static inline void Unlock(tSireTexture2D* surface) {
+		SIRE_PROFILE_SCOPE("Sire::Unlock");
 
-			glEnableVertexAttribArray(2);
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, uv0));
+		GetRenderer()->Unlock(surface->ptrs.surface);
+	}
 
-			glEnableVertexAttribArray(3);
-			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(tVertex), (void*)offsetof(tVertex, uv1));
+	static inline SirePtr<tSireTexture2D> GetBackBuffer(int32_t buffer) {
+		if (!IsRendererActive())
+			return nullptr;
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(uint16_t), indices.data());
+#ifdef SIRE_DX11ON12
+		if (d3d11on12::isD3D11on12) {
+			d3d11on12::bufferIndex = d3d11on12::swapChain3->GetCurrentBackBufferIndex();
+			d3d11on12::d3d11On12Device->AcquireWrappedResources(d3d11on12::d3d11WrappedBackBuffers[d3d11on12::bufferIndex].GetAddressOf(), 1);
+			d3d11on12::d3d11Context->OMSetRenderTargets(1, d3d11on12::d3d11RenderTargetViews[d3d11on12::bufferIndex].GetAddressOf(), 0);
+		}
+#endif
 
-			glUseProgram(shaderProgram);
+		if (buffer == -1)
+			return GetFakeBackBuffer(0);
 
-			tConstBuff tempcb = cb;
-			tempcb.matrix.Transpose();
-			glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "proj"), 1, GL_FALSE, &tempcb.matrix.ToFloatArray()[0]);
-			glUniform1i(glGetUniformLocation(shaderProgram, "hasTex"), tempcb.hasTex);
-			glUniform1i(glGetUniformLocation(shaderProgram, "hasMask"), tempcb.hasMask);
-			glUniform1i(glGetUniformLocation(shaderProgram, "swapColors"), tempcb.swapColors);
+		SirePtr<tSireTexture2D> out(new tSireTexture2D);
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, tex);
-			glUniform1i(glGetUniformLocation(shaderProgram, "tex0"), 0);
+		switch (GetCurrentRenderer()) {
+#ifdef SIRE_DX9
+			case SIRE_RENDERER_DX9:
+			{
+				auto result = GetRenderers<SireDirectX9>(GetCurrentRenderer())->GetBackBufferSurface(buffer);
+				auto desc = GetRenderers<SireDirectX9>(GetCurrentRenderer())->GetDesc(result);
+				out->Set(desc.Width, desc.Height, SireDirectX9::GetPixelFormat(desc.Format), nullptr, reinterpret_cast<uintptr_t*>(result));
+			} break;
+#endif
+#ifdef SIRE_DX10
+			case SIRE_RENDERER_DX10:
+			{
+				auto tex = GetRenderers<SireDirectX10>(GetCurrentRenderer())->GetBackBuffer(buffer);
 
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, mask);
-			glUniform1i(glGetUniformLocation(shaderProgram, "mask0"), 1);
+				if (tex) {
+					auto result = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+					auto desc = GetRenderers<SireDirectX10>(GetCurrentRenderer())->GetDesc(tex);
 
-			glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_SHORT, 0);
+					if (tex) {
+						out->Set(desc.Width, desc.Height, GetPixelFormat(desc.Format), reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex));
+					}
+				}
+			} break;
+#endif
+#ifdef SIRE_DX11
+			case SIRE_RENDERER_DX11:
+			{
+				auto tex = GetRenderers<SireDirectX11>(GetCurrentRenderer())->GetBackBuffer(buffer);
 
-			glBindVertexArray(0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glUseProgram(0);
+				if (tex) {
+					auto result = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+					auto desc = GetRenderers<SireDirectX11>(GetCurrentRenderer())->GetDesc(tex);
 
-			wglMakeCurrent(con, prevconres);
+					if (tex) {
+						out->Set(desc.Width, desc.Height, GetPixelFormat(desc.Format), reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex));
+					}
+				}
+			} break;
+#endif
+#ifdef SIRE_DX12
+			case SIRE_RENDERER_DX12:
+			{
+			} break;
+#endif
+#ifdef SIRE_OPENGL
+			case SIRE_RENDERER_OPENGL:
+			{
+			} break;
+#endif
+#ifdef SIRE_SOFTWARE
+			case SIRE_RENDERER_SOFTWARE:
+			{
+				auto result = GetRenderers<SireSoftware>(GetCurrentRenderer())->GetBackBuffer();
+				result->AddRef();
+				out->Set(result->w, result->h, GetRenderer()->GetTextureFormat(), reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(result));
+			} break;
+#endif
 		}
 
-		void SetVertices(tVertex const& v) override {
+		return out;
+	}
 
-		}
+	// Format new textures are created in, per renderer. Defaults to the back buffer format.
+	static inline void SetTextureFormat(eSireRenderer renderer, eSirePixelFormat format) {
+		if (!IsRendererActive(renderer))
+			return;
 
-		void SetRenderStates(tRenderState const& s) override {
-			if (s.blendEnable)
-				glEnable(GL_BLEND);
-			else
-				glDisable(GL_BLEND);
+		if (GetPixelSize(format) != 4)
+			return;
 
-			glBlendFunc(GL_SRC_ALPHA, SireToOpenGLBlendState(s.srcBlend));
-			glBlendFunc(GL_DST_ALPHA, SireToOpenGLBlendState(s.dstBlend));
+		GetRenderers(renderer)->SetTextureFormat(format);
+	}
 
-			glEnable(GL_CULL_FACE);
-			glCullFace(SireToOpenGLCullMode(s.cullMode));
+#ifdef SIRE_DX11ON12
+	static inline void SetCommandQueue(ID3D12CommandQueue* pCommandQueue) {
+		d3d11on12::SetCommandQueue(pCommandQueue);
+	}
+#endif
 
-			glEnable(GL_DEPTH_TEST);
-			glDisable(GL_STENCIL_TEST);
-			glEnable(GL_SCISSOR_TEST);
+	static inline eSirePixelFormat GetTextureFormat(eSireRenderer renderer) {
+		if (!IsRendererActive(renderer))
+			return SIRE_PIXEL_FORMAT_UNKNOWN;
 
-			glPolygonMode(GL_FRONT_AND_BACK, SireFillMode(s.fillMode));
-		}
+		return GetRenderers(renderer)->GetTextureFormat();
+	}
 
-		void SetViewport(tSireViewport const& v) override {
-			glViewport(static_cast<int32_t>(v.x), static_cast<int32_t>(v.y), static_cast<int32_t>(v.w), static_cast<int32_t>(v.h));
-		}
+	static inline SirePtr<tSireRenderTarget> CreateRenderTargetView(SirePtr<tSireTexture2D> const& texture) {
+		SIRE_PROFILE_SCOPE("Sire::CreateRenderTargetView");
 
-		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+		if (!IsRendererActive())
+			return nullptr;
 
-		}
+		UseTexture(texture.Get());
 
-		void SetTexture(uintptr_t* texture, uintptr_t* textureMask) override {
-			tex = texture ? reinterpret_cast<tTexture2D*>(texture)->id : 0;
-			mask = textureMask ? reinterpret_cast<tTexture2D*>(textureMask)->id : 0;
-		}
+		SirePtr<tSireRenderTarget> out(new tSireRenderTarget);
+		switch (GetCurrentRenderer()) {
+#ifdef SIRE_DX9
+			case SIRE_RENDERER_DX9:
+				out->Set((uintptr_t*)GetRenderers<SireDirectX9>(GetCurrentRenderer())->GetSurfaceLevel((IDirect3DTexture9*)texture->ptrs.texture, 0));
+				break;
+#endif
+#ifdef SIRE_DX10
+			case SIRE_RENDERER_DX10:
+			{
+				auto renderer = GetRenderers<SireDirectX10>(GetCurrentRenderer());
+				if (ID3D10Texture2D* copy = renderer->CreateRenderTargetCopy((ID3D10Texture2D*)texture->ptrs.surface)) {
+					ID3D10ShaderResourceView* view = renderer->CreateShaderResourceView(copy);
+					if (!view) {
+						Release(copy);
+						return nullptr;
+					}
 
-		// End virtual override
+					SwapTextureViews(texture.Get(), (uintptr_t*)view, (uintptr_t*)copy);
+				}
 
-		uint32_t SireFillMode(int8_t mode) {
-			switch (mode) {
-				case SIRE_FILL_WIREFRAME:
-					return GL_LINE;
-				case SIRE_FILL_SOLID:
-					return GL_FILL;
-			}
+				out->Set((uintptr_t*)renderer->CreateRenderTarget((ID3D10Texture2D*)texture->ptrs.surface));
+			} break;
+#endif
+#ifdef SIRE_DX11
+			case SIRE_RENDERER_DX11:
+			{
+				auto renderer = GetRenderers<SireDirectX11>(GetCurrentRenderer());
+				if (ID3D11Texture2D* copy = renderer->CreateRenderTargetCopy((ID3D11Texture2D*)texture->ptrs.surface)) {
+					ID3D11ShaderResourceView* view = renderer->CreateShaderResourceView(copy);
+					if (!view) {
+						Release(copy);
+						return nullptr;
+					}
 
-			return 0;
+					SwapTextureViews(texture.Get(), (uintptr_t*)view, (uintptr_t*)copy);
+				}
+
+				out->Set((uintptr_t*)renderer->CreateRenderTarget((ID3D11Texture2D*)texture->ptrs.surface));
+			} break;
+#endif
+#ifdef SIRE_SOFTWARE
+			case SIRE_RENDERER_SOFTWARE:
+				reinterpret_cast<tSoftwareImage*>(texture->ptrs.surface)->AddRef();
+				out->Set(texture->ptrs.surface);
+				break;
+#endif
 		}
 
-		uint32_t SireToOpenGLCullMode(int8_t mode) {
-			switch (mode) {
-				case SIRE_CULL_NONE:
-					glDisable(GL_CULL_FACE);
-					return 0;
-				case SIRE_CULL_FRONT:
-					return GL_FRONT;
-				case SIRE_CULL_BACK:
-					return GL_BACK;
-			}
+		out->textureId = texture->id;
+		TraceTextureBind(texture.Get());
+		TraceRenderTarget(out->renderTargetView, texture->ptrs.texture);
+		return out;
+	}
 
-			return 0;
-		}
+	// Converts count pixels to a 4 byte format, swapping red and blue, adding alpha to RGB8 and premultiplying as needed.
+	// 4 byte formats can be converted in place.
+	// parallel false keeps the work on the calling thread.
+	static inline bool ConvertPixels(uint8_t const* src, eSirePixelFormat srcFormat, uint8_t* dst, eSirePixelFormat dstFormat, uint32_t count, bool premultiply = false, bool parallel = true) {
+		if (!src || !dst || GetPixelSize(srcFormat) == 0 || GetPixelSize(dstFormat) != 4)
+			return false;
 
-		uint32_t SireToOpenGLBlendState(int8_t blend) {
-			switch (blend) {
-				case SIRE_BLEND_ZERO:
-					return GL_ZERO;
-				case SIRE_BLEND_ONE:
-					return GL_ONE;
-				case SIRE_BLEND_SRC_COLOR:
-					return GL_SRC_COLOR;
-				case SIRE_BLEND_INV_SRC_COLOR:
-					return GL_ONE_MINUS_SRC_COLOR;
-				case SIRE_BLEND_SRC_ALPHA:
-					return GL_SRC_ALPHA;
-				case SIRE_BLEND_INV_SRC_ALPHA:
-					return GL_ONE_MINUS_SRC_ALPHA;
-				case SIRE_BLEND_DEST_ALPHA:
-					return GL_DST_ALPHA;
-				case SIRE_BLEND_INV_DEST_ALPHA:
-					return GL_ONE_MINUS_DST_ALPHA;
-				case SIRE_BLEND_DEST_COLOR:
-					return GL_DST_COLOR;
-				case SIRE_BLEND_INV_DEST_COLOR:
-					return GL_ONE_MINUS_DST_COLOR;
-				case SIRE_BLEND_SRC_ALPHA_SAT:
-					return GL_SRC_ALPHA_SATURATE;
-			}
+		tConvertContext context = { src, dst, count, srcFormat == SIRE_PIXEL_FORMAT_RGB8, IsBgraFormat(srcFormat) != IsBgraFormat(dstFormat), premultiply };
+		if (parallel)
+			threadPool.ParallelFor(count, 16384, ConvertPixelRange, &context);
+		else
+			ConvertPixelRange(&context, 0, count);
+
+		return true;
+	}
 
+	// Fills out with mip levels 1 to n - 1 of an RGBA8 image back to back and returns n, the full chain down to 1x1.
+	static inline uint32_t GenerateMipChain(int32_t width, int32_t height, uint8_t const* pixels, bool srgb, std::vector<uint8_t>& out, bool parallel = true) {
+		out.clear();
+		if (!pixels || width <= 0 || height <= 0)
 			return 0;
-		}
 
-		tTexture2D* GetBackBuffer(uint32_t buffer) {
-			int32_t w = 0;
-			int32_t h = 0;
+		uint32_t levels = GetMipLevelCount(width, height);
 
-			HDC hdc = wglGetCurrentDC();
-			HDC hMemoryDC = CreateCompatibleDC(hdc);
+		size_t size = 0;
+		for (int32_t w = width, h = height; w > 1 || h > 1;) {
+			w = (std::max)(w >> 1, 1);
+			h = (std::max)(h >> 1, 1);
+			size += static_cast<size_t>(w) * h * 4;
+		}
+		out.resize(size);
 
-			RECT windowRect = {};
-			GetClientRect(WindowFromDC(hdc), &windowRect);
+		if (srgb)
+			GetSrgbTables();
 
-			w = windowRect.right - windowRect.left;
-			h = windowRect.bottom - windowRect.top;
+		tMipContext context = { pixels, width, height, out.data(), 0, srgb };
+		for (uint32_t i = 1; i < levels; i++) {
+			int32_t w = (std::max)(context.srcWidth >> 1, 1);
+			int32_t h = (std::max)(context.srcHeight >> 1, 1);
+			context.dstWidth = w;
 
-			HBITMAP hBitmap = CreateCompatibleBitmap(hdc, w, h);
-			HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
+			if (parallel)
+				threadPool.ParallelFor(h, 16, DownsampleRows, &context);
+			else
+				DownsampleRows(&context, 0, h);
 
-			BitBlt(hMemoryDC, 0, 0, w, h, hdc, 0, 0, SRCCOPY);
+			context.src = context.dst;
+			context.srcWidth = w;
+			context.srcHeight = h;
+			context.dst += static_cast<size_t>(w) * h * 4;
+		}
 
-			BITMAPINFO bitmapInfo = { 0 };
-			bitmapInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-			bitmapInfo.bmiHeader.biWidth = w;
-			bitmapInfo.bmiHeader.biHeight = -h;
-			bitmapInfo.bmiHeader.biPlanes = 1;
-			bitmapInfo.bmiHeader.biBitCount = 32;
+		return levels;
+	}
 
-			uint8_t* pixels = new unsigned char[w * h * 4];
+	// pixelFormat describes the source pixels, UNKNOWN takes them as already in the texture format. They're converted once here.
+	static inline SirePtr<tSireTexture2D> CreateTexture(int32_t width, int32_t height, uint8_t* pixels, eSireMipmaps mipmaps = SIRE_MIPMAPS_NONE, eSirePixelFormat pixelFormat = SIRE_PIXEL_FORMAT_UNKNOWN, bool premultiply = false) {
+		SIRE_PROFILE_SCOPE("Sire::CreateTexture");
 
-			GetDIBits(hMemoryDC, hBitmap, 0, h, pixels, &bitmapInfo, DIB_RGB_COLORS);
+		if (!IsRendererActive())
+			return nullptr;
 
-			tTexture2D* out = CreateTexture(w, h, pixels);
+		eSirePixelFormat textureFormat = GetRenderer()->GetTextureFormat();
+		if (pixelFormat == SIRE_PIXEL_FORMAT_UNKNOWN)
+			pixelFormat = textureFormat;
 
-			delete[] pixels;
+		std::vector<uint8_t> converted;
+		if (pixels && (premultiply || IsBgraFormat(pixelFormat) != IsBgraFormat(textureFormat) || GetPixelSize(pixelFormat) != 4)) {
+			converted.resize(static_cast<size_t>(width) * height * 4);
+			if (!ConvertPixels(pixels, pixelFormat, converted.data(), textureFormat, width * height, premultiply))
+				return nullptr;
 
-			return out;
+			pixels = converted.data();
 		}
 
-		tTexture2D* CreateTexture(int32_t width, int32_t height, uint8_t* pixels) {
-			tTexture2D* out = new tTexture2D();
-			glGenTextures(1, &out->id);
-			glBindTexture(GL_TEXTURE_2D, out->id);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		bool generateMips = mipmaps == SIRE_MIPMAPS_GPU;
+		uint32_t mipLevels = 1;
+		std::vector<uint8_t> mipPixels;
+		if (pixels && (mipmaps == SIRE_MIPMAPS_BOX || mipmaps == SIRE_MIPMAPS_BOX_SRGB))
+			mipLevels = GenerateMipChain(width, height, pixels, mipmaps == SIRE_MIPMAPS_BOX_SRGB, mipPixels);
 
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-			glGenerateMipmap(GL_TEXTURE_2D);
+		return UploadTexture(width, height, pixels, textureFormat, mipLevels, mipPixels.data(), generateMips);
+	}
 
-			glBindTexture(GL_TEXTURE_2D, 0);
+	// Decodes PNG, TGA or BMP data. pixels come out 4 bytes per pixel, format tells their channel order.
+	static inline bool DecodeImage(uint8_t const* data, size_t size, std::vector<uint8_t>& pixels, int32_t& width, int32_t& height, eSirePixelFormat& format) {
+		static constexpr uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
 
-			out->width = width;
-			out->height = height;
+		if (!data)
+			return false;
 
-			return out;
+		if (size >= 8 && !memcmp(data, pngSignature, 8)) {
+			format = SIRE_PIXEL_FORMAT_RGBA8;
+			return DecodePng(data, size, pixels, width, height);
 		}
 
-		void CopyResources() {
-
-		}
-	};
+		format = SIRE_PIXEL_FORMAT_BGRA8;
+		if (size >= 2 && data[0] == 'B' && data[1] == 'M')
+			return DecodeBmp(data, size, pixels, width, height);
 
-#endif
+		// TGA has no signature.
+		return DecodeTga(data, size, pixels, width, height);
+	}
 
-#ifdef SIRE_VULKAN
-	struct SireVulkan : SireRenderer {
-		SireVulkan() {
+	// The file is read and decoded on a loader thread. The texture shows a placeholder and has state SIRE_TEXTURE_LOADING
+	// until a later EndFrame uploads it, w and h are 0 until then, so hosts that never call EndFrame keep the placeholder.
+	// Render thread only, like CreateTexture.
+	static inline SirePtr<tSireTexture2D> LoadTextureAsync(std::string const& path, eSireMipmaps mipmaps = SIRE_MIPMAPS_NONE) {
+		return QueueTextureLoad(path, nullptr, 0, mipmaps);
+	}
 
-		}
+	// Same from an encoded image in memory, data is copied.
+	static inline SirePtr<tSireTexture2D> LoadTextureAsync(uint8_t const* data, size_t size, eSireMipmaps mipmaps = SIRE_MIPMAPS_NONE) {
+		if (!data || !size)
+			return nullptr;
 
-		// Start virtual override
+		return QueueTextureLoad(std::string(), data, size, mipmaps);
+	}
 
-		bool IsRendererActive() override {
-			return false;
-		}
+	// Time EndFrame may spend uploading decoded textures, at least one is uploaded per frame.
+	static inline void SetTextureUploadBudget(float milliseconds) {
+		textureUploadBudget = milliseconds;
+	}
 
-		void Init(uintptr_t* ptr) override {
+	// Called by EndFrame.
+	static inline void ProcessTextureUploads() {
+		SIRE_PROFILE_SCOPE("Sire::ProcessTextureUploads");
 
-		}
+		if (!IsRendererActive())
+			return;
 
-		void Shutdown() override {
+		auto start = std::chrono::steady_clock::now();
+		while (tTextureLoad* load = textureLoader.Pop()) {
+			FinishTextureLoad(load);
+			delete load;
 
+			std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			if (elapsed.count() >= textureUploadBudget)
+				break;
 		}
+	}
 
-		void Begin() override {
-
-		}
+	// Bytes of GPU memory textures may use before evictable ones are released, least recently used first. 0 disables it.
+	static inline void SetTextureBudget(uint64_t bytes) {
+		textureStats.budget = bytes;
+		EnforceTextureBudget();
+	}
 
-		void End() override {
-		}
+	// An evictable texture can be released when over budget and is recreated by reloader the next time it's used,
+	// key is passed back to tell textures apart. nullptr makes it resident again. The reloader must outlive the texture.
+	static inline void SetTextureEvictable(SirePtr<tSireTexture2D> const& texture, tSireTextureReloader* reloader, uint64_t key = 0) {
+		if (!texture)
+			return;
 
-		void SetVertices(tVertex const& v) override {
-		}
+		if (!reloader && texture->state == SIRE_TEXTURE_EVICTED)
+			UseTexture(texture.Get());
 
-		void SetRenderStates(tRenderState const& s) override {
+		UnlinkTexture(texture.Get());
+		texture->reloader = reloader;
+		texture->reloadKey = key;
 
+		if (reloader && texture->tracked && texture->state == SIRE_TEXTURE_READY) {
+			texture->lastUsedFrame = frameCount;
+			LinkTexture(texture.Get());
+			EnforceTextureBudget();
 		}
+	}
 
-		void SetViewport(tSireViewport const& v) override {
+	static inline tSireTextureStats GetTextureStats() {
+		return textureStats;
+	}
 
-		}
+	// Writes every batch submitted through End to a trace file, with the states, textures and render targets it uses
+	// and a marker per EndFrame. Textures created earlier are read back when first bound, custom shaders and meshes
+	// aren't captured.
+	static inline bool BeginTraceCapture(std::string const& path) {
+		return traceWriter.Open(path);
+	}
 
-		void CopyResource(uintptr_t* dst, uintptr_t* src) override {
+	static inline void EndTraceCapture() {
+		traceWriter.Close();
+	}
 
-		}
+	// Plays a trace back through the current renderer, calling EndFrame at every recorded frame and then frameCallback,
+	// which can present and return false to stop. Vertices go through SetVertex3f so submission costs are replayed too.
+	static inline bool ReplayTrace(std::string const& path, bool (*frameCallback)(uint32_t frame, void* user) = nullptr, void* user = nullptr) {
+		std::vector<uint8_t> data;
+		if (!ReadFileData(path, data))
+			return false;
 
-		void SetTexture(uintptr_t* tex, uintptr_t* mask) override {
+		return ReplayTrace(data.data(), data.size(), frameCallback, user);
+	}
 
-		}
+	static inline bool ReplayTrace(uint8_t const* data, size_t size, bool (*frameCallback)(uint32_t frame, void* user) = nullptr, void* user = nullptr) {
+		if (!IsRendererActive() || !data)
+			return false;
 
-		// End virtual override	
-	};
+		tTraceReader reader = { data, data + size };
+		tTraceWriter::tHeader header = {};
+		if (!reader.Read(header) || header.magic != tTraceWriter::SIRE_TRACE_MAGIC || header.version != tTraceWriter::SIRE_TRACE_VERSION)
+			return false;
 
-#endif
+		if (header.vertexSize != sizeof(tVertex) || header.statesSize != sizeof(tRenderState) || header.constantsSize != sizeof(tConstBuff) || header.viewportSize != sizeof(tSireViewport))
+			return false;
 
-	static constexpr auto SIRE_NUM_MIN_VERTEX_INDEX = 4096;
+		struct tTexture {
+			int32_t w;
+			int32_t h;
+			eSirePixelFormat format;
+			uint32_t mipLevels;
+			SirePtr<tSireTexture2D> texture;
+		};
 
-	static inline tSireShared shared = {};
+		struct tTarget {
+			uint32_t texture;
+			SirePtr<tSireRenderTarget> view;
+		};
 
-	static inline eSirePrimitiveType primitiveType = SIRE_TRIANGLE;
-	static inline std::vector<tVertex> vertices = {};
-	static inline tSireFloat4 color = {};
-	static inline tSireFloat2 uv0 = {};
-	static inline tSireFloat2 uv1 = {};
+		std::unordered_map<uint32_t, tTexture> textures;
+		std::unordered_map<uint32_t, tTarget> targets;
+		SirePtr<tSireTexture2D> noTexture = nullptr;
+		SirePtr<tSireRenderTarget> noTarget = nullptr;
 
-	static inline std::vector<uint16_t> indices = {};
-	static inline uint32_t numIndices = 0;
+		// Declared textures without data are created blank on first use.
+		auto getTexture = [&](uint32_t id) -> SirePtr<tSireTexture2D> const& {
+			auto it = textures.find(id);
+			if (it == textures.end() || it->second.w <= 0 || it->second.h <= 0)
+				return noTexture;
 
-	static inline std::array<SireRenderer*, SIRE_NUM_RENDERERS> renderers = {};
-	static inline eSireRenderer currentRenderer = SIRE_RENDERER_NULL;
-	static inline uintptr_t* currentRendererMainPtr = nullptr;
-	static inline bool renderersInitialised = false;
+			if (!it->second.texture)
+				it->second.texture = CreateTexture(it->second.w, it->second.h, nullptr);
 
-	static inline tConstBuff cb = { {}, false, false };
+			return it->second.texture;
+		};
 
-	static inline uintptr_t* currentRenderTargetView = nullptr;
+		eSirePixelFormat textureFormat = GetRenderer()->GetTextureFormat();
+		std::vector<uint8_t> pixels;
+		std::vector<uint16_t> replayIndices;
+		bool prevAutoReset = frameArenaAutoReset;
+
+		// The trace overwrites the caller's state, it is put back once the replay is done.
+		tRenderState prevRenderStates = shared.renderStates;
+		tSireViewport prevViewport = shared.viewport;
+		tConstBuff prevcb = cb;
+		eSirePrimitiveType prevType = primitiveType;
+		tSireFloat4 prevColor = color;
+		tSireFloat2 prevUv0 = uv0;
+		tSireFloat2 prevUv1 = uv1;
+		uintptr_t* prevTexture = currentTexture;
+		uintptr_t* prevMask = currentMask;
+		uint64_t prevTextureId = currentTextureId;
+		uint64_t prevMaskId = currentMaskId;
+		uintptr_t* prevRenderTargetView = currentRenderTargetView;
+		uint64_t prevRenderTargetTexture = currentRenderTargetTexture;
+		uint32_t frame = 0;
+		bool drawn = false;
+		bool result = true;
+
+		BeginFrame();
+		while (reader.ptr < reader.end) {
+			uint8_t command = 0;
+			reader.Read(command);
+
+			switch (command) {
+				case SIRE_TRACE_FRAME:
+				{
+					EndFrame();
+					drawn = false;
+					if (frameCallback && !frameCallback(frame++, user)) {
+						reader.ptr = reader.end;
+						break;
+					}
+					BeginFrame();
+				} break;
+				case SIRE_TRACE_TEXTURE:
+				{
+					uint32_t id = 0;
+					tTexture texture = { 0, 0, SIRE_PIXEL_FORMAT_UNKNOWN, 1, nullptr };
+					uint32_t format = 0;
+					result = reader.Read(id) && reader.Read(texture.w) && reader.Read(texture.h) && reader.Read(format) && reader.Read(texture.mipLevels) && format <= SIRE_PIXEL_FORMAT_BC7;
+					texture.format = result ? static_cast<eSirePixelFormat>(format) : SIRE_PIXEL_FORMAT_UNKNOWN;
+
+					if (texture.w > SIRE_MAX_IMAGE_DIMENSION || texture.h > SIRE_MAX_IMAGE_DIMENSION || (!IsCompressedFormat(texture.format) && texture.format != SIRE_PIXEL_FORMAT_UNKNOWN && GetPixelSize(texture.format) != 4))
+						result = false;
+
+					if (result) {
+						textures.erase(id);
+						textures.emplace(id, std::move(texture));
+					}
+				} break;
+				case SIRE_TRACE_TEXTURE_DATA:
+				{
+					uint32_t id = 0;
+					uint64_t dataSize = 0;
+					result = reader.Read(id) && reader.Read(dataSize);
+					uint8_t const* src = result ? reader.Skip(static_cast<size_t>(dataSize)) : nullptr;
+					result = src != nullptr;
+
+					auto it = textures.find(id);
+					if (!result || it == textures.end() || it->second.w <= 0 || it->second.h <= 0)
+						break;
 
-	static inline std::string glslShader3_3_0 = R"(
-	#version 330 core
+					tTexture& t = it->second;
+					uint64_t levelSize = GetImageDataSize(t.format, t.w, t.h, 1);
+					uint32_t mipLevels = dataSize == GetImageDataSize(t.format, t.w, t.h, t.mipLevels) ? t.mipLevels : 1;
+					if (dataSize < levelSize)
+						break;
 
-	layout(std140) uniform ConstantBuffer
-	{
-		mat4 proj;
-		int hasTex;
-		int hasMask;
-		int swapColors;    
-	};
+					if (IsCompressedFormat(t.format)) {
+						if (!t.texture)
+							t.texture = CreateCompressedTexture(t.w, t.h, t.format, src, mipLevels);
+						break;
+					}
 
-	uniform sampler2D tex0;
-	uniform sampler2D mask0;
+					// The trace may come from a renderer with the other channel order.
+					pixels.assign(src, src + (mipLevels > 1 ? dataSize : levelSize));
+					if (IsBgraFormat(t.format) != IsBgraFormat(textureFormat))
+						ConvertPixels(pixels.data(), t.format, pixels.data(), textureFormat, static_cast<uint32_t>(pixels.size() / 4));
+
+					if (t.texture)
+						UpdateTexture(t.texture, pixels.data());
+					else
+						t.texture = UploadTexture(t.w, t.h, pixels.data(), textureFormat, mipLevels, mipLevels > 1 ? pixels.data() + levelSize : nullptr, false);
+				} break;
+				case SIRE_TRACE_RENDER_TARGET:
+				{
+					uint32_t id = 0;
+					tTarget target = { 0, nullptr };
+					result = reader.Read(id) && reader.Read(target.texture);
+					if (result) {
+						targets.erase(id);
+						targets.emplace(id, std::move(target));
+					}
+				} break;
+				case SIRE_TRACE_STATES:
+					result = reader.Read(shared.renderStates);
+					break;
+				case SIRE_TRACE_CONSTANTS:
+					result = reader.Read(cb);
+					break;
+				case SIRE_TRACE_VIEWPORT:
+				{
+					FlushSortedDraws();
+					result = reader.Read(shared.viewport);
+					if (result)
+						GetRenderer()->SetViewport(shared.viewport);
+				} break;
+				case SIRE_TRACE_BIND:
+				{
+					uint32_t bound[3] = {};
+					result = reader.Read(bound);
+					if (!result)
+						break;
 
-	layout(location = 0) in vec4 position;
-	layout(location = 1) in vec4 color;
-	layout(location = 2) in vec2 uv0;
-	layout(location = 3) in vec2 uv1;
+					// Binding may update the texture flags, the recorded constants are kept.
+					tConstBuff prevcb = cb;
+					SetTexture(getTexture(bound[0]), getTexture(bound[1]));
+					cb = prevcb;
 
-	out vec4 FragColor;
+					auto it = targets.find(bound[2]);
+					if (it == targets.end() || !getTexture(it->second.texture)) {
+						SetRenderTarget(noTarget);
+						break;
+					}
 
-	void main()
-	{
-		gl_Position = proj * position;
-		FragColor = color;
+					if (!it->second.view)
+						it->second.view = CreateRenderTargetView(getTexture(it->second.texture));
+					SetRenderTarget(it->second.view);
+				} break;
+				case SIRE_TRACE_DRAW:
+				{
+					uint8_t type = 0;
+					uint32_t count[3] = {};
+					result = reader.Read(type) && reader.Read(count) && type <= SIRE_TRIANGLE_FAN && count[0] <= count[2];
+					result = result && count[1] <= 65536 && count[2] <= 65536;
+					uint8_t const* src = result ? reader.Skip(static_cast<size_t>(count[1]) * sizeof(tVertex)) : nullptr;
+					uint8_t const* srcIndices = src ? reader.Skip(static_cast<size_t>(count[2]) * sizeof(uint16_t)) : nullptr;
+					result = srcIndices != nullptr;
+					if (!result)
+						break;
 
-		if (hasTex )
-		{
-			FragColor *= texture(tex0, uv0);
-			FragColor.a = max(FragColor.a, color.a);
-		}
+					Begin(static_cast<eSirePrimitiveType>(type));
+					for (uint32_t i = 0; i < count[1]; i++) {
+						tVertex v;
+						memcpy(&v, src + i * sizeof(tVertex), sizeof(tVertex));
+						SetColor4f(v.col.x, v.col.y, v.col.z, v.col.w);
+						SetTexCoords4f(v.uv0.x, v.uv0.y, v.uv1.x, v.uv1.y);
+						SetVertex3f(v.pos.x, v.pos.y, v.pos.z);
+					}
 
-		if (hasMask)
-		{
-			FragColor *= texture(mask0, uv1);
-		}
+					if (count[2]) {
+						replayIndices.resize(count[2]);
+						memcpy(replayIndices.data(), srcIndices, count[2] * sizeof(uint16_t));
+						SetIndices(replayIndices, static_cast<int32_t>(count[0]));
+					}
+					End();
+					drawn = true;
+				} break;
+				default:
+					result = false;
+					break;
+			}
 
-		if (swapColors)
-		{	
-			float prev = FragColor.r;
-			FragColor.r = FragColor.b;
-			FragColor.b = prev;
+			if (!result)
+				break;
 		}
-	}
-	)";
 
-	static inline std::string hlslShader2_0 = R"(
-	matrix proj;
-	int hasTex;
-	int hasMask;
-	int swapColors;
-	
-	sampler2D tex0 : register(s0);
-	sampler2D mask0 : register(s1);
-	
-	struct VOut
-	{
-		float4 position : POSITION;
-		float4 color : COLOR;
-		float2 uv0 : TEXCOORD0;
-		float2 uv1 : TEXCOORD1;
-	};
-	
-	VOut VShader(float4 position : POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1)
-	{
-		VOut output;
-	
-		output.position = mul(position, proj);
-		output.color = color;
-		output.uv0 = uv0;
-		output.uv1 = uv1;
-	
-		return output;
+		// A capture stopped mid frame still gets its last frame.
+		if (drawn) {
+			EndFrame();
+			if (frameCallback)
+				frameCallback(frame, user);
+		}
+
+		// Queued draws can still refer to the replay textures.
+		FlushSortedDraws();
+
+		shared.renderStates = prevRenderStates;
+		shared.viewport = prevViewport;
+		cb = prevcb;
+		primitiveType = prevType;
+		color = prevColor;
+		uv0 = prevUv0;
+		uv1 = prevUv1;
+		currentTexture = prevTexture;
+		currentMask = prevMask;
+		currentTextureId = prevTextureId;
+		currentMaskId = prevMaskId;
+		currentRenderTargetView = prevRenderTargetView;
+		currentRenderTargetTexture = prevRenderTargetTexture;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		GetRenderer()->SetViewport(shared.viewport);
+		frameArenaAutoReset = prevAutoReset;
+
+		return result;
 	}
-	
-	float4 PShader(VOut input) : COLOR
-	{
-		float4 c = input.color;
-
-		if (hasTex)
-		{   
-			c *= tex2D(tex0, input.uv0);
-			c.a = max(c.a, input.color.a);
-		}
-		
-		if (hasMask)
-		{
-			c *= tex2D(mask0, input.uv1);
-		}
 
-		if (swapColors)
-		{	
-			float prev = c.r;
-			c.r = c.b;
-			c.b = prev;
-		}
-		
-		return c;
+	static inline tSireFrameStats GetFrameStats() {
+		return lastFrameStats;
 	}
-	)";
 
-	static inline std::string hlslShader4_0 = R"(
-	cbuffer ConstantBuffer : register(b0)
-	{
-		matrix proj;
-		int hasTex;
-		int hasMask;
-		int swapColors;
-	};
-	
-	Texture2D tex0 : register(t0);
-	Texture2D mask0 : register(t1);
-	SamplerState sampler0 : register(s0);
-	
-	struct VOut
-	{
-		float4 position : POSITION;
-		float4 color : COLOR;
-		float2 uv0 : TEXCOORD0;
-		float2 uv1 : TEXCOORD1;
-	};
-	
-	VOut VShader(float4 position : POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1)
-	{
-		VOut output;
-	
-		output.position = mul(position, proj);
-		output.color = color;
-		output.uv0 = uv0;
-		output.uv1 = uv1;
-	
-		return output;
+	// Timestamp queries around every batch on DX10, DX11 and OpenGL, the software renderer times itself on the CPU.
+	// Frames are delimited by EndFrame and read back a few frames later without waiting on the GPU.
+	static inline void SetGpuTiming(bool enable) {
+		gpuTiming = enable;
 	}
-	
-	float4 PShader(VOut input) : SV_Target
-	{
-		float4 c = input.color;
-	
-		if (hasTex)
-		{
-			c *= tex0.Sample(sampler0, input.uv0);
-			c.a = max(c.a, input.color.a);
-		}
-	
-		if (hasMask)
-		{
-			c *= mask0.Sample(sampler0, input.uv1);
-		}
 
-		if (swapColors)
-		{	
-			float prev = c.r;
-			c.r = c.b;
-			c.b = prev;
-		}
-	
-		return c;
+	// Batches submitted from now on are timed under this tag, nullptr for none. Only the pointer is kept.
+	static inline void SetTimingTag(const char* tag) {
+		timingTag = tag;
 	}
-	)";
 
+	// The newest frame the GPU has finished, false until there is one.
+	static inline bool GetGpuTimings(tSireGpuFrameTiming& out) {
+		if (!gpuFrameTimingValid)
+			return false;
 
-	static inline std::string hlslShader5_0 = R"(
-	cbuffer ConstantBuffer : register(b0)
-	{
-		matrix proj;
-		int hasTex;
-		int hasMask;
-		int swapColors;
-	};
-	
-	Texture2D tex0 : register(t0);
-	Texture2D mask0 : register(t1);
-	SamplerState sampler0 : register(s0);
-	
-	struct VOut
-	{
-		float4 position : SV_POSITION;
-		float4 color : COLOR;
-		float2 uv0 : TEXCOORD0;
-		float2 uv1 : TEXCOORD1;
-	};
-	
-	VOut VShader(float4 position : POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1)
-	{
-		VOut output;
-	
-		output.position = mul(position, proj);
-		output.color = color;
-		output.uv0 = uv0;
-		output.uv1 = uv1;
-	
-		return output;
+		out = gpuFrameTiming;
+		return true;
 	}
-	
-	float4 PShader(float4 position : SV_POSITION, float4 color : COLOR, float2 uv0 : TEXCOORD0, float2 uv1 : TEXCOORD1) : SV_TARGET
-	{
-		float4 c = color;
-	
-		if (hasTex)
-		{   
-			c *= tex0.Sample(sampler0, uv0);
-			c.a = max(c.a, color.a);
-		}
-		
-		if (hasMask)
-		{
-			c *= mask0.Sample(sampler0, uv1);
-		}
 
-		if (swapColors)
-		{	
-			float prev = c.r;
-			c.r = c.b;
-			c.b = prev;
-		}
-		
-		return c;
+	// Names the calling thread in profile dumps.
+	static inline void SetProfileThreadName(const char* name) {
+#ifdef SIRE_PROFILE
+		GetProfileRing()->name.store(name, std::memory_order_relaxed);
+#endif
 	}
-	)";
 
-public:
-	static inline eSireRenderer const GetCurrentRenderer() {
-		return currentRenderer;
+	// Events that started before this call are left out of later dumps.
+	static inline void ClearProfile() {
+#ifdef SIRE_PROFILE
+		profileClearTime.store(GetProfileTime(), std::memory_order_relaxed);
+#endif
 	}
 
-	template <typename T = SireRenderer>
-	static inline T* const GetRenderers(eSireRenderer re) {
-		return reinterpret_cast<T*>(renderers.at(re));
-	}
+	// Writes the events of every thread, each thread keeps its newest 32768. Other threads keep recording while the
+	// dump runs. Returns false when SIRE_PROFILE is not defined.
+	static inline bool DumpProfile(std::string const& path, eSireProfileFormat format = SIRE_PROFILE_FORMAT_CHROME_JSON) {
+#ifdef SIRE_PROFILE
+		std::string out;
+		if (format == SIRE_PROFILE_FORMAT_PERFETTO)
+			WritePerfettoProfile(out);
+		else
+			WriteChromeProfile(out);
 
-	static inline bool IsRendererActive(eSireRenderer renderer) {
-		return renderer != SIRE_RENDERER_NULL && GetRenderers(renderer)->IsRendererActive();
-	}
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f)
+			return false;
 
-	static inline bool IsRendererActive() {
-		return GetCurrentRenderer() != SIRE_RENDERER_NULL && GetRenderers(GetCurrentRenderer())->IsRendererActive();
+		bool result = fwrite(out.data(), 1, out.size(), f) == out.size();
+		return fclose(f) == 0 && result;
+#else
+		return false;
+#endif
 	}
 
-	static inline void Begin(eSirePrimitiveType type) {
-		if (!IsRendererActive())
-			return;
+	// Replays a trace runs times through the current renderer and keeps the fastest CPU time of every frame, EndFrame
+	// included. Counts come from the last run. frameCallback runs outside the timed part, e.g. to clear and present.
+	// With SIRE_SOFTWARE the back buffer is cleared before every frame and read back after the last one when
+	// captureImage is set, so the results depend on nothing but the trace.
+	static inline bool RunPerfTrace(uint8_t const* data, size_t size, tSirePerfResult& out, uint32_t runs = 3, bool captureImage = true, bool (*frameCallback)(uint32_t frame, void* user) = nullptr, void* user = nullptr) {
+		out = tSirePerfResult();
+		if (!IsRendererActive() || !data || !runs)
+			return false;
 
-		primitiveType = type;
-		vertices.clear();
-		indices.clear();
-		numIndices = 0;
+		struct tContext {
+			tSirePerfResult* out;
+			uint32_t run;
+			bool capture;
+			bool (*frameCallback)(uint32_t frame, void* user);
+			void* user;
+			std::chrono::steady_clock::time_point start;
+		} context = { &out, 0, false, frameCallback, user, {} };
+
+		for (; context.run < runs; context.run++) {
+			context.capture = captureImage && context.run == runs - 1;
+			ClearPerfBackBuffer();
+			context.start = std::chrono::steady_clock::now();
+
+			bool result = ReplayTrace(data, size, [](uint32_t frame, void* ptr) {
+				tContext& c = *static_cast<tContext*>(ptr);
+				std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - c.start;
+
+				if (c.run == 0) {
+					c.out->frames.push_back({ elapsed.count(), lastFrameStats });
+				}
+				else if (frame < c.out->frames.size()) {
+					tSirePerfFrame& f = c.out->frames[frame];
+					f.cpuMs = (std::min)(f.cpuMs, elapsed.count());
+					f.stats = lastFrameStats;
+				}
 
-		color = { 1.0f, 1.0f, 1.0f, 1.0f };
-		uv0 = { 0.0f, 0.0f };
-		uv1 = { 0.0f, 0.0f };
+				if (c.capture)
+					ReadPerfBackBuffer(c.out->image, c.out->width, c.out->height);
 
-		return GetRenderers(GetCurrentRenderer())->Begin();
-	}
+				bool result = !c.frameCallback || c.frameCallback(frame, c.user);
 
-	static inline void End() {
-		if (!IsRendererActive())
-			return;
+				ClearPerfBackBuffer();
+				c.start = std::chrono::steady_clock::now();
+				return result;
+			}, &context);
 
-		// Deduce indices automatically if unset.
-		if (indices.empty()) {
-			uint16_t i = 0;
-			for (auto& it : vertices) {
-				indices.push_back(i++);
-			}
+			if (!result)
+				return false;
+		}
+
+		std::vector<float> times;
+		for (auto& it : out.frames) {
+			times.push_back(it.cpuMs);
+			out.draws += it.stats.draws;
+			out.vertices += it.stats.vertices;
+			out.uploadBytes += it.stats.uploadBytes;
+		}
 
-			numIndices = static_cast<uint32_t>(indices.size());
+		if (!times.empty()) {
+			std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+			out.cpuMs = times[times.size() / 2];
 		}
 
-		GetRenderers(GetCurrentRenderer())->SetRenderStates(shared.renderStates);
-		return GetRenderers(GetCurrentRenderer())->End();
+		return true;
 	}
 
-	static inline void SetColor4f(float r, float g, float b, float a) {
-		if (!IsRendererActive())
-			return;
+	// Writes the totals to a text file, and the image next to it as path + ".tga" when there is one.
+	static inline bool SavePerfBaseline(std::string const& path, tSirePerfResult const& result) {
+		FILE* f = fopen(path.c_str(), "w");
+		if (!f)
+			return false;
 
-		color = { r, g, b, a };
-	}
+		fprintf(f, "sire-perf %u\n", SIRE_PERF_BASELINE_VERSION);
+		fprintf(f, "frames %u\n", static_cast<uint32_t>(result.frames.size()));
+		fprintf(f, "cpu_ms %.6f\n", result.cpuMs);
+		fprintf(f, "draws %llu\n", static_cast<unsigned long long>(result.draws));
+		fprintf(f, "vertices %llu\n", static_cast<unsigned long long>(result.vertices));
+		fprintf(f, "upload_bytes %llu\n", static_cast<unsigned long long>(result.uploadBytes));
+		bool written = ferror(f) == 0;
+		fclose(f);
 
-	static inline void SetColor3f(float r, float g, float b) {
-		if (!IsRendererActive())
-			return;
+		if (written && !result.image.empty())
+			written = WriteTga(path + ".tga", result.width, result.height, result.image.data());
 
-		SetColor4f(r, g, b, 1.0f);
+		return written;
 	}
 
-	static inline void SetTexCoords4f(float x1, float y1, float x2, float y2) {
-		if (!IsRendererActive())
-			return;
+	// frames of the baseline only carries the count, every frame is zero.
+	static inline bool LoadPerfBaseline(std::string const& path, tSirePerfResult& out) {
+		out = tSirePerfResult();
 
-		uv0 = { x1, y1 };
-		uv1 = { x2, y2 };
-	}
+		FILE* f = fopen(path.c_str(), "r");
+		if (!f)
+			return false;
 
-	static inline void SetTexCoords2f(float x, float y) {
-		if (!IsRendererActive())
-			return;
+		char key[32] = {};
+		uint32_t version = 0;
+		bool result = fscanf(f, "%31s %u", key, &version) == 2 && !strcmp(key, "sire-perf") && version == SIRE_PERF_BASELINE_VERSION;
 
-		SetTexCoords4f(x, y, x, y);
-	}
+		while (result && fscanf(f, "%31s", key) == 1) {
+			if (!strcmp(key, "cpu_ms")) {
+				result = fscanf(f, "%lf", &out.cpuMs) == 1;
+				continue;
+			}
 
-	static inline void SetVertex3f(float x, float y, float z) {
-		if (!IsRendererActive())
-			return;
+			unsigned long long value = 0;
+			result = fscanf(f, "%llu", &value) == 1;
 
-		tVertex v = {};
-		v.pos.x = x;
-		v.pos.y = y;
-		v.pos.z = z;
-		v.col = color;
-		v.uv0 = uv0;
-		v.uv1 = uv1;
+			if (!strcmp(key, "frames"))
+				out.frames.resize(static_cast<size_t>((std::min)(value, 1ull << 24)));
+			else if (!strcmp(key, "draws"))
+				out.draws = value;
+			else if (!strcmp(key, "vertices"))
+				out.vertices = value;
+			else if (!strcmp(key, "upload_bytes"))
+				out.uploadBytes = value;
+		}
+		fclose(f);
 
-		vertices.push_back(v);
+		if (!result)
+			return false;
+
+		std::vector<uint8_t> data;
+		if (ReadFileData(path + ".tga", data) && DecodeTga(data.data(), data.size(), out.image, out.width, out.height))
+			ConvertPixels(out.image.data(), SIRE_PIXEL_FORMAT_BGRA8, out.image.data(), SIRE_PIXEL_FORMAT_RGBA8, static_cast<uint32_t>(out.image.size() / 4));
 
-		return GetRenderers(GetCurrentRenderer())->SetVertices(v);
+		return true;
 	}
 
-	static inline void SetVertex2f(float x, float y) {
-		if (!IsRendererActive())
-			return;
+	// Counts the RGBA8 pixels with a channel differing by more than threshold. diff, when given, gets an image of the
+	// differences in red over a faded copy of a.
+	static inline uint64_t DiffImages(uint8_t const* a, uint8_t const* b, int32_t width, int32_t height, uint8_t threshold, std::vector<uint8_t>* diff = nullptr) {
+		if (!a || !b || width <= 0 || height <= 0)
+			return 0;
 
-		SetVertex3f(x, y, 0.0f);
-	}
+		size_t count = static_cast<size_t>(width) * height;
+		if (diff)
+			diff->resize(count * 4);
 
-	static inline void SetIndex1i(uint16_t i) {
-		if (!IsRendererActive())
-			return;
+		uint64_t out = 0;
+		for (size_t i = 0; i < count; i++) {
+			uint8_t const* pa = a + i * 4;
+			uint8_t const* pb = b + i * 4;
 
-		indices.push_back(i);
-	}
+			bool different = false;
+			for (int32_t k = 0; k < 4; k++)
+				different |= std::abs(pa[k] - pb[k]) > threshold;
 
-	static inline void SetIndices(std::vector<uint16_t> const& i, int32_t n) {
-		if (!IsRendererActive())
-			return;
+			out += different;
 
-		indices = i;
-		numIndices = n;
+			if (diff) {
+				uint8_t* pd = diff->data() + i * 4;
+				uint8_t gray = static_cast<uint8_t>((pa[0] + pa[1] + pa[2]) / 12);
+				pd[0] = different ? 255 : gray;
+				pd[1] = different ? 0 : gray;
+				pd[2] = different ? 0 : gray;
+				pd[3] = 255;
+			}
+		}
+
+		return out;
 	}
 
-	static inline void SetRenderState(eSireRenderState state, uint32_t value) {
-		if (!IsRendererActive())
-			return;
+	// Appends a line per measurement to report and returns false if any of them regressed past the tolerance.
+	// Results faster or smaller than the baseline always pass.
+	static inline bool ComparePerf(tSirePerfResult const& result, tSirePerfResult const& baseline, tSirePerfTolerance const& tolerance, std::string& report) {
+		bool pass = true;
+		char line[256];
+
+		auto check = [&](const char* name, double value, double base, double limit) {
+			bool ok = value <= limit;
+			double change = base > 0.0 ? (value - base) * 100.0 / base : 0.0;
+			snprintf(line, sizeof(line), "  %-12s %14.3f baseline %14.3f (%+.1f%%)%s\n", name, value, base, change, ok ? "" : " REGRESSED");
+			report += line;
+			pass &= ok;
+		};
 
-		switch (state) {
-			case SIRE_BLEND_ALPHATESTENABLE:
-				shared.renderStates.blendEnable = value;
-				break;
-			case SIRE_BLEND_SRCBLEND:
-				shared.renderStates.srcBlend = value;
-				break;
-			case SIRE_BLEND_DESTBLEND:
-				shared.renderStates.destBlendAlpha = value;
-				break;
-			case SIRE_BLEND_BLENDOP:
-				shared.renderStates.blendop = value;
-				break;
-			case SIRE_BLEND_SRCBLENDALPHA:
-				shared.renderStates.srcBlendAlpha = value;
-				break;
-			case SIRE_BLEND_DESTBLENDALPHA:
-				shared.renderStates.destBlendAlpha = value;
-				break;
-			case SIRE_BLEND_BLENDOPALPHA:
-				shared.renderStates.blendOpAlpha = value;
-				break;
-			case SIRE_BLEND_WRITEMASK:
-				shared.renderStates.renderTargetWriteMask = value;
-				break;
-			case SIRE_BLEND_CULLMODE:
-				shared.renderStates.cullMode = value;
-				break;
-			case SIRE_BLEND_FILLMODE:
-				shared.renderStates.fillMode = value;
-				break;
-			case SIRE_BLEND_STENCILENABLE:
-				shared.renderStates.stencilEnable = value;
-				break;
-			case SIRE_BLEND_COLORWRITEENABLE:
-				shared.renderStates.sampleMask = value;
-				break;
+		if (result.frames.size() != baseline.frames.size()) {
+			snprintf(line, sizeof(line), "  frames %u, baseline %u MISMATCH\n", static_cast<uint32_t>(result.frames.size()), static_cast<uint32_t>(baseline.frames.size()));
+			report += line;
+			pass = false;
 		}
-	}
 
-	static inline void SetPixelShader(uintptr_t* ps) {
-		if (!IsRendererActive())
-			return;
+		check("cpu_ms", result.cpuMs, baseline.cpuMs, baseline.cpuMs * (1.0 + tolerance.cpuTime));
+		check("draws", static_cast<double>(result.draws), static_cast<double>(baseline.draws), static_cast<double>(baseline.draws + tolerance.draws));
+		check("upload_bytes", static_cast<double>(result.uploadBytes), static_cast<double>(baseline.uploadBytes), baseline.uploadBytes * (1.0 + tolerance.uploadBytes));
+
+		if (tolerance.differentPixels >= 0.0f && !result.image.empty() && !baseline.image.empty()) {
+			if (result.width != baseline.width || result.height != baseline.height) {
+				snprintf(line, sizeof(line), "  image %dx%d, baseline %dx%d MISMATCH\n", result.width, result.height, baseline.width, baseline.height);
+				report += line;
+				pass = false;
+			}
+			else {
+				uint64_t different = DiffImages(result.image.data(), baseline.image.data(), result.width, result.height, tolerance.pixelThreshold);
+				double limit = static_cast<double>(tolerance.differentPixels) * result.width * result.height;
+				snprintf(line, sizeof(line), "  %-12s %14llu pixels differ%s\n", "image", static_cast<unsigned long long>(different), different <= limit ? "" : " CHANGED");
+				report += line;
+				pass &= different <= limit;
+			}
+		}
 
-		GetRenderers(GetCurrentRenderer())->SetPixelShader(ps);
+		return pass;
 	}
 
-	static inline void SetVertexShader(uintptr_t* vs) {
-		if (!IsRendererActive())
-			return;
+	// Replays every trace of the corpus and compares it with baselineDirectory/<trace file name>.perf, returning the
+	// number of traces that failed. Missing baselines, or all of them with updateBaselines, are written instead.
+	// An image that changed is written next to its baseline as .diff.tga.
+	static inline uint32_t RunPerfRegression(std::vector<std::string> const& traces, std::string const& baselineDirectory, tSirePerfTolerance const& tolerance, std::string& report, bool updateBaselines = false, uint32_t runs = 3) {
+		uint32_t failures = 0;
+
+		for (auto& it : traces) {
+			size_t slash = it.find_last_of("/\\");
+			std::string name = slash == std::string::npos ? it : it.substr(slash + 1);
+			std::string baselinePath = baselineDirectory.empty() ? name + ".perf" : baselineDirectory + "/" + name + ".perf";
+
+			report += name + "\n";
+
+			std::vector<uint8_t> data;
+			tSirePerfResult result;
+			if (!ReadFileData(it, data) || !RunPerfTrace(data.data(), data.size(), result, runs, tolerance.differentPixels >= 0.0f)) {
+				report += "  replay FAILED\n";
+				failures++;
+				continue;
+			}
 
-		GetRenderers(GetCurrentRenderer())->SetVertexShader(vs);
-	}
+			tSirePerfResult baseline;
+			if (updateBaselines || !LoadPerfBaseline(baselinePath, baseline)) {
+				bool written = SavePerfBaseline(baselinePath, result);
+				report += written ? "  baseline written\n" : "  baseline write FAILED\n";
+				failures += !written;
+				continue;
+			}
 
-	static inline void SetTextureStage(uint32_t stage, SirePtr<tSireTexture2D> texture) {
+			if (ComparePerf(result, baseline, tolerance, report))
+				continue;
 
-	}
+			failures++;
 
-	static inline void SetShaderConstantFloat() {
+			if (!result.image.empty() && result.width == baseline.width && result.height == baseline.height) {
+				std::vector<uint8_t> diff;
+				if (DiffImages(result.image.data(), baseline.image.data(), result.width, result.height, tolerance.pixelThreshold, &diff))
+					WriteTga(baselinePath + ".diff.tga", result.width, result.height, diff.data());
+			}
+		}
 
+		return failures;
 	}
 
-	static inline void SetShaderConstantInt() {
-
+	static inline uint32_t GetCompressedSize(eSirePixelFormat format, int32_t width, int32_t height) {
+		return GetCompressedRowSize(format, width) * ((height + 3) / 4);
 	}
 
-	template <typename T>
-	static inline void Init(eSireRenderer re, T* ptr) {
-		if (currentRenderer != SIRE_RENDERER_NULL)
-			return;
+	// blocks holds GetCompressedSize bytes per level, block rows top to bottom and mipLevels levels back to back.
+	// The texture is immutable and can't be a render target.
+	static inline SirePtr<tSireTexture2D> CreateCompressedTexture(int32_t width, int32_t height, eSirePixelFormat format, uint8_t const* blocks, uint32_t mipLevels = 1) {
+		SIRE_PROFILE_SCOPE("Sire::CreateCompressedTexture");
 
-		if (vertices.max_size() < SIRE_NUM_MIN_VERTEX_INDEX)
-			vertices.reserve(SIRE_NUM_MIN_VERTEX_INDEX);
+		if (!IsRendererActive())
+			return nullptr;
 
-		if (indices.max_size() < SIRE_NUM_MIN_VERTEX_INDEX)
-			indices.reserve(SIRE_NUM_MIN_VERTEX_INDEX);
+		if (!blocks || width <= 0 || height <= 0 || !IsCompressedFormat(format))
+			return nullptr;
 
-		if (!renderersInitialised) {
-			if (!renderers.at(re)) {
-				SireRenderer* renderer = nullptr;
+		mipLevels = (std::max)((std::min)(mipLevels, GetMipLevelCount(width, height)), 1u);
 
-				switch (re) {
-					case SIRE_RENDERER_NULL:
-						break;
+		SirePtr<tSireTexture2D> out(new tSireTexture2D);
+
+		switch (GetCurrentRenderer()) {
 #ifdef SIRE_DX9
-					case SIRE_RENDERER_DX9:
-						renderer = new SireDirectX9();
-						break;
+			case SIRE_RENDERER_DX9:
+			{
+				IDirect3DSurface9* sout = nullptr;
+				auto result = GetRenderers<SireDirectX9>(GetCurrentRenderer())->CreateCompressedTexture(width, height, format, blocks, &sout, mipLevels);
+
+				if (result)
+					out->Set(width, height, format, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(sout), mipLevels);
+			} break;
 #endif
 #ifdef SIRE_DX10
-					case SIRE_RENDERER_DX10:
-						renderer = new SireDirectX10();
-						break;
+			case SIRE_RENDERER_DX10:
+			{
+				auto tex = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateCompressedTexture(width, height, format, blocks, mipLevels);
+
+				if (tex) {
+					auto result = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+
+					if (result)
+						out->Set(width, height, format, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex), mipLevels);
+				}
+			} break;
 #endif
 #ifdef SIRE_DX11
-					case SIRE_RENDERER_DX11:
-						renderer = new SireDirectX11();
-						break;
-#endif
-#ifdef SIRE_DX12
-					case SIRE_RENDERER_DX12:
-						renderer = new SireDirectX12();
-						break;
-#endif
-#ifdef SIRE_OPENGL
-					case SIRE_RENDERER_OPENGL:
-						renderer = new SireOpenGL();
-						break;
+			case SIRE_RENDERER_DX11:
+			{
+				auto tex = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateCompressedTexture(width, height, format, blocks, mipLevels);
+
+				if (tex) {
+					auto result = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+
+					if (result)
+						out->Set(width, height, format, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex), mipLevels);
+				}
+			} break;
 #endif
-#ifdef SIRE_VULKAN
-					case SIRE_RENDERER_VULKAN:
-						renderer = new SireVulkan();
-						break;
+#ifdef SIRE_SOFTWARE
+			case SIRE_RENDERER_SOFTWARE:
+			{
+				auto result = GetRenderers<SireSoftware>(GetCurrentRenderer())->CreateCompressedTexture(width, height, format, blocks);
+
+				if (result) {
+					result->AddRef();
+					out->Set(width, height, format, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(result), mipLevels);
+				}
+			} break;
 #endif
+		}
+
+		if (!out->ptrs.texture)
+			return nullptr;
+
+		frameStats.uploadBytes += GetImageDataSize(format, width, height, mipLevels);
+		TraceTextureData(out.Get(), blocks, static_cast<size_t>(GetImageDataSize(format, width, height, mipLevels)));
+		return out;
+	}
+
+	// RGBA8 pixels to BC1 or BC3 blocks, block rows are spread over the worker threads. Edge blocks repeat the last row and column.
+	static inline bool CompressTexture(int32_t width, int32_t height, uint8_t const* pixels, eSirePixelFormat format, std::vector<uint8_t>& out) {
+		if (!pixels || width <= 0 || height <= 0)
+			return false;
+
+		if (format != SIRE_PIXEL_FORMAT_BC1 && format != SIRE_PIXEL_FORMAT_BC3)
+			return false;
+
+		out.resize(GetCompressedSize(format, width, height));
+
+		struct tContext {
+			int32_t width;
+			int32_t height;
+			uint8_t const* pixels;
+			eSirePixelFormat format;
+			uint8_t* out;
+		} context = { width, height, pixels, format, out.data() };
+
+		threadPool.ParallelFor((height + 3) / 4, 4, [](void* ptr, uint32_t begin, uint32_t end) {
+			tContext& c = *static_cast<tContext*>(ptr);
+			uint32_t blockSize = GetCompressedBlockSize(c.format);
+			uint32_t rowSize = GetCompressedRowSize(c.format, c.width);
+
+			alignas(16) uint8_t block[64];
+			for (uint32_t by = begin; by < end; by++) {
+				uint8_t* dst = c.out + by * rowSize;
+				for (int32_t bx = 0; bx < (c.width + 3) / 4; bx++, dst += blockSize) {
+					for (int32_t i = 0; i < 16; i++) {
+						int32_t x = (std::min)(bx * 4 + (i & 3), c.width - 1);
+						int32_t y = (std::min)(static_cast<int32_t>(by) * 4 + (i >> 2), c.height - 1);
+						memcpy(block + i * 4, c.pixels + (static_cast<size_t>(y) * c.width + x) * 4, 4);
+					}
+
+					if (c.format == SIRE_PIXEL_FORMAT_BC3) {
+						EncodeAlphaBlock(block, dst);
+						EncodeColorBlock(block, false, dst + 8);
+					}
+					else {
+						EncodeColorBlock(block, true, dst);
+					}
 				}
+			}
+		}, &context);
 
-				renderers.at(re) = renderer;
+		return true;
+	}
+
+	// BC1 or BC3 blocks back to RGBA8, for software paths and readback. BC7 isn't decoded.
+	static inline bool DecompressTexture(int32_t width, int32_t height, eSirePixelFormat format, uint8_t const* blocks, std::vector<uint8_t>& out) {
+		if (!blocks || width <= 0 || height <= 0)
+			return false;
+
+		if (format != SIRE_PIXEL_FORMAT_BC1 && format != SIRE_PIXEL_FORMAT_BC3)
+			return false;
+
+		out.resize(static_cast<size_t>(width) * height * 4);
+
+		uint32_t blockSize = GetCompressedBlockSize(format);
+		uint8_t block[64];
+		for (int32_t by = 0; by < (height + 3) / 4; by++) {
+			for (int32_t bx = 0; bx < (width + 3) / 4; bx++, blocks += blockSize) {
+				if (format == SIRE_PIXEL_FORMAT_BC3) {
+					DecodeColorBlock(blocks + 8, true, block);
+					DecodeAlphaBlock(blocks, block);
+				}
+				else {
+					DecodeColorBlock(blocks, false, block);
+				}
+
+				for (int32_t i = 0; i < 16; i++) {
+					int32_t x = bx * 4 + (i & 3);
+					int32_t y = by * 4 + (i >> 2);
+					if (x < width && y < height)
+						memcpy(&out[(static_cast<size_t>(y) * width + x) * 4], block + i * 4, 4);
+				}
 			}
-			renderersInitialised = true;
 		}
 
-		currentRenderer = re;
-		currentRendererMainPtr = reinterpret_cast<uintptr_t*>(ptr);
-
-		GetRenderers(GetCurrentRenderer())->Init(currentRendererMainPtr);
+		return true;
+	}
 
-		SetRenderState(SIRE_BLEND_ALPHATESTENABLE, true);
-		SetRenderState(SIRE_BLEND_SRCBLEND, SIRE_BLEND_SRC_ALPHA);
-		SetRenderState(SIRE_BLEND_DESTBLEND, SIRE_BLEND_INV_SRC_ALPHA);
-		SetRenderState(SIRE_BLEND_BLENDOP, SIRE_BLEND_OP_ADD);
-		SetRenderState(SIRE_BLEND_SRCBLENDALPHA, SIRE_BLEND_ONE);
-		SetRenderState(SIRE_BLEND_DESTBLENDALPHA, SIRE_BLEND_ZERO);
-		SetRenderState(SIRE_BLEND_BLENDOPALPHA, SIRE_BLEND_OP_ADD);
-		SetRenderState(SIRE_BLEND_WRITEMASK, SIRE_COLOR_WRITE_ENABLE_ALL);
-		SetRenderState(SIRE_BLEND_CULLMODE, SIRE_CULL_NONE);
-		SetRenderState(SIRE_BLEND_FILLMODE, SIRE_FILL_SOLID);
-		SetRenderState(SIRE_BLEND_STENCILENABLE, FALSE);
-		SetRenderState(SIRE_BLEND_COLORWRITEENABLE, 0xFFFFFFFF);
+	// Maps a pack written by WriteTexturePack, nullptr if it's missing or malformed. Textures created from it don't
+	// reference the mapping, the pack can be released once they exist.
+	static inline SirePtr<tSireTexturePack> OpenTexturePack(std::string const& path) {
+		SirePtr<tSireTexturePack> out(new tSireTexturePack);
+		if (!out->Open(path))
+			return nullptr;
 
-		auto windowSize = GetWindowSize();
-		SetViewport(0.0f, 0.0f, static_cast<float>(windowSize.x), static_cast<float>(windowSize.y));
+		return out;
 	}
 
-	static inline void Shutdown() {
-		if (currentRenderer == SIRE_RENDERER_NULL)
-			return;
+	// Converts, mips and compresses the images once for OpenTexturePack. format is what gets stored: RGBA8 or BGRA8
+	// (or their _SRGB variants) matching the renderer's texture format, or BC1/BC3 to compress. mipmaps can be NONE,
+	// BOX or BOX_SRGB. Names are stored as hashes and must be unique.
+	static inline bool WriteTexturePack(std::string const& path, std::vector<tSireTexturePackImage> const& images, eSirePixelFormat format, eSireMipmaps mipmaps = SIRE_MIPMAPS_NONE, bool premultiply = false) {
+		bool compress = format == SIRE_PIXEL_FORMAT_BC1 || format == SIRE_PIXEL_FORMAT_BC3;
+		if (!compress && GetPixelSize(format) != 4)
+			return false;
 
-		GetRenderers(GetCurrentRenderer())->Shutdown();
+		if (mipmaps == SIRE_MIPMAPS_GPU)
+			return false;
 
-		vertices.clear();
-		indices.clear();
+		struct tImage {
+			tSireTexturePack::tEntry entry;
+			std::vector<uint8_t> data;
+		};
 
-		if (renderersInitialised) {
-			for (auto& it : renderers) {
-				if (it) {
-					delete it;
-					it = nullptr;
+		std::vector<tImage> packed(images.size());
+		for (size_t i = 0; i < images.size(); i++) {
+			tSireTexturePackImage const& src = images[i];
+			if (!src.pixels || src.width <= 0 || src.height <= 0 || src.width > SIRE_MAX_IMAGE_DIMENSION || src.height > SIRE_MAX_IMAGE_DIMENSION)
+				return false;
+
+			// The BC encoder takes RGBA8.
+			eSirePixelFormat srcFormat = src.format == SIRE_PIXEL_FORMAT_UNKNOWN ? SIRE_PIXEL_FORMAT_RGBA8 : src.format;
+			eSirePixelFormat levelFormat = compress ? SIRE_PIXEL_FORMAT_RGBA8 : format;
+			uint32_t count = static_cast<uint32_t>(src.width * src.height);
+
+			std::vector<uint8_t> pixels(static_cast<size_t>(count) * 4);
+			if (!ConvertPixels(src.pixels, srcFormat, pixels.data(), levelFormat, count, premultiply))
+				return false;
+
+			uint32_t mipLevels = 1;
+			std::vector<uint8_t> mipPixels;
+			if (mipmaps == SIRE_MIPMAPS_BOX || mipmaps == SIRE_MIPMAPS_BOX_SRGB)
+				mipLevels = GenerateMipChain(src.width, src.height, pixels.data(), mipmaps == SIRE_MIPMAPS_BOX_SRGB, mipPixels);
+
+			tImage& out = packed[i];
+			if (compress) {
+				std::vector<uint8_t> blocks;
+				uint8_t const* level = pixels.data();
+				int32_t w = src.width;
+				int32_t h = src.height;
+				for (uint32_t j = 0; j < mipLevels; j++) {
+					CompressTexture(w, h, level, format, blocks);
+					out.data.insert(out.data.end(), blocks.begin(), blocks.end());
+
+					level = (j == 0 ? mipPixels.data() : level + static_cast<size_t>(w) * h * 4);
+					w = (std::max)(w >> 1, 1);
+					h = (std::max)(h >> 1, 1);
 				}
 			}
+			else {
+				out.data = std::move(pixels);
+				out.data.insert(out.data.end(), mipPixels.begin(), mipPixels.end());
+			}
 
-			renderersInitialised = false;
+			out.entry = {};
+			out.entry.key = Hash64(src.name.data(), src.name.size());
+			out.entry.size = out.data.size();
+			out.entry.width = src.width;
+			out.entry.height = src.height;
+			out.entry.format = format;
+			out.entry.mipLevels = mipLevels;
 		}
 
-		currentRenderer = SIRE_RENDERER_NULL;
-		currentRendererMainPtr = nullptr;
+		std::sort(packed.begin(), packed.end(), [](tImage const& a, tImage const& b) { return a.entry.key < b.entry.key; });
+		for (size_t i = 1; i < packed.size(); i++) {
+			if (packed[i].entry.key == packed[i - 1].entry.key)
+				return false;
+		}
 
-#ifdef SIRE_DX11ON12
-		if (d3d11on12::isD3D11on12)
-			d3d11on12::ReleaseViewsBuffersAndContext();
-#endif
-	}
+		uint32_t alignment = tSireTexturePack::SIRE_TEXTURE_PACK_ALIGNMENT;
+		uint64_t offset = sizeof(tSireTexturePack::tHeader) + packed.size() * sizeof(tSireTexturePack::tEntry);
+		for (auto& it : packed) {
+			offset = (offset + alignment - 1) & ~static_cast<uint64_t>(alignment - 1);
+			it.entry.offset = offset;
+			offset += it.entry.size;
+		}
 
-	template<typename T>
-	static inline void Release(T*& res) {
-		if (res) {
-			res->Release();
-			res = nullptr;
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f)
+			return false;
+
+		tSireTexturePack::tHeader header = { tSireTexturePack::SIRE_TEXTURE_PACK_MAGIC, tSireTexturePack::SIRE_TEXTURE_PACK_VERSION, static_cast<uint32_t>(packed.size()), 0 };
+		bool result = fwrite(&header, sizeof(header), 1, f) == 1;
+		for (auto& it : packed)
+			result = result && fwrite(&it.entry, sizeof(it.entry), 1, f) == 1;
+
+		uint8_t padding[tSireTexturePack::SIRE_TEXTURE_PACK_ALIGNMENT] = {};
+		for (auto& it : packed) {
+			long position = result ? ftell(f) : -1;
+			result = result && position >= 0 && static_cast<uint64_t>(position) <= it.entry.offset;
+			result = result && fwrite(padding, 1, static_cast<size_t>(it.entry.offset - position), f) == it.entry.offset - position;
+			result = result && fwrite(it.data.data(), 1, it.data.size(), f) == it.data.size();
 		}
+		fclose(f);
+
+		if (!result)
+			remove(path.c_str());
+
+		return result;
 	}
 
-	template<typename T>
-	static inline void Release(T**& res, int32_t count) {
-		if (res) {
-			for (int32_t i = 0; i < count; i++) {
-				if (res[i]) {
-					res[i]->Release();
-					res[i] = nullptr;
-				}
-			}
+	// Creates a texture from a pack entry, nullptr if there's no image with that name. Uncompressed levels stored in the
+	// renderer's channel order and compressed ones are uploaded straight from the mapping, others are swizzled first.
+	static inline SirePtr<tSireTexture2D> CreateTexture(tSireTexturePack const& pack, std::string const& name) {
+		SIRE_PROFILE_SCOPE("Sire::CreateTexture");
+
+		if (!IsRendererActive())
+			return nullptr;
+
+		tSireTexturePack::tEntry const* entry = pack.Find(name);
+		if (!entry)
+			return nullptr;
+
+		eSirePixelFormat format = static_cast<eSirePixelFormat>(entry->format);
+		uint8_t const* data = pack.data + entry->offset;
+		if (IsCompressedFormat(format))
+			return CreateCompressedTexture(entry->width, entry->height, format, data, entry->mipLevels);
+
+		// The backends only read the pixels.
+		eSirePixelFormat textureFormat = GetRenderer()->GetTextureFormat();
+		uint8_t* pixels = const_cast<uint8_t*>(data);
+		std::vector<uint8_t> converted;
+		if (IsBgraFormat(format) != IsBgraFormat(textureFormat)) {
+			converted.resize(static_cast<size_t>(entry->size));
+			ConvertPixels(data, format, converted.data(), textureFormat, static_cast<uint32_t>(entry->size / 4));
+			pixels = converted.data();
 		}
-	}
 
-	static inline HWND GetHWND() {
-		return GetRenderers(GetCurrentRenderer())->GetWindow();
+		uint8_t* mipPixels = entry->mipLevels > 1 ? pixels + static_cast<size_t>(entry->width) * entry->height * 4 : nullptr;
+		return UploadTexture(entry->width, entry->height, pixels, textureFormat, entry->mipLevels, mipPixels, false);
 	}
 
-	static inline tSireInt2 GetWindowSize() {
-		RECT windowRect;
-		GetClientRect((HWND)GetHWND(), &windowRect);
+	// Uploads the geometry once into immutable buffers, draw it any number of times with DrawMesh.
+	static inline SirePtr<tSireMesh> CreateMesh(std::vector<tVertex> const& meshVertices, std::vector<uint16_t> const& meshIndices, eSirePrimitiveType type = SIRE_TRIANGLE) {
+		if (!IsRendererActive())
+			return nullptr;
 
-		tSireInt2 out;
-		out.x = static_cast<int32_t>(windowRect.right - windowRect.left);
-		out.y = static_cast<int32_t>(windowRect.bottom - windowRect.top);
+		if (meshVertices.empty())
+			return nullptr;
+
+		SirePtr<tSireMesh> out(new tSireMesh);
+
+		uint16_t const* meshIndexData = meshIndices.empty() ? nullptr : meshIndices.data();
+		uint32_t meshIndexCount = static_cast<uint32_t>(meshIndices.size());
+
+		// Topologies the backend can't draw are expanded once here instead of every draw.
+		std::vector<uint16_t> expanded;
+		uint32_t count = meshIndexCount ? meshIndexCount : static_cast<uint32_t>(meshVertices.size());
+		if (!GetRenderer()->SupportsTopology(type, HasPrimitiveRestart(type, meshIndexData, count))) {
+			expanded.resize(count * 3);
+			expanded.resize(ExpandTopology(type, meshIndexData, count, expanded.data(), static_cast<uint32_t>(expanded.size())));
+			if (expanded.empty())
+				return nullptr;
+
+			meshIndexData = expanded.data();
+			meshIndexCount = static_cast<uint32_t>(expanded.size());
+			type = GetListTopology(type);
+		}
+
+		uintptr_t* vb = nullptr;
+		uintptr_t* ib = nullptr;
+		if (!GetRenderer()->CreateMesh(meshVertices.data(), static_cast<uint32_t>(meshVertices.size()), meshIndexData, meshIndexCount, &vb, &ib))
+			return nullptr;
+
+		out->numVertices = static_cast<uint32_t>(meshVertices.size());
+		out->numIndices = meshIndexCount;
+		out->primitiveType = type;
+		out->ptrs.vertexBuffer = vb;
+		out->ptrs.indexBuffer = ib;
 
 		return out;
 	}
 
-	// These 2 works for old devices but process it's too slow to be used each frame.
-	static inline void _GetClosestPowerOfTwoSize(uint32_t& width, uint32_t& height) {
-		height = static_cast<uint32_t>(std::pow(2, std::ceil(std::log2(height))));
-		width = height;
-	}
+	// Draws with the current texture and render states, transform is applied before the projection.
+	static inline void DrawMesh(SirePtr<tSireMesh> const& mesh, tSireMatrix const& transform, tSireFloat4 const& tint) {
+		if (!IsRendererActive())
+			return;
 
-	static inline std::vector<uint8_t> _ResizePixels(uint8_t* srcPixels, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight) {
-		float scaleX = static_cast<float>(dstWidth) / static_cast<float>(srcWidth);
-		float scaleY = static_cast<float>(dstHeight) / static_cast<float>(srcHeight);
+		if (!mesh || !mesh->ptrs.vertexBuffer)
+			return;
 
-		std::vector<uint8_t> resizedPixels(dstWidth * dstHeight * 4, 0);
+		tConstBuff prevcb = cb;
+		eSirePrimitiveType prevType = primitiveType;
 
-		for (uint32_t y = 0; y < dstHeight; ++y) {
-			for (uint32_t x = 0; x < dstWidth; ++x) {
-				uint32_t srcX = static_cast<int>(x / scaleX);
-				uint32_t srcY = static_cast<int>(y / scaleY);
-				uint32_t srcIndex = (srcY * srcWidth + srcX) * 4;
-				uint32_t dstIndex = (y * dstWidth + x) * 4;
+		cb.matrix = transform * cb.matrix;
+		cb.tint = tint;
+		primitiveType = mesh->primitiveType;
 
-				if (srcX < srcWidth && srcY < srcHeight) {
-					resizedPixels[dstIndex] = srcPixels[srcIndex];
-					resizedPixels[dstIndex + 1] = srcPixels[srcIndex + 1];
-					resizedPixels[dstIndex + 2] = srcPixels[srcIndex + 2];
-					resizedPixels[dstIndex + 3] = srcPixels[srcIndex + 3];
-				}
-			}
+		if (!currentLayer)
+			TouchRenderTarget();
+
+		if (currentLayer || sortedSubmission) {
+			RecordDraw(mesh->ptrs.vertexBuffer, mesh->ptrs.indexBuffer, mesh->numVertices, mesh->numIndices);
+		}
+		else {
+			tBackend* renderer = GetRenderer();
+			CountDraw(mesh->numVertices, mesh->numIndices, false);
+			renderer->Begin();
+			ApplyRenderStates(renderer, shared.renderStates);
+			BeginBatchTiming(renderer, timingTag);
+			renderer->DrawMesh(mesh->ptrs.vertexBuffer, mesh->ptrs.indexBuffer, mesh->numVertices, mesh->numIndices);
+			EndBatchTiming(renderer);
 		}
 
-		return resizedPixels;
+		cb = prevcb;
+		primitiveType = prevType;
 	}
-	//
 
-	// Use only if device has non power of 2 support.
-	static inline SirePtr<tSireTexture2D> GetFakeBackBuffer(uint32_t buffer) {
-		static std::vector<uint8_t> data;
-		HWND wnd = GetHWND();
-		auto windowSize = GetWindowSize();
+	// Draws until EndLayer are recorded instead of submitted. rect is left, top, right, bottom in viewport pixels.
+	// Layers can't be nested.
+	static inline void BeginLayer(uint32_t id, tSireFloat4 const& rect) {
+		if (!IsRendererActive())
+			return;
 
-		uint32_t fileSize = (windowSize.x * windowSize.y * 4);
-		if (data.size() < fileSize) {
-			data.resize(fileSize);
-		}
+		if (currentLayer)
+			return;
 
-		HDC dc = GetDC(GetHWND());
-		static HDC compdc = nullptr;
-		static HBITMAP bmp = nullptr;
-		static tSireInt2 size = { 0, 0 };
+		tLayer& layer = layers[id];
+		layer.rect = rect;
+		layer.list.Clear();
 
-		if (size.x != windowSize.x || size.y != windowSize.y) {
-			if (bmp)
-				DeleteObject(bmp);
+		layer.pendingHash = Hash64(&rect, sizeof(rect));
+		layer.pendingHash = Hash64(&shared.viewport, sizeof(shared.viewport), layer.pendingHash);
 
-			if (compdc)
-				DeleteDC(compdc);
+		currentLayer = &layer;
+	}
 
-			compdc = CreateCompatibleDC(dc);
-			bmp = CreateCompatibleBitmap(dc, windowSize.x, windowSize.y);
-			size = windowSize;
+	// Re-renders the layer target only when the recorded draws changed, then composites it with one quad.
+	// Layer content is expected to use the default SRC_ALPHA, INV_SRC_ALPHA blending.
+	static inline void EndLayer() {
+		if (!IsRendererActive())
+			return;
+
+		if (!currentLayer)
+			return;
+
+		tLayer& layer = *currentLayer;
+		currentLayer = nullptr;
+
+		int32_t w = static_cast<int32_t>(ceilf(layer.rect.z - layer.rect.x));
+		int32_t h = static_cast<int32_t>(ceilf(layer.rect.w - layer.rect.y));
+		if (w <= 0 || h <= 0 || layer.list.commands.empty())
+			return;
+
+		if (!layer.target.texture || layer.target.texture->w != w || layer.target.texture->h != h) {
+			ReleaseLayerTarget(layer.target);
+			layer.target = AcquireLayerTarget(w, h);
+			layer.hash = 0;
 		}
 
-		HBITMAP bmpOld = static_cast<HBITMAP>(SelectObject(compdc, bmp));
+		// No render target support, draw as usual.
+		if (!layer.target.texture) {
+			ReplayLayer(layer, nullptr);
+			return;
+		}
 
-		BitBlt(compdc, 0, 0, windowSize.x, windowSize.y, dc, 0, 0, SRCCOPY);
-		GetBitmapBits(bmp, fileSize, data.data());
+		if (layer.hash != layer.pendingHash) {
+			ReplayLayer(layer, layer.target.target->renderTargetView);
+			TouchTexture(layer.target.texture.Get());
+			layer.hash = layer.pendingHash;
+		}
 
-		auto out = CreateTexture(windowSize.x, windowSize.y, data.data());
-		out->swapColors = true;
+		tConstBuff prevcb = cb;
+		tRenderState prevStates = shared.renderStates;
 
-		SelectObject(compdc, bmpOld);
-		ReleaseDC(wnd, dc);
+		shared.renderStates.blendEnable = true;
+		shared.renderStates.srcBlend = SIRE_BLEND_ONE;
+		shared.renderStates.dstBlend = SIRE_BLEND_INV_SRC_ALPHA;
+		shared.renderStates.blendop = SIRE_BLEND_OP_ADD;
 
-		return out;
-	}
+		uintptr_t* prevTexture = currentTexture;
+		uintptr_t* prevMask = currentMask;
+		uint64_t prevTextureId = currentTextureId;
+		uint64_t prevMaskId = currentMaskId;
 
-	static inline uint8_t* Lock(tSireTexture2D* surface) {
-		return GetRenderers(GetCurrentRenderer())->Lock(surface->ptrs.surface);
+		TraceTextureBind(layer.target.texture.Get());
+		currentTexture = layer.target.texture->ptrs.texture;
+		currentMask = nullptr;
+		currentTextureId = layer.target.texture->id;
+		currentMaskId = 0;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		cb.texAlpha = true;
+
+		DrawRect({ layer.rect.x, layer.rect.y, layer.rect.x + w, layer.rect.y + h });
+
+		currentTexture = prevTexture;
+		currentMask = prevMask;
+		currentTextureId = prevTextureId;
+		currentMaskId = prevMaskId;
+		GetRenderer()->SetTexture(currentTexture, currentMask);
+		shared.renderStates = prevStates;
+		cb = prevcb;
 	}
 
-	static inline void Unlock(tSireTexture2D* surface) {
-		GetRenderers(GetCurrentRenderer())->Unlock(surface->ptrs.surface);
+	// Forces the next EndLayer to re-render, use it when a texture drawn in the layer changed its content.
+	static inline void InvalidateLayer(uint32_t id) {
+		auto it = layers.find(id);
+		if (it != layers.end())
+			it->second.hash = 0;
 	}
 
-	static inline SirePtr<tSireTexture2D> GetBackBuffer(int32_t buffer) {
-		if (!IsRendererActive())
-			return nullptr;
+	static inline void ReleaseLayer(uint32_t id) {
+		auto it = layers.find(id);
+		if (it == layers.end())
+			return;
 
-#ifdef SIRE_DX11ON12
-		if (d3d11on12::isD3D11on12) {
-			d3d11on12::bufferIndex = d3d11on12::swapChain3->GetCurrentBackBufferIndex();
-			d3d11on12::d3d11On12Device->AcquireWrappedResources(d3d11on12::d3d11WrappedBackBuffers[d3d11on12::bufferIndex].GetAddressOf(), 1);
-			d3d11on12::d3d11Context->OMSetRenderTargets(1, d3d11on12::d3d11RenderTargetViews[d3d11on12::bufferIndex].GetAddressOf(), 0);
-		}
-#endif
+		if (currentLayer == &it->second)
+			currentLayer = nullptr;
 
-		if (buffer == -1)
-			return GetFakeBackBuffer(0);
+		ReleaseLayerTarget(it->second.target);
+		layers.erase(it);
+	}
 
-		SirePtr<tSireTexture2D> out(new tSireTexture2D);
+	static inline void ReleaseLayers() {
+		currentLayer = nullptr;
+		layers.clear();
+		layerTargetPool.clear();
+	}
 
-		switch (GetCurrentRenderer()) {
-#ifdef SIRE_DX9
-			case SIRE_RENDERER_DX9:
-			{
-				auto result = GetRenderers<SireDirectX9>(GetCurrentRenderer())->GetBackBufferSurface(buffer);
-				auto desc = GetRenderers<SireDirectX9>(GetCurrentRenderer())->GetDesc(result);
-				out->Set(desc.Width, desc.Height, desc.Format, nullptr, reinterpret_cast<uintptr_t*>(result));
-			} break;
-#endif
-#ifdef SIRE_DX10
-			case SIRE_RENDERER_DX10:
-			{
-				auto tex = GetRenderers<SireDirectX10>(GetCurrentRenderer())->GetBackBuffer(buffer);
+	// Queued draws are submitted ordered by layer, depth, shader, blend state and texture.
+	// Flushed by FlushSortedDraws, EndFrame, when disabled or when the render target or viewport changes.
+	static inline void SetSortedSubmission(bool enable) {
+		if (!enable)
+			FlushSortedDraws();
 
-				if (tex) {
-					auto result = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateShaderResourceView(tex);
-					auto desc = GetRenderers<SireDirectX10>(GetCurrentRenderer())->GetDesc(tex);
+		sortedSubmission = enable;
+	}
 
-					if (tex) {
-						out->Set(desc.Width, desc.Height, 0, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex));
-					}
-				}
-			} break;
-#endif
-#ifdef SIRE_DX11
-			case SIRE_RENDERER_DX11:
-			{
-				auto tex = GetRenderers<SireDirectX11>(GetCurrentRenderer())->GetBackBuffer(buffer);
+	static inline void SetSortLayer(uint8_t layer) {
+		sortLayer = layer;
+	}
 
-				if (tex) {
-					auto result = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateShaderResourceView(tex);
-					auto desc = GetRenderers<SireDirectX11>(GetCurrentRenderer())->GetDesc(tex);
+	// Blended draws keep their submission order by default, opaque draws keep it relative to blended draws. Opaque
+	// draws between the same two blended draws can still swap, there's no depth test, so overlapping opaque content
+	// needs its own depths. Draws given the same depth may be reordered by state, use it for content that doesn't
+	// overlap. Pass -1 to restore the default. Explicit depths share the range with the automatic order, keep them
+	// on their own sort layer.
+	static inline void SetSortDepth(int32_t depth) {
+		sortDepth = (std::min)(depth, 0xFFFF);
+	}
 
-					if (tex) {
-						out->Set(desc.Width, desc.Height, 0, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex));
-					}
-				}
-			} break;
-#endif
-#ifdef SIRE_DX12
-			case SIRE_RENDERER_DX12:
-			{
-			} break;
-#endif
-#ifdef SIRE_OPENGL
-			case SIRE_RENDERER_OPENGL:
-			{
-			} break;
-#endif
+	static inline void FlushSortedDraws() {
+		SIRE_PROFILE_SCOPE("Sire::FlushSortedDraws");
+
+		if (IsRendererActive() && !sortedDraws.commands.empty()) {
+			SortDrawCommands();
+			SubmitSortedDraws();
 		}
 
-		return out;
+		sortedDraws.Clear();
+		shaderSortIds.clear();
+		blendSortIds.clear();
+		textureSortIds.clear();
+		sortSequence = 0;
 	}
 
-	// Not global, format is currently renderer based.
-	static inline void SetTextureFormat(eSireRenderer renderer, uint32_t format) {
-		if (!IsRendererActive(renderer))
-			return;
+	// Glyphs are rendered at SIRE_TEXT_SDF_SIZE pixels into a distance field atlas shared by all fonts and sizes.
+	// Returns -1 on failure.
+	static inline int32_t LoadFont(const char* name, bool bold = false) {
+		tFont font = {};
+		font.rasterizer = glyphRasterizer ? glyphRasterizer : &gdiGlyphRasterizer;
+		font.face = font.rasterizer->CreateFace(name, SIRE_TEXT_SDF_SIZE, bold, font.metrics);
+		if (!font.face)
+			return -1;
+
+		fonts.push_back(std::move(font));
+		return static_cast<int32_t>(fonts.size() - 1);
+	}
 
-		GetRenderers(renderer)->SetTextureFormat(format);
+	// Used by fonts loaded afterwards, pass nullptr to restore GDI.
+	static inline void SetGlyphRasterizer(tSireGlyphRasterizer* rasterizer) {
+		glyphRasterizer = rasterizer;
 	}
 
-#ifdef SIRE_DX11ON12
-	static inline void SetCommandQueue(ID3D12CommandQueue* pCommandQueue) {
-		d3d11on12::SetCommandQueue(pCommandQueue);
+	// Strings drawn until EndText are emitted as a single batch.
+	static inline void BeginText() {
+		textBatchActive = true;
 	}
-#endif
 
-	static inline uint32_t GetTextureFormat(eSireRenderer renderer) {
-		if (!IsRendererActive(renderer))
-			return 0;
+	static inline void EndText() {
+		textBatchActive = false;
 
-		return GetRenderers(renderer)->GetTextureFormat();
+		if (!IsRendererActive())
+			return;
+
+		FlushTextBatch();
 	}
 
-	static inline SirePtr<tSireRenderTarget> CreateRenderTargetView(SirePtr<tSireTexture2D> const& texture) {
+	// x and y are the top-left of the first line, size is the line height in pixels. Layouts are cached by content, font and size.
+	static inline void DrawString(int32_t font, std::string const& text, float x, float y, float size, tSireFloat4 const& col = { 1.0f, 1.0f, 1.0f, 1.0f }) {
 		if (!IsRendererActive())
-			return nullptr;
+			return;
 
-		SirePtr<tSireRenderTarget> out(new tSireRenderTarget);
-		switch (GetCurrentRenderer()) {
-			case SIRE_RENDERER_DX9:
-				out->Set((uintptr_t*)GetRenderers<SireDirectX9>(GetCurrentRenderer())->GetSurfaceLevel((IDirect3DTexture9*)texture->ptrs.surface, 0));
-				break;
-			case SIRE_RENDERER_DX10:
-				out->Set((uintptr_t*)GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateRenderTarget((ID3D10Texture2D*)texture->ptrs.surface));
-				break;
-			case SIRE_RENDERER_DX11:
-				out->Set((uintptr_t*)GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateRenderTarget((ID3D11Texture2D*)texture->ptrs.surface));
-				break;
+		if (font < 0 || font >= static_cast<int32_t>(fonts.size()) || text.empty())
+			return;
+
+		tTextLayout const& layout = GetTextLayout(font, text, size);
+
+		// A batch holds 10922 quads, their 6 indices each fill the 65536 of the dynamic index buffers.
+		const size_t batchVertices = 65536 / 6 * 4;
+		if (textVertices.size() + layout.vertices.size() > batchVertices)
+			FlushTextBatch();
+
+		// Longer layouts are split across batches.
+		for (size_t first = 0; first < layout.vertices.size();) {
+			if (textVertices.size() >= batchVertices)
+				FlushTextBatch();
+
+			size_t count = (std::min)(layout.vertices.size() - first, batchVertices - textVertices.size());
+			uint32_t base = static_cast<uint32_t>(textVertices.size());
+			for (size_t i = first; i < first + count; i++) {
+				tVertex v = layout.vertices[i];
+				v.pos.x += x;
+				v.pos.y += y;
+				v.col = col;
+				textVertices.push_back(v);
+			}
+
+			for (uint32_t i = base; i < textVertices.size(); i += 4) {
+				const uint16_t quad[] = { 0, 1, 2, 0, 2, 3 };
+				for (auto& it : quad)
+					textIndices.push_back(static_cast<uint16_t>(i + it));
+			}
+
+			first += count;
 		}
 
-		return out;
+		if (!textBatchActive)
+			FlushTextBatch();
 	}
 
-	static inline SirePtr<tSireTexture2D> CreateTexture(int32_t width, int32_t height, uint8_t* pixels) {
+	// True once a glyph didn't fit the text atlas, such glyphs are laid out but drawn blank.
+	static inline bool IsTextAtlasFull() {
+		return textAtlas.full;
+	}
+
+	static inline tSireFloat2 MeasureString(int32_t font, std::string const& text, float size) {
+		if (font < 0 || font >= static_cast<int32_t>(fonts.size()) || text.empty())
+			return { 0.0f, 0.0f };
+
+		return GetTextLayout(font, text, size).extent;
+	}
+
+	// Paths are tessellated once and cached by content, fill rule and anti-aliasing, offset moves the cached geometry.
+	// The anti-aliased fringe needs alpha blending.
+	static inline void FillPath(tSirePath const& path, tSireFloat4 const& col, eSireFillRule rule = SIRE_FILL_RULE_NONZERO, bool antiAlias = true, tSireFloat2 const& offset = { 0.0f, 0.0f }) {
 		if (!IsRendererActive())
-			return nullptr;
+			return;
 
-		SirePtr<tSireTexture2D> out(new tSireTexture2D);
+		if (path.verbs.empty())
+			return;
 
-		switch (GetCurrentRenderer()) {
-#ifdef SIRE_DX9
-			case SIRE_RENDERER_DX9:
-			{
-				IDirect3DSurface9* sout = nullptr;
-				auto result = GetRenderers<SireDirectX9>(GetCurrentRenderer())->CreateTexture(width, height, pixels, &sout);
+		DrawPathGeometry(GetFillGeometry(path, rule, antiAlias), col, offset);
+	}
 
-				if (result)
-					out->Set(width, height, 0, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(sout));
-			} break;
-#endif
-#ifdef SIRE_DX10
-			case SIRE_RENDERER_DX10:
-			{
-				auto tex = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateTexture(width, height, pixels);
+	static inline void StrokePath(tSirePath const& path, tSireStrokeStyle const& style, tSireFloat4 const& col, bool antiAlias = true, tSireFloat2 const& offset = { 0.0f, 0.0f }) {
+		if (!IsRendererActive())
+			return;
 
-				if (tex) {
-					auto result = GetRenderers<SireDirectX10>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+		if (path.verbs.empty() || style.width <= 0.0f)
+			return;
 
-					if (result)
-						out->Set(width, height, 0, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex));
-				}
-			} break;
-#endif
-#ifdef SIRE_DX11
-			case SIRE_RENDERER_DX11:
-			{
-				auto tex = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateTexture(width, height, pixels);
+		DrawPathGeometry(GetStrokeGeometry(path, style, antiAlias), col, offset);
+	}
 
-				if (tex) {
-					auto result = GetRenderers<SireDirectX11>(GetCurrentRenderer())->CreateShaderResourceView(tex);
+	static inline void UpdateTexture(SirePtr<tSireTexture2D> const& texture, uint8_t* pixels) {
+		SIRE_PROFILE_SCOPE("Sire::UpdateTexture");
 
-					if (result)
-						out->Set(width, height, 0, reinterpret_cast<uintptr_t*>(result), reinterpret_cast<uintptr_t*>(tex));
-				}
-			} break;
-#endif
-#ifdef SIRE_DX12
-			case SIRE_RENDERER_DX12:
-				break;
-#endif
-#ifdef SIRE_OPENGL
-			case SIRE_RENDERER_OPENGL:
-			{
-			} break;
-#endif
-		}
+		if (!IsRendererActive())
+			return;
 
-		return out;
+		if (!texture || !pixels)
+			return;
+
+		UseTexture(texture.Get());
+		TouchTexture(texture.Get());
+		frameStats.uploadBytes += static_cast<uint64_t>(texture->w) * texture->h * 4;
+		TraceTextureData(texture.Get(), pixels, static_cast<size_t>(texture->w) * texture->h * 4);
+		GetRenderer()->UpdateTexture(texture->ptrs.surface, texture->w, texture->h, pixels);
 	}
 
 	static inline void SetViewport(float x, float y, float w, float h) {
 		if (!IsRendererActive())
 			return;
 
+		// Queued draws don't keep their viewport.
+		if (x != shared.viewport.x || y != shared.viewport.y || w != shared.viewport.w || h != shared.viewport.h)
+			FlushSortedDraws();
+
 		shared.viewport.x = x;
 		shared.viewport.y = y;
 		shared.viewport.w = w;
 		shared.viewport.h = h;
 
-		return GetRenderers(GetCurrentRenderer())->SetViewport(shared.viewport);
+		return GetRenderer()->SetViewport(shared.viewport);
 	}
 
 	static inline void CopyResource(SirePtr<tSireTexture2D> const& dst, SirePtr<tSireTexture2D> const& src) {
+		SIRE_PROFILE_SCOPE("Sire::CopyResource");
+
 		if (!IsRendererActive())
 			return;
 
 		if (!src || !dst)
 			return;
 
+		UseTexture(dst.Get());
+		UseTexture(src.Get());
+		TouchTexture(dst.Get());
+
 		dst->w = src->w;
 		dst->h = src->h;
 		dst->format = src->format;
-		dst->swapColors = src->swapColors;
 
-		return GetRenderers(GetCurrentRenderer())->CopyResource(dst->ptrs.surface, src->ptrs.surface);
+		return GetRenderer()->CopyResource(dst->ptrs.surface, src->ptrs.surface);
 	}
 
 	static inline void SetProjectionMode(eSireProjection proj) {
@@ -3933,22 +13284,37 @@ public:
 		uintptr_t* tex0 = nullptr;
 		uintptr_t* tex1 = nullptr;
 
-		if (tex) {
+		UseTexture(tex.Get());
+		UseTexture(mask.Get());
+		TraceTextureBind(tex.Get());
+		TraceTextureBind(mask.Get());
+
+		if (tex)
 			tex0 = tex->ptrs.texture;
-			cb.swapColors = tex->swapColors;
-		}
 
 		if (mask)
 			tex1 = mask->ptrs.texture;
 
-		return GetRenderers(GetCurrentRenderer())->SetTexture(tex0, tex1);
+		currentTexture = tex0;
+		currentMask = tex1;
+		currentTextureId = tex ? tex->id : 0;
+		currentMaskId = mask ? mask->id : 0;
+		return GetRenderer()->SetTexture(tex0, tex1);
 	}
 
 	static inline void SetRenderTarget(SirePtr<tSireRenderTarget> const& renderTargetView) {
-		if (renderTargetView)
+		// Queued draws don't keep their target.
+		if ((renderTargetView ? renderTargetView->renderTargetView : nullptr) != currentRenderTargetView)
+			FlushSortedDraws();
+
+		if (renderTargetView) {
 			currentRenderTargetView = renderTargetView->renderTargetView;
-		else
+			currentRenderTargetTexture = renderTargetView->textureId;
+		}
+		else {
 			currentRenderTargetView = nullptr;
+			currentRenderTargetTexture = 0;
+		}
 	}
 
 	static inline void DrawTriangle(tSireFloat4 const& rect) {